@@ -0,0 +1,447 @@
+// Storage benchmarks: DatabaseManager operations against generated corpora of
+// 1k, 10k and 100k notes.
+//
+//   notes-db-bench                       # QtTest text output
+//   notes-db-bench --json results.json   # also write the results as JSON
+//   NOTES_BENCH_SIZES=1000,10000 notes-db-bench getNote
+//
+// Other arguments go to QtTest, so functions, rows and -iterations can be picked
+// as with any QtTest binary.
+
+#include <QtTest>
+#include <QCoreApplication>
+#include <QStandardItemModel>
+#include <QTemporaryDir>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QRandomGenerator>
+#include <QXmlStreamReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QDir>
+#include "db/DatabaseManager.h"
+
+// Notes are spread evenly over this many folders
+static const int FOLDER_COUNT = 50;
+static const int BODY_SIZE = 1024;
+
+static const char *WORDS[] = {
+    "note", "storage", "folder", "draft", "idea", "list", "meeting", "todo", "link", "query",
+    "project", "review", "release", "change", "plan", "summary", "question", "answer", "detail", "index"
+};
+
+class DatabaseBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void createNote_data();
+    void createNote();
+    void updateNote_data();
+    void updateNote();
+    void getNote_data();
+    void getNote();
+    void getNotesInFolder_data();
+    void getNotesInFolder();
+    void populateNotesModel_data();
+    void populateNotesModel();
+    void deleteFolder_data();
+    void deleteFolder();
+    void scanAndImportMarkdownFiles_data();
+    void scanAndImportMarkdownFiles();
+    void recreateAllMarkdownFiles_data();
+    void recreateAllMarkdownFiles();
+
+private:
+    void addCorpusRows();
+    bool openCorpus(int notes, bool withFiles);
+    bool buildTemplate(int notes, const QString &path);
+    QString generateBody(QRandomGenerator &random, int noteNumber) const;
+    int folderWithMostNotes() const;
+    QList<int> noteIds() const;
+
+    QTemporaryDir m_workDir;
+    QList<int> m_sizes;
+    int m_run = 0;
+};
+
+void DatabaseBenchmark::initTestCase()
+{
+    QVERIFY(m_workDir.isValid());
+
+    m_sizes = {1000, 10000, 100000};
+    const QString sizes = qEnvironmentVariable("NOTES_BENCH_SIZES");
+    if (!sizes.isEmpty()) {
+        m_sizes.clear();
+        for (const QString &size : sizes.split(',', Qt::SkipEmptyParts)) {
+            m_sizes.append(size.trimmed().toInt());
+        }
+    }
+}
+
+void DatabaseBenchmark::cleanup()
+{
+    DatabaseManager::instance().close();
+}
+
+void DatabaseBenchmark::addCorpusRows()
+{
+    QTest::addColumn<int>("notes");
+    for (int size : m_sizes) {
+        QString tag = size % 1000 == 0 ? QString("%1k").arg(size / 1000) : QString::number(size);
+        QTest::newRow(tag.toUtf8().constData()) << size;
+    }
+}
+
+// Every row starts from a fresh copy of the corpus, so mutations do not carry
+// over. With withFiles, the notes also have their markdown files written.
+bool DatabaseBenchmark::openCorpus(int notes, bool withFiles)
+{
+    DatabaseManager &db = DatabaseManager::instance();
+    db.close();
+
+    const QString templatePath = m_workDir.filePath(QString("template-%1.db").arg(notes));
+    if (!QFile::exists(templatePath) && !buildTemplate(notes, templatePath)) {
+        return false;
+    }
+
+    const QString runDir = m_workDir.filePath(QString("run-%1").arg(++m_run));
+    QDir().mkpath(runDir);
+    const QString runPath = runDir + "/notes.db";
+    if (!QFile::copy(templatePath, runPath)) {
+        return false;
+    }
+
+    db.setDatabasePath(runPath);
+    if (!db.open() || !db.initializeSchema()) {
+        return false;
+    }
+    db.setNotesDirectory(runDir + "/md");
+    db.enableAutoSave(false);
+
+    if (withFiles) {
+        return db.recreateAllMarkdownFiles();
+    }
+    return true;
+}
+
+// Bulk inserts the corpus in one transaction; going through createNote would
+// write a markdown file per note and take far longer than the benchmarks.
+bool DatabaseBenchmark::buildTemplate(int notes, const QString &path)
+{
+    DatabaseManager &db = DatabaseManager::instance();
+    db.setDatabasePath(path);
+    if (!db.open() || !db.initializeSchema()) {
+        return false;
+    }
+    db.setNotesDirectory(QFileInfo(path).absolutePath() + "/template-md");
+    db.enableAutoSave(false);
+
+    QList<int> folderIds;
+    for (int i = 0; i < FOLDER_COUNT; ++i) {
+        folderIds.append(db.createFolder(QString("Folder %1").arg(i + 1)));
+    }
+
+    // The connection can only be closed once the queries on it are gone
+    bool committed = false;
+    {
+        QSqlDatabase sql = db.database();
+        QRandomGenerator random(notes);
+        QDateTime base = QDateTime(QDate(2024, 1, 1), QTime(0, 0));
+        sql.transaction();
+        QSqlQuery q(sql);
+        q.prepare("INSERT INTO notes (folder_id, title, body, filepath, created_at, updated_at) VALUES (?, ?, ?, '', ?, ?)");
+        bool seeded = true;
+        for (int i = 0; i < notes && seeded; ++i) {
+            QDateTime timestamp = base.addSecs(i * 60);
+            q.addBindValue(folderIds[i % folderIds.size()]);
+            q.addBindValue(QString("Note %1").arg(i + 1));
+            q.addBindValue(generateBody(random, i + 1));
+            q.addBindValue(timestamp);
+            q.addBindValue(timestamp);
+            seeded = q.exec();
+            if (!seeded) {
+                qWarning() << "Failed to seed note:" << q.lastError();
+            }
+        }
+        if (seeded) {
+            committed = sql.commit();
+        } else {
+            sql.rollback();
+        }
+    }
+    db.close();
+    return committed;
+}
+
+QString DatabaseBenchmark::generateBody(QRandomGenerator &random, int noteNumber) const
+{
+    QString body = QString("# Note %1\n\n").arg(noteNumber);
+    const int wordCount = int(sizeof(WORDS) / sizeof(WORDS[0]));
+    while (body.size() < BODY_SIZE) {
+        body += QLatin1String(WORDS[random.bounded(wordCount)]);
+        body += random.bounded(12) == 0 ? QStringLiteral(".\n\n") : QStringLiteral(" ");
+    }
+    return body;
+}
+
+int DatabaseBenchmark::folderWithMostNotes() const
+{
+    QSqlQuery q(DatabaseManager::instance().database());
+    if (q.exec("SELECT folder_id FROM notes GROUP BY folder_id ORDER BY COUNT(*) DESC LIMIT 1") && q.next()) {
+        return q.value(0).toInt();
+    }
+    return -1;
+}
+
+QList<int> DatabaseBenchmark::noteIds() const
+{
+    QList<int> ids;
+    QSqlQuery q(DatabaseManager::instance().database());
+    q.exec("SELECT id FROM notes ORDER BY id");
+    while (q.next()) {
+        ids.append(q.value(0).toInt());
+    }
+    return ids;
+}
+
+void DatabaseBenchmark::createNote_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::createNote()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, false));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    int folderId = folderWithMostNotes();
+    QRandomGenerator random(1);
+    int created = 0;
+    QBENCHMARK {
+        QString body = generateBody(random, notes + ++created);
+        db.createNote(folderId, QString("Created %1").arg(created), body);
+    }
+}
+
+void DatabaseBenchmark::updateNote_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::updateNote()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, false));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    const QList<int> ids = noteIds();
+    QRandomGenerator random(2);
+    int updated = 0;
+    QBENCHMARK {
+        int noteId = ids[random.bounded(ids.size())];
+        db.updateNote(noteId, QString("Note %1").arg(noteId), generateBody(random, ++updated));
+    }
+}
+
+void DatabaseBenchmark::getNote_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::getNote()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, false));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    const QList<int> ids = noteIds();
+    QRandomGenerator random(3);
+    QBENCHMARK {
+        NoteData note = db.getNote(ids[random.bounded(ids.size())]);
+        Q_UNUSED(note);
+    }
+}
+
+void DatabaseBenchmark::getNotesInFolder_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::getNotesInFolder()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, false));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    int folderId = folderWithMostNotes();
+    QBENCHMARK {
+        QList<NoteData> folderNotes = db.getNotesInFolder(folderId);
+        Q_UNUSED(folderNotes);
+    }
+}
+
+void DatabaseBenchmark::populateNotesModel_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::populateNotesModel()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, false));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    int folderId = folderWithMostNotes();
+    QStandardItemModel model;
+    QBENCHMARK {
+        db.populateNotesModel(&model, folderId);
+    }
+    QVERIFY(model.rowCount() > 0);
+}
+
+void DatabaseBenchmark::deleteFolder_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::deleteFolder()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, true));
+
+    // Deleting is not repeatable, so this is a single cold run
+    DatabaseManager &db = DatabaseManager::instance();
+    int folderId = folderWithMostNotes();
+    bool deleted = false;
+    QBENCHMARK_ONCE {
+        deleted = db.deleteFolder(folderId);
+    }
+    QVERIFY(deleted);
+}
+
+void DatabaseBenchmark::scanAndImportMarkdownFiles_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::scanAndImportMarkdownFiles()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, true));
+
+    // Every file is already imported, as on a normal start-up
+    DatabaseManager &db = DatabaseManager::instance();
+    QBENCHMARK {
+        db.scanAndImportMarkdownFiles();
+    }
+    QCOMPARE(noteIds().size(), notes);
+}
+
+void DatabaseBenchmark::recreateAllMarkdownFiles_data()
+{
+    addCorpusRows();
+}
+
+void DatabaseBenchmark::recreateAllMarkdownFiles()
+{
+    QFETCH(int, notes);
+    QVERIFY(openCorpus(notes, true));
+
+    DatabaseManager &db = DatabaseManager::instance();
+    bool recreated = false;
+    QBENCHMARK {
+        recreated = db.recreateAllMarkdownFiles();
+    }
+    QVERIFY(recreated);
+}
+
+// Turns the BenchmarkResult entries of QtTest's XML log into a flat JSON report
+static bool writeJsonReport(const QString &xmlPath, const QString &jsonPath)
+{
+    QFile xmlFile(xmlPath);
+    if (!xmlFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader xml(&xmlFile);
+    while (!xml.atEnd()) {
+        if (!xml.readNextStartElement()) {
+            continue;
+        }
+        if (xml.name() == QLatin1String("TestFunction")) {
+            function = xml.attributes().value("name").toString();
+        } else if (xml.name() == QLatin1String("BenchmarkResult")) {
+            QXmlStreamAttributes attributes = xml.attributes();
+            QJsonObject result;
+            result["function"] = function;
+            result["corpus"] = attributes.value("tag").toString();
+            result["metric"] = attributes.value("metric").toString();
+            result["value"] = attributes.value("value").toDouble();  // Per iteration
+            result["iterations"] = attributes.value("iterations").toInt();
+            results.append(result);
+        }
+    }
+    if (xml.hasError()) {
+        qWarning() << "Failed to read benchmark log:" << xml.errorString();
+        return false;
+    }
+
+    QJsonObject report;
+    report["suite"] = "DatabaseBenchmark";
+    report["qtVersion"] = QString(qVersion());
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["results"] = results;
+
+    QFile jsonFile(jsonPath);
+    if (!jsonFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    jsonFile.write(QJsonDocument(report).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("notes-db-bench");
+    QStandardPaths::setTestModeEnabled(true);
+
+    // --json <file> is ours; everything else is passed to QtTest
+    QStringList args;
+    QString jsonPath;
+    const QStringList arguments = app.arguments();
+    for (int i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == "--json" && i + 1 < arguments.size()) {
+            jsonPath = arguments[++i];
+        } else {
+            args.append(arguments[i]);
+        }
+    }
+
+    QTemporaryDir logDir;
+    QString xmlPath = logDir.filePath("results.xml");
+    if (!jsonPath.isEmpty()) {
+        args << "-o" << xmlPath + ",xml" << "-o" << "-,txt";
+    }
+
+    DatabaseBenchmark benchmark;
+    int failures = QTest::qExec(&benchmark, args);
+
+    if (!jsonPath.isEmpty() && !writeJsonReport(xmlPath, jsonPath)) {
+        qWarning() << "Failed to write" << jsonPath;
+        return failures + 1;
+    }
+    return failures;
+}
+
+#include "DatabaseBenchmark.moc"
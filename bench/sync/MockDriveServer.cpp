@@ -0,0 +1,702 @@
+#include "MockDriveServer.h"
+#include "sync/DriveBatch.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QPointer>
+#include <QTimer>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QRegularExpression>
+#include <QCryptographicHash>
+#include <QDebug>
+
+static const QString FOLDER_MIME_TYPE = "application/vnd.google-apps.folder";
+static const QString FILES_PATH = "/drive/v3/files";
+static const QString UPLOAD_PATH = "/upload/drive/v3/files";
+static const QString BATCH_PATH = "/batch/drive/v3";
+static const QString TOKEN_PATH = "/token";
+
+// Drive's default and largest page sizes for files.list
+static const int DEFAULT_PAGE_SIZE = 100;
+static const int MAX_PAGE_SIZE = 1000;
+
+MockDriveServer::MockDriveServer(QObject *parent)
+    : QObject(parent)
+    , m_server(new QTcpServer(this))
+    , m_nextId(1)
+    , m_minLatencyMs(0)
+    , m_maxLatencyMs(0)
+    , m_errorRate(0.0)
+    , m_rateLimit(0)
+    , m_random(1)
+    , m_windowStart(0)
+    , m_windowRequests(0)
+    , m_active(0)
+    , m_lastResponseAt(-1)
+{
+    connect(m_server, &QTcpServer::newConnection, this, &MockDriveServer::onNewConnection);
+    m_clock.start();
+}
+
+MockDriveServer::~MockDriveServer()
+{
+}
+
+bool MockDriveServer::listen(quint16 port)
+{
+    if (!m_server->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Mock Drive server failed to listen:" << m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+QString MockDriveServer::baseUrl() const
+{
+    return QString("http://127.0.0.1:%1").arg(m_server->serverPort());
+}
+
+QString MockDriveServer::apiBaseUrl() const
+{
+    return baseUrl() + "/drive/v3";
+}
+
+QString MockDriveServer::uploadBaseUrl() const
+{
+    return baseUrl() + "/upload/drive/v3";
+}
+
+QString MockDriveServer::batchUrl() const
+{
+    return baseUrl() + BATCH_PATH;
+}
+
+QString MockDriveServer::tokenUrl() const
+{
+    return baseUrl() + TOKEN_PATH;
+}
+
+void MockDriveServer::setLatency(int minMs, int maxMs)
+{
+    m_minLatencyMs = qMax(0, minMs);
+    m_maxLatencyMs = qMax(m_minLatencyMs, maxMs);
+}
+
+void MockDriveServer::setErrorRate(double rate)
+{
+    m_errorRate = qBound(0.0, rate, 1.0);
+}
+
+void MockDriveServer::setRateLimit(int requestsPerSecond)
+{
+    m_rateLimit = qMax(0, requestsPerSecond);
+}
+
+void MockDriveServer::setSeed(quint32 seed)
+{
+    m_random.seed(seed);
+}
+
+QString MockDriveServer::addFolder(const QString &name, const QString &parentId)
+{
+    QJsonObject metadata;
+    metadata["name"] = name;
+    metadata["mimeType"] = FOLDER_MIME_TYPE;
+    if (!parentId.isEmpty()) {
+        metadata["parents"] = QJsonArray() << parentId;
+    }
+    HttpResponse response = createFile(metadata, nullptr);
+    return QJsonDocument::fromJson(response.body).object()["id"].toString();
+}
+
+QString MockDriveServer::addFile(const QString &name, const QString &parentId, const QByteArray &content,
+                                 const QJsonObject &appProperties)
+{
+    QJsonObject metadata;
+    metadata["name"] = name;
+    metadata["mimeType"] = "text/markdown";
+    metadata["parents"] = QJsonArray() << parentId;
+    if (!appProperties.isEmpty()) {
+        metadata["appProperties"] = appProperties;
+    }
+    HttpResponse response = createFile(metadata, &content);
+    return QJsonDocument::fromJson(response.body).object()["id"].toString();
+}
+
+int MockDriveServer::fileCount() const
+{
+    int count = 0;
+    for (const DriveFile &file : m_files) {
+        if (file.mimeType != FOLDER_MIME_TYPE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+QByteArray MockDriveServer::fileContent(const QString &fileId) const
+{
+    return m_files.value(fileId).content;
+}
+
+MockDriveServer::Stats MockDriveServer::stats() const
+{
+    return m_stats;
+}
+
+void MockDriveServer::resetStats()
+{
+    m_stats = Stats();
+    m_lastResponseAt = -1;
+}
+
+int MockDriveServer::activeRequests() const
+{
+    return m_active;
+}
+
+qint64 MockDriveServer::lastResponseAt() const
+{
+    return m_lastResponseAt;
+}
+
+const QElapsedTimer &MockDriveServer::clock() const
+{
+    return m_clock;
+}
+
+void MockDriveServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockDriveServer::readRequests(QTcpSocket *socket)
+{
+    QByteArray &buffer = m_buffers[socket];
+    buffer += socket->readAll();
+
+    forever {
+        int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            return;
+        }
+
+        const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() < 2) {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        HttpRequest request;
+        request.method = requestLine[0];
+        request.url = QUrl::fromEncoded(requestLine[1]);
+        for (int i = 1; i < lines.size(); ++i) {
+            int colon = lines[i].indexOf(':');
+            if (colon > 0) {
+                request.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+            }
+        }
+
+        int contentLength = request.headers.value("content-length").toInt();
+        int messageSize = headerEnd + 4 + contentLength;
+        if (buffer.size() < messageSize) {
+            return;
+        }
+        request.body = buffer.mid(headerEnd + 4, contentLength);
+        buffer.remove(0, messageSize);
+
+        m_stats.requests++;
+        m_stats.bytesReceived += messageSize;
+        m_active++;
+
+        bool keepAlive = request.headers.value("connection").toLower() != "close";
+        HttpResponse response = handle(request);
+        QByteArray reply = serialize(response, keepAlive);
+
+        // The reply goes out after the simulated latency
+        QPointer<QTcpSocket> target(socket);
+        QTimer::singleShot(nextLatency(), this, [this, target, reply, keepAlive]() {
+            m_active--;
+            m_lastResponseAt = m_clock.elapsed();
+            if (!target) {
+                return;
+            }
+            m_stats.bytesSent += reply.size();
+            target->write(reply);
+            if (!keepAlive) {
+                target->disconnectFromHost();
+            }
+        });
+    }
+}
+
+MockDriveServer::HttpResponse MockDriveServer::handle(const HttpRequest &request)
+{
+    QString path = request.url.path();
+
+    if (throttle()) {
+        m_stats.throttled++;
+        HttpResponse response = errorResponse(429, "Rate Limit Exceeded");
+        response.headers.append(qMakePair(QByteArray("Retry-After"), QByteArray("1")));
+        return response;
+    }
+
+    if (path == BATCH_PATH && request.method == "POST") {
+        return handleBatch(request);
+    }
+
+    m_stats.callsByRoute[routeName(request.method, path)]++;
+    if (path != TOKEN_PATH && m_errorRate > 0.0 && m_random.generateDouble() < m_errorRate) {
+        m_stats.injectedErrors++;
+        return errorResponse(503, "Service Unavailable");
+    }
+    return route(request);
+}
+
+MockDriveServer::HttpResponse MockDriveServer::route(const HttpRequest &request)
+{
+    QString path = request.url.path();
+    QUrlQuery query(request.url);
+
+    if (path == TOKEN_PATH) {
+        QJsonObject token;
+        token["access_token"] = "mock-access-token";
+        token["token_type"] = "Bearer";
+        token["expires_in"] = 3600;
+        return jsonResponse(200, token);
+    }
+
+    // Upload session URLs carry their own authorization
+    bool sessionUpload = query.hasQueryItem("upload_id");
+    if (!sessionUpload && !request.headers.value("authorization").startsWith("Bearer ")) {
+        return errorResponse(401, "Login Required");
+    }
+
+    QJsonObject metadata = QJsonDocument::fromJson(request.body).object();
+
+    if (path.startsWith(UPLOAD_PATH)) {
+        QString fileId = path.mid(UPLOAD_PATH.size() + 1);
+        if (sessionUpload) {
+            if (!m_sessions.contains(query.queryItemValue("upload_id"))) {
+                return errorResponse(404, "Upload session not found");
+            }
+            UploadSession session = m_sessions.take(query.queryItemValue("upload_id"));
+            return session.fileId.isEmpty()
+                ? createFile(session.metadata, &request.body)
+                : updateFile(session.fileId, session.query, session.metadata, &request.body);
+        }
+
+        QString uploadType = query.queryItemValue("uploadType");
+        if (!fileId.isEmpty() && !m_files.contains(fileId)) {
+            return errorResponse(404, "File not found: " + fileId);
+        }
+        if (uploadType == "resumable") {
+            UploadSession session;
+            session.fileId = fileId;
+            session.metadata = metadata;
+            session.query = query;
+            QString sessionId = QString::number(m_nextId++);
+            m_sessions.insert(sessionId, session);
+
+            HttpResponse response;
+            response.headers.append(qMakePair(QByteArray("Location"),
+                (uploadBaseUrl() + "/files?uploadType=resumable&upload_id=" + sessionId).toUtf8()));
+            return response;
+        }
+        if (uploadType == "media") {
+            return fileId.isEmpty() ? createFile(QJsonObject(), &request.body)
+                                    : updateFile(fileId, query, QJsonObject(), &request.body);
+        }
+        return errorResponse(400, "Unsupported uploadType: " + uploadType);
+    }
+
+    if (path == FILES_PATH) {
+        if (request.method == "GET") {
+            return listFiles(query);
+        }
+        if (request.method == "POST") {
+            return createFile(metadata, nullptr);
+        }
+        return errorResponse(405, "Method not allowed");
+    }
+
+    if (path.startsWith(FILES_PATH + "/")) {
+        QString fileId = path.mid(FILES_PATH.size() + 1);
+        if (!m_files.contains(fileId)) {
+            return errorResponse(404, "File not found: " + fileId);
+        }
+        if (request.method == "GET") {
+            if (query.queryItemValue("alt") == "media") {
+                HttpResponse response;
+                response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("text/markdown")));
+                response.body = m_files.value(fileId).content;
+                return response;
+            }
+            return jsonResponse(200, resource(m_files.value(fileId)));
+        }
+        if (request.method == "PATCH") {
+            return updateFile(fileId, query, metadata, nullptr);
+        }
+        if (request.method == "DELETE") {
+            return deleteFile(fileId);
+        }
+        return errorResponse(405, "Method not allowed");
+    }
+
+    return errorResponse(404, "Not found: " + path);
+}
+
+MockDriveServer::HttpResponse MockDriveServer::handleBatch(const HttpRequest &request)
+{
+    QByteArray boundary = DriveBatch::boundaryFromContentType(request.headers.value("content-type"));
+    if (boundary.isEmpty()) {
+        return errorResponse(400, "Missing batch boundary");
+    }
+
+    const QByteArray responseBoundary = "batch_mock_response";
+    QByteArray payload;
+
+    const QByteArray delimiter = "--" + boundary;
+    int pos = request.body.indexOf(delimiter);
+    while (pos >= 0) {
+        int partStart = pos + delimiter.size();
+        if (request.body.mid(partStart, 2) == "--") {
+            break;
+        }
+        int next = request.body.indexOf(delimiter, partStart);
+        QByteArray part = request.body.mid(partStart, next < 0 ? -1 : next - partStart).trimmed();
+        pos = next;
+
+        // MIME headers of the part, then the embedded HTTP request
+        int mimeEnd = part.indexOf("\r\n\r\n");
+        if (mimeEnd < 0) {
+            continue;
+        }
+        QByteArray contentId;
+        for (const QByteArray &line : part.left(mimeEnd).split('\n')) {
+            if (line.toLower().startsWith("content-id:")) {
+                contentId = line.mid(11).trimmed();
+            }
+        }
+        QByteArray http = part.mid(mimeEnd + 4);
+        int headerEnd = http.indexOf("\r\n\r\n");
+        QByteArray head = headerEnd < 0 ? http : http.left(headerEnd);
+        const QList<QByteArray> requestLine = head.split('\n').first().trimmed().split(' ');
+        if (requestLine.size() < 2) {
+            continue;
+        }
+
+        HttpRequest call;
+        call.method = requestLine[0];
+        call.url = QUrl::fromEncoded(requestLine[1]);
+        call.headers.insert("authorization", request.headers.value("authorization"));
+        call.body = headerEnd < 0 ? QByteArray() : http.mid(headerEnd + 4);
+
+        m_stats.batchParts++;
+        m_stats.callsByRoute[routeName(call.method, call.url.path())]++;
+        HttpResponse response;
+        if (m_errorRate > 0.0 && m_random.generateDouble() < m_errorRate) {
+            m_stats.injectedErrors++;
+            response = errorResponse(503, "Service Unavailable");
+        } else {
+            response = route(call);
+        }
+
+        contentId.replace("<", "").replace(">", "");
+        payload += "--" + responseBoundary + "\r\n";
+        payload += "Content-Type: application/http\r\n";
+        payload += "Content-ID: <response-" + contentId + ">\r\n\r\n";
+        payload += "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasonPhrase(response.status) + "\r\n";
+        for (const auto &header : response.headers) {
+            payload += header.first + ": " + header.second + "\r\n";
+        }
+        payload += "\r\n" + response.body + "\r\n";
+    }
+    payload += "--" + responseBoundary + "--\r\n";
+
+    HttpResponse response;
+    response.headers.append(qMakePair(QByteArray("Content-Type"), "multipart/mixed; boundary=" + responseBoundary));
+    response.body = payload;
+    return response;
+}
+
+MockDriveServer::HttpResponse MockDriveServer::listFiles(const QUrlQuery &query) const
+{
+    QString q = query.queryItemValue("q", QUrl::FullyDecoded);
+    int pageSize = query.hasQueryItem("pageSize") ? query.queryItemValue("pageSize").toInt() : DEFAULT_PAGE_SIZE;
+    pageSize = qBound(1, pageSize, MAX_PAGE_SIZE);
+    int offset = query.queryItemValue("pageToken").toInt();
+
+    // Parent clauses are answered from the child index instead of a full scan
+    QStringList candidates;
+    static const QRegularExpression parentClause("'([^']*)' in parents");
+    QRegularExpressionMatch parent = parentClause.match(q);
+    if (parent.hasMatch()) {
+        candidates = m_children.value(parent.captured(1));
+    } else {
+        candidates = m_files.keys();
+    }
+
+    QJsonArray files;
+    int matched = 0;
+    bool more = false;
+    for (const QString &id : candidates) {
+        auto it = m_files.constFind(id);
+        if (it == m_files.constEnd() || !matchesQuery(it.value(), q)) {
+            continue;
+        }
+        if (matched++ < offset) {
+            continue;
+        }
+        if (files.size() == pageSize) {
+            more = true;
+            break;
+        }
+        files.append(resource(it.value()));
+    }
+
+    QJsonObject result;
+    result["files"] = files;
+    if (more) {
+        result["nextPageToken"] = QString::number(offset + pageSize);
+    }
+    return jsonResponse(200, result);
+}
+
+MockDriveServer::HttpResponse MockDriveServer::createFile(const QJsonObject &metadata, const QByteArray *content)
+{
+    DriveFile file;
+    file.id = newFileId();
+    file.name = metadata["name"].toString("Untitled");
+    file.mimeType = metadata["mimeType"].toString("application/octet-stream");
+    file.appProperties = metadata["appProperties"].toObject();
+    if (content) {
+        file.content = *content;
+    }
+    file.modifiedTime = QDateTime::currentDateTimeUtc();
+
+    QStringList parents;
+    for (const QJsonValue &value : metadata["parents"].toArray()) {
+        parents.append(value.toString());
+    }
+    setParents(file, parents.isEmpty() ? QStringList() << "root" : parents);
+
+    m_files.insert(file.id, file);
+    return jsonResponse(200, resource(file));
+}
+
+MockDriveServer::HttpResponse MockDriveServer::updateFile(const QString &fileId, const QUrlQuery &query,
+                                                          const QJsonObject &metadata, const QByteArray *content)
+{
+    if (!m_files.contains(fileId)) {
+        return errorResponse(404, "File not found: " + fileId);
+    }
+    DriveFile &file = m_files[fileId];
+
+    if (metadata.contains("name")) {
+        file.name = metadata["name"].toString();
+    }
+    if (metadata.contains("mimeType")) {
+        file.mimeType = metadata["mimeType"].toString();
+    }
+    // appProperties are merged key by key; null removes a key
+    const QJsonObject appProperties = metadata["appProperties"].toObject();
+    for (auto it = appProperties.begin(); it != appProperties.end(); ++it) {
+        if (it.value().isNull()) {
+            file.appProperties.remove(it.key());
+        } else {
+            file.appProperties[it.key()] = it.value();
+        }
+    }
+    if (content) {
+        file.content = *content;
+    }
+
+    QStringList parents = file.parents;
+    for (const QString &removed : query.queryItemValue("removeParents").split(',', Qt::SkipEmptyParts)) {
+        parents.removeAll(removed);
+    }
+    for (const QString &added : query.queryItemValue("addParents").split(',', Qt::SkipEmptyParts)) {
+        if (!parents.contains(added)) {
+            parents.append(added);
+        }
+    }
+    setParents(file, parents);
+
+    file.modifiedTime = QDateTime::currentDateTimeUtc();
+    return jsonResponse(200, resource(file));
+}
+
+MockDriveServer::HttpResponse MockDriveServer::deleteFile(const QString &fileId)
+{
+    // Deleting a folder deletes what is in it
+    const QStringList children = m_children.take(fileId);
+    for (const QString &child : children) {
+        if (m_files.contains(child)) {
+            deleteFile(child);
+        }
+    }
+
+    DriveFile file = m_files.take(fileId);
+    setParents(file, QStringList());
+
+    HttpResponse response;
+    response.status = 204;
+    return response;
+}
+
+bool MockDriveServer::matchesQuery(const DriveFile &file, const QString &query) const
+{
+    static const QRegularExpression parentClause("^'([^']*)' in parents$");
+    static const QRegularExpression fieldClause("^(name|mimeType)\\s*(!=|=)\\s*'([^']*)'$");
+
+    const QStringList clauses = query.split(" and ", Qt::SkipEmptyParts);
+    for (const QString &rawClause : clauses) {
+        QString clause = rawClause.trimmed();
+
+        QRegularExpressionMatch match = parentClause.match(clause);
+        if (match.hasMatch()) {
+            if (!file.parents.contains(match.captured(1))) {
+                return false;
+            }
+            continue;
+        }
+
+        match = fieldClause.match(clause);
+        if (match.hasMatch()) {
+            QString value = match.captured(1) == "name" ? file.name : file.mimeType;
+            bool equal = value == match.captured(3);
+            if (equal != (match.captured(2) == "=")) {
+                return false;
+            }
+        }
+        // Other clauses (trashed=false) hold for every stored file
+    }
+    return true;
+}
+
+QJsonObject MockDriveServer::resource(const DriveFile &file) const
+{
+    QJsonObject json;
+    json["kind"] = "drive#file";
+    json["id"] = file.id;
+    json["name"] = file.name;
+    json["mimeType"] = file.mimeType;
+    json["parents"] = QJsonArray::fromStringList(file.parents);
+    json["modifiedTime"] = file.modifiedTime.toString(Qt::ISODateWithMs);
+    if (!file.appProperties.isEmpty()) {
+        json["appProperties"] = file.appProperties;
+    }
+    if (file.mimeType != FOLDER_MIME_TYPE) {
+        json["size"] = QString::number(file.content.size());
+        json["md5Checksum"] = QString(QCryptographicHash::hash(file.content, QCryptographicHash::Md5).toHex());
+    }
+    return json;
+}
+
+QString MockDriveServer::newFileId()
+{
+    // Zero padded, so listings come back in creation order
+    return QString("mock%1").arg(m_nextId++, 10, 10, QChar('0'));
+}
+
+void MockDriveServer::setParents(DriveFile &file, const QStringList &parents)
+{
+    for (const QString &parent : file.parents) {
+        m_children[parent].removeAll(file.id);
+    }
+    file.parents = parents;
+    for (const QString &parent : parents) {
+        m_children[parent].append(file.id);
+    }
+}
+
+bool MockDriveServer::throttle()
+{
+    if (m_rateLimit <= 0) {
+        return false;
+    }
+    qint64 now = m_clock.elapsed();
+    if (now - m_windowStart >= 1000) {
+        m_windowStart = now;
+        m_windowRequests = 0;
+    }
+    return ++m_windowRequests > m_rateLimit;
+}
+
+int MockDriveServer::nextLatency()
+{
+    if (m_maxLatencyMs <= m_minLatencyMs) {
+        return m_minLatencyMs;
+    }
+    return m_random.bounded(m_minLatencyMs, m_maxLatencyMs + 1);
+}
+
+QString MockDriveServer::routeName(const QByteArray &method, const QString &path)
+{
+    // Collapse file IDs, so calls group by endpoint
+    QString name = path;
+    if (name.startsWith(UPLOAD_PATH)) {
+        name = name.size() > UPLOAD_PATH.size() ? "upload/files/{id}" : "upload/files";
+    } else if (name.startsWith(FILES_PATH)) {
+        name = name.size() > FILES_PATH.size() ? "files/{id}" : "files";
+    } else if (name.startsWith("/")) {
+        name.remove(0, 1);
+    }
+    return QString::fromLatin1(method) + ' ' + name;
+}
+
+MockDriveServer::HttpResponse MockDriveServer::jsonResponse(int status, const QJsonObject &json)
+{
+    HttpResponse response;
+    response.status = status;
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/json; charset=UTF-8")));
+    response.body = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+MockDriveServer::HttpResponse MockDriveServer::errorResponse(int status, const QString &message)
+{
+    QJsonObject error;
+    error["code"] = status;
+    error["message"] = message;
+    QJsonObject body;
+    body["error"] = error;
+    return jsonResponse(status, body);
+}
+
+QByteArray MockDriveServer::reasonPhrase(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 429: return "Too Many Requests";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+QByteArray MockDriveServer::serialize(const HttpResponse &response, bool keepAlive)
+{
+    QByteArray message = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasonPhrase(response.status) + "\r\n";
+    for (const auto &header : response.headers) {
+        message += header.first + ": " + header.second + "\r\n";
+    }
+    message += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+    message += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    message += "\r\n";
+    message += response.body;
+    return message;
+}
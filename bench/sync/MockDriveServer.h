@@ -0,0 +1,154 @@
+#ifndef MOCKDRIVESERVER_H
+#define MOCKDRIVESERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QStringList>
+
+class QTcpServer;
+class QTcpSocket;
+
+// In-process HTTP stand-in for the parts of Drive v3 that GoogleDriveManager
+// uses: file listing with queries and paging, folder and file creation,
+// metadata updates, resumable and media uploads, media downloads, deletes,
+// multipart batches and the OAuth token endpoint. Responses can be delayed,
+// fail at a set rate with 503, and be throttled with 429 above a request rate.
+class MockDriveServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        int requests = 0;          // HTTP requests, a batch counts once
+        int batchParts = 0;        // Calls carried inside batches
+        int throttled = 0;         // Answered with 429
+        int injectedErrors = 0;    // Answered with 503
+        qint64 bytesReceived = 0;
+        qint64 bytesSent = 0;
+        QMap<QString, int> callsByRoute;  // "PATCH upload/files" -> count, batch parts included
+    };
+
+    explicit MockDriveServer(QObject *parent = nullptr);
+    ~MockDriveServer() override;
+
+    bool listen(quint16 port = 0);
+    QString baseUrl() const;
+    QString apiBaseUrl() const;
+    QString uploadBaseUrl() const;
+    QString batchUrl() const;
+    QString tokenUrl() const;
+
+    // Simulated service behaviour
+    void setLatency(int minMs, int maxMs);
+    void setErrorRate(double rate);          // 0 to 1, per call
+    void setRateLimit(int requestsPerSecond);  // 0 for no limit
+    void setSeed(quint32 seed);
+
+    // Remote content
+    QString addFolder(const QString &name, const QString &parentId = QString());
+    QString addFile(const QString &name, const QString &parentId, const QByteArray &content,
+                    const QJsonObject &appProperties = QJsonObject());
+    int fileCount() const;                   // Files that are not folders
+    QByteArray fileContent(const QString &fileId) const;
+
+    // Load
+    Stats stats() const;
+    void resetStats();
+    int activeRequests() const;
+    qint64 lastResponseAt() const;           // Milliseconds on clock(), -1 before the first one
+    const QElapsedTimer &clock() const;
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct HttpRequest
+    {
+        QByteArray method;
+        QUrl url;
+        QHash<QByteArray, QByteArray> headers;  // Lower-case names
+        QByteArray body;
+    };
+
+    struct HttpResponse
+    {
+        int status = 200;
+        QList<QPair<QByteArray, QByteArray>> headers;
+        QByteArray body;
+    };
+
+    struct DriveFile
+    {
+        QString id;
+        QString name;
+        QString mimeType;
+        QStringList parents;
+        QJsonObject appProperties;
+        QByteArray content;
+        QDateTime modifiedTime;
+    };
+
+    // Upload session opened by a resumable upload request
+    struct UploadSession
+    {
+        QString fileId;           // Empty when the upload creates a file
+        QJsonObject metadata;
+        QUrlQuery query;
+    };
+
+    void readRequests(QTcpSocket *socket);
+
+    HttpResponse handle(const HttpRequest &request);
+    HttpResponse route(const HttpRequest &request);
+    HttpResponse handleBatch(const HttpRequest &request);
+    HttpResponse listFiles(const QUrlQuery &query) const;
+    HttpResponse createFile(const QJsonObject &metadata, const QByteArray *content);
+    HttpResponse updateFile(const QString &fileId, const QUrlQuery &query, const QJsonObject &metadata,
+                            const QByteArray *content);
+    HttpResponse deleteFile(const QString &fileId);
+    bool matchesQuery(const DriveFile &file, const QString &query) const;
+    QJsonObject resource(const DriveFile &file) const;
+    QString newFileId();
+    void setParents(DriveFile &file, const QStringList &parents);
+    bool throttle();
+    int nextLatency();
+
+    static QString routeName(const QByteArray &method, const QString &path);
+    static HttpResponse jsonResponse(int status, const QJsonObject &json);
+    static HttpResponse errorResponse(int status, const QString &message);
+    static QByteArray reasonPhrase(int status);
+    static QByteArray serialize(const HttpResponse &response, bool keepAlive);
+
+    QTcpServer *m_server;
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+
+    QMap<QString, DriveFile> m_files;
+    QHash<QString, QStringList> m_children;   // Parent ID -> file IDs
+    QHash<QString, UploadSession> m_sessions;
+    quint64 m_nextId;
+
+    int m_minLatencyMs;
+    int m_maxLatencyMs;
+    double m_errorRate;
+    int m_rateLimit;
+    QRandomGenerator m_random;
+
+    // Requests in the current one-second rate window
+    qint64 m_windowStart;
+    int m_windowRequests;
+
+    Stats m_stats;
+    int m_active;
+    qint64 m_lastResponseAt;
+    QElapsedTimer m_clock;
+};
+
+#endif // MOCKDRIVESERVER_H
@@ -0,0 +1,342 @@
+// Sync benchmark: drives SyncManager and GoogleDriveManager against
+// MockDriveServer and reports request counts, bytes and throughput for a full
+// upload or download of a generated note set, a smart sync replaying edits
+// queued in the outbox, or a manual full sync.
+//
+//   notes-sync-bench --mode upload --notes 2000 --latency 80 --jitter 40 --error-rate 0.02
+//   notes-sync-bench --mode download --notes 500 --rate-limit 20 --json
+//   notes-sync-bench --mode smart --notes 300 --latency 20
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QStandardPaths>
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QEventLoop>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QDir>
+#include <functional>
+#include "MockDriveServer.h"
+#include "db/DatabaseManager.h"
+#include "sync/GoogleDriveManager.h"
+#include "sync/SyncManager.h"
+#include "sync/SyncOutbox.h"
+
+struct BenchOptions
+{
+    QString mode;
+    int notes = 1000;
+    int folders = 10;
+    int bodySize = 2048;
+    int latencyMs = 50;
+    int jitterMs = 0;
+    double errorRate = 0.0;
+    int rateLimit = 0;
+    quint32 seed = 1;
+    int timeoutSec = 600;
+    int settleMs = 2000;
+    bool json = false;
+};
+
+static const char *WORDS[] = {
+    "note", "sync", "drive", "folder", "draft", "idea", "list", "meeting", "todo", "link",
+    "project", "review", "release", "change", "plan", "summary", "question", "answer", "detail", "week"
+};
+
+// Markdown body of about the given size, the same for the same generator state
+static QString generateBody(QRandomGenerator &random, const QString &title, int size)
+{
+    QString body = "# " + title + "\n\n";
+    int wordCount = int(sizeof(WORDS) / sizeof(WORDS[0]));
+    while (body.size() < size) {
+        body += QLatin1String(WORDS[random.bounded(wordCount)]);
+        body += random.bounded(12) == 0 ? QStringLiteral(".\n\n") : QStringLiteral(" ");
+    }
+    return body;
+}
+
+static void seedLocalNotes(DatabaseManager &db, const BenchOptions &options)
+{
+    QRandomGenerator random(options.seed);
+    QList<int> folderIds;
+    for (int i = 0; i < options.folders; ++i) {
+        folderIds.append(db.createFolder(QString("Folder %1").arg(i + 1)));
+    }
+    for (int i = 0; i < options.notes; ++i) {
+        QString title = QString("Note %1").arg(i + 1);
+        db.createNote(folderIds[i % folderIds.size()], title, generateBody(random, title, options.bodySize));
+    }
+}
+
+static void seedRemoteNotes(MockDriveServer &server, const BenchOptions &options)
+{
+    QRandomGenerator random(options.seed);
+    QString rootId = server.addFolder("Notes App");
+    QStringList folderIds;
+    for (int i = 0; i < options.folders; ++i) {
+        folderIds.append(server.addFolder(QString("Folder %1").arg(i + 1), rootId));
+    }
+    for (int i = 0; i < options.notes; ++i) {
+        QString title = QString("Note %1").arg(i + 1);
+        server.addFile(title + ".md", folderIds[i % folderIds.size()],
+                       generateBody(random, title, options.bodySize).toUtf8());
+    }
+}
+
+// Queues every local note the way edits made while offline would be
+static void queueLocalEdits(DatabaseManager &db, SyncOutbox &outbox)
+{
+    QSqlQuery q(db.database());
+    if (!q.exec("SELECT id FROM notes ORDER BY id")) {
+        return;
+    }
+    db.database().transaction();
+    while (q.next()) {
+        outbox.enqueueUpload(q.value(0).toInt());
+    }
+    db.database().commit();
+}
+
+static int localNoteCount(DatabaseManager &db)
+{
+    QSqlQuery q(db.database());
+    if (!q.exec("SELECT COUNT(*) FROM notes") || !q.next()) {
+        return -1;
+    }
+    return q.value(0).toInt();
+}
+
+// Runs the event loop until done() holds or the timeout passes
+static bool waitUntil(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+        if (done() || timer.elapsed() > timeoutMs) {
+            loop.quit();
+        }
+    });
+    poll.start(20);
+    if (!done()) {
+        loop.exec();
+    }
+    return done();
+}
+
+static bool parseOptions(const QCoreApplication &app, BenchOptions *options, bool *verbose)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures a full Drive sync against a local mock server.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"mode", "upload, download, smart or full.", "mode", "upload"},
+        {"notes", "Number of notes.", "count", "1000"},
+        {"folders", "Number of folders the notes are spread over.", "count", "10"},
+        {"body-size", "Approximate note body size in bytes.", "bytes", "2048"},
+        {"latency", "Server response latency.", "ms", "50"},
+        {"jitter", "Random extra latency, up to this much.", "ms", "0"},
+        {"error-rate", "Share of calls answered with 503.", "rate", "0"},
+        {"rate-limit", "Requests per second before 429, 0 for none.", "rps", "0"},
+        {"seed", "Seed for note content, latency and errors.", "seed", "1"},
+        {"timeout", "Give up after this long.", "seconds", "600"},
+        {"settle-ms", "Idle time that marks the end of the run.", "ms", "2000"},
+        {"json", "Print the result as JSON."},
+        {"verbose", "Keep debug output from the sync code."},
+    });
+    parser.process(app);
+
+    options->mode = parser.value("mode");
+    options->notes = parser.value("notes").toInt();
+    options->folders = qMax(1, parser.value("folders").toInt());
+    options->bodySize = parser.value("body-size").toInt();
+    options->latencyMs = parser.value("latency").toInt();
+    options->jitterMs = parser.value("jitter").toInt();
+    options->errorRate = parser.value("error-rate").toDouble();
+    options->rateLimit = parser.value("rate-limit").toInt();
+    options->seed = parser.value("seed").toUInt();
+    options->timeoutSec = parser.value("timeout").toInt();
+    options->settleMs = parser.value("settle-ms").toInt();
+    options->json = parser.isSet("json");
+    *verbose = parser.isSet("verbose");
+
+    if (!QStringList({"upload", "download", "smart", "full"}).contains(options->mode)) {
+        QTextStream(stderr) << "Unknown mode: " << options->mode << "\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("notes-sync-bench");
+
+    BenchOptions options;
+    bool verbose = false;
+    if (!parseOptions(app, &options, &verbose)) {
+        return 2;
+    }
+    if (!verbose) {
+        QLoggingCategory::setFilterRules("*.debug=false\n*.info=false");
+    }
+
+    // Keep settings and sync state away from a real installation
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).removeRecursively();
+
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        QTextStream(stderr) << "Could not create a working directory\n";
+        return 1;
+    }
+
+    MockDriveServer server;
+    if (!server.listen()) {
+        return 1;
+    }
+    server.setSeed(options.seed);
+
+    DatabaseManager &db = DatabaseManager::instance();
+    db.setDatabasePath(workDir.filePath("notes.db"));
+    if (!db.open() || !db.initializeSchema()) {
+        QTextStream(stderr) << "Could not open the benchmark database\n";
+        return 1;
+    }
+    db.setAutoImportEnabled(false);
+    db.setNotesDirectory(workDir.filePath("notes"));
+
+    // Every mode but download sends local notes up
+    bool uploads = options.mode != "download";
+    if (uploads) {
+        seedLocalNotes(db, options);
+    } else {
+        seedRemoteNotes(server, options);
+    }
+    int localNotesBefore = localNoteCount(db);
+
+    GoogleDriveManager *drive = new GoogleDriveManager();
+    drive->setServiceUrls(server.apiBaseUrl(), server.uploadBaseUrl(), server.batchUrl(), server.tokenUrl());
+    SyncManager sync(&db, drive);
+
+    bool syncFinished = false;
+    QString syncError;
+    QObject::connect(&sync, &SyncManager::syncCompleted, [&]() { syncFinished = true; });
+    QObject::connect(&sync, &SyncManager::syncFailed, [&](const QString &error) {
+        syncFinished = true;
+        syncError = error;
+    });
+
+    // Signing in looks up the Notes App folder; that is setup, not measured
+    drive->setTokens("bench-access-token", "bench-refresh-token", QDateTime::currentDateTimeUtc().addSecs(3600));
+    if (!waitUntil([&]() { return syncFinished && server.activeRequests() == 0; }, options.timeoutSec * 1000)) {
+        QTextStream(stderr) << "Timed out connecting to the mock server\n";
+        return 1;
+    }
+
+    server.setLatency(options.latencyMs, options.latencyMs + options.jitterMs);
+    server.setErrorRate(options.errorRate);
+    server.setRateLimit(options.rateLimit);
+    server.resetStats();
+
+    syncFinished = false;
+    syncError.clear();
+    SyncOutbox outbox(db.database());
+    if (options.mode == "smart") {
+        queueLocalEdits(db, outbox);
+    }
+    qint64 start = server.clock().elapsed();
+    if (options.mode == "upload") {
+        sync.uploadAllNotes();
+    } else if (options.mode == "download") {
+        sync.downloadAllNotes();
+    } else if (options.mode == "smart") {
+        // The structure check lists every folder, then the outbox drains
+        sync.smartSync();
+    } else {
+        sync.syncAllNotes();
+    }
+
+    // Retries and outbox replay outlive syncCompleted, so the run ends once
+    // nothing has been sent for settle-ms
+    bool settled = waitUntil([&]() {
+        if (server.activeRequests() > 0 || drive->inFlightBytes() > 0) {
+            return false;
+        }
+        if (uploads && outbox.pendingCount() > 0) {
+            return false;
+        }
+        qint64 lastActivity = qMax(start, server.lastResponseAt());
+        return server.clock().elapsed() - lastActivity >= options.settleMs;
+    }, options.timeoutSec * 1000);
+
+    qint64 wallMs = qMax<qint64>(1, server.lastResponseAt() - start);
+    MockDriveServer::Stats stats = server.stats();
+    int transferred = uploads ? server.fileCount() : localNoteCount(db) - localNotesBefore;
+    bool complete = settled && transferred == options.notes;
+    int calls = stats.requests + stats.batchParts;
+
+    QJsonObject routes;
+    for (auto it = stats.callsByRoute.constBegin(); it != stats.callsByRoute.constEnd(); ++it) {
+        routes[it.key()] = it.value();
+    }
+
+    QJsonObject result;
+    result["mode"] = options.mode;
+    result["notes"] = options.notes;
+    result["folders"] = options.folders;
+    result["bodySize"] = options.bodySize;
+    result["latencyMs"] = options.latencyMs;
+    result["jitterMs"] = options.jitterMs;
+    result["errorRate"] = options.errorRate;
+    result["rateLimit"] = options.rateLimit;
+    result["seed"] = double(options.seed);
+    result["wallMs"] = double(wallMs);
+    result["notesPerSecond"] = options.notes * 1000.0 / wallMs;
+    result["httpRequests"] = stats.requests;
+    result["batchParts"] = stats.batchParts;
+    result["callsPerNote"] = options.notes > 0 ? double(calls) / options.notes : 0.0;
+    result["throttled"] = stats.throttled;
+    result["injectedErrors"] = stats.injectedErrors;
+    result["bytesReceived"] = double(stats.bytesReceived);
+    result["bytesSent"] = double(stats.bytesSent);
+    result["callsByRoute"] = routes;
+    result["transferred"] = transferred;
+    result["settled"] = settled;
+    result["complete"] = complete;
+    if (!syncError.isEmpty()) {
+        result["syncError"] = syncError;
+    }
+
+    QTextStream out(stdout);
+    if (options.json) {
+        out << QJsonDocument(result).toJson(QJsonDocument::Indented);
+    } else {
+        out << "mode            " << options.mode << " (" << options.notes << " notes, "
+            << options.folders << " folders, " << options.bodySize << " B bodies)\n";
+        out << "server          " << options.latencyMs << "+" << options.jitterMs << " ms, error rate "
+            << options.errorRate << ", rate limit " << options.rateLimit << "/s\n";
+        out << "wall time       " << wallMs << " ms\n";
+        out << "throughput      " << QString::number(options.notes * 1000.0 / wallMs, 'f', 1) << " notes/s\n";
+        out << "HTTP requests   " << stats.requests << " (" << stats.batchParts << " batched calls, "
+            << QString::number(result["callsPerNote"].toDouble(), 'f', 2) << " calls/note)\n";
+        out << "throttled       " << stats.throttled << "\n";
+        out << "injected errors " << stats.injectedErrors << "\n";
+        out << "bytes in/out    " << stats.bytesReceived << " / " << stats.bytesSent << "\n";
+        for (auto it = stats.callsByRoute.constBegin(); it != stats.callsByRoute.constEnd(); ++it) {
+            out << "  " << it.key() << ": " << it.value() << "\n";
+        }
+        out << "transferred     " << transferred << " of " << options.notes
+            << (settled ? "" : " (timed out)") << "\n";
+    }
+    out.flush();
+
+    return complete ? 0 : 1;
+}
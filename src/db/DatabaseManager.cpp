@@ -1,4 +1,6 @@
 #include "DatabaseManager.h"
+#include "../utils/Tracer.h"
+#include "../utils/Metrics.h"
 
 #include <QCoreApplication>
 #include <QDir>
@@ -11,10 +13,112 @@
 #include <QStandardItem>
 #include <QSettings>
 #include <QFile>
+#include <QSaveFile>
 #include <QTextStream>
 #include <QRegularExpression>
 #include <QSet>
 #include <QMap>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+// Slow-query log defaults
+static const int DEFAULT_SLOW_QUERY_THRESHOLD_MS = 50;
+static const int MAX_SLOW_QUERIES = 100;
+
+// Listings show this much of a body they do not read
+static const int BODY_PREVIEW_CHARS = 500;
+
+// Body compression. A compressed body is a blob: one codec byte, then the data.
+static const int DEFAULT_COMPRESSION_THRESHOLD_BYTES = 16 * 1024;
+static const char BODY_CODEC_QCOMPRESS = 'z';
+
+static QString storageModeName(StorageMode mode) {
+    return mode == StorageMode::Files ? QStringLiteral("files") : QStringLiteral("database");
+}
+
+// Listings read the preview in place of a body that is compressed or, in Files
+// mode, in a file; the second column says whether the body is cut short
+static QString listedBody(StorageMode mode, const QString &table = QString()) {
+    if (mode == StorageMode::Files) {
+        return QString("COALESCE(%1body_preview, ''), length(%1body_preview) >= %2").arg(table).arg(BODY_PREVIEW_CHARS);
+    }
+    return QString("CASE WHEN typeof(%1body) = 'blob' THEN %1body_preview ELSE %1body END, typeof(%1body) = 'blob'").arg(table);
+}
+
+// Matches text anywhere; % and _ in it match literally
+static QString likePattern(const QString &text) {
+    QString pattern = text;
+    pattern.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+    return "%" + pattern + "%";
+}
+
+static QString contentHash(const QString &body) {
+    return QString::fromLatin1(QCryptographicHash::hash(body.toUtf8(), QCryptographicHash::Md5).toHex());
+}
+
+static QStringList searchWords(const QString &text) {
+    static const QRegularExpression separators("\\W+", QRegularExpression::UseUnicodePropertiesOption);
+    return text.toLower().split(separators, Qt::SkipEmptyParts);
+}
+
+// The distinct words of a body, lowercased, in first-seen order. LIKE finds any
+// word or part of one in this without a second copy of the body being kept.
+static QString searchTerms(const QString &body) {
+    QStringList terms;
+    QSet<QString> seen;
+    for (const QString &word : searchWords(body)) {
+        if (!seen.contains(word)) {
+            seen.insert(word);
+            terms << word;
+        }
+    }
+    return terms.join(' ');
+}
+
+// Empty when the body is below the threshold or does not compress by a tenth
+static QByteArray compressBody(const QString &body, int threshold) {
+    if (threshold < 0) return QByteArray();
+    
+    QByteArray utf8 = body.toUtf8();
+    if (utf8.size() < threshold) return QByteArray();
+    
+    QByteArray compressed = qCompress(utf8);
+    if (compressed.size() + 1 > utf8.size() - utf8.size() / 10) return QByteArray();
+    
+    METRIC_COUNTER("db.compressed_bodies").add();
+    METRIC_COUNTER("db.compression_bytes_saved").add(quint64(utf8.size() - compressed.size() - 1));
+    return BODY_CODEC_QCOMPRESS + compressed;
+}
+
+// notes.body holds text, or a blob written by compressBody
+static QString decodeBody(const QVariant &stored) {
+    if (stored.userType() != QMetaType::QByteArray) {
+        return stored.toString();
+    }
+    
+    const QByteArray blob = stored.toByteArray();
+    if (blob.isEmpty()) return QString();
+    if (blob.at(0) != BODY_CODEC_QCOMPRESS) {
+        qWarning() << "Unknown note body codec:" << int(blob.at(0));
+        return QString();
+    }
+    MetricTimer timer(METRIC_HISTOGRAM("db.decompress_body_us"));
+    return QString::fromUtf8(qUncompress(reinterpret_cast<const uchar *>(blob.constData()) + 1, blob.size() - 1));
+}
+
+// Drops the front matter saveNoteToMarkdownFile writes, and the blank line after it
+static QString markdownBody(QString content) {
+    if (content.startsWith("---\n")) {
+        int end = content.indexOf("\n---\n", 3);
+        if (end >= 0) {
+            content.remove(0, end + 5);
+            if (content.startsWith('\n')) {
+                content.remove(0, 1);
+            }
+        }
+    }
+    return content;
+}
 
 DatabaseManager &DatabaseManager::instance() {
     static DatabaseManager mgr;
@@ -27,7 +131,11 @@ DatabaseManager::DatabaseManager(QObject *parent)
       m_notesDirectory(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/Notes"),
       m_autoSaveEnabled(true),
       m_autoSaveInterval(2000),
-      m_autoImportEnabled(false) {
+      m_storageMode(StorageMode::Database),
+      m_autoImportEnabled(false),
+      m_tracingEnabled(false),
+      m_slowQueryThresholdMs(DEFAULT_SLOW_QUERY_THRESHOLD_MS),
+      m_compressionThresholdBytes(DEFAULT_COMPRESSION_THRESHOLD_BYTES) {
     
     // Setup auto-save timer
     connect(m_autoSaveTimer, &QTimer::timeout, this, &DatabaseManager::performAutoSave);
@@ -40,13 +148,23 @@ DatabaseManager::~DatabaseManager() {
     }
 }
 
+void DatabaseManager::setDatabasePath(const QString &path) {
+    m_databasePath = path;
+}
+
 QString DatabaseManager::databaseFilePath() const {
+    if (!m_databasePath.isEmpty()) {
+        return m_databasePath;
+    }
     const QString appData = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir().mkpath(appData);
     return appData + QDir::separator() + QStringLiteral("notes.db");
 }
 
 QString DatabaseManager::settingsFilePath() const {
+    if (!m_databasePath.isEmpty()) {
+        return QFileInfo(m_databasePath).absolutePath() + QDir::separator() + QStringLiteral("settings.ini");
+    }
     const QString appData = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir().mkpath(appData);
     return appData + QDir::separator() + QStringLiteral("settings.ini");
@@ -66,11 +184,24 @@ bool DatabaseManager::open() {
     return true;
 }
 
+void DatabaseManager::close() {
+    if (!m_db.isValid()) return;
+
+    // Write pending markdown files while the notes can still be read
+    exportMarkdownMirror();
+    m_autoSaveTimer->stop();
+
+    const QString connectionName = m_db.connectionName();
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
 bool DatabaseManager::initializeSchema() {
     if (!isOpen() && !open()) return false;
 
     QSqlQuery q(m_db);
-    if (!q.exec(QStringLiteral("PRAGMA foreign_keys = ON;"))) {
+    if (!execQuery(q, QStringLiteral("PRAGMA foreign_keys = ON;"))) {
         QString errorMsg = QString("Database initialization failed. The application may not function correctly.\n\nError details: %1").arg(q.lastError().text());
         emit databaseError(errorMsg);
         qWarning() << "Failed to enable foreign_keys pragma:" << q.lastError();
@@ -91,11 +222,16 @@ CREATE TABLE IF NOT EXISTS notes (
   title TEXT NOT NULL,
   body TEXT NOT NULL,
   filepath TEXT,
+  content_hash TEXT,
+  search_terms TEXT,
+  body_preview TEXT,
   created_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,
   updated_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,
   FOREIGN KEY(folder_id) REFERENCES folders(id) ON DELETE CASCADE
 );
 
+CREATE INDEX IF NOT EXISTS idx_notes_folder ON notes(folder_id, updated_at);
+
 CREATE TABLE IF NOT EXISTS tags (
   id INTEGER PRIMARY KEY AUTOINCREMENT,
   name TEXT NOT NULL UNIQUE
@@ -121,13 +257,49 @@ CREATE TABLE IF NOT EXISTS settings (
   key TEXT PRIMARY KEY,
   value TEXT NOT NULL
 );
+
+CREATE TABLE IF NOT EXISTS sync_outbox (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  note_id INTEGER NOT NULL,
+  op TEXT NOT NULL,
+  remote_id TEXT,
+  state TEXT NOT NULL DEFAULT 'queued',
+  attempts INTEGER NOT NULL DEFAULT 0,
+  last_error TEXT,
+  created_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  updated_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE INDEX IF NOT EXISTS idx_sync_outbox_state ON sync_outbox(state, id);
+
+CREATE INDEX IF NOT EXISTS idx_sync_outbox_note ON sync_outbox(note_id);
+
+CREATE TABLE IF NOT EXISTS sync_state (
+  note_id INTEGER PRIMARY KEY,
+  remote_id TEXT NOT NULL UNIQUE,
+  content_hash TEXT,
+  revision INTEGER NOT NULL DEFAULT 0,
+  title TEXT,
+  folder_id INTEGER,
+  note_updated_at DATETIME,
+  synced_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE TABLE IF NOT EXISTS sync_tombstones (
+  note_id INTEGER PRIMARY KEY,
+  remote_id TEXT,
+  state TEXT NOT NULL DEFAULT 'queued',
+  attempts INTEGER NOT NULL DEFAULT 0,
+  last_error TEXT,
+  deleted_at DATETIME NOT NULL DEFAULT CURRENT_TIMESTAMP
+);
 )SQL");
 
     const QStringList statements = schemaSql.split(';', Qt::SkipEmptyParts);
     for (QString stmt : statements) {
         stmt = stmt.trimmed();
         if (stmt.isEmpty()) continue;
-        if (!q.exec(stmt + ';')) {
+        if (!execQuery(q, stmt + ';')) {
             QString errorMsg = QString("Failed to initialize database structure. The application may not function correctly.\n\nError details: %1").arg(q.lastError().text());
             emit databaseError(errorMsg);
             qWarning() << "Failed to run schema statement:" << stmt << "error:" << q.lastError();
@@ -159,22 +331,32 @@ void DatabaseManager::migrateDatabase() {
     QSqlQuery q(m_db);
     
     // Check if filepath column exists
-    if (!q.exec("PRAGMA table_info(notes)")) {
+    if (!execQuery(q, "PRAGMA table_info(notes)")) {
         qWarning() << "Failed to check table schema:" << q.lastError();
         return;
     }
     
-    bool hasFilepathColumn = false;
+    QSet<QString> notesColumns;
     while (q.next()) {
-        if (q.value(1).toString() == "filepath") {
-            hasFilepathColumn = true;
-            break;
+        notesColumns.insert(q.value(1).toString());
+    }
+    
+    // The hash, search terms and a preview of the body, kept in Files storage
+    // mode; the search terms and preview also stand in for a compressed body
+    const QList<QPair<QString, QString>> notesAdditions = {
+        {"content_hash", "ALTER TABLE notes ADD COLUMN content_hash TEXT"},
+        {"search_terms", "ALTER TABLE notes ADD COLUMN search_terms TEXT"},
+        {"body_preview", "ALTER TABLE notes ADD COLUMN body_preview TEXT"}
+    };
+    for (const auto &column : notesAdditions) {
+        if (!notesColumns.contains(column.first) && !execQuery(q, column.second)) {
+            qWarning() << "Failed to add" << column.first << "column to notes:" << q.lastError();
         }
     }
     
     // Add filepath column if it doesn't exist
-    if (!hasFilepathColumn) {
-        if (!q.exec("ALTER TABLE notes ADD COLUMN filepath TEXT")) {
+    if (!notesColumns.contains("filepath")) {
+        if (!execQuery(q, "ALTER TABLE notes ADD COLUMN filepath TEXT")) {
             qWarning() << "Failed to add filepath column:" << q.lastError();
             return;
         }
@@ -183,16 +365,65 @@ void DatabaseManager::migrateDatabase() {
         // Convert existing notes to markdown files
         convertExistingNotesToMarkdown();
     }
+    
+    // sync_state gained the synced revision, title and folder for remote identity
+    if (!execQuery(q, "PRAGMA table_info(sync_state)")) {
+        qWarning() << "Failed to check sync_state schema:" << q.lastError();
+        return;
+    }
+    
+    QSet<QString> syncStateColumns;
+    while (q.next()) {
+        syncStateColumns.insert(q.value(1).toString());
+    }
+    
+    const QList<QPair<QString, QString>> syncStateAdditions = {
+        {"revision", "ALTER TABLE sync_state ADD COLUMN revision INTEGER NOT NULL DEFAULT 0"},
+        {"title", "ALTER TABLE sync_state ADD COLUMN title TEXT"},
+        {"folder_id", "ALTER TABLE sync_state ADD COLUMN folder_id INTEGER"},
+        {"note_updated_at", "ALTER TABLE sync_state ADD COLUMN note_updated_at DATETIME"}
+    };
+    for (const auto &column : syncStateAdditions) {
+        if (!syncStateColumns.contains(column.first) && !execQuery(q, column.second)) {
+            qWarning() << "Failed to add" << column.first << "column to sync_state:" << q.lastError();
+        }
+    }
+    
+    // Notes synced before note_updated_at existed count as synced in their current version;
+    // anything edited since is still in the outbox
+    if (!syncStateColumns.contains("note_updated_at")
+        && !execQuery(q, "UPDATE sync_state SET note_updated_at = "
+                   "(SELECT updated_at FROM notes WHERE notes.id = sync_state.note_id) "
+                   "WHERE content_hash IS NOT NULL")) {
+        qWarning() << "Failed to backfill note_updated_at in sync_state:" << q.lastError();
+    }
+    
+    // Every note delete, including those cascaded from a folder, leaves a tombstone
+    // for the next sync to propagate to Drive. Unsent uploads of the note go with it.
+    if (!execQuery(q, "CREATE TRIGGER IF NOT EXISTS notes_tombstone AFTER DELETE ON notes BEGIN "
+                "DELETE FROM sync_outbox WHERE note_id = old.id AND op = 'upload' AND state IN ('queued', 'failed'); "
+                "INSERT OR REPLACE INTO sync_tombstones (note_id, remote_id) "
+                "VALUES (old.id, (SELECT remote_id FROM sync_state WHERE note_id = old.id)); "
+                "END")) {
+        qWarning() << "Failed to create tombstone trigger:" << q.lastError();
+    }
+    
+    // Deletes used to be queued in the outbox
+    if (!execQuery(q, "INSERT OR IGNORE INTO sync_tombstones (note_id, remote_id, attempts, last_error) "
+                "SELECT note_id, remote_id, attempts, last_error FROM sync_outbox WHERE op = 'delete' AND state != 'done'")
+        || !execQuery(q, "DELETE FROM sync_outbox WHERE op = 'delete'")) {
+        qWarning() << "Failed to move queued deletes to sync_tombstones:" << q.lastError();
+    }
 }
 
 void DatabaseManager::convertExistingNotesToMarkdown() {
     QSqlQuery q(m_db);
-    q.exec("SELECT id, title, body FROM notes WHERE filepath IS NULL OR filepath = ''");
+    execQuery(q, "SELECT id, title, body FROM notes WHERE filepath IS NULL OR filepath = ''");
     
     while (q.next()) {
         int noteId = q.value(0).toInt();
         QString title = q.value(1).toString();
-        QString body = q.value(2).toString();
+        QString body = decodeBody(q.value(2));
         
         // Save existing note to markdown file
         saveNoteToMarkdownFile(noteId, title, body);
@@ -203,7 +434,7 @@ void DatabaseManager::convertExistingNotesToMarkdown() {
 
 void DatabaseManager::createDefaultFolders() {
     QSqlQuery q(m_db);
-    q.exec("SELECT COUNT(*) FROM folders");
+    execQuery(q, "SELECT COUNT(*) FROM folders");
     if (q.next() && q.value(0).toInt() == 0) {
         // Create default folders
         createFolder("Personal");
@@ -231,27 +462,52 @@ QSqlDatabase DatabaseManager::database() const {
 
 // Note operations
 int DatabaseManager::createNote(int folderId, const QString &title, const QString &body) {
+    METRIC_COUNTER("db.note_creates").add();
+    const bool filesMode = m_storageMode == StorageMode::Files;
+    const QDateTime now = QDateTime::currentDateTime();
+    
+    // In Files mode the file is written first and the row points at it
+    QString filename;
+    if (filesMode) {
+        filename = uniqueMarkdownFilename(title);
+        if (!writeMarkdownFile(filename, title, body, now, folderId)) {
+            emit operationFailed("Create Note", QString("Unable to write the note's markdown file in %1. Please check that the notes directory is writable.").arg(m_notesDirectory));
+            return -1;
+        }
+    }
+    
     QSqlQuery q(m_db);
-    q.prepare("INSERT INTO notes (folder_id, title, body, filepath, created_at, updated_at) VALUES (?, ?, ?, ?, ?, ?)");
+    q.prepare("INSERT INTO notes (folder_id, title, body, search_terms, body_preview, filepath, content_hash, created_at, updated_at) "
+              "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
     q.addBindValue(folderId);
     q.addBindValue(title);
-    q.addBindValue(body);
-    q.addBindValue(QString()); // filepath will be set when saving to markdown
-    q.addBindValue(QDateTime::currentDateTime());
-    q.addBindValue(QDateTime::currentDateTime());
+    if (filesMode) {
+        q.addBindValue(QString(""));
+        q.addBindValue(searchTerms(body));
+        q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+    } else {
+        bindBody(q, body);
+    }
+    q.addBindValue(filename); // In Database mode, set when the mirror is written
+    q.addBindValue(filesMode ? QVariant(contentHash(body)) : QVariant());
+    q.addBindValue(now);
+    q.addBindValue(now);
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to create the note. Please check if you have sufficient disk space and try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Create Note", errorMsg);
         qWarning() << "Failed to create note:" << q.lastError();
+        if (filesMode) {
+            QFile::remove(m_notesDirectory + QDir::separator() + filename);
+        }
         return -1;
     }
     
     int noteId = q.lastInsertId().toInt();
     
-    // Automatically save to markdown file
-    if (noteId > 0) {
-        saveNoteToMarkdownFile(noteId, title, body);
+    if (noteId > 0 && !filesMode) {
+        // The markdown mirror follows with the next auto-save pass
+        markNoteAsModified(noteId);
     }
     
     emit noteSaved(noteId);
@@ -259,47 +515,184 @@ int DatabaseManager::createNote(int folderId, const QString &title, const QStrin
 }
 
 bool DatabaseManager::updateNote(int noteId, const QString &title, const QString &body) {
+    TRACE_SCOPE("db", "DatabaseManager::updateNote");
+    MetricTimer timer(METRIC_HISTOGRAM("db.update_note_us"));
+    METRIC_COUNTER("db.note_updates").add();
+    METRIC_COUNTER("db.note_chars_written").add(quint64(body.size()));
     QSqlQuery q(m_db);
-    q.prepare("UPDATE notes SET title = ?, body = ?, updated_at = ? WHERE id = ?");
-    q.addBindValue(title);
-    q.addBindValue(body);
+    if (m_storageMode == StorageMode::Files) {
+        // The file is written first; the row then records what it holds
+        if (!saveNoteToMarkdownFile(noteId, title, body)) {
+            emit operationFailed("Update Note", QString("Unable to save changes to the note's markdown file in %1. Please check that the notes directory is writable.").arg(m_notesDirectory));
+            METRIC_COUNTER("db.update_errors").add();
+            return false;
+        }
+        q.prepare("UPDATE notes SET title = ?, body = '', content_hash = ?, search_terms = ?, body_preview = ?, updated_at = ? WHERE id = ?");
+        q.addBindValue(title);
+        q.addBindValue(contentHash(body));
+        q.addBindValue(searchTerms(body));
+        q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+    } else {
+        q.prepare("UPDATE notes SET title = ?, body = ?, search_terms = ?, body_preview = ?, updated_at = ? WHERE id = ?");
+        q.addBindValue(title);
+        bindBody(q, body);
+    }
     q.addBindValue(QDateTime::currentDateTime());
     q.addBindValue(noteId);
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to save changes to the note. Please try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Update Note", errorMsg);
+        METRIC_COUNTER("db.update_errors").add();
         qWarning() << "Failed to update note:" << q.lastError();
         return false;
     }
     
-    // Automatically save to markdown file
-    saveNoteToMarkdownFile(noteId, title, body);
+    if (m_storageMode == StorageMode::Database) {
+        markNoteAsModified(noteId);
+    }
+    
+    emit noteSaved(noteId);
+    return true;
+}
+
+bool DatabaseManager::moveNote(int noteId, int folderId) {
+    // The front matter names the folder too. In Files mode the row change rolls
+    // back if the file cannot be rewritten; in Database mode the mirror follows.
+    const bool filesMode = m_storageMode == StorageMode::Files;
+    NoteData note;
+    if (filesMode) {
+        note = getNote(noteId);
+        m_db.transaction();
+    }
+    
+    // Moving in place keeps the note ID, so sync sees a move rather than a new note
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE notes SET folder_id = ?, updated_at = ? WHERE id = ?");
+    q.addBindValue(folderId);
+    q.addBindValue(QDateTime::currentDateTime());
+    q.addBindValue(noteId);
+    
+    if (!execQuery(q)) {
+        if (filesMode) {
+            m_db.rollback();
+        }
+        QString errorMsg = QString("Unable to move the note. Please try again.\n\nError details: %1").arg(q.lastError().text());
+        emit operationFailed("Move Note", errorMsg);
+        qWarning() << "Failed to move note:" << q.lastError();
+        return false;
+    }
+    
+    if (filesMode) {
+        if (!saveNoteToMarkdownFile(noteId, note.title, note.body) || !m_db.commit()) {
+            m_db.rollback();
+            emit operationFailed("Move Note", QString("Unable to update the note's markdown file in %1. Please check that the notes directory is writable.").arg(m_notesDirectory));
+            return false;
+        }
+    } else {
+        markNoteAsModified(noteId);
+    }
     
     emit noteSaved(noteId);
     return true;
 }
 
+int DatabaseManager::writeRestoredNote(int noteId, int folderId, const QString &title, const QString &body) {
+    const bool filesMode = m_storageMode == StorageMode::Files;
+    const QDateTime now = QDateTime::currentDateTime();
+    
+    // Updated in place when the note still exists, inserted otherwise
+    QSqlQuery q(m_db);
+    for (bool update : {noteId > 0, false}) {
+        if (update) {
+            q.prepare("UPDATE notes SET folder_id = ?, title = ?, body = ?, search_terms = ?, body_preview = ?, "
+                      "content_hash = ?, updated_at = ? WHERE id = ?");
+        } else {
+            q.prepare("INSERT INTO notes (folder_id, title, body, search_terms, body_preview, content_hash, updated_at, created_at) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+        }
+        q.addBindValue(folderId);
+        q.addBindValue(title);
+        if (filesMode) {
+            // Kept uncompressed; finishRestore() moves it to the file
+            q.addBindValue(body);
+            q.addBindValue(searchTerms(body));
+            q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+            q.addBindValue(contentHash(body));
+        } else {
+            bindBody(q, body);
+            q.addBindValue(QVariant());
+        }
+        q.addBindValue(now);
+        q.addBindValue(update ? QVariant(noteId) : QVariant(now));
+        
+        if (!execQuery(q)) {
+            qWarning() << "Failed to write restored note:" << title << q.lastError();
+            return -1;
+        }
+        if (!update) {
+            return q.lastInsertId().toInt();
+        }
+        if (q.numRowsAffected() > 0) {
+            return noteId;
+        }
+    }
+    return -1;
+}
+
+int DatabaseManager::writeRestoredFolder(const QString &name) {
+    QSqlQuery q(m_db);
+    q.prepare("INSERT INTO folders (name) VALUES (?)");
+    q.addBindValue(name);
+    if (!execQuery(q)) {
+        qWarning() << "Failed to write restored folder:" << name << q.lastError();
+        return -1;
+    }
+    return q.lastInsertId().toInt();
+}
 
+void DatabaseManager::finishRestore(const QList<int> &noteIds, const QList<int> &folderIds) {
+    for (int folderId : folderIds) {
+        emit folderSaved(folderId);
+    }
+    
+    for (int noteId : noteIds) {
+        if (m_storageMode == StorageMode::Database) {
+            markNoteAsModified(noteId);
+        } else {
+            // A failed write leaves the body in the row, where reads still find it
+            NoteData note = getNote(noteId);
+            QSqlQuery q(m_db);
+            q.prepare("UPDATE notes SET body = '' WHERE id = ?");
+            q.addBindValue(noteId);
+            if (!saveNoteToMarkdownFile(noteId, note.title, note.body) || !execQuery(q)) {
+                qWarning() << "Failed to write the markdown file of restored note" << noteId;
+            }
+        }
+        emit noteSaved(noteId);
+    }
+}
 
 bool DatabaseManager::deleteNote(int noteId) {
-    // Get note info before deletion to remove markdown file
-    NoteData note = getNote(noteId);
+    METRIC_COUNTER("db.note_deletes").add();
+    // Get the file path before deletion to remove markdown file
+    QString filePath = getNoteFilePath(noteId);
     
     QSqlQuery q(m_db);
     q.prepare("DELETE FROM notes WHERE id = ?");
     q.addBindValue(noteId);
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to delete the note. Please try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Delete Note", errorMsg);
         qWarning() << "Failed to delete note:" << q.lastError();
         return false;
     }
     
+    m_modifiedNotes.remove(noteId);
+    
     // Remove markdown file if it exists
-    if (!note.filepath.isEmpty()) {
-        QString filePath = m_notesDirectory + QDir::separator() + note.filepath;
+    if (!filePath.isEmpty()) {
         QFile file(filePath);
         if (file.exists()) {
             if (!file.remove()) {
@@ -313,6 +706,7 @@ bool DatabaseManager::deleteNote(int noteId) {
 }
 
 NoteData DatabaseManager::getNote(int noteId) {
+    METRIC_COUNTER("db.note_loads").add();
     QSqlQuery q(m_db);
     q.prepare("SELECT id, folder_id, title, body, filepath, created_at, updated_at FROM notes WHERE id = ?");
     q.addBindValue(noteId);
@@ -320,12 +714,12 @@ NoteData DatabaseManager::getNote(int noteId) {
     NoteData note;
     note.id = -1;
     
-    if (q.exec() && q.next()) {
+    if (execQuery(q) && q.next()) {
         note.id = q.value(0).toInt();
         note.folderId = q.value(1).toInt();
         note.title = q.value(2).toString();
-        note.body = q.value(3).toString();
         note.filepath = q.value(4).toString();
+        note.body = noteBody(q.value(3), note.filepath);
         note.createdAt = q.value(5).toDateTime();
         note.updatedAt = q.value(6).toDateTime();
     }
@@ -334,21 +728,25 @@ NoteData DatabaseManager::getNote(int noteId) {
 }
 
 QList<NoteData> DatabaseManager::getNotesInFolder(int folderId) {
+    METRIC_COUNTER("db.folder_listings").add();
     QList<NoteData> notes;
     QSqlQuery q(m_db);
-    q.prepare("SELECT id, folder_id, title, body, filepath, created_at, updated_at FROM notes WHERE folder_id = ? ORDER BY updated_at DESC");
+    // Compressed and file-stored bodies are left on disk; their preview takes their place
+    q.prepare("SELECT id, folder_id, title, filepath, created_at, updated_at, " + listedBody(m_storageMode) + " "
+              "FROM notes WHERE folder_id = ? ORDER BY updated_at DESC");
     q.addBindValue(folderId);
     
-    if (q.exec()) {
+    if (execQuery(q)) {
         while (q.next()) {
             NoteData note;
             note.id = q.value(0).toInt();
             note.folderId = q.value(1).toInt();
             note.title = q.value(2).toString();
-            note.body = q.value(3).toString();
-            note.filepath = q.value(4).toString();
-            note.createdAt = q.value(5).toDateTime();
-            note.updatedAt = q.value(6).toDateTime();
+            note.filepath = q.value(3).toString();
+            note.createdAt = q.value(4).toDateTime();
+            note.updatedAt = q.value(5).toDateTime();
+            note.body = q.value(6).toString();
+            note.partialBody = q.value(7).toBool();
             notes.append(note);
         }
     }
@@ -359,12 +757,10 @@ QList<NoteData> DatabaseManager::getNotesInFolder(int folderId) {
 QList<QPair<QString, QString>> DatabaseManager::getAllNotes() {
     QList<QPair<QString, QString>> notes;
     QSqlQuery q(m_db);
-    q.exec("SELECT title, body FROM notes ORDER BY updated_at DESC");
+    execQuery(q, "SELECT title, " + listedBody(m_storageMode) + " FROM notes ORDER BY updated_at DESC");
     
     while (q.next()) {
-        QString title = q.value(0).toString();
-        QString body = q.value(1).toString();
-        notes.append(qMakePair(title, body));
+        notes.append(qMakePair(q.value(0).toString(), q.value(1).toString()));
     }
     
     return notes;
@@ -373,15 +769,15 @@ QList<QPair<QString, QString>> DatabaseManager::getAllNotes() {
 QList<NoteData> DatabaseManager::getAllNotesWithPaths() {
     QList<NoteData> notes;
     QSqlQuery q(m_db);
-    q.exec("SELECT id, folder_id, title, body, filepath, created_at, updated_at FROM notes ORDER BY updated_at DESC");
+    execQuery(q, "SELECT id, folder_id, title, body, filepath, created_at, updated_at FROM notes ORDER BY updated_at DESC");
     
     while (q.next()) {
         NoteData note;
         note.id = q.value(0).toInt();
         note.folderId = q.value(1).toInt();
         note.title = q.value(2).toString();
-        note.body = q.value(3).toString();
         note.filepath = q.value(4).toString();
+        note.body = noteBody(q.value(3), note.filepath);
         note.createdAt = q.value(5).toDateTime();
         note.updatedAt = q.value(6).toDateTime();
         notes.append(note);
@@ -393,25 +789,117 @@ QList<NoteData> DatabaseManager::getAllNotesWithPaths() {
 QList<QPair<QString, QList<QPair<QString, QString>>>> DatabaseManager::getFolderStructure() {
     QList<QPair<QString, QList<QPair<QString, QString>>>> folderStructure;
     
-    // Get all folders
-    QList<FolderData> folders = getAllFolders();
+    // One pass over folders and their notes instead of a query per folder
+    QSqlQuery q(m_db);
+    if (!execQuery(q, "SELECT f.id, f.name, n.title, " + listedBody(m_storageMode, "n.") + " FROM folders f "
+                "LEFT JOIN notes n ON n.folder_id = f.id "
+                "ORDER BY f.id, n.updated_at DESC")) {
+        qWarning() << "Failed to load folder structure:" << q.lastError();
+        return folderStructure;
+    }
     
-    for (const FolderData &folder : folders) {
-        QString folderName = folder.name;
-        QList<QPair<QString, QString>> notesInFolder;
-        
-        // Get notes in this folder
-        QList<NoteData> notes = getNotesInFolder(folder.id);
-        for (const NoteData &note : notes) {
-            notesInFolder.append(qMakePair(note.title, note.body));
+    int currentFolderId = -1;
+    while (q.next()) {
+        int folderId = q.value(0).toInt();
+        if (folderId != currentFolderId) {
+            folderStructure.append(qMakePair(q.value(1).toString(), QList<QPair<QString, QString>>()));
+            currentFolderId = folderId;
+        }
+        if (!q.value(2).isNull()) {
+            folderStructure.last().second.append(qMakePair(q.value(2).toString(), q.value(3).toString()));
         }
-        
-        folderStructure.append(qMakePair(folderName, notesInFolder));
     }
     
     return folderStructure;
 }
 
+QList<NoteData> DatabaseManager::searchNotes(const QString &text, int limit) {
+    METRIC_COUNTER("db.searches").add();
+    QList<NoteData> notes;
+    
+    // LIKE is case-insensitive for ASCII. Plain bodies are matched directly;
+    // for compressed bodies, and for every note in Files mode, each word of the
+    // text must be in the note's search terms instead
+    const bool filesMode = m_storageMode == StorageMode::Files;
+    QString pattern = likePattern(text);
+    QString where = "title LIKE ? ESCAPE '\\'";
+    QVariantList values = {pattern};
+    if (!filesMode) {
+        where += " OR (typeof(body) = 'text' AND body LIKE ? ESCAPE '\\')";
+        values << pattern;
+    }
+    
+    QStringList words;
+    for (const QString &word : searchWords(text)) {
+        words << "search_terms LIKE ? ESCAPE '\\'";
+        values << likePattern(word);
+    }
+    if (!words.isEmpty()) {
+        where += QString(" OR (%1%2)").arg(filesMode ? QString() : QString("typeof(body) = 'blob' AND "), words.join(" AND "));
+    }
+    
+    QSqlQuery q(m_db);
+    q.prepare("SELECT id, folder_id, title, filepath, created_at, updated_at, " + listedBody(m_storageMode) + " "
+              "FROM notes WHERE " + where + " ORDER BY updated_at DESC LIMIT ?");
+    for (const QVariant &value : values) {
+        q.addBindValue(value);
+    }
+    q.addBindValue(limit);
+    
+    if (!execQuery(q)) {
+        qWarning() << "Failed to search notes:" << q.lastError();
+        return notes;
+    }
+    while (q.next()) {
+        NoteData note;
+        note.id = q.value(0).toInt();
+        note.folderId = q.value(1).toInt();
+        note.title = q.value(2).toString();
+        note.filepath = q.value(3).toString();
+        note.createdAt = q.value(4).toDateTime();
+        note.updatedAt = q.value(5).toDateTime();
+        note.body = q.value(6).toString();
+        note.partialBody = q.value(7).toBool();
+        notes.append(note);
+    }
+    
+    return notes;
+}
+
+QList<NoteChange> DatabaseManager::getNotesChangedSinceSync(int afterNoteId, int limit) {
+    QList<NoteChange> changes;
+    
+    // Walks notes by primary key and never reads bodies; sync_state holds the
+    // updated_at, title and folder of the version Drive has
+    QSqlQuery q(m_db);
+    q.prepare("SELECT n.id, n.folder_id, f.name, n.title, n.updated_at FROM notes n "
+              "JOIN folders f ON f.id = n.folder_id "
+              "LEFT JOIN sync_state s ON s.note_id = n.id "
+              "WHERE n.id > ? AND (s.note_id IS NULL OR s.note_updated_at IS NULL "
+              "OR julianday(n.updated_at) > julianday(s.note_updated_at) "
+              "OR s.title IS NOT n.title OR s.folder_id IS NOT n.folder_id) "
+              "ORDER BY n.id LIMIT ?");
+    q.addBindValue(afterNoteId);
+    q.addBindValue(limit);
+    
+    if (!execQuery(q)) {
+        qWarning() << "Failed to query notes changed since last sync:" << q.lastError();
+        return changes;
+    }
+    
+    while (q.next()) {
+        NoteChange change;
+        change.id = q.value(0).toInt();
+        change.folderId = q.value(1).toInt();
+        change.folderName = q.value(2).toString();
+        change.title = q.value(3).toString();
+        change.updatedAt = q.value(4).toDateTime();
+        changes.append(change);
+    }
+    
+    return changes;
+}
+
 // Folder operations
 int DatabaseManager::createFolder(const QString &name, int parentId) {
     QSqlQuery q(m_db);
@@ -419,7 +907,7 @@ int DatabaseManager::createFolder(const QString &name, int parentId) {
     q.addBindValue(name);
     q.addBindValue(parentId > 0 ? parentId : QVariant());
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to create the folder. Please try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Create Folder", errorMsg);
         qWarning() << "Failed to create folder:" << q.lastError();
@@ -437,7 +925,7 @@ bool DatabaseManager::updateFolder(int folderId, const QString &name) {
     q.addBindValue(name);
     q.addBindValue(folderId);
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to rename the folder. Please try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Update Folder", errorMsg);
         qWarning() << "Failed to update folder:" << q.lastError();
@@ -449,14 +937,21 @@ bool DatabaseManager::updateFolder(int folderId, const QString &name) {
 }
 
 bool DatabaseManager::deleteFolder(int folderId) {
-    // Get all notes in this folder before deletion to remove markdown files
-    QList<NoteData> notes = getNotesInFolder(folderId);
-    
+    // Get the markdown files of the notes in this folder before deletion
     QSqlQuery q(m_db);
+    QMap<int, QString> filepaths;
+    q.prepare("SELECT id, filepath FROM notes WHERE folder_id = ?");
+    q.addBindValue(folderId);
+    if (execQuery(q)) {
+        while (q.next()) {
+            filepaths.insert(q.value(0).toInt(), q.value(1).toString());
+        }
+    }
+    
     q.prepare("DELETE FROM folders WHERE id = ?");
     q.addBindValue(folderId);
     
-    if (!q.exec()) {
+    if (!execQuery(q)) {
         QString errorMsg = QString("Unable to delete the folder. Please try again.\n\nError details: %1").arg(q.lastError().text());
         emit operationFailed("Delete Folder", errorMsg);
         qWarning() << "Failed to delete folder:" << q.lastError();
@@ -464,9 +959,10 @@ bool DatabaseManager::deleteFolder(int folderId) {
     }
     
     // Remove all markdown files for notes in this folder
-    for (const NoteData &note : notes) {
-        if (!note.filepath.isEmpty()) {
-            QString filePath = m_notesDirectory + QDir::separator() + note.filepath;
+    for (auto it = filepaths.constBegin(); it != filepaths.constEnd(); ++it) {
+        m_modifiedNotes.remove(it.key());
+        if (!it.value().isEmpty()) {
+            QString filePath = m_notesDirectory + QDir::separator() + it.value();
             QFile file(filePath);
             if (file.exists()) {
                 if (!file.remove()) {
@@ -488,7 +984,7 @@ FolderData DatabaseManager::getFolder(int folderId) {
     FolderData folder;
     folder.id = -1;
     
-    if (q.exec() && q.next()) {
+    if (execQuery(q) && q.next()) {
         folder.id = q.value(0).toInt();
         folder.name = q.value(1).toString();
         folder.parentId = q.value(2).toInt();
@@ -500,7 +996,7 @@ FolderData DatabaseManager::getFolder(int folderId) {
 QList<FolderData> DatabaseManager::getAllFolders() {
     QList<FolderData> folders;
     QSqlQuery q(m_db);
-    q.exec("SELECT id, name, parent_id FROM folders ORDER BY name");
+    execQuery(q, "SELECT id, name, parent_id FROM folders ORDER BY name");
     
     while (q.next()) {
         FolderData folder;
@@ -532,10 +1028,64 @@ void DatabaseManager::setAutoSaveInterval(int milliseconds) {
     saveSettings();
 }
 
-void DatabaseManager::setNotesDirectory(const QString &path) {
+bool DatabaseManager::setNotesDirectory(const QString &path) {
+    if (QDir::cleanPath(path) == QDir::cleanPath(m_notesDirectory)) {
+        return true;
+    }
+    
+    // Files mode keeps the only copy of each body in its file
+    if (m_storageMode == StorageMode::Files && isOpen() && !moveNoteFiles(path)) {
+        return false;
+    }
+    
     m_notesDirectory = path;
     ensureNotesDirectoryExists();
     saveSettings();
+    return true;
+}
+
+bool DatabaseManager::moveNoteFiles(const QString &path) {
+    QStringList filenames;
+    QSqlQuery q(m_db);
+    if (!execQuery(q, "SELECT filepath FROM notes WHERE filepath IS NOT NULL AND filepath != ''")) {
+        emit operationFailed("Change Notes Directory", q.lastError().text());
+        return false;
+    }
+    while (q.next()) {
+        filenames.append(q.value(0).toString());
+    }
+    
+    QDir from(m_notesDirectory);
+    QDir to(path);
+    if (!to.mkpath(".")) {
+        emit operationFailed("Change Notes Directory", QString("Unable to create %1; the notes directory was not changed.").arg(path));
+        return false;
+    }
+    // The rows keep their file names, so a name taken in the new directory stops the move
+    for (const QString &filename : filenames) {
+        if (from.exists(filename) && to.exists(filename)) {
+            emit operationFailed("Change Notes Directory", QString("\"%1\" already exists in %2; the notes directory was not changed.").arg(filename, path));
+            return false;
+        }
+    }
+    
+    QStringList moved;
+    for (const QString &filename : filenames) {
+        if (!from.exists(filename)) {
+            // A restored note whose file is not written yet
+            continue;
+        }
+        if (!QFile::rename(from.filePath(filename), to.filePath(filename))) {
+            for (const QString &done : moved) {
+                QFile::rename(to.filePath(done), from.filePath(done));
+            }
+            emit operationFailed("Change Notes Directory", QString("Unable to move \"%1\" to %2; the notes directory was not changed.").arg(filename, path));
+            return false;
+        }
+        moved.append(filename);
+        emit operationProgress("Change Notes Directory", moved.size(), filenames.size());
+    }
+    return true;
 }
 
 QString DatabaseManager::getNotesDirectory() const {
@@ -548,53 +1098,311 @@ void DatabaseManager::performAutoSave() {
     }
     
     // Save all modified notes to markdown files
-    for (int noteId : m_modifiedNotes) {
+    bool exported = exportMarkdownMirror();
+    emit autoSaveTriggered();
+    
+    // Retry the ones that failed with the next auto-save
+    if (!exported) {
+        m_autoSaveTimer->start(m_autoSaveInterval);
+    }
+}
+
+bool DatabaseManager::exportMarkdownMirror() {
+    if (m_storageMode == StorageMode::Files) {
+        // The files are the notes and already current
+        m_modifiedNotes.clear();
+        return true;
+    }
+    
+    bool allExported = true;
+    const QSet<int> pending = m_modifiedNotes;
+    for (int noteId : pending) {
         NoteData note = getNote(noteId);
-        if (note.id != -1) {
-            saveNoteToMarkdownFile(noteId, note.title, note.body);
+        // A note deleted since it was queued has nothing to export
+        if (note.id == -1 || saveNoteToMarkdownFile(noteId, note.title, note.body)) {
+            m_modifiedNotes.remove(noteId);
+        } else {
+            allExported = false;
         }
-        emit autoSaveTriggered();
     }
     
-    m_modifiedNotes.clear();
-    
-    // Restart timer for next auto-save
-    if (m_autoSaveEnabled) {
-        m_autoSaveTimer->start(m_autoSaveInterval);
-    }
+    return allExported;
 }
 
 bool DatabaseManager::syncAllNotesWithFiles() {
-    QList<NoteData> notes = getAllNotesWithPaths();
+    // IDs and titles only; syncNoteWithFile reads a body when it has to
+    QList<QPair<int, QString>> notes;
+    QSqlQuery q(m_db);
+    execQuery(q, "SELECT id, title FROM notes ORDER BY id");
+    while (q.next()) {
+        notes.append(qMakePair(q.value(0).toInt(), q.value(1).toString()));
+    }
+    
     bool allSynced = true;
+    int done = 0;
     
-    for (const NoteData &note : notes) {
-        if (!syncNoteWithFile(note.id)) {
+    for (const auto &note : notes) {
+        if (!syncNoteWithFile(note.first)) {
             allSynced = false;
-            qWarning() << "Failed to sync note:" << note.id << note.title;
+            qWarning() << "Failed to sync note:" << note.first << note.second;
         }
+        emit operationProgress("Sync Files", ++done, notes.size());
     }
     
     return allSynced;
 }
 
 bool DatabaseManager::recreateAllMarkdownFiles() {
+    // In Files mode there is nothing but the files to recreate them from
+    if (m_storageMode == StorageMode::Files) {
+        return true;
+    }
+    
     QList<NoteData> notes = getAllNotesWithPaths();
     bool allRecreated = true;
+    int done = 0;
     
     for (const NoteData &note : notes) {
-        if (!saveNoteToMarkdownFile(note.id, note.title, note.body)) {
+        if (saveNoteToMarkdownFile(note.id, note.title, note.body)) {
+            m_modifiedNotes.remove(note.id);
+        } else {
             allRecreated = false;
             qWarning() << "Failed to recreate markdown file for note:" << note.id << note.title;
         }
+        emit operationProgress("Recreate Files", ++done, notes.size());
     }
     
     return allRecreated;
 }
 
+QStringList DatabaseManager::checkIntegrity() {
+    QStringList problems;
+    QSqlQuery q(m_db);
+    
+    if (!execQuery(q, "PRAGMA integrity_check")) {
+        problems.append(QString("integrity_check failed: %1").arg(q.lastError().text()));
+    }
+    while (q.next()) {
+        QString result = q.value(0).toString();
+        if (result != "ok") {
+            problems.append(QString("integrity_check: %1").arg(result));
+        }
+    }
+    
+    if (!execQuery(q, "PRAGMA foreign_key_check")) {
+        problems.append(QString("foreign_key_check failed: %1").arg(q.lastError().text()));
+    }
+    while (q.next()) {
+        problems.append(QString("Row %1 in %2 points to a missing row in %3")
+                            .arg(q.value(1).toString(), q.value(0).toString(), q.value(2).toString()));
+    }
+    
+    // Every note should have its markdown file; in Database mode once the
+    // pending mirror is written
+    exportMarkdownMirror();
+    int checked = 0;
+    int total = -1;
+    if (execQuery(q, "SELECT COUNT(*) FROM notes") && q.next()) {
+        total = q.value(0).toInt();
+    }
+    if (!execQuery(q, "SELECT id, title, filepath FROM notes ORDER BY id")) {
+        problems.append(QString("Failed to list notes: %1").arg(q.lastError().text()));
+    }
+    while (q.next()) {
+        int noteId = q.value(0).toInt();
+        QString filepath = q.value(2).toString();
+        if (filepath.isEmpty()) {
+            problems.append(QString("Note %1 (%2) has no markdown file").arg(noteId).arg(q.value(1).toString()));
+        } else if (!QFileInfo::exists(m_notesDirectory + QDir::separator() + filepath)) {
+            problems.append(QString("Note %1 (%2): %3 is missing").arg(noteId).arg(q.value(1).toString(), filepath));
+        }
+        emit operationProgress("Check Integrity", ++checked, total);
+    }
+    
+    return problems;
+}
+
+bool DatabaseManager::vacuum() {
+    // Bodies saved before compression, or under a higher threshold, are
+    // compressed first so VACUUM gives their pages back
+    compressStoredBodies();
+    
+    QSqlQuery q(m_db);
+    if (!execQuery(q, "VACUUM")) {
+        emit operationFailed("Vacuum", q.lastError().text());
+        qWarning() << "Failed to vacuum database:" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+int DatabaseManager::compressStoredBodies() {
+    if (m_storageMode == StorageMode::Files || m_compressionThresholdBytes < 0) return 0;
+    
+    // length() counts characters, and a character is at most four UTF-8 bytes
+    QList<int> candidates;
+    QSqlQuery q(m_db);
+    q.prepare("SELECT id FROM notes WHERE typeof(body) = 'text' AND length(body) >= ?");
+    q.addBindValue(m_compressionThresholdBytes / 4);
+    if (!execQuery(q)) {
+        qWarning() << "Failed to find bodies to compress:" << q.lastError();
+        return 0;
+    }
+    while (q.next()) {
+        candidates.append(q.value(0).toInt());
+    }
+    
+    int compressed = 0;
+    int done = 0;
+    m_db.transaction();
+    for (int noteId : candidates) {
+        QSqlQuery read(m_db);
+        read.prepare("SELECT body FROM notes WHERE id = ?");
+        read.addBindValue(noteId);
+        if (execQuery(read) && read.next()) {
+            QString body = read.value(0).toString();
+            QByteArray blob = compressBody(body, m_compressionThresholdBytes);
+            if (!blob.isEmpty()) {
+                // updated_at is left alone; the note itself did not change
+                q.prepare("UPDATE notes SET body = ?, search_terms = ?, body_preview = ? WHERE id = ?");
+                q.addBindValue(blob);
+                q.addBindValue(searchTerms(body));
+                q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+                q.addBindValue(noteId);
+                if (execQuery(q)) {
+                    compressed++;
+                } else {
+                    qWarning() << "Failed to compress body of note" << noteId << q.lastError();
+                }
+            }
+        }
+        emit operationProgress("Compress Notes", ++done, candidates.size());
+    }
+    m_db.commit();
+    
+    return compressed;
+}
+
+// Body compression
+void DatabaseManager::setCompressionThreshold(int bytes) {
+    m_compressionThresholdBytes = bytes;
+}
+
+int DatabaseManager::compressionThreshold() const {
+    return m_compressionThresholdBytes;
+}
+
+// Slow-query log
+void DatabaseManager::setSlowQueryThreshold(int milliseconds) {
+    m_slowQueryThresholdMs = milliseconds;
+}
+
+int DatabaseManager::slowQueryThreshold() const {
+    return m_slowQueryThresholdMs;
+}
+
+QList<SlowQuery> DatabaseManager::slowQueries() const {
+    return m_slowQueries;
+}
+
+bool DatabaseManager::execQuery(QSqlQuery &q, const QString &sql) const {
+    // For a SELECT this covers the first step, which is where SQLite sorts
+    // and scans when no index serves the query
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = sql.isEmpty() ? q.exec() : q.exec(sql);
+    qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+    
+    METRIC_HISTOGRAM("db.query_us").record(elapsedUs);
+    if (m_slowQueryThresholdMs >= 0 && elapsedUs >= qint64(m_slowQueryThresholdMs) * 1000) {
+        recordSlowQuery(q, elapsedUs / 1000);
+    }
+    return ok;
+}
+
+static QString parameterShape(const QSqlQuery &q) {
+    QStringList shape;
+    const int count = q.boundValues().size();
+    for (int i = 0; i < count; ++i) {
+        QVariant value = q.boundValue(i);
+        if (value.isNull()) {
+            shape << "null";
+        } else if (value.userType() == QMetaType::QString) {
+            shape << QString("text(%1)").arg(value.toString().size());
+        } else if (value.userType() == QMetaType::QByteArray) {
+            shape << QString("blob(%1)").arg(value.toByteArray().size());
+        } else {
+            shape << QString::fromLatin1(value.typeName());
+        }
+    }
+    return shape.join(", ");
+}
+
+void DatabaseManager::recordSlowQuery(const QSqlQuery &q, qint64 elapsedMs) const {
+    SlowQuery record;
+    record.at = QDateTime::currentDateTime();
+    record.elapsedMs = elapsedMs;
+    record.sql = q.lastQuery().simplified();
+    record.parameters = parameterShape(q);
+    record.plan = explainQueryPlan(q);
+    
+    METRIC_COUNTER("db.slow_queries").add();
+    qWarning().noquote() << QString("Slow query, %1 ms: %2 [%3]").arg(elapsedMs).arg(record.sql, record.parameters)
+                         << (record.plan.isEmpty() ? QString() : "\n" + record.plan);
+    
+    m_slowQueries.append(record);
+    while (m_slowQueries.size() > MAX_SLOW_QUERIES) {
+        m_slowQueries.removeFirst();
+    }
+}
+
+QString DatabaseManager::explainQueryPlan(const QSqlQuery &q) const {
+    // Only statements that read or write rows have a plan worth reading
+    const QString sql = q.lastQuery().trimmed();
+    static const QRegularExpression planned("^(SELECT|INSERT|UPDATE|DELETE|REPLACE|WITH)\\b",
+                                            QRegularExpression::CaseInsensitiveOption);
+    if (!planned.match(sql).hasMatch()) {
+        return QString();
+    }
+    
+    auto cached = m_queryPlans.constFind(sql);
+    if (cached != m_queryPlans.constEnd()) {
+        return cached.value();
+    }
+    
+    // Run directly rather than through execQuery, so this is never timed itself
+    QSqlQuery explain(m_db);
+    if (!explain.prepare("EXPLAIN QUERY PLAN " + sql)) {
+        return QString();
+    }
+    const int count = q.boundValues().size();
+    for (int i = 0; i < count; ++i) {
+        explain.addBindValue(q.boundValue(i));
+    }
+    if (!explain.exec()) {
+        return QString();
+    }
+    
+    // Rows are (id, parent, unused, detail); indent each step under its parent
+    QStringList steps;
+    QHash<int, int> depths;
+    while (explain.next()) {
+        int id = explain.value(0).toInt();
+        int parent = explain.value(1).toInt();
+        int depth = parent == 0 ? 0 : depths.value(parent) + 1;
+        depths.insert(id, depth);
+        steps << QString(depth * 2, ' ') + explain.value(3).toString();
+    }
+    
+    QString plan = steps.join('\n');
+    m_queryPlans.insert(sql, plan);
+    return plan;
+}
+
 void DatabaseManager::markNoteAsModified(int noteId) {
+    // Without auto-save the mirror is written on close() or exportMarkdownMirror()
+    m_modifiedNotes.insert(noteId);
     if (m_autoSaveEnabled) {
-        m_modifiedNotes.insert(noteId);
         m_autoSaveTimer->start(m_autoSaveInterval);
     }
 }
@@ -639,15 +1447,18 @@ void DatabaseManager::scanAndImportMarkdownFiles() {
     filters << "*.md";
     
     QFileInfoList files = dir.entryInfoList(filters, QDir::Files | QDir::Readable);
+    int scanned = 0;
     
     for (const QFileInfo &fileInfo : files) {
+        emit operationProgress("Import Files", ++scanned, files.size());
+        
         // Check if this file is already imported
         QString filename = fileInfo.fileName();
         QSqlQuery q(m_db);
         q.prepare("SELECT id FROM notes WHERE filepath = ?");
         q.addBindValue(filename);
         
-        if (q.exec() && q.next()) {
+        if (execQuery(q) && q.next()) {
             // File already imported, skip
             continue;
         }
@@ -659,7 +1470,8 @@ void DatabaseManager::scanAndImportMarkdownFiles() {
             QString content = in.readAll();
             file.close();
             
-            // Parse markdown content
+            // Parse markdown content; in Files mode the body stays as the file has it
+            const QString fileBody = markdownBody(content);
             QString title = fileInfo.baseName();
             QString body = content;
             
@@ -677,23 +1489,50 @@ void DatabaseManager::scanAndImportMarkdownFiles() {
             
             // Create note in "Imported" folder (create only if doesn't exist)
             int folderId = getOrCreateImportedFolder();
-            if (folderId > 0) {
+            if (folderId <= 0) {
+                continue;
+            }
+            
+            if (m_storageMode == StorageMode::Database) {
                 createNote(folderId, title, body);
+                continue;
+            }
+            
+            // In Files mode the file becomes the note as it is, rather than being
+            // copied to a new one
+            QSqlQuery insert(m_db);
+            insert.prepare("INSERT INTO notes (folder_id, title, body, filepath, content_hash, search_terms, body_preview, created_at, updated_at) "
+                           "VALUES (?, ?, '', ?, ?, ?, ?, ?, ?)");
+            insert.addBindValue(folderId);
+            insert.addBindValue(title);
+            insert.addBindValue(filename);
+            insert.addBindValue(contentHash(fileBody));
+            insert.addBindValue(searchTerms(fileBody));
+            insert.addBindValue(fileBody.left(BODY_PREVIEW_CHARS));
+            insert.addBindValue(fileInfo.birthTime().isValid() ? fileInfo.birthTime() : fileInfo.lastModified());
+            insert.addBindValue(fileInfo.lastModified());
+            if (execQuery(insert)) {
+                emit noteSaved(insert.lastInsertId().toInt());
+            } else {
+                qWarning() << "Failed to import markdown file:" << filename << insert.lastError();
             }
         }
     }
 }
 
-void DatabaseManager::exportNoteToFile(int noteId, const QString &filePath) {
+bool DatabaseManager::exportNoteToFile(int noteId, const QString &filePath) {
     NoteData note = getNote(noteId);
-    if (note.id == -1) return;
+    if (note.id == -1) return false;
     
     QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << note.body;
-        file.close();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open export file:" << filePath << file.errorString();
+        return false;
     }
+    QTextStream out(&file);
+    out << note.body;
+    out.flush();
+    return out.status() == QTextStream::Ok && file.error() == QFileDevice::NoError;
 }
 
 void DatabaseManager::importNoteFromFile(const QString &filePath, int folderId) {
@@ -717,6 +1556,10 @@ void DatabaseManager::saveSettings() {
     settings.setValue("auto_save_enabled", m_autoSaveEnabled);
     settings.setValue("auto_save_interval", m_autoSaveInterval);
     settings.setValue("auto_import_enabled", m_autoImportEnabled);
+    settings.setValue("tracing_enabled", m_tracingEnabled);
+    settings.setValue("slow_query_threshold_ms", m_slowQueryThresholdMs);
+    settings.setValue("storage_mode", storageModeName(m_storageMode));
+    settings.setValue("compression_threshold_bytes", m_compressionThresholdBytes);
 }
 
 void DatabaseManager::loadSettings() {
@@ -725,6 +1568,15 @@ void DatabaseManager::loadSettings() {
     m_autoSaveEnabled = settings.value("auto_save_enabled", m_autoSaveEnabled).toBool();
     m_autoSaveInterval = settings.value("auto_save_interval", m_autoSaveInterval).toInt();
     m_autoImportEnabled = settings.value("auto_import_enabled", m_autoImportEnabled).toBool();
+    m_tracingEnabled = settings.value("tracing_enabled", m_tracingEnabled).toBool();
+    m_slowQueryThresholdMs = settings.value("slow_query_threshold_ms", m_slowQueryThresholdMs).toInt();
+    m_compressionThresholdBytes = settings.value("compression_threshold_bytes", m_compressionThresholdBytes).toInt();
+    m_storageMode = settings.value("storage_mode", storageModeName(m_storageMode)).toString() == storageModeName(StorageMode::Files)
+        ? StorageMode::Files : StorageMode::Database;
+    
+    if (m_tracingEnabled) {
+        Tracer::instance().start();
+    }
     
     if (m_autoSaveEnabled) {
         m_autoSaveTimer->start(m_autoSaveInterval);
@@ -760,6 +1612,8 @@ void DatabaseManager::populateFolderModel(QStandardItemModel *model) {
 }
 
 void DatabaseManager::populateNotesModel(QStandardItemModel *model, int folderId) {
+    TRACE_SCOPE("db", "DatabaseManager::populateNotesModel");
+    MetricTimer timer(METRIC_HISTOGRAM("db.populate_notes_model_us"));
     if (!model) return;
     
     model->clear();
@@ -772,6 +1626,7 @@ void DatabaseManager::populateNotesModel(QStandardItemModel *model, int folderId
         item->setData(note.id, Qt::UserRole);
         item->setData(note.body, Qt::UserRole + 1); // Note content
         item->setData(note.updatedAt, Qt::UserRole + 2); // Date
+        item->setData(note.partialBody, Qt::UserRole + 5); // Content is a preview
 
         
         // Create snippet from body
@@ -804,6 +1659,11 @@ void DatabaseManager::saveNoteFromModel(const QModelIndex &index, QStandardItemM
     QString title = item->text();
     QString body = item->data(Qt::UserRole + 1).toString();
     
+    // The model only has the preview of a compressed or file-stored body
+    if (noteId > 0 && item->data(Qt::UserRole + 5).toBool()) {
+        body = getNote(noteId).body;
+    }
+    
     if (noteId > 0) {
         updateNote(noteId, title, body);
     }
@@ -837,35 +1697,59 @@ QString DatabaseManager::generateMarkdownFilename(const QString &title) const {
 }
 
 bool DatabaseManager::saveNoteToMarkdownFile(int noteId, const QString &title, const QString &body) {
-    NoteData note = getNote(noteId);
-    if (note.id == -1) return false;
+    TRACE_SCOPE("file", "DatabaseManager::saveNoteToMarkdownFile");
+    // Only the metadata; in Files mode the body would come from the file being replaced
+    QSqlQuery meta(m_db);
+    meta.prepare("SELECT folder_id, filepath, created_at FROM notes WHERE id = ?");
+    meta.addBindValue(noteId);
+    if (!execQuery(meta) || !meta.next()) return false;
+    
+    int folderId = meta.value(0).toInt();
+    QString filename = meta.value(1).toString();
+    QDateTime createdAt = meta.value(2).toDateTime();
     
     // Generate filename if not exists
-    QString filename;
-    if (note.filepath.isEmpty()) {
-        filename = generateMarkdownFilename(title);
-        note.filepath = filename;
+    if (filename.isEmpty()) {
+        filename = uniqueMarkdownFilename(title);
         
         // Update database with filepath
         QSqlQuery q(m_db);
         q.prepare("UPDATE notes SET filepath = ? WHERE id = ?");
         q.addBindValue(filename);
         q.addBindValue(noteId);
-        if (!q.exec()) {
+        if (!execQuery(q)) {
             qWarning() << "Failed to update note filepath:" << q.lastError();
             return false;
         }
-    } else {
-        filename = note.filepath;
     }
     
+    return writeMarkdownFile(filename, title, body, createdAt, folderId);
+}
+
+QString DatabaseManager::uniqueMarkdownFilename(const QString &title) const {
+    QString filename = generateMarkdownFilename(title);
+    
+    // Bulk creation can produce the same name twice within one second
+    QString baseName = filename.left(filename.length() - 3);
+    for (int n = 2; QFile::exists(m_notesDirectory + QDir::separator() + filename); ++n) {
+        filename = QString("%1_%2.md").arg(baseName).arg(n);
+    }
+    return filename;
+}
+
+bool DatabaseManager::writeMarkdownFile(const QString &filename, const QString &title, const QString &body,
+                                        const QDateTime &createdAt, int folderId) {
+    TRACE_SCOPE("file", "DatabaseManager::writeMarkdownFile");
+    MetricTimer timer(METRIC_HISTOGRAM("file.markdown_write_us"));
+    
     // Create full file path
     QString filePath = m_notesDirectory + QDir::separator() + filename;
     
-    // Write markdown file
-    QFile file(filePath);
+    // Write markdown file; replaced in one step, as in Files mode it is the only copy
+    QSaveFile file(filePath);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
         qWarning() << "Failed to open file for writing:" << filePath;
+        METRIC_COUNTER("file.write_errors").add();
         return false;
     }
     
@@ -875,68 +1759,114 @@ bool DatabaseManager::saveNoteToMarkdownFile(int noteId, const QString &title, c
     // Write frontmatter
     out << "---\n";
     out << "title: \"" << title << "\"\n";
-    out << "created: " << note.createdAt.toString(Qt::ISODate) << "\n";
+    out << "created: " << createdAt.toString(Qt::ISODate) << "\n";
     out << "modified: " << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n";
-    out << "folder_id: " << note.folderId << "\n";
+    out << "folder_id: " << folderId << "\n";
     out << "---\n\n";
     
     // Write note body
     out << body;
+    out.flush();
     
-    file.close();
+    qint64 size = file.size();
+    if (!file.commit()) {
+        qWarning() << "Failed to write file:" << filePath;
+        METRIC_COUNTER("file.write_errors").add();
+        return false;
+    }
+    
+    METRIC_COUNTER("file.markdown_writes").add();
+    METRIC_COUNTER("file.bytes_written").add(quint64(size));
     return true;
 }
 
 bool DatabaseManager::loadNoteFromMarkdownFile(int noteId) {
-    NoteData note = getNote(noteId);
-    if (note.id == -1 || note.filepath.isEmpty()) return false;
-    
-    QString filePath = m_notesDirectory + QDir::separator() + note.filepath;
-    QFile file(filePath);
+    QSqlQuery q(m_db);
+    q.prepare("SELECT title, filepath FROM notes WHERE id = ?");
+    q.addBindValue(noteId);
+    if (!execQuery(q) || !q.next() || q.value(1).toString().isEmpty()) return false;
     
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qWarning() << "Failed to open markdown file:" << filePath;
+    QString body;
+    if (!readMarkdownBody(q.value(1).toString(), body)) {
+        qWarning() << "Failed to open markdown file:" << getNoteFilePath(noteId);
         return false;
     }
     
+    // In Files mode the file already is the note; only its index can be behind
+    if (m_storageMode == StorageMode::Files) {
+        return indexNoteBody(noteId, body, QDateTime::currentDateTime());
+    }
+    
+    // Update note body in database
+    return updateNote(noteId, q.value(0).toString(), body.trimmed());
+}
+
+bool DatabaseManager::readMarkdownBody(const QString &filepath, QString &body) const {
+    if (filepath.isEmpty()) return false;
+    
+    QFile file(m_notesDirectory + QDir::separator() + filepath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+    
     QTextStream in(&file);
     in.setCodec("UTF-8");
-    QString content = in.readAll();
-    file.close();
-    
-    // Parse frontmatter and content
-    QStringList lines = content.split('\n');
-    QString body;
-    bool inFrontmatter = false;
-    bool frontmatterEnded = false;
+    body = markdownBody(in.readAll());
+    return true;
+}
+
+QString DatabaseManager::noteBody(const QVariant &storedBody, const QString &filepath) const {
+    // In Files mode a body still in the row is a restore whose file is not written yet
+    QString body = decodeBody(storedBody);
+    if (m_storageMode == StorageMode::Database || !body.isEmpty()) {
+        return body;
+    }
     
-    for (const QString &line : lines) {
-        if (line.trimmed() == "---") {
-            if (!inFrontmatter) {
-                inFrontmatter = true;
-            } else {
-                frontmatterEnded = true;
-                continue;
-            }
-        } else if (inFrontmatter && !frontmatterEnded) {
-            // Parse frontmatter (could be extended for more metadata)
-            continue;
-        } else if (frontmatterEnded) {
-            body += line + "\n";
-        }
+    if (!readMarkdownBody(filepath, body)) {
+        qWarning() << "Failed to read markdown file:" << m_notesDirectory + QDir::separator() + filepath;
+    }
+    return body;
+}
+
+void DatabaseManager::bindBody(QSqlQuery &q, const QString &body) {
+    QByteArray compressed = compressBody(body, m_compressionThresholdBytes);
+    if (compressed.isEmpty()) {
+        q.addBindValue(body);
+        q.addBindValue(QVariant());
+        q.addBindValue(QVariant());
+    } else {
+        q.addBindValue(compressed);
+        q.addBindValue(searchTerms(body));
+        q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+    }
+}
+
+bool DatabaseManager::indexNoteBody(int noteId, const QString &body, const QDateTime &updatedAt) {
+    QSqlQuery q(m_db);
+    if (updatedAt.isValid()) {
+        q.prepare("UPDATE notes SET content_hash = ?, search_terms = ?, body_preview = ?, updated_at = ? WHERE id = ?");
+    } else {
+        q.prepare("UPDATE notes SET content_hash = ?, search_terms = ?, body_preview = ? WHERE id = ?");
+    }
+    q.addBindValue(contentHash(body));
+    q.addBindValue(searchTerms(body));
+    q.addBindValue(body.left(BODY_PREVIEW_CHARS));
+    if (updatedAt.isValid()) {
+        q.addBindValue(updatedAt);
     }
+    q.addBindValue(noteId);
     
-    // Update note body in database
-    return updateNote(noteId, note.title, body.trimmed());
+    if (!execQuery(q)) {
+        qWarning() << "Failed to index note body:" << noteId << q.lastError();
+        return false;
+    }
+    return true;
 }
 
 QString DatabaseManager::getNoteFilePath(int noteId) const {
-    // Query database directly to avoid calling non-const method
     QSqlQuery q(m_db);
     q.prepare("SELECT filepath FROM notes WHERE id = ?");
     q.addBindValue(noteId);
     
-    if (q.exec() && q.next()) {
+    if (execQuery(q) && q.next()) {
         QString filepath = q.value(0).toString();
         if (!filepath.isEmpty()) {
             return m_notesDirectory + QDir::separator() + filepath;
@@ -947,6 +1877,12 @@ QString DatabaseManager::getNoteFilePath(int noteId) const {
 }
 
 bool DatabaseManager::ensureNoteFileExists(int noteId) {
+    // In Files mode a missing file cannot be recreated; its body went with it
+    if (m_storageMode == StorageMode::Files) {
+        QString filePath = getNoteFilePath(noteId);
+        return !filePath.isEmpty() && QFileInfo::exists(filePath);
+    }
+    
     NoteData note = getNote(noteId);
     if (note.id == -1) return false;
     
@@ -1005,24 +1941,38 @@ QStringList DatabaseManager::getMarkdownFileList() {
 }
 
 bool DatabaseManager::syncNoteWithFile(int noteId) {
-    NoteData note = getNote(noteId);
-    if (note.id == -1) return false;
+    QSqlQuery q(m_db);
+    q.prepare("SELECT filepath, content_hash FROM notes WHERE id = ?");
+    q.addBindValue(noteId);
+    if (!execQuery(q) || !q.next()) return false;
     
-    // Check if markdown file exists and is newer than database
-    QString filePath = m_notesDirectory + QDir::separator() + note.filepath;
-    QFile file(filePath);
+    QString filepath = q.value(0).toString();
     
-    if (!file.exists()) {
-        // File doesn't exist, recreate it
-        return saveNoteToMarkdownFile(noteId, note.title, note.body);
+    if (m_storageMode == StorageMode::Files) {
+        // The file is the note; re-index it when it was edited outside the app
+        QString body;
+        if (!readMarkdownBody(filepath, body)) {
+            qWarning() << "Markdown file of note" << noteId << "is missing:" << filepath;
+            return false;
+        }
+        if (contentHash(body) == q.value(1).toString()) {
+            return true;
+        }
+        QFileInfo fileInfo(m_notesDirectory + QDir::separator() + filepath);
+        return indexNoteBody(noteId, body, fileInfo.lastModified());
     }
     
-    QFileInfo fileInfo(filePath);
-    if (fileInfo.lastModified() > note.updatedAt) {
-        // File is newer, load from file
-        return loadNoteFromMarkdownFile(noteId);
+    // The database wins; the mirror is only written when missing or behind
+    bool missing = filepath.isEmpty() || !QFileInfo::exists(m_notesDirectory + QDir::separator() + filepath);
+    if (!missing && !m_modifiedNotes.contains(noteId)) {
+        return true;
     }
     
+    NoteData note = getNote(noteId);
+    if (!saveNoteToMarkdownFile(noteId, note.title, note.body)) {
+        return false;
+    }
+    m_modifiedNotes.remove(noteId);
     return true;
 }
 
@@ -1032,7 +1982,7 @@ int DatabaseManager::getOrCreateImportedFolder() {
     q.prepare("SELECT id FROM folders WHERE name = ?");
     q.addBindValue("Imported");
     
-    if (q.exec() && q.next()) {
+    if (execQuery(q) && q.next()) {
         // Folder already exists, return its ID
         return q.value(0).toInt();
     }
@@ -1049,6 +1999,121 @@ bool DatabaseManager::isAutoImportEnabled() const {
     return m_autoImportEnabled;
 }
 
+void DatabaseManager::setTracingEnabled(bool enabled) {
+    if (m_tracingEnabled == enabled) return;
+    
+    m_tracingEnabled = enabled;
+    if (enabled) {
+        Tracer::instance().start();
+    } else {
+        Tracer::instance().stop();
+    }
+    saveSettings();
+}
+
+bool DatabaseManager::isTracingEnabled() const {
+    return m_tracingEnabled;
+}
+
+bool DatabaseManager::setStorageMode(StorageMode mode) {
+    if (m_storageMode == mode) return true;
+    
+    if (!isOpen()) {
+        qWarning() << "Cannot change the storage mode while the database is closed";
+        return false;
+    }
+    if (!convertNotesToStorageMode(mode)) {
+        return false;
+    }
+    
+    m_storageMode = mode;
+    saveSettings();
+    return true;
+}
+
+StorageMode DatabaseManager::storageMode() const {
+    return m_storageMode;
+}
+
+bool DatabaseManager::convertNotesToStorageMode(StorageMode mode) {
+    // Write the pending mirror first, so notes saved since the last export get
+    // their file names outside the transaction a failure rolls back
+    if (mode == StorageMode::Files && !exportMarkdownMirror()) {
+        emit operationFailed("Change Storage Mode", "Unable to write the markdown files of all notes; the storage mode was not changed.");
+        return false;
+    }
+    
+    // Only the IDs up front; each body is loaded, converted and written in turn
+    QList<int> noteIds;
+    QSqlQuery q(m_db);
+    if (!execQuery(q, "SELECT id FROM notes ORDER BY id")) {
+        emit operationFailed("Change Storage Mode", q.lastError().text());
+        qWarning() << "Failed to list notes:" << q.lastError();
+        return false;
+    }
+    while (q.next()) {
+        noteIds.append(q.value(0).toInt());
+    }
+    
+    m_db.transaction();
+    int done = 0;
+    for (int noteId : noteIds) {
+        NoteData note;
+        note.id = noteId;
+        q.prepare("SELECT title, body, filepath FROM notes WHERE id = ?");
+        q.addBindValue(noteId);
+        bool converted = execQuery(q) && q.next();
+        if (converted) {
+            note.title = q.value(0).toString();
+            note.body = decodeBody(q.value(1));
+            note.filepath = q.value(2).toString();
+            q.finish();
+        }
+        
+        if (converted && mode == StorageMode::Files) {
+            // The file gets the body, the row keeps its hash, search terms and preview
+            converted = saveNoteToMarkdownFile(note.id, note.title, note.body);
+            if (converted) {
+                q.prepare("UPDATE notes SET body = '', content_hash = ?, search_terms = ?, body_preview = ? WHERE id = ?");
+                q.addBindValue(contentHash(note.body));
+                q.addBindValue(searchTerms(note.body));
+                q.addBindValue(note.body.left(BODY_PREVIEW_CHARS));
+                q.addBindValue(note.id);
+                converted = execQuery(q);
+            }
+        } else if (converted) {
+            // The body comes back from the file into the row, unless it never left it
+            QString body = note.body;
+            converted = !body.isEmpty() || readMarkdownBody(note.filepath, body);
+            if (converted) {
+                q.prepare("UPDATE notes SET body = ?, search_terms = ?, body_preview = ?, content_hash = NULL WHERE id = ?");
+                bindBody(q, body);
+                q.addBindValue(note.id);
+                converted = execQuery(q);
+            }
+        }
+        
+        if (!converted) {
+            m_db.rollback();
+            QString errorMsg = QString("Unable to convert note \"%1\" (%2); the storage mode was not changed.")
+                                   .arg(note.title, note.filepath.isEmpty() ? QString("no markdown file") : note.filepath);
+            emit operationFailed("Change Storage Mode", errorMsg);
+            qWarning() << "Failed to convert note" << note.id << "to storage mode" << storageModeName(mode);
+            return false;
+        }
+        emit operationProgress("Change Storage Mode", ++done, noteIds.size());
+    }
+    
+    if (!m_db.commit()) {
+        m_db.rollback();
+        emit operationFailed("Change Storage Mode", m_db.lastError().text());
+        return false;
+    }
+    
+    m_modifiedNotes.clear();
+    return true;
+}
+
 void DatabaseManager::manualImportMarkdownFiles() {
     // Force import even if auto-import is disabled
     scanAndImportMarkdownFiles();
@@ -7,9 +7,11 @@
 #include <QVariant>
 #include <QTimer>
 #include <QSet>
+#include <QHash>
 
 class QStandardItemModel;
 class QStandardItem;
+class QSqlQuery;
 
 struct NoteData {
     int id;
@@ -19,6 +21,16 @@ struct NoteData {
     QString filepath;  // Path to the .md file
     QDateTime createdAt;
     QDateTime updatedAt;
+    bool partialBody = false;  // Listings: body is only the start of a compressed or file-stored body
+};
+
+// A note that differs from what was last synced, without its body
+struct NoteChange {
+    int id;
+    int folderId;
+    QString folderName;
+    QString title;
+    QDateTime updatedAt;
 };
 
 struct FolderData {
@@ -27,12 +39,31 @@ struct FolderData {
     int parentId;
 };
 
+// Where note bodies are kept; see DatabaseManager::setStorageMode()
+enum class StorageMode {
+    Database,  // notes.body; the .md files are a mirror exported after the fact
+    Files      // the .md files; notes keeps metadata, a content hash, search terms and a preview
+};
+
+// A query that ran at or above the slow-query threshold
+struct SlowQuery {
+    QDateTime at;
+    qint64 elapsedMs;
+    QString sql;
+    QString parameters;  // Types and sizes of the bound values, never the values
+    QString plan;        // EXPLAIN QUERY PLAN, one step per line
+};
+
 class DatabaseManager : public QObject {
     Q_OBJECT
 public:
     static DatabaseManager &instance();
 
+    // Must be called before open(), or after close(); settings.ini then lives next
+    // to the database. Defaults to notes.db in AppData.
+    void setDatabasePath(const QString &path);
     bool open();
+    void close();
     bool initializeSchema();
     bool isOpen() const;
     QSqlDatabase database() const;
@@ -40,16 +71,38 @@ public:
     // Note operations
     int createNote(int folderId, const QString &title, const QString &body);
     bool updateNote(int noteId, const QString &title, const QString &body);
+    bool moveNote(int noteId, int folderId);
     bool deleteNote(int noteId);
     NoteData getNote(int noteId);
+    // Listing; a compressed body, or any body in Files mode, comes back as its
+    // preview, with partialBody set when the preview may be shorter than the note.
+    // getAllNotes and getFolderStructure return previews the same way.
     QList<NoteData> getNotesInFolder(int folderId);
     QList<QPair<QString, QString>> getAllNotes();
     QList<NoteData> getAllNotesWithPaths();
     QList<QPair<QString, QList<QPair<QString, QString>>>> getFolderStructure();
     
-    // Auto-save tracking
+    // Notes whose title or body contains text (case-insensitive), newest first.
+    // Compressed bodies, and every body in Files mode, are matched by their search
+    // terms, so every word of the text must be in them, and come back as previews
+    // like getNotesInFolder.
+    QList<NoteData> searchNotes(const QString &text, int limit = 100);
+    
+    // Notes created, edited, renamed or moved since their last acknowledged sync,
+    // in ID order. Page through by passing the last ID of the previous batch.
+    QList<NoteChange> getNotesChangedSinceSync(int afterNoteId, int limit);
+    
+    // Queues the note's markdown mirror for the next auto-save pass
     void markNoteAsModified(int noteId);
     
+    // Bulk restores. These write rows and nothing else, so a batch of them can
+    // share the caller's transaction and roll back whole; in Files mode the body
+    // waits in the row. Once the transaction has committed, finishRestore()
+    // writes the files, queues the mirror and emits noteSaved and folderSaved.
+    int writeRestoredNote(int noteId, int folderId, const QString &title, const QString &body);
+    int writeRestoredFolder(const QString &name);
+    void finishRestore(const QList<int> &noteIds, const QList<int> &folderIds);
+    
     // Markdown file operations
     QString generateMarkdownFilename(const QString &title) const;
     bool saveNoteToMarkdownFile(int noteId, const QString &title, const QString &body);
@@ -70,13 +123,15 @@ public:
     // Auto-save functionality
     void enableAutoSave(bool enabled = true);
     void setAutoSaveInterval(int milliseconds = 2000);
-    void setNotesDirectory(const QString &path);
+    // In Files mode the note files move to the new directory; if one cannot,
+    // nothing changes and operationFailed is reported
+    bool setNotesDirectory(const QString &path);
     QString getNotesDirectory() const;
     
     // File system integration
     void importReadmeFiles(const QString &directory);
     void scanAndImportMarkdownFiles();
-    void exportNoteToFile(int noteId, const QString &filePath);
+    bool exportNoteToFile(int noteId, const QString &filePath);
     void importNoteFromFile(const QString &filePath, int folderId);
     
     // Auto-import control
@@ -84,14 +139,49 @@ public:
     bool isAutoImportEnabled() const;
     void manualImportMarkdownFiles();
     
+    // Storage mode. Every save writes the body once: in Database mode to
+    // notes.body, with the markdown mirror written by the auto-save pass, on
+    // close() and by exportMarkdownMirror(), and edits made to the files outside
+    // the app are not read back; in Files mode to the .md file, which reads then
+    // go to. Switching converts the existing notes (reporting operationProgress)
+    // and changes nothing if a file cannot be written or read. Persisted.
+    bool setStorageMode(StorageMode mode);
+    StorageMode storageMode() const;
+    // Writes the mirror of notes saved since their last export; Database mode only
+    bool exportMarkdownMirror();
+    
+    // Performance tracing (see utils/Tracer.h); persisted, applied on load
+    void setTracingEnabled(bool enabled);
+    bool isTracingEnabled() const;
+    
     // Settings
     void saveSettings();
     void loadSettings();
     
-    // Bulk operations
+    // Slow-query log. Every query is timed; those at or above the threshold are
+    // logged with their parameter shape and query plan, and the most recent are
+    // kept for slowQueries(). A negative threshold turns the log off.
+    void setSlowQueryThreshold(int milliseconds);
+    int slowQueryThreshold() const;
+    QList<SlowQuery> slowQueries() const;
+    
+    // Bodies of at least this many UTF-8 bytes are stored compressed, when that
+    // saves space, and decompressed by getNote(). Listings and search read a
+    // preview and search terms kept next to them instead. Negative turns it off;
+    // vacuum() compresses bodies stored before.
+    void setCompressionThreshold(int bytes);
+    int compressionThreshold() const;
+    
+    // Bulk operations; these report operationProgress as they go
     bool syncAllNotesWithFiles();
     bool recreateAllMarkdownFiles();
     
+    // Maintenance. checkIntegrity returns the problems found, empty when the
+    // database and the markdown files are consistent. vacuum compresses large
+    // bodies stored uncompressed before reclaiming space.
+    QStringList checkIntegrity();
+    bool vacuum();
+    
     // Model integration
     void populateFolderModel(QStandardItemModel *model);
     void populateNotesModel(QStandardItemModel *model, int folderId);
@@ -108,6 +198,7 @@ signals:
     void autoSaveTriggered();
     void databaseError(const QString &errorMessage);
     void operationFailed(const QString &operation, const QString &errorMessage);
+    void operationProgress(const QString &operation, int current, int total);
 
 private slots:
     void performAutoSave();
@@ -124,18 +215,49 @@ private:
     void ensureNotesDirectoryExists();
     void migrateDatabase();
     void convertExistingNotesToMarkdown();
+    bool convertNotesToStorageMode(StorageMode mode);
+    bool moveNoteFiles(const QString &path);
+    QString uniqueMarkdownFilename(const QString &title) const;
+    bool writeMarkdownFile(const QString &filename, const QString &title, const QString &body,
+                           const QDateTime &createdAt, int folderId);
+    
+    // Files mode: the body of a note is whatever its file holds after the front
+    // matter, and the row keeps a hash and the search terms of it. A restored
+    // body stays in the row until its file is written.
+    bool readMarkdownBody(const QString &filepath, QString &body) const;
+    QString noteBody(const QVariant &storedBody, const QString &filepath) const;
+    // Binds body, search_terms and body_preview for Database mode
+    void bindBody(QSqlQuery &q, const QString &body);
+    int compressStoredBodies();
+    bool indexNoteBody(int noteId, const QString &body, const QDateTime &updatedAt = QDateTime());
+    
+    // Runs q (prepared, or sql when given) and times it for the slow-query log
+    bool execQuery(QSqlQuery &q, const QString &sql = QString()) const;
+    void recordSlowQuery(const QSqlQuery &q, qint64 elapsedMs) const;
+    QString explainQueryPlan(const QSqlQuery &q) const;
     
     QSqlDatabase m_db;
+    QString m_databasePath;
     QTimer *m_autoSaveTimer;
     QString m_notesDirectory;
     bool m_autoSaveEnabled;
     int m_autoSaveInterval;
     
-    // Track modified notes for auto-save
+    StorageMode m_storageMode;
+    
+    // Notes whose markdown mirror is behind the database
     QSet<int> m_modifiedNotes;
     
     // Auto-import settings
     bool m_autoImportEnabled;
+    bool m_tracingEnabled;
+    
+    // Slow-query log; plans are cached per statement text
+    int m_slowQueryThresholdMs;
+    mutable QList<SlowQuery> m_slowQueries;
+    mutable QHash<QString, QString> m_queryPlans;
+    
+    int m_compressionThresholdBytes;
 };
 
 
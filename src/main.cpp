@@ -10,9 +10,12 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QLoggingCategory>
+#include <QCommandLineParser>
 #include <QDebug>
 #include "ui/MainWindow.h"
 #include "utils/Logger.h"
+#include "utils/Tracer.h"
+#include "utils/Metrics.h"
 
 static void setApplicationIdentity() {
     QCoreApplication::setOrganizationName("Orchard");
@@ -40,6 +43,29 @@ static void setupLogging() {
     #ifndef QT_DEBUG
     QLoggingCategory::setFilterRules("*.debug=false\n*.info=false\n*.warning=false");
     #endif
+    
+    // qDebug() and friends go through the same asynchronous writer
+    logger.installMessageHandler();
+}
+
+static void setupTracing(const QStringList& arguments) {
+    // --trace records into AppData/traces, --trace-file=<path> into a chosen file.
+    // Tracing can also be switched on in Settings.
+    QCommandLineParser parser;
+    QCommandLineOption traceOption("trace", "Record a performance trace.");
+    QCommandLineOption traceFileOption("trace-file", "Record a performance trace into <path>.", "path");
+    parser.addOption(traceOption);
+    parser.addOption(traceFileOption);
+    parser.parse(arguments);  // Not process(), so other arguments are left alone
+    
+    if (parser.isSet(traceFileOption)) {
+        Tracer::instance().start(parser.value(traceFileOption));
+    } else if (parser.isSet(traceOption)) {
+        Tracer::instance().start();
+    }
+    if (Tracer::instance().isRecording()) {
+        LOG_INFO("app", QString("Recording a trace to %1").arg(Tracer::instance().filePath()));
+    }
 }
 
 static void showErrorMessage(const QString& title, const QString& message) {
@@ -60,6 +86,7 @@ int main(int argc, char *argv[]) {
 
         setApplicationIdentity();
         setupLogging();
+        setupTracing(app.arguments());
         
         // Simple single instance check using a lock file
         QString lockFile = QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/notes-app.lock";
@@ -101,11 +128,17 @@ int main(int argc, char *argv[]) {
             app.setWindowIcon(appIcon);
         }
 
+        // Snapshot of the metrics registry in AppData/metrics.json, for bug reports
+        Metrics::instance().startPeriodicDump();
+
         MainWindow window;
         window.resize(1200, 720);
         window.show();
 
-        return app.exec();
+        int result = app.exec();
+        Metrics::instance().stopPeriodicDump();
+        Metrics::instance().dumpNow();
+        return result;
         
     } catch (const std::exception& e) {
         LOG_CRITICAL("app", QString("Unhandled exception in main: %1").arg(e.what()));
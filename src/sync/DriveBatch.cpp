@@ -0,0 +1,260 @@
+#include "DriveBatch.h"
+#include <QNetworkRequest>
+#include <QUuid>
+#include <QUrl>
+#include <cstring>
+
+namespace {
+// Splits a header block ("Name: value" lines) into name/value pairs
+QList<QPair<QByteArray, QByteArray>> parseHeaderLines(const QByteArray &block)
+{
+    QList<QPair<QByteArray, QByteArray>> headers;
+    const QList<QByteArray> lines = block.split('\n');
+    for (QByteArray line : lines) {
+        line = line.trimmed();
+        int colon = line.indexOf(':');
+        if (colon <= 0) {
+            continue;
+        }
+        headers.append(qMakePair(line.left(colon).trimmed(), line.mid(colon + 1).trimmed()));
+    }
+    return headers;
+}
+
+// Splits a message at the first empty line, accepting CRLF or bare LF
+bool splitHeadersAndBody(const QByteArray &message, QByteArray *headers, QByteArray *body)
+{
+    int separator = message.indexOf("\r\n\r\n");
+    int separatorLength = 4;
+    int bareSeparator = message.indexOf("\n\n");
+    if (separator < 0 || (bareSeparator >= 0 && bareSeparator < separator)) {
+        separator = bareSeparator;
+        separatorLength = 2;
+    }
+    if (separator < 0) {
+        *headers = message;
+        body->clear();
+        return false;
+    }
+    *headers = message.left(separator);
+    *body = message.mid(separator + separatorLength);
+    return true;
+}
+
+int itemIndexFromContentId(const QByteArray &contentId)
+{
+    // Drive answers <itemN> with <response-itemN>
+    QByteArray id = contentId;
+    id.replace('<', "").replace('>', "");
+    int pos = id.lastIndexOf("item");
+    if (pos < 0) {
+        return -1;
+    }
+    bool ok = false;
+    int index = id.mid(pos + 4).toInt(&ok);
+    return ok ? index : -1;
+}
+}
+
+namespace DriveBatch
+{
+
+QByteArray makeBoundary()
+{
+    return "batch_" + QUuid::createUuid().toByteArray(QUuid::Id128);
+}
+
+QByteArray boundaryFromContentType(const QByteArray &contentType)
+{
+    const QList<QByteArray> params = contentType.split(';');
+    for (const QByteArray &param : params) {
+        QByteArray trimmed = param.trimmed();
+        if (trimmed.toLower().startsWith("boundary=")) {
+            QByteArray boundary = trimmed.mid(9);
+            if (boundary.startsWith('"') && boundary.endsWith('"') && boundary.size() >= 2) {
+                boundary = boundary.mid(1, boundary.size() - 2);
+            }
+            return boundary;
+        }
+    }
+    return QByteArray();
+}
+
+QByteArray encode(const QList<DriveBatchItem> &items, const QByteArray &boundary)
+{
+    QByteArray payload;
+    for (int i = 0; i < items.size(); ++i) {
+        const DriveBatchItem &item = items[i];
+
+        payload += "--" + boundary + "\r\n";
+        payload += "Content-Type: application/http\r\n";
+        payload += "Content-ID: <item" + QByteArray::number(i) + ">\r\n\r\n";
+
+        payload += item.method + ' ' + QUrl(item.path).toEncoded() + " HTTP/1.1\r\n";
+        if (!item.body.isEmpty()) {
+            payload += "Content-Type: application/json; charset=UTF-8\r\n";
+        }
+        payload += "\r\n";
+        payload += item.body;
+        payload += "\r\n";
+    }
+    payload += "--" + boundary + "--\r\n";
+    return payload;
+}
+
+QMap<int, DriveBatchResponse> decode(const QByteArray &payload, const QByteArray &boundary)
+{
+    QMap<int, DriveBatchResponse> responses;
+    if (boundary.isEmpty()) {
+        return responses;
+    }
+
+    const QByteArray delimiter = "--" + boundary;
+    int pos = payload.indexOf(delimiter);
+    while (pos >= 0) {
+        int partStart = pos + delimiter.size();
+        if (payload.mid(partStart, 2) == "--") {
+            break; // Closing delimiter
+        }
+        int next = payload.indexOf(delimiter, partStart);
+        QByteArray part = payload.mid(partStart, next < 0 ? -1 : next - partStart);
+        pos = next;
+
+        // Strip the CRLF that follows the delimiter and precedes the next one
+        while (part.startsWith("\r\n") || part.startsWith('\n')) {
+            part.remove(0, part.startsWith("\r\n") ? 2 : 1);
+        }
+        if (part.endsWith("\r\n")) {
+            part.chop(2);
+        } else if (part.endsWith('\n')) {
+            part.chop(1);
+        }
+
+        QByteArray mimeHeaders;
+        QByteArray httpMessage;
+        if (!splitHeadersAndBody(part, &mimeHeaders, &httpMessage)) {
+            continue;
+        }
+
+        int index = -1;
+        for (const auto &header : parseHeaderLines(mimeHeaders)) {
+            if (header.first.toLower() == "content-id") {
+                index = itemIndexFromContentId(header.second);
+            }
+        }
+        if (index < 0) {
+            continue;
+        }
+
+        QByteArray httpHeaders;
+        DriveBatchResponse response;
+        splitHeadersAndBody(httpMessage, &httpHeaders, &response.body);
+
+        int statusLineEnd = httpHeaders.indexOf('\n');
+        QByteArray statusLine = httpHeaders.left(statusLineEnd).trimmed();
+        QList<QByteArray> statusParts = statusLine.split(' ');
+        if (statusParts.size() >= 2) {
+            response.statusCode = statusParts[1].toInt();
+            response.reasonPhrase = statusLine.mid(statusParts[0].size() + statusParts[1].size() + 2);
+        }
+        if (statusLineEnd >= 0) {
+            response.headers = parseHeaderLines(httpHeaders.mid(statusLineEnd + 1));
+        }
+
+        responses.insert(index, response);
+    }
+
+    return responses;
+}
+
+} // namespace DriveBatch
+
+DriveBatchPartReply::DriveBatchPartReply(const DriveBatchItem &item, const DriveBatchResponse &response, QObject *parent)
+    : QNetworkReply(parent)
+    , m_data(response.body)
+    , m_offset(0)
+{
+    applyItem(item);
+
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, response.statusCode);
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, response.reasonPhrase);
+    for (const auto &header : response.headers) {
+        setRawHeader(header.first, header.second);
+    }
+
+    QNetworkReply::NetworkError networkError = errorForStatus(response.statusCode);
+    if (networkError != QNetworkReply::NoError) {
+        setError(networkError, QString("HTTP %1 %2").arg(response.statusCode).arg(QString::fromUtf8(response.reasonPhrase)));
+    }
+
+    open(QIODevice::ReadOnly);
+    setFinished(true);
+}
+
+DriveBatchPartReply::DriveBatchPartReply(const DriveBatchItem &item, QNetworkReply::NetworkError error,
+                                         const QString &errorString, QObject *parent)
+    : QNetworkReply(parent)
+    , m_offset(0)
+{
+    applyItem(item);
+    setError(error, errorString);
+    open(QIODevice::ReadOnly);
+    setFinished(true);
+}
+
+void DriveBatchPartReply::applyItem(const DriveBatchItem &item)
+{
+    setOperation(QNetworkAccessManager::CustomOperation);
+    setUrl(QUrl(item.path));
+}
+
+void DriveBatchPartReply::abort()
+{
+    // Nothing in flight, the data is already complete
+}
+
+qint64 DriveBatchPartReply::bytesAvailable() const
+{
+    return m_data.size() - m_offset + QIODevice::bytesAvailable();
+}
+
+bool DriveBatchPartReply::isSequential() const
+{
+    return true;
+}
+
+qint64 DriveBatchPartReply::readData(char *data, qint64 maxSize)
+{
+    if (m_offset >= m_data.size()) {
+        return -1;
+    }
+    qint64 count = qMin(maxSize, m_data.size() - m_offset);
+    memcpy(data, m_data.constData() + m_offset, count);
+    m_offset += count;
+    return count;
+}
+
+QNetworkReply::NetworkError DriveBatchPartReply::errorForStatus(int statusCode)
+{
+    if (statusCode >= 200 && statusCode < 300) {
+        return QNetworkReply::NoError;
+    }
+    switch (statusCode) {
+        case 401: return QNetworkReply::AuthenticationRequiredError;
+        case 403: return QNetworkReply::ContentAccessDenied;
+        case 404: return QNetworkReply::ContentNotFoundError;
+        case 409: return QNetworkReply::ContentConflictError;
+        case 410: return QNetworkReply::ContentGoneError;
+        case 500: return QNetworkReply::InternalServerError;
+        case 501: return QNetworkReply::OperationNotImplementedError;
+        case 503: return QNetworkReply::ServiceUnavailableError;
+        default: break;
+    }
+    if (statusCode >= 500) {
+        return QNetworkReply::UnknownServerError;
+    }
+    if (statusCode >= 400) {
+        return QNetworkReply::UnknownContentError;
+    }
+    return QNetworkReply::ProtocolFailure;
+}
@@ -0,0 +1,72 @@
+#ifndef DRIVEBATCH_H
+#define DRIVEBATCH_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+#include <QNetworkReply>
+#include "DriveRequest.h"
+
+// One small Drive API call (folder create, delete, metadata PATCH) that can be
+// packed into a multipart/mixed batch request.
+struct DriveBatchItem
+{
+    QByteArray method;       // "POST", "PATCH", "DELETE", ...
+    QString path;            // Path relative to the API host, e.g. "/drive/v3/files/<id>"
+    QByteArray body;         // JSON payload, empty for DELETE
+    DriveRequestContext context;  // Handed to the handler with the demultiplexed reply
+};
+
+// One parsed part of a batch response
+struct DriveBatchResponse
+{
+    int statusCode = 0;
+    QByteArray reasonPhrase;
+    QList<QPair<QByteArray, QByteArray>> headers;
+    QByteArray body;
+};
+
+namespace DriveBatch
+{
+    // Drive rejects batches with more than 100 calls
+    constexpr int MaxItemsPerBatch = 100;
+
+    QByteArray makeBoundary();
+    QByteArray boundaryFromContentType(const QByteArray &contentType);
+
+    // Builds the multipart/mixed body; part N gets Content-ID <itemN>
+    QByteArray encode(const QList<DriveBatchItem> &items, const QByteArray &boundary);
+
+    // Parses a multipart/mixed batch reply, keyed by the item index from Content-ID
+    QMap<int, DriveBatchResponse> decode(const QByteArray &payload, const QByteArray &boundary);
+}
+
+// Read-only QNetworkReply that replays one part of a batch response, so the
+// per-request handlers can process it exactly like a standalone reply.
+class DriveBatchPartReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    DriveBatchPartReply(const DriveBatchItem &item, const DriveBatchResponse &response, QObject *parent = nullptr);
+    DriveBatchPartReply(const DriveBatchItem &item, QNetworkReply::NetworkError error,
+                        const QString &errorString, QObject *parent = nullptr);
+
+    void abort() override;
+    qint64 bytesAvailable() const override;
+    bool isSequential() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+
+private:
+    void applyItem(const DriveBatchItem &item);
+    static QNetworkReply::NetworkError errorForStatus(int statusCode);
+
+    QByteArray m_data;
+    qint64 m_offset;
+};
+
+#endif // DRIVEBATCH_H
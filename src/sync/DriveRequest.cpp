@@ -0,0 +1,28 @@
+#include "DriveRequest.h"
+
+const char *driveRequestTypeName(DriveRequestType type)
+{
+    switch (type) {
+    case DriveRequestType::Auth: return "auth";
+    case DriveRequestType::TokenRefresh: return "token_refresh";
+    case DriveRequestType::Upload: return "upload";
+    case DriveRequestType::UploadMetadata: return "upload_metadata";
+    case DriveRequestType::UploadContent: return "upload_content";
+    case DriveRequestType::UploadSession: return "upload_session";
+    case DriveRequestType::Download: return "download";
+    case DriveRequestType::DownloadStream: return "download_stream";
+    case DriveRequestType::Delete: return "delete";
+    case DriveRequestType::List: return "list";
+    case DriveRequestType::ListAll: return "list_all";
+    case DriveRequestType::Create: return "create";
+    case DriveRequestType::CreateFolder: return "create_folder";
+    case DriveRequestType::CreateSubfolder: return "create_subfolder";
+    case DriveRequestType::FindFolder: return "find_folder";
+    case DriveRequestType::ListSubfolders: return "list_subfolders";
+    case DriveRequestType::ListNotesInFolder: return "list_notes_in_folder";
+    case DriveRequestType::UpdateMetadata: return "update_metadata";
+    case DriveRequestType::Batch: return "batch";
+    case DriveRequestType::Count: break;
+    }
+    return "unknown";
+}
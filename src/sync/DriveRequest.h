@@ -0,0 +1,66 @@
+#ifndef DRIVEREQUEST_H
+#define DRIVEREQUEST_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include <QMetaType>
+
+// Kind of Drive call; selects its completion handler and its timing bucket
+enum class DriveRequestType
+{
+    Auth,
+    TokenRefresh,
+    Upload,
+    UploadMetadata,
+    UploadContent,
+    UploadSession,
+    Download,
+    DownloadStream,
+    Delete,
+    List,
+    ListAll,
+    Create,
+    CreateFolder,
+    CreateSubfolder,
+    FindFolder,
+    ListSubfolders,
+    ListNotesInFolder,
+    UpdateMetadata,
+    Batch,
+    Count
+};
+
+Q_DECLARE_METATYPE(DriveRequestType)
+
+const char *driveRequestTypeName(DriveRequestType type);
+
+// What a Drive call is about. It travels with the request through retries and
+// batching and is handed to the completion handler with the reply.
+struct DriveRequestContext
+{
+    DriveRequestType type = DriveRequestType::List;
+    QString noteId;             // Remote file the call is about
+    QString fileId;
+    QString title;
+    QString folderId;
+    QString folderName;
+    QString localNoteId;        // Set for uploads of local notes
+    int uploadGeneration = 0;
+    quint64 uploadJobId = 0;
+    int batchAttempt = 0;
+    QElapsedTimer started;      // First attempt, so timings include retries and batching
+
+    DriveRequestContext() = default;
+    explicit DriveRequestContext(DriveRequestType requestType) : type(requestType) {}
+};
+
+// Latency of completed requests of one type
+struct DriveRequestTiming
+{
+    int count = 0;
+    int failures = 0;
+    qint64 totalMs = 0;
+    qint64 maxMs = 0;
+};
+
+#endif // DRIVEREQUEST_H
@@ -1,22 +1,24 @@
 #include "GoogleDriveManager.h"
 #include "ConfigLoader.h"
+#include "../utils/Tracer.h"
+#include "../utils/Metrics.h"
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QUrlQuery>
+#include <QBuffer>
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
 #include <QTextStream>
-#include <QApplication>
 #include <QDesktopServices>
 #include <QUrl>
 #include <QTimer>
 #include <QDateTime>
 #include <QDebug>
-#include <QCryptographicHash>
+#include <limits>
 
 // Helper function to convert technical error messages to user-friendly ones
 static QString makeUserFriendlyError(const QString& technicalError) {
@@ -77,17 +79,36 @@ static QString makeUserFriendlyError(const QString& technicalError) {
 
 // Constants
 const QString GoogleDriveManager::API_BASE_URL = "https://www.googleapis.com/drive/v3";
+const QString GoogleDriveManager::UPLOAD_BASE_URL = "https://www.googleapis.com/upload/drive/v3";
+const QString GoogleDriveManager::BATCH_URL = "https://www.googleapis.com/batch/drive/v3";
 const QString GoogleDriveManager::AUTH_BASE_URL = "https://accounts.google.com/oauth/authorize";
 const QString GoogleDriveManager::TOKEN_BASE_URL = "https://oauth2.googleapis.com/token";
 const QString GoogleDriveManager::SCOPE = "https://www.googleapis.com/auth/drive.file";
 
+// Tokens are refreshed this long before they expire, and requests wait for a
+// refresh once less than TOKEN_EXPIRY_SKEW_SECS is left
+static const int TOKEN_REFRESH_MARGIN_SECS = 300;
+static const int TOKEN_EXPIRY_SKEW_SECS = 60;
+
 GoogleDriveManager::GoogleDriveManager(QObject *parent)
-    : QObject(parent)
+    : SyncBackend(parent)
     , m_networkManager(new QNetworkAccessManager(this))
     , m_isAuthenticated(false)
     , m_tokenRefreshTimer(new QTimer(this))
-    , m_pendingSubfolderIndex(0)
+    , m_pendingSubfolderCreates(0)
+    , m_batchTimer(new QTimer(this))
+    , m_circuitTimer(new QTimer(this))
     , m_structureChecked(false)
+    , m_pendingFolderListings(0)
+    , m_pendingListPages(0)
+    , m_listingFailed(false)
+    , m_nextUploadJobId(1)
+    , m_inFlightBytes(0)
+    , m_tokenRefreshInFlight(false)
+    , m_apiBaseUrl(API_BASE_URL)
+    , m_uploadBaseUrl(UPLOAD_BASE_URL)
+    , m_batchUrl(BATCH_URL)
+    , m_tokenUrl(TOKEN_BASE_URL)
 {
     // Load credentials from ConfigLoader
     m_clientId = ConfigLoader::instance().getClientId();
@@ -97,46 +118,115 @@ GoogleDriveManager::GoogleDriveManager(QObject *parent)
     // Load saved tokens
     loadTokens();
     
-    // Set up token refresh timer
+    // Set up token refresh timer, armed shortly before the token expires
+    m_tokenRefreshTimer->setSingleShot(true);
     connect(m_tokenRefreshTimer, &QTimer::timeout, this, &GoogleDriveManager::refreshTokenIfNeeded);
     startTokenRefreshTimer();
     
-    // Connect network replies
-    connect(m_networkManager, &QNetworkAccessManager::finished, this, [this](QNetworkReply *reply) {
-        // Route responses based on stored request info
-        QString requestType = reply->property("requestType").toString();
-        if (requestType == "auth") {
-            handleAuthResponse(reply);
-        } else if (requestType == "token_refresh") {
-            handleTokenRefresh(reply);
-        } else if (requestType == "upload") {
-            handleUploadResponse(reply);
-        } else if (requestType == "upload_metadata") {
-            handleUploadMetadataResponse(reply);
-        } else if (requestType == "upload_content") {
-            handleUploadContentResponse(reply);
-        } else if (requestType == "upload_session") {
-            handleUploadSessionResponse(reply);
-        } else if (requestType == "download") {
-            handleDownloadResponse(reply);
-        } else if (requestType == "delete") {
-            handleDeleteResponse(reply);
-        } else if (requestType == "list") {
-            handleListResponse(reply);
-        } else if (requestType == "create") {
-            handleCreateResponse(reply);
-        } else if (requestType == "create_folder") {
-            handleCreateFolderResponse(reply);
-        } else if (requestType == "create_subfolder") {
-            handleCreateSubfolderResponse(reply);
-        } else if (requestType == "find_folder") {
-            handleFindFolderResponse(reply);
-        } else if (requestType == "list_subfolders") {
-            handleListSubfoldersResponse(reply);
-        } else if (requestType == "list_notes_in_folder") {
-            handleListNotesInFolderResponse(reply);
-        }
+    // Small metadata operations issued in the same event loop pass are sent as one batch
+    m_batchTimer->setSingleShot(true);
+    connect(m_batchTimer, &QTimer::timeout, this, &GoogleDriveManager::flushBatch);
+    
+    // When the breaker cooldown ends, let the next sync probe Drive again
+    m_circuitTimer->setSingleShot(true);
+    connect(m_circuitTimer, &QTimer::timeout, this, [this]() {
+        qDebug() << "Circuit breaker cooldown over, allowing sync to probe Google Drive";
+        emit circuitBreakerChanged(false);
     });
+    
+    m_requestTimings.resize(static_cast<int>(DriveRequestType::Count));
+}
+
+void GoogleDriveManager::onReplyFinished(QNetworkReply *reply)
+{
+    TRACE_SCOPE("sync", "GoogleDriveManager::onReplyFinished");
+    PendingRequest pending = releaseSentRequest(reply);
+    const DriveRequestContext &context = pending.context;
+    if (!context.localNoteId.isEmpty()) {
+        m_activeUploads.remove(context.localNoteId, reply);
+    }
+    
+    // A newer edit of the note replaced this upload, nobody is waiting for it
+    if (pending.superseded) {
+        qDebug() << "Dropping superseded upload for local note:" << context.localNoteId;
+        m_uploadJobs.remove(context.uploadJobId);
+        reply->deleteLater();
+        return;
+    }
+    
+    // Drive rejected the token before its expiry, e.g. after the machine slept
+    if (replayAfterTokenRefresh(reply, pending)) {
+        return;
+    }
+    
+    // Transient failures are replayed after a backoff instead of reaching the handlers
+    if (retryIfTransient(reply, pending)) {
+        return;
+    }
+    
+    // Handlers read what they need synchronously; release the reply and its body
+    reply->deleteLater();
+    completeRequest(reply, context);
+}
+
+void GoogleDriveManager::completeRequest(QNetworkReply *reply, const DriveRequestContext &context)
+{
+    // Time from the first attempt, so retries and batching count against the operation
+    qint64 elapsedMs = context.started.isValid() ? context.started.elapsed() : 0;
+    bool success = reply->error() == QNetworkReply::NoError;
+    
+    DriveRequestTiming &timing = m_requestTimings[static_cast<int>(context.type)];
+    timing.count++;
+    if (!success) {
+        timing.failures++;
+    }
+    timing.totalMs += elapsedMs;
+    timing.maxMs = qMax(timing.maxMs, elapsedMs);
+    METRIC_HISTOGRAM("drive.request_ms").record(elapsedMs);
+    if (!success) {
+        METRIC_COUNTER("drive.request_failures").add();
+    }
+    emit requestFinished(context.type, elapsedMs, success);
+    
+    (this->*handlerFor(context.type))(reply, context);
+}
+
+GoogleDriveManager::ReplyHandler GoogleDriveManager::handlerFor(DriveRequestType type)
+{
+    switch (type) {
+    case DriveRequestType::Auth: return &GoogleDriveManager::handleAuthResponse;
+    case DriveRequestType::TokenRefresh: return &GoogleDriveManager::handleTokenRefresh;
+    case DriveRequestType::Upload: return &GoogleDriveManager::handleUploadResponse;
+    case DriveRequestType::UploadMetadata: return &GoogleDriveManager::handleUploadMetadataResponse;
+    case DriveRequestType::UploadContent: return &GoogleDriveManager::handleUploadContentResponse;
+    case DriveRequestType::UploadSession: return &GoogleDriveManager::handleUploadSessionResponse;
+    case DriveRequestType::Download: return &GoogleDriveManager::handleDownloadResponse;
+    case DriveRequestType::DownloadStream: return &GoogleDriveManager::handleStreamedDownloadResponse;
+    case DriveRequestType::Delete: return &GoogleDriveManager::handleDeleteResponse;
+    case DriveRequestType::List: return &GoogleDriveManager::handleListResponse;
+    case DriveRequestType::ListAll: return &GoogleDriveManager::handleListAllResponse;
+    case DriveRequestType::Create: return &GoogleDriveManager::handleCreateResponse;
+    case DriveRequestType::CreateFolder: return &GoogleDriveManager::handleCreateFolderResponse;
+    case DriveRequestType::CreateSubfolder: return &GoogleDriveManager::handleCreateSubfolderResponse;
+    case DriveRequestType::FindFolder: return &GoogleDriveManager::handleFindFolderResponse;
+    case DriveRequestType::ListSubfolders: return &GoogleDriveManager::handleListSubfoldersResponse;
+    case DriveRequestType::ListNotesInFolder: return &GoogleDriveManager::handleListNotesInFolderResponse;
+    case DriveRequestType::UpdateMetadata: return &GoogleDriveManager::handleUpdateMetadataResponse;
+    case DriveRequestType::Batch:
+    case DriveRequestType::Count:
+        break;
+    }
+    return &GoogleDriveManager::handleBatchResponse;
+}
+
+DriveRequestTiming GoogleDriveManager::requestTiming(DriveRequestType type) const
+{
+    return m_requestTimings.value(static_cast<int>(type));
+}
+
+void GoogleDriveManager::resetRequestTimings()
+{
+    m_requestTimings.fill(DriveRequestTiming());
 }
 
 GoogleDriveManager::~GoogleDriveManager()
@@ -210,19 +300,27 @@ void GoogleDriveManager::requestAccessToken(const QString &authCode)
     query.addQueryItem("grant_type", "authorization_code");
     query.addQueryItem("redirect_uri", m_redirectUri);
     
-    QNetworkRequest request{QUrl(TOKEN_BASE_URL)};
+    QNetworkRequest request{QUrl(m_tokenUrl)};
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
     
-    QNetworkReply *reply = m_networkManager->post(request, query.toString().toUtf8());
-    trackRequest(reply, "auth");
+    // Authorization codes are single use, so this is only replayed if it never got out
+    sendRequest("POST", request, query.toString().toUtf8(), false, DriveRequestContext(DriveRequestType::Auth));
 }
 
 void GoogleDriveManager::refreshToken()
 {
+    // One refresh at a time, everything else waits for its result
+    if (m_tokenRefreshInFlight) {
+        qDebug() << "Token refresh already in progress";
+        return;
+    }
+    
     if (m_refreshToken.isEmpty()) {
         emit error(makeUserFriendlyError("No refresh token available"));
+        failParkedRequests("No refresh token available");
         return;
     }
+    m_tokenRefreshInFlight = true;
     
     QUrlQuery query;
     query.addQueryItem("client_id", m_clientId);
@@ -230,11 +328,10 @@ void GoogleDriveManager::refreshToken()
     query.addQueryItem("refresh_token", m_refreshToken);
     query.addQueryItem("grant_type", "refresh_token");
     
-    QNetworkRequest request{QUrl(TOKEN_BASE_URL)};
+    QNetworkRequest request{QUrl(m_tokenUrl)};
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
     
-    QNetworkReply *reply = m_networkManager->post(request, query.toString().toUtf8());
-    trackRequest(reply, "token_refresh");
+    sendRequest("POST", request, query.toString().toUtf8(), true, DriveRequestContext(DriveRequestType::TokenRefresh));
 }
 
 void GoogleDriveManager::logout()
@@ -243,10 +340,35 @@ void GoogleDriveManager::logout()
     m_refreshToken.clear();
     m_tokenExpiry = QDateTime();
     m_isAuthenticated = false;
+    m_tokenRefreshTimer->stop();
     saveTokens();
+    failParkedRequests("Not authenticated");
     emit authenticationChanged(false);
 }
 
+void GoogleDriveManager::setServiceUrls(const QString &apiBaseUrl, const QString &uploadBaseUrl,
+                                        const QString &batchUrl, const QString &tokenUrl)
+{
+    m_apiBaseUrl = apiBaseUrl;
+    m_uploadBaseUrl = uploadBaseUrl;
+    m_batchUrl = batchUrl;
+    m_tokenUrl = tokenUrl;
+}
+
+void GoogleDriveManager::setTokens(const QString &accessToken, const QString &refreshToken, const QDateTime &expiry)
+{
+    // Not saved, so the stored sign-in is left alone
+    m_accessToken = accessToken;
+    m_refreshToken = refreshToken;
+    m_tokenExpiry = expiry;
+    m_isAuthenticated = !m_accessToken.isEmpty();
+    startTokenRefreshTimer();
+    emit authenticationChanged(m_isAuthenticated);
+    if (m_isAuthenticated) {
+        releaseParkedRequests();
+    }
+}
+
 void GoogleDriveManager::forceReauthenticate()
 {
     qDebug() << "Forcing re-authentication...";
@@ -262,10 +384,14 @@ void GoogleDriveManager::forceReauthenticate()
     m_remoteNoteHashes.clear();
     m_remoteNoteIds.clear();
     m_remoteFolderIds.clear();
+    m_remoteNotesByLocalId.clear();
+    m_remoteNoteParents.clear();
     m_subfolderIds.clear();
     
     // Save cleared state
+    m_tokenRefreshTimer->stop();
     saveTokens();
+    failParkedRequests("Not authenticated");
     
     // Emit authentication changed
     emit authenticationChanged(false);
@@ -288,76 +414,32 @@ void GoogleDriveManager::uploadNote(const QString &noteId, const QString &conten
     
     qDebug() << "Uploading note:" << title << "to folder:" << m_syncFolderId;
     qDebug() << "Note content length:" << content.length();
-    qDebug() << "Note content preview:" << content.mid(0, 100) + "...";
-    qDebug() << "Note content (full):" << content;
     
     // Validate content before proceeding
-    if (content.isEmpty()) {
-        qDebug() << "ERROR: Content is empty, cannot upload note!";
-        emit error(makeUserFriendlyError("Note content is empty"));
-        return;
-    }
-    
     if (content.trimmed().isEmpty()) {
-        qDebug() << "ERROR: Content is only whitespace, cannot upload note!";
-        emit error(makeUserFriendlyError("Note content is only whitespace"));
+        qDebug() << "ERROR: Content is empty or only whitespace, cannot upload note!";
+        emit error(makeUserFriendlyError("Note content is empty"));
         return;
     }
     
     // Check if content is just the title (which would indicate an error)
     if (content.trimmed() == title.trimmed()) {
         qDebug() << "ERROR: Content is just the title, this indicates a serious error!";
-        qDebug() << "Title:" << title;
-        qDebug() << "Content:" << content;
         emit error("Note content is just the title - this indicates an error in content passing");
         return;
     }
     
-    // Use resumable upload instead of multipart for better reliability
-    QString url = noteId.isEmpty() ? 
-        QString("%1/files?uploadType=resumable").arg(API_BASE_URL) :
-        QString("%1/files/%2?uploadType=resumable").arg(API_BASE_URL, noteId);
-    
-    QNetworkRequest request{QUrl(url)};
-    addAuthHeader(request);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    
-    // Create metadata JSON
-    QJsonObject metadata;
-    metadata["name"] = title + ".md";
-    metadata["parents"] = QJsonArray() << m_syncFolderId;
-    metadata["mimeType"] = "text/markdown";
-    
-    if (!noteId.isEmpty()) {
-        // Update existing file
-        metadata["id"] = noteId;
-    }
-    
-    QByteArray metadataJson = QJsonDocument(metadata).toJson();
-    qDebug() << "Upload metadata:" << QString::fromUtf8(metadataJson);
-    
-    // First, create the file with metadata
-    QNetworkReply *reply;
-    if (noteId.isEmpty()) {
-        // For new files, POST the metadata
-        reply = m_networkManager->post(request, metadataJson);
-    } else {
-        // For updates, PUT the metadata
-        reply = m_networkManager->put(request, metadataJson);
-    }
-    
-    // Store the content for the second request
-    reply->setProperty("content", content);
-    reply->setProperty("title", title);
-    reply->setProperty("folderId", m_syncFolderId);
-    reply->setProperty("noteId", noteId);
-    
-    trackRequest(reply, "upload_metadata", noteId);
-    
-    qDebug() << "Upload metadata request sent for note:" << title;
+    UploadJob job;
+    job.remoteId = noteId;
+    job.title = title;
+    job.folderId = m_syncFolderId;
+    job.body = [content]() { return content.toUtf8(); };
+    startUpload(job, QJsonObject(), QString());
 }
 
-void GoogleDriveManager::uploadNoteToFolder(const QString &noteId, const QString &content, const QString &title, const QString &folderId)
+void GoogleDriveManager::uploadNoteToFolder(const QString &noteId, const QString &content, const QString &title, const QString &folderId,
+                                            const QString &localNoteId, const QJsonObject &appProperties,
+                                            const QString &removeParentId)
 {
     if (!isAuthenticated()) {
         emit error(makeUserFriendlyError("Not authenticated"));
@@ -371,64 +453,72 @@ void GoogleDriveManager::uploadNoteToFolder(const QString &noteId, const QString
     
     qDebug() << "Uploading note:" << title << "to specific folder:" << folderId;
     qDebug() << "Note content length:" << content.length();
-    qDebug() << "Note content preview:" << content.mid(0, 100) + "...";
-    qDebug() << "Note content (full):" << content;
     
     // Validate content before proceeding
-    if (content.isEmpty()) {
-        qDebug() << "ERROR: Content is empty, cannot upload note!";
+    if (content.trimmed().isEmpty()) {
+        qDebug() << "ERROR: Content is empty or only whitespace, cannot upload note!";
         emit error(makeUserFriendlyError("Note content is empty"));
         return;
     }
     
-    if (content.trimmed().isEmpty()) {
-        qDebug() << "ERROR: Content is only whitespace, cannot upload note!";
-        emit error(makeUserFriendlyError("Note content is only whitespace"));
-        return;
+    UploadJob job;
+    job.localNoteId = localNoteId;
+    job.remoteId = noteId;
+    job.title = title;
+    job.folderId = folderId;
+    job.body = [content]() { return content.toUtf8(); };
+    startUpload(job, appProperties, removeParentId);
+}
+
+void GoogleDriveManager::startUpload(const UploadJob &job, const QJsonObject &appProperties, const QString &removeParentId)
+{
+    // Use resumable upload instead of multipart for better reliability. Existing
+    // files are updated in place with PATCH so they keep their ID.
+    QUrl url(job.remoteId.isEmpty() ?
+        QString("%1/files").arg(m_uploadBaseUrl) :
+        QString("%1/files/%2").arg(m_uploadBaseUrl, job.remoteId));
+    QUrlQuery query;
+    query.addQueryItem("uploadType", "resumable");
+    if (!job.remoteId.isEmpty() && !removeParentId.isEmpty() && removeParentId != job.folderId) {
+        // The note moved to another folder since it was last uploaded
+        query.addQueryItem("addParents", job.folderId);
+        query.addQueryItem("removeParents", removeParentId);
     }
+    url.setQuery(query);
     
-    // Use resumable upload instead of multipart for better reliability
-    QString url = noteId.isEmpty() ? 
-        QString("%1/files?uploadType=resumable").arg(API_BASE_URL) :
-        QString("%1/files/%2?uploadType=resumable").arg(API_BASE_URL, noteId);
-    
-    QNetworkRequest request{QUrl(url)};
+    QNetworkRequest request(url);
     addAuthHeader(request);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     
     // Create metadata JSON
     QJsonObject metadata;
-    metadata["name"] = title + ".md";
-    metadata["parents"] = QJsonArray() << folderId;
+    metadata["name"] = job.title + ".md";
     metadata["mimeType"] = "text/markdown";
+    if (!appProperties.isEmpty()) {
+        metadata["appProperties"] = appProperties;
+    }
     
-    if (!noteId.isEmpty()) {
-        // Update existing file
-        metadata["id"] = noteId;
+    if (job.remoteId.isEmpty()) {
+        // Parents can only be set on creation, updates move files with addParents/removeParents
+        metadata["parents"] = QJsonArray() << job.folderId;
     }
     
-    QByteArray metadataJson = QJsonDocument(metadata).toJson();
+    QByteArray metadataJson = QJsonDocument(metadata).toJson(QJsonDocument::Compact);
     qDebug() << "Upload metadata:" << QString::fromUtf8(metadataJson);
     
-    // First, create the file with metadata
-    QNetworkReply *reply;
-    if (noteId.isEmpty()) {
-        // For new files, POST the metadata
-        reply = m_networkManager->post(request, metadataJson);
-    } else {
-        // For updates, PUT the metadata
-        reply = m_networkManager->put(request, metadataJson);
-    }
+    // The job stays here; requests only carry its ID, and the body is read from
+    // the job's provider when the content request goes out
+    quint64 jobId = m_nextUploadJobId++;
+    m_uploadJobs.insert(jobId, job);
     
-    // Store the content for the second request
-    reply->setProperty("content", content);
-    reply->setProperty("title", title);
-    reply->setProperty("folderId", folderId);
-    reply->setProperty("noteId", noteId);
+    DriveRequestContext context = uploadContext(DriveRequestType::UploadMetadata, jobId);
+    context.noteId = job.remoteId;
     
-    trackRequest(reply, "upload_metadata", noteId);
+    // First, create the file with metadata. Opening a resumable session creates
+    // nothing on Drive until content is uploaded, so it is safe to replay.
+    sendRequest(job.remoteId.isEmpty() ? "POST" : "PATCH", request, metadataJson, true, context);
     
-    qDebug() << "Upload metadata request sent for note:" << title << "to folder:" << folderId;
+    qDebug() << "Upload metadata request sent for note:" << job.title << "to folder:" << job.folderId;
 }
 
 void GoogleDriveManager::downloadNote(const QString &noteId)
@@ -438,27 +528,59 @@ void GoogleDriveManager::downloadNote(const QString &noteId)
         return;
     }
     
-    QString url = QString("%1/files/%2?alt=media").arg(API_BASE_URL, noteId);
+    QString url = QString("%1/files/%2?alt=media").arg(m_apiBaseUrl, noteId);
     QNetworkRequest request{QUrl(url)};
     addAuthHeader(request);
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    trackRequest(reply, "download", noteId);
+    DriveRequestContext context(DriveRequestType::Download);
+    context.noteId = noteId;
+    sendRequest("GET", request, QByteArray(), true, context);
 }
 
-void GoogleDriveManager::deleteNote(const QString &noteId)
+void GoogleDriveManager::downloadNoteStreaming(const QString &fileId)
 {
     if (!isAuthenticated()) {
         emit error(makeUserFriendlyError("Not authenticated"));
+        emit noteStreamFinished(fileId, false);
         return;
     }
     
-    QString url = QString("%1/files/%2").arg(API_BASE_URL, noteId);
+    QString url = QString("%1/files/%2?alt=media").arg(m_apiBaseUrl, fileId);
     QNetworkRequest request{QUrl(url)};
     addAuthHeader(request);
     
-    QNetworkReply *reply = m_networkManager->deleteResource(request);
-    trackRequest(reply, "delete", noteId);
+    DriveRequestContext context(DriveRequestType::DownloadStream);
+    context.fileId = fileId;
+    sendRequest("GET", request, QByteArray(), true, context);
+}
+
+void GoogleDriveManager::streamReply(QNetworkReply *reply, const QString &fileId)
+{
+    // Hand the body on as it arrives; error bodies stay in the reply for the handlers
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply, fileId]() {
+        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (statusCode < 200 || statusCode >= 300) {
+            return;
+        }
+        QByteArray chunk = reply->readAll();
+        METRIC_COUNTER("drive.bytes_received").add(quint64(chunk.size()));
+        emit noteDataReceived(fileId, chunk);
+    });
+}
+
+void GoogleDriveManager::deleteNote(const QString &noteId)
+{
+    if (!isAuthenticated()) {
+        emit error(makeUserFriendlyError("Not authenticated"));
+        return;
+    }
+    
+    DriveBatchItem item;
+    item.method = "DELETE";
+    item.path = apiPath("files/" + noteId);
+    item.context = DriveRequestContext(DriveRequestType::Delete);
+    item.context.noteId = noteId;
+    enqueueBatchItem(item);
 }
 
 void GoogleDriveManager::listNotes()
@@ -475,7 +597,7 @@ void GoogleDriveManager::listNotes()
     }
     
     // Build the query properly
-    QUrl url(API_BASE_URL + "/files");
+    QUrl url(m_apiBaseUrl + "/files");
     QUrlQuery query;
     query.addQueryItem("q", QString("'%1' in parents and trashed=false").arg(m_syncFolderId));
     query.addQueryItem("fields", "files(id,name,modifiedTime,size)");
@@ -487,8 +609,54 @@ void GoogleDriveManager::listNotes()
     qDebug() << "Listing notes from folder:" << m_syncFolderId;
     qDebug() << "URL:" << url.toString();
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    trackRequest(reply, "list");
+    sendRequest("GET", request, QByteArray(), true, DriveRequestContext(DriveRequestType::List));
+}
+
+void GoogleDriveManager::listAllNotes()
+{
+    if (!isAuthenticated()) {
+        emit error(makeUserFriendlyError("Not authenticated"));
+        emit remoteNotesListed(QList<RemoteNoteFile>(), false);
+        return;
+    }
+    
+    if (m_syncFolderId.isEmpty()) {
+        qDebug() << "No sync folder ID set, cannot list notes yet";
+        emit remoteNotesListed(QList<RemoteNoteFile>(), false);
+        return;
+    }
+    
+    if (m_pendingListPages > 0) {
+        qDebug() << "Full listing already in progress";
+        return;
+    }
+    
+    m_listedNotes.clear();
+    m_listingFailed = false;
+    listFolderContents(m_syncFolderId, QString());
+}
+
+void GoogleDriveManager::listFolderContents(const QString &folderId, const QString &folderName, const QString &pageToken)
+{
+    QUrl url(m_apiBaseUrl + "/files");
+    QUrlQuery query;
+    query.addQueryItem("q", QString("'%1' in parents and trashed=false").arg(folderId));
+    query.addQueryItem("fields", "nextPageToken,files(id,name,mimeType,size,modifiedTime,md5Checksum,appProperties)");
+    query.addQueryItem("pageSize", "1000");
+    query.addQueryItem("spaces", "drive");
+    if (!pageToken.isEmpty()) {
+        query.addQueryItem("pageToken", pageToken);
+    }
+    url.setQuery(query);
+    
+    QNetworkRequest request(url);
+    addAuthHeader(request);
+    
+    DriveRequestContext context(DriveRequestType::ListAll);
+    context.folderId = folderId;
+    context.folderName = folderName;
+    sendRequest("GET", request, QByteArray(), true, context);
+    m_pendingListPages++;
 }
 
 void GoogleDriveManager::createNote(const QString &title, const QString &content)
@@ -508,13 +676,7 @@ void GoogleDriveManager::createFolder(const QString &folderName)
         return;
     }
     
-    qDebug() << "Creating folder:" << folderName << "in parent folder:" << m_syncFolderId;
-    
-    // Create the folder in Google Drive
-    QUrl url(API_BASE_URL + "/files");
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    addAuthHeader(request);
+    qDebug() << "Queueing folder creation:" << folderName << "in parent folder:" << m_syncFolderId;
     
     QJsonObject folderMetadata;
     folderMetadata["name"] = folderName;
@@ -523,16 +685,44 @@ void GoogleDriveManager::createFolder(const QString &folderName)
     // Set parent folder to the Notes App folder
     folderMetadata["parents"] = QJsonArray{m_syncFolderId};
     
-    QJsonDocument doc(folderMetadata);
-    QByteArray data = doc.toJson();
-    
-    qDebug() << "Folder creation request data:" << QString::fromUtf8(data);
-    qDebug() << "Parent ID being set:" << m_syncFolderId;
+    DriveBatchItem item;
+    item.method = "POST";
+    item.path = apiPath("files");
+    item.body = QJsonDocument(folderMetadata).toJson(QJsonDocument::Compact);
+    item.context = DriveRequestContext(DriveRequestType::CreateSubfolder);
+    item.context.folderName = folderName;
+    enqueueBatchItem(item);
+}
+
+void GoogleDriveManager::updateFileMetadata(const QString &fileId, const QJsonObject &metadata,
+                                            const QString &addParentId, const QString &removeParentId)
+{
+    if (!isAuthenticated()) {
+        emit error(makeUserFriendlyError("Not authenticated"));
+        return;
+    }
     
-    QNetworkReply *reply = m_networkManager->post(request, data);
-    trackRequest(reply, "create_subfolder", "");
+    enqueueBatchItem(metadataUpdateItem(fileId, metadata, addParentId, removeParentId));
+}
+
+DriveBatchItem GoogleDriveManager::metadataUpdateItem(const QString &fileId, const QJsonObject &metadata,
+                                                      const QString &addParentId, const QString &removeParentId) const
+{
+    QString path = apiPath("files/" + fileId);
+    if (!addParentId.isEmpty() && !removeParentId.isEmpty() && addParentId != removeParentId) {
+        QUrlQuery query;
+        query.addQueryItem("addParents", addParentId);
+        query.addQueryItem("removeParents", removeParentId);
+        path += "?" + query.toString(QUrl::FullyEncoded);
+    }
     
-    qDebug() << "Folder creation request sent for:" << folderName;
+    DriveBatchItem item;
+    item.method = "PATCH";
+    item.path = path;
+    item.body = QJsonDocument(metadata).toJson(QJsonDocument::Compact);
+    item.context = DriveRequestContext(DriveRequestType::UpdateMetadata);
+    item.context.fileId = fileId;
+    return item;
 }
 
 void GoogleDriveManager::syncAll()
@@ -661,8 +851,8 @@ void GoogleDriveManager::createSubfoldersAndUploadNotes(const QList<QPair<QStrin
         return;
     }
     
-    // Reset subfolder index and check existing structure
-    m_pendingSubfolderIndex = 0;
+    // Check existing structure, missing subfolders are created afterwards
+    m_pendingSubfolderCreates = 0;
     checkExistingStructure();
 }
 
@@ -674,29 +864,30 @@ void GoogleDriveManager::checkExistingStructure()
     listSubfolders();
 }
 
-void GoogleDriveManager::createNextSubfolder()
+void GoogleDriveManager::createMissingSubfolders()
 {
-    if (m_pendingSubfolderIndex >= m_pendingFolderStructure.size()) {
-        // All subfolders processed, start uploading notes
-        qDebug() << "All subfolders processed, starting note uploads...";
-        qDebug() << "Available subfolder IDs:" << m_subfolderIds;
-        startNoteUploads();
-        return;
+    for (const auto &folderData : m_pendingFolderStructure) {
+        QString folderName = folderData.first;
+        if (m_subfolderIds.contains(folderName)) {
+            qDebug() << "Subfolder already exists:" << folderName << "with ID:" << m_subfolderIds[folderName] << ", skipping creation";
+            continue;
+        }
+        
+        qDebug() << "Creating subfolder:" << folderName << "in parent folder:" << m_syncFolderId;
+        m_pendingSubfolderCreates++;
+        createFolder(folderName);
     }
     
-    const auto &folderData = m_pendingFolderStructure[m_pendingSubfolderIndex];
-    QString folderName = folderData.first;
-    
-    // Check if this subfolder already exists
-    if (m_subfolderIds.contains(folderName)) {
-        qDebug() << "Subfolder already exists:" << folderName << "with ID:" << m_subfolderIds[folderName] << ", skipping creation";
-        m_pendingSubfolderIndex++;
-        createNextSubfolder(); // Process next folder
+    if (m_pendingSubfolderCreates == 0) {
+        // Nothing to create, start uploading notes
+        qDebug() << "All subfolders exist, starting note uploads...";
+        qDebug() << "Available subfolder IDs:" << m_subfolderIds;
+        startNoteUploads();
         return;
     }
     
-    qDebug() << "Creating subfolder:" << folderName << "in parent folder:" << m_syncFolderId;
-    createFolder(folderName);
+    // Send all folder creations together instead of waiting for the next event loop pass
+    flushBatch();
 }
 
 void GoogleDriveManager::startNoteUploads()
@@ -714,12 +905,13 @@ void GoogleDriveManager::startNoteUploads()
                 QString content = note.second;
                 
                 // Check if note already exists
-                if (m_remoteNoteIds.contains(title)) {
-                    QString existingNoteId = m_remoteNoteIds[title];
+                QString key = remoteNoteKey(folderName, title);
+                if (m_remoteNoteIds.contains(key)) {
+                    QString existingNoteId = m_remoteNoteIds[key];
                     qDebug() << "Note already exists:" << title << "with ID:" << existingNoteId << ", checking if update needed";
                     
                     // Check if content has changed
-                    QString existingHash = m_remoteNoteHashes.value(title, "");
+                    QString existingHash = m_remoteNoteHashes.value(key, "");
                     QString newHash = calculateFileHash(content);
                     
                     if (existingHash != newHash) {
@@ -747,7 +939,7 @@ void GoogleDriveManager::listSubfolders()
     }
     
     // Query for subfolders in the Notes App folder
-    QUrl url(API_BASE_URL + "/files");
+    QUrl url(m_apiBaseUrl + "/files");
     QUrlQuery query;
     query.addQueryItem("q", QString("'%1' in parents and mimeType='application/vnd.google-apps.folder' and trashed=false").arg(m_syncFolderId));
     query.addQueryItem("fields", "files(id,name)");
@@ -757,8 +949,7 @@ void GoogleDriveManager::listSubfolders()
     QNetworkRequest request(url);
     addAuthHeader(request);
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    trackRequest(reply, "list_subfolders", "");
+    sendRequest("GET", request, QByteArray(), true, DriveRequestContext(DriveRequestType::ListSubfolders));
     
     qDebug() << "Listing subfolders in Notes App folder...";
 }
@@ -771,21 +962,19 @@ void GoogleDriveManager::listNotesInFolder(const QString &folderId, const QStrin
     }
     
     // Query for notes in the specific subfolder
-    QUrl url(API_BASE_URL + "/files");
+    QUrl url(m_apiBaseUrl + "/files");
     QUrlQuery query;
     query.addQueryItem("q", QString("'%1' in parents and trashed=false").arg(folderId));
-    query.addQueryItem("fields", "files(id,name)");
+    query.addQueryItem("fields", "files(id,name,appProperties)");
     query.addQueryItem("spaces", "drive");
     
     url.setQuery(query);
     QNetworkRequest request(url);
     addAuthHeader(request);
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    trackRequest(reply, "list_notes_in_folder", "");
-    
-    // Store folder name in the reply for response handling
-    reply->setProperty("folderName", folderName);
+    DriveRequestContext context(DriveRequestType::ListNotesInFolder);
+    context.folderName = folderName;
+    sendRequest("GET", request, QByteArray(), true, context);
     
     qDebug() << "Listing notes in subfolder:" << folderName;
 }
@@ -815,13 +1004,7 @@ void GoogleDriveManager::addAuthHeader(QNetworkRequest &request)
     qDebug() << "Is authenticated:" << m_isAuthenticated;
     
     if (!m_accessToken.isEmpty()) {
-        // Check if token is expired
-        if (m_tokenExpiry.isValid() && QDateTime::currentDateTime() >= m_tokenExpiry) {
-            qDebug() << "WARNING: Token is expired, attempting refresh...";
-            refreshTokenIfNeeded();
-            // Continue with current token for this request, it will be refreshed for next request
-        }
-        
+        // An expiring token is refreshed by dispatchRequest before the request goes out
         QString authHeader = QString("Bearer %1").arg(m_accessToken);
         request.setRawHeader("Authorization", authHeader.toUtf8());
         qDebug() << "Auth header set:" << authHeader.mid(0, 30) + "...";
@@ -833,57 +1016,460 @@ void GoogleDriveManager::addAuthHeader(QNetworkRequest &request)
 
 QString GoogleDriveManager::getApiUrl(const QString &endpoint) const
 {
-    return QString("%1/%2").arg(API_BASE_URL, endpoint);
+    return QString("%1/%2").arg(m_apiBaseUrl, endpoint);
+}
+
+QString GoogleDriveManager::apiPath(const QString &endpoint) const
+{
+    return QString("%1/%2").arg(QUrl(m_apiBaseUrl).path(), endpoint);
 }
 
-void GoogleDriveManager::trackRequest(QNetworkReply *reply, const QString &requestType, const QString &noteId)
+void GoogleDriveManager::enqueueBatchItem(const DriveBatchItem &item)
 {
-    if (reply) {
-        reply->setProperty("requestType", requestType);
-        if (!noteId.isEmpty()) {
-            reply->setProperty("noteId", noteId);
+    m_batchQueue.append(item);
+    if (!m_batchQueue.last().context.started.isValid()) {
+        m_batchQueue.last().context.started.start();
+    }
+    
+    if (m_batchQueue.size() >= DriveBatch::MaxItemsPerBatch) {
+        flushBatch();
+    } else if (!m_batchTimer->isActive()) {
+        m_batchTimer->start(0);
+    }
+}
+
+void GoogleDriveManager::flushBatch()
+{
+    m_batchTimer->stop();
+    
+    while (!m_batchQueue.isEmpty()) {
+        QList<DriveBatchItem> items = m_batchQueue.mid(0, DriveBatch::MaxItemsPerBatch);
+        m_batchQueue = m_batchQueue.mid(items.size());
+        
+        // A lone operation gains nothing from the multipart envelope
+        if (items.size() == 1) {
+            sendBatchItem(items.first());
+            continue;
+        }
+        
+        QByteArray boundary = DriveBatch::makeBoundary();
+        QNetworkRequest request{QUrl(m_batchUrl)};
+        addAuthHeader(request);
+        request.setHeader(QNetworkRequest::ContentTypeHeader, QByteArray("multipart/mixed; boundary=") + boundary);
+        
+        // The envelope can be replayed as a whole only if every call in it can
+        bool idempotent = true;
+        for (const DriveBatchItem &item : items) {
+            idempotent = idempotent && item.method != "POST";
         }
+        
+        PendingRequest pending;
+        pending.context = DriveRequestContext(DriveRequestType::Batch);
+        pending.verb = "POST";
+        pending.request = request;
+        pending.body = DriveBatch::encode(items, boundary);
+        pending.idempotent = idempotent;
+        pending.batchItems = items;
+        dispatchRequest(pending);
+        
+        qDebug() << "Batch request sent with" << items.size() << "operations";
     }
 }
 
-void GoogleDriveManager::startTokenRefreshTimer()
+void GoogleDriveManager::sendBatchItem(const DriveBatchItem &item)
 {
-    // Check token every 5 minutes
-    m_tokenRefreshTimer->start(5 * 60 * 1000);
+    QUrl url = QUrl(m_apiBaseUrl).resolved(QUrl(item.path));
+    QNetworkRequest request(url);
+    addAuthHeader(request);
+    if (!item.body.isEmpty()) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    }
+    
+    sendRequest(item.method, request, item.body, item.method != "POST", item.context);
 }
 
-void GoogleDriveManager::refreshTokenIfNeeded()
+void GoogleDriveManager::sendRequest(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body,
+                                     bool idempotent, const DriveRequestContext &context, int attempt)
 {
-    qDebug() << "Checking if token refresh is needed...";
-    qDebug() << "Token expiry:" << m_tokenExpiry.toString();
-    qDebug() << "Current time:" << QDateTime::currentDateTime().toString();
+    PendingRequest pending;
+    pending.context = context;
+    pending.verb = verb;
+    pending.request = request;
+    pending.body = body;
+    pending.idempotent = idempotent;
+    pending.attempt = attempt;
+    dispatchRequest(pending);
+}
+
+void GoogleDriveManager::dispatchRequest(const PendingRequest &pending)
+{
+    const DriveRequestContext &context = pending.context;
+    if (isUploadSuperseded(context.localNoteId, context.uploadGeneration)) {
+        qDebug() << "Dropping superseded upload for local note:" << context.localNoteId;
+        m_uploadJobs.remove(context.uploadJobId);
+        return;
+    }
+    
+    QNetworkRequest request = pending.request;
+    if (request.hasRawHeader("Authorization")) {
+        // Wait for a fresh token rather than sending one Drive is about to reject
+        if (m_tokenRefreshInFlight || isTokenExpiring(TOKEN_EXPIRY_SKEW_SECS)) {
+            parkRequest(pending);
+            return;
+        }
+        // Requests parked or retried since they were built pick up the current token
+        addAuthHeader(request);
+    }
     
-    if (m_tokenExpiry.isValid()) {
-        int secondsToExpiry = QDateTime::currentDateTime().secsTo(m_tokenExpiry);
-        qDebug() << "Seconds until token expiry:" << secondsToExpiry;
+    QNetworkReply *reply;
+    qint64 heldBytes = pending.body.size();
+    if (pending.streamsUploadBody) {
+        // Content requests read the body from the job each time they go out,
+        // it lives only as long as the request
+        QByteArray body = uploadBody(context.uploadJobId);
+        if (body.isEmpty()) {
+            finishUploadJob(context.uploadJobId, context.noteId, false);
+            return;
+        }
+        heldBytes = body.size();
         
-        if (secondsToExpiry < 300) {
-            qDebug() << "Token expires soon, refreshing...";
-            refreshToken();
+        auto *device = new QBuffer;
+        device->setData(body);
+        device->open(QIODevice::ReadOnly);
+        if (pending.verb == "PUT") {
+            reply = m_networkManager->put(request, device);
         } else {
-            qDebug() << "Token is still valid";
+            reply = m_networkManager->sendCustomRequest(request, pending.verb, device);
         }
+        device->setParent(reply);
+    } else if (pending.verb == "GET") {
+        reply = m_networkManager->get(request);
+    } else if (pending.verb == "POST") {
+        reply = m_networkManager->post(request, pending.body);
+    } else if (pending.verb == "PUT") {
+        reply = m_networkManager->put(request, pending.body);
     } else {
-        qDebug() << "Token expiry is not valid";
+        reply = m_networkManager->sendCustomRequest(request, pending.verb, pending.body);
+    }
+    
+    PendingRequest sent = pending;
+    sent.request = request;
+    sent.heldBytes = heldBytes;
+    holdSentRequest(reply, sent);
+}
+
+void GoogleDriveManager::holdSentRequest(QNetworkReply *reply, const PendingRequest &pending)
+{
+    PendingRequest held = pending;
+    if (!held.context.started.isValid()) {
+        held.context.started.start();
+    }
+    m_sentRequests.insert(reply, held);
+    m_inFlightBytes += pending.heldBytes;
+    emit inFlightBytesChanged(m_inFlightBytes);
+    
+    METRIC_COUNTER("drive.requests").add();
+    METRIC_COUNTER("drive.bytes_sent").add(quint64(pending.heldBytes));
+    METRIC_GAUGE("drive.requests_in_flight").set(m_sentRequests.size());
+    METRIC_GAUGE("drive.bytes_in_flight").set(m_inFlightBytes);
+    
+    if (!pending.batchItems.isEmpty()) {
+        m_inFlightBatches.insert(reply, pending.batchItems);
+    }
+    if (!pending.context.localNoteId.isEmpty()) {
+        m_activeUploads.insert(pending.context.localNoteId, reply);
+    }
+    if (pending.context.type == DriveRequestType::DownloadStream) {
+        streamReply(reply, pending.context.fileId);
+    }
+    
+    // Each reply completes through the context it was sent with
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        onReplyFinished(reply);
+    });
+}
+
+GoogleDriveManager::PendingRequest GoogleDriveManager::releaseSentRequest(QNetworkReply *reply)
+{
+    PendingRequest pending = m_sentRequests.take(reply);
+    if (pending.heldBytes > 0) {
+        m_inFlightBytes -= pending.heldBytes;
+        emit inFlightBytesChanged(m_inFlightBytes);
+    }
+    
+    // Streamed bodies were counted as they arrived and are empty here
+    METRIC_COUNTER("drive.bytes_received").add(quint64(reply->bytesAvailable()));
+    METRIC_GAUGE("drive.requests_in_flight").set(m_sentRequests.size());
+    METRIC_GAUGE("drive.bytes_in_flight").set(m_inFlightBytes);
+    return pending;
+}
+
+qint64 GoogleDriveManager::inFlightBytes() const
+{
+    return m_inFlightBytes;
+}
+
+bool GoogleDriveManager::retryIfTransient(QNetworkReply *reply, PendingRequest pending)
+{
+    if (reply->error() == QNetworkReply::NoError) {
+        recordRequestOutcome(false);
+        return false;
+    }
+    
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    // Peek so the handler can still read the error body if we give up
+    QByteArray body = reply->peek(4096);
+    bool transient = m_retryPolicy.isTransient(statusCode, reply->error(), body);
+    int delay = m_retryPolicy.retryDelayMs(pending.attempt, statusCode, reply->error(), pending.idempotent,
+                                           reply->rawHeader("Retry-After"), body);
+    if (delay < 0) {
+        recordRequestOutcome(transient);
+        return false;
+    }
+    
+    m_inFlightBatches.remove(reply);
+    METRIC_COUNTER("drive.retries").add();
+    
+    qDebug() << "Retrying" << driveRequestTypeName(pending.context.type) << "request in" << delay << "ms"
+             << "(attempt" << pending.attempt + 1 << "of" << m_retryPolicy.maxAttempts() << ")"
+             << "HTTP status:" << statusCode << "error:" << reply->errorString();
+    
+    reply->deleteLater();
+    pending.attempt++;
+    
+    QTimer::singleShot(delay, this, [this, pending]() {
+        if (pending.context.type == DriveRequestType::DownloadStream) {
+            // The body is sent again from the start
+            emit noteDownloadRestarted(pending.context.fileId);
+        }
+        dispatchRequest(pending);
+    });
+    return true;
+}
+
+bool GoogleDriveManager::replayAfterTokenRefresh(QNetworkReply *reply, PendingRequest pending)
+{
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode != 401 || pending.authReplayed || !pending.request.hasRawHeader("Authorization")
+        || m_refreshToken.isEmpty()) {
+        return false;
+    }
+    
+    qDebug() << "Access token rejected for" << driveRequestTypeName(pending.context.type)
+             << "request, replaying it with a refreshed token";
+    m_inFlightBatches.remove(reply);
+    reply->deleteLater();
+    pending.authReplayed = true;
+    METRIC_COUNTER("drive.auth_replays").add();
+    
+    if (pending.request.rawHeader("Authorization") == QString("Bearer %1").arg(m_accessToken).toUtf8()) {
+        // Sent with the current token, so that one is dead whatever its expiry says
+        m_tokenExpiry = QDateTime::currentDateTime();
+        parkRequest(pending);
+    } else {
+        // The token was refreshed while this request was out
+        dispatchRequest(pending);
+    }
+    return true;
+}
+
+void GoogleDriveManager::parkRequest(const PendingRequest &pending)
+{
+    qDebug() << "Parking" << driveRequestTypeName(pending.context.type) << "request until the token is refreshed";
+    m_parkedRequests.append(pending);
+    refreshToken();
+}
+
+void GoogleDriveManager::releaseParkedRequests()
+{
+    if (m_parkedRequests.isEmpty()) {
+        return;
+    }
+    qDebug() << "Token refreshed, releasing" << m_parkedRequests.size() << "parked requests";
+    
+    QList<PendingRequest> parked;
+    parked.swap(m_parkedRequests);
+    for (const PendingRequest &pending : parked) {
+        dispatchRequest(pending);
+    }
+}
+
+void GoogleDriveManager::failParkedRequests(const QString &reason)
+{
+    QList<PendingRequest> parked;
+    parked.swap(m_parkedRequests);
+    
+    // Parked requests never got a reply; hand their handlers a failed one
+    for (const PendingRequest &pending : parked) {
+        QList<DriveBatchItem> items = pending.batchItems;
+        if (items.isEmpty()) {
+            DriveBatchItem item;
+            item.method = pending.verb;
+            item.path = pending.request.url().toString();
+            item.context = pending.context;
+            items.append(item);
+        }
+        for (const DriveBatchItem &item : items) {
+            auto *failed = new DriveBatchPartReply(item, QNetworkReply::AuthenticationRequiredError, reason, this);
+            completeRequest(failed, item.context);
+            failed->deleteLater();
+        }
+    }
+}
+
+bool GoogleDriveManager::isTokenExpiring(int withinSecs) const
+{
+    return m_tokenExpiry.isValid() && QDateTime::currentDateTime().secsTo(m_tokenExpiry) < withinSecs;
+}
+
+bool GoogleDriveManager::retryBatchItem(const DriveBatchItem &item, const DriveBatchResponse &response)
+{
+    if (response.statusCode >= 200 && response.statusCode < 300) {
+        return false;
+    }
+    
+    QByteArray retryAfter;
+    for (const auto &header : response.headers) {
+        if (header.first.toLower() == "retry-after") {
+            retryAfter = header.second;
+        }
+    }
+    
+    int attempt = item.context.batchAttempt;
+    int delay = m_retryPolicy.retryDelayMs(attempt, response.statusCode, QNetworkReply::UnknownServerError,
+                                           item.method != "POST", retryAfter, response.body);
+    if (delay < 0) {
+        return false;
+    }
+    
+    qDebug() << "Re-queueing" << driveRequestTypeName(item.context.type) << "batch operation in" << delay << "ms, HTTP status:" << response.statusCode;
+    
+    DriveBatchItem retryItem = item;
+    retryItem.context.batchAttempt = attempt + 1;
+    QTimer::singleShot(delay, this, [this, retryItem]() {
+        enqueueBatchItem(retryItem);
+    });
+    return true;
+}
+
+void GoogleDriveManager::recordRequestOutcome(bool transientFailure)
+{
+    if (!transientFailure) {
+        bool wasOpen = m_circuitBreaker.isOpen();
+        if (m_circuitBreaker.recordSuccess()) {
+            qDebug() << "Google Drive reachable again, circuit breaker closed";
+            m_circuitTimer->stop();
+            if (wasOpen) {
+                emit circuitBreakerChanged(false);
+            }
+        }
+        return;
+    }
+    
+    if (m_circuitBreaker.recordFailure()) {
+        int cooldown = m_circuitBreaker.remainingCooldownMs();
+        qDebug() << "Repeated transient Google Drive failures, pausing automatic sync for" << cooldown << "ms";
+        m_circuitTimer->start(cooldown);
+        emit circuitBreakerChanged(true);
+    }
+}
+
+bool GoogleDriveManager::isCircuitOpen() const
+{
+    return m_circuitBreaker.isOpen();
+}
+
+DriveRequestContext GoogleDriveManager::uploadContext(DriveRequestType type, quint64 jobId) const
+{
+    const UploadJob job = m_uploadJobs.value(jobId);
+    DriveRequestContext context(type);
+    context.title = job.title;
+    context.localNoteId = job.localNoteId;
+    context.uploadGeneration = m_uploadGenerations.value(job.localNoteId);
+    context.uploadJobId = jobId;
+    return context;
+}
+
+bool GoogleDriveManager::isUploadSuperseded(const QString &localNoteId, int generation) const
+{
+    return !localNoteId.isEmpty() && m_uploadGenerations.value(localNoteId) != generation;
+}
+
+void GoogleDriveManager::reportUpload(const QString &localNoteId, const QString &remoteId, bool success)
+{
+    emit uploadComplete(remoteId, success);
+    if (!localNoteId.isEmpty()) {
+        emit localNoteUploaded(localNoteId, remoteId, success);
     }
+}
+
+void GoogleDriveManager::cancelUploads(const QString &localNoteId)
+{
+    // Bumping the generation also stops pending retries and chained content uploads
+    m_uploadGenerations[localNoteId]++;
     
-    // Check if token is already expired
-    if (m_tokenExpiry.isValid() && QDateTime::currentDateTime() >= m_tokenExpiry) {
-        qDebug() << "Token is expired, attempting refresh...";
-        if (!m_refreshToken.isEmpty()) {
-            refreshToken();
+    for (auto it = m_uploadsAwaitingFolder.begin(); it != m_uploadsAwaitingFolder.end();) {
+        if (it.value() == localNoteId) {
+            it = m_uploadsAwaitingFolder.erase(it);
         } else {
+            ++it;
+        }
+    }
+    
+    const QList<QNetworkReply*> replies = m_activeUploads.values(localNoteId);
+    m_activeUploads.remove(localNoteId);
+    for (QNetworkReply *reply : replies) {
+        qDebug() << "Cancelling superseded upload for local note:" << localNoteId;
+        auto it = m_sentRequests.find(reply);
+        if (it != m_sentRequests.end()) {
+            it->superseded = true;
+        }
+        reply->abort();
+    }
+}
+
+void GoogleDriveManager::startTokenRefreshTimer()
+{
+    // Refresh ahead of expiry so requests rarely have to wait for it. A timer
+    // that fires late, e.g. after sleep, is covered by the gate in dispatchRequest.
+    m_tokenRefreshTimer->stop();
+    if (!m_tokenExpiry.isValid() || m_refreshToken.isEmpty()) {
+        return;
+    }
+    
+    qint64 delay = QDateTime::currentDateTime().msecsTo(m_tokenExpiry) - TOKEN_REFRESH_MARGIN_SECS * 1000;
+    qDebug() << "Scheduling token refresh in" << qMax<qint64>(0, delay) / 1000 << "seconds";
+    m_tokenRefreshTimer->start(static_cast<int>(qBound<qint64>(0, delay, std::numeric_limits<int>::max())));
+}
+
+void GoogleDriveManager::refreshTokenIfNeeded()
+{
+    qDebug() << "Checking if token refresh is needed...";
+    qDebug() << "Token expiry:" << m_tokenExpiry.toString();
+    
+    if (!m_tokenExpiry.isValid()) {
+        qDebug() << "Token expiry is not valid";
+        return;
+    }
+    
+    if (!isTokenExpiring(TOKEN_REFRESH_MARGIN_SECS)) {
+        qDebug() << "Token is still valid";
+        startTokenRefreshTimer();
+        return;
+    }
+    
+    if (m_refreshToken.isEmpty()) {
+        if (isTokenExpiring(0)) {
             qDebug() << "No refresh token available, need to re-authenticate";
             m_isAuthenticated = false;
             emit authenticationChanged(false);
             emit error(makeUserFriendlyError("Access token expired and no refresh token available. Please re-authenticate."));
         }
+        return;
     }
+    
+    qDebug() << "Token expires soon, refreshing...";
+    refreshToken();
 }
 
 void GoogleDriveManager::saveTokens()
@@ -922,7 +1508,7 @@ void GoogleDriveManager::loadTokens()
 
 // Response handlers
 
-void GoogleDriveManager::handleAuthResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleAuthResponse(QNetworkReply *reply, const DriveRequestContext &)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
@@ -936,7 +1522,9 @@ void GoogleDriveManager::handleAuthResponse(QNetworkReply *reply)
         
         m_isAuthenticated = true;
         saveTokens();
+        startTokenRefreshTimer();
         emit authenticationChanged(true);
+        releaseParkedRequests();
         
         // Get or create app data folder
         // TODO: Implement folder creation logic
@@ -945,8 +1533,10 @@ void GoogleDriveManager::handleAuthResponse(QNetworkReply *reply)
     }
 }
 
-void GoogleDriveManager::handleTokenRefresh(QNetworkReply *reply)
+void GoogleDriveManager::handleTokenRefresh(QNetworkReply *reply, const DriveRequestContext &)
 {
+    m_tokenRefreshInFlight = false;
+    
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
         QJsonObject response = doc.object();
@@ -957,16 +1547,19 @@ void GoogleDriveManager::handleTokenRefresh(QNetworkReply *reply)
         m_tokenExpiry = QDateTime::currentDateTime().addSecs(expiresIn);
         
         saveTokens();
+        startTokenRefreshTimer();
+        releaseParkedRequests();
     } else {
         emit error(makeUserFriendlyError("Token refresh failed: " + reply->errorString()));
         m_isAuthenticated = false;
+        failParkedRequests("Token refresh failed: " + reply->errorString());
         emit authenticationChanged(false);
     }
 }
 
-void GoogleDriveManager::handleUploadResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleUploadResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
-    QString noteId = reply->property("noteId").toString();
+    QString noteId = context.noteId;
     bool success = (reply->error() == QNetworkReply::NoError);
     
     qDebug() << "Upload response received for note ID:" << noteId;
@@ -993,57 +1586,25 @@ void GoogleDriveManager::handleUploadResponse(QNetworkReply *reply)
     emit uploadComplete(noteId, success);
 }
 
-void GoogleDriveManager::handleUploadMetadataResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleUploadMetadataResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
-    QString noteId = reply->property("noteId").toString();
-    QString content = reply->property("content").toString();
-    QString title = reply->property("title").toString();
-    QString folderId = reply->property("folderId").toString();
+    quint64 jobId = context.uploadJobId;
+    QString noteId = context.noteId;
+    QString title = context.title;
+    QString localNoteId = context.localNoteId;
+    int uploadGeneration = context.uploadGeneration;
     
     qDebug() << "Upload metadata response received for note:" << title;
-    qDebug() << "Content length from property:" << content.length();
-    qDebug() << "Content preview from property:" << content.mid(0, 200) + "...";
-    qDebug() << "Content (full) from property:" << content;
     
     if (reply->error() == QNetworkReply::NoError) {
         // For resumable uploads, we need to check the response headers for the upload session URL
         QByteArray responseData = reply->readAll();
         QString locationHeader = reply->rawHeader("Location");
         
-            if (!locationHeader.isEmpty()) {
+        if (!locationHeader.isEmpty()) {
             qDebug() << "Got resumable upload session URL:" << locationHeader;
-            // Validate content before uploading
-            if (content.isEmpty()) {
-                qDebug() << "ERROR: Content is empty, cannot upload!";
-                emit uploadComplete(noteId, false);
-                return;
-            }
-            
-            // Check if content is just whitespace
-            if (content.trimmed().isEmpty()) {
-                qDebug() << "ERROR: Content is only whitespace, cannot upload!";
-                emit uploadComplete(noteId, false);
-                return;
-            }
-            
-            // Check if content is just the title (which would indicate an error)
-            if (content.trimmed() == title.trimmed()) {
-                qDebug() << "WARNING: Content appears to be just the title, this might indicate an error";
-                qDebug() << "Title:" << title;
-                qDebug() << "Content:" << content;
-                qDebug() << "This suggests the content parameter is not being passed correctly!";
-            }
-            
-            // Check if content contains markdown-like content
-            if (content.contains("#") || content.contains("*") || content.contains("`") || content.contains("[")) {
-                qDebug() << "Content appears to contain markdown formatting - good!";
-            } else {
-                qDebug() << "WARNING: Content does not appear to contain markdown formatting";
-                qDebug() << "This might indicate the content is not being passed correctly";
-            }
-            
             // Use the resumable upload session URL to upload content
-            uploadFileContentToSession(locationHeader, content, title, noteId);
+            uploadFileContentToSession(jobId, locationHeader);
         } else {
             // Fallback: try to get file ID from response body
             QJsonDocument doc = QJsonDocument::fromJson(responseData);
@@ -1052,216 +1613,154 @@ void GoogleDriveManager::handleUploadMetadataResponse(QNetworkReply *reply)
             QString fileId = response["id"].toString();
             if (!fileId.isEmpty()) {
                 qDebug() << "File metadata uploaded successfully, file ID:" << fileId;
-                // Validate content before uploading
-                if (content.isEmpty()) {
-                    qDebug() << "ERROR: Content is empty, cannot upload!";
-                    emit uploadComplete(noteId, false);
-                    return;
-                }
-                
-                // Check if content is just whitespace
-                if (content.trimmed().isEmpty()) {
-                    qDebug() << "ERROR: Content is only whitespace, cannot upload!";
-                    emit uploadComplete(noteId, false);
-                    return;
-                }
-                
-                // Check if content is just the title (which would indicate an error)
-                if (content.trimmed() == title.trimmed()) {
-                    qDebug() << "WARNING: Content appears to be just the title, this might indicate an error";
-                    qDebug() << "Title:" << title;
-                    qDebug() << "Content:" << content;
-                    qDebug() << "This suggests the content parameter is not being passed correctly!";
-                }
-                
-                // Check if content contains markdown-like content
-                if (content.contains("#") || content.contains("*") || content.contains("`") || content.contains("[")) {
-                    qDebug() << "Content appears to contain markdown formatting - good!";
-                } else {
-                    qDebug() << "WARNING: Content does not appear to contain markdown formatting";
-                    qDebug() << "This might indicate the content is not being passed correctly";
-                }
                 
                 // Add a small delay before uploading content to allow Google Drive to process
-                QTimer::singleShot(1000, [this, fileId, content, title, noteId]() {
-                    uploadFileContent(fileId, content, title, noteId);
+                QTimer::singleShot(1000, this, [this, jobId, fileId, localNoteId, uploadGeneration]() {
+                    if (isUploadSuperseded(localNoteId, uploadGeneration)) {
+                        qDebug() << "Skipping content upload superseded by a newer edit for local note:" << localNoteId;
+                        m_uploadJobs.remove(jobId);
+                        return;
+                    }
+                    uploadFileContent(jobId, fileId);
                 });
             } else {
                 qDebug() << "No file ID found in response, upload failed";
-                emit uploadComplete(noteId, false);
+                finishUploadJob(jobId, noteId, false);
             }
         }
         
     } else {
         qDebug() << "Upload metadata failed with error:" << reply->errorString();
         qDebug() << "HTTP status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        emit uploadComplete(noteId, false);
+        finishUploadJob(jobId, noteId, false);
     }
 }
 
-void GoogleDriveManager::uploadFileContent(const QString &fileId, const QString &content, const QString &title, const QString &noteId)
+void GoogleDriveManager::uploadFileContent(quint64 jobId, const QString &fileId)
 {
-    qDebug() << "Uploading file content for:" << title << "with file ID:" << fileId;
-    qDebug() << "Content length:" << content.length();
-    qDebug() << "Content preview:" << content.mid(0, 200) + "...";
-    
-    // Validate content before uploading
-    if (content.isEmpty()) {
-        qDebug() << "ERROR: Content is empty, cannot upload!";
-        emit uploadComplete(noteId.isEmpty() ? fileId : noteId, false);
+    if (!m_uploadJobs.contains(jobId)) {
         return;
     }
+    UploadJob job = m_uploadJobs.value(jobId);
+    qDebug() << "Uploading file content for:" << job.title << "with file ID:" << fileId;
     
-    // Check if content is just whitespace
-    if (content.trimmed().isEmpty()) {
-        qDebug() << "ERROR: Content is only whitespace, cannot upload!";
-        emit uploadComplete(noteId.isEmpty() ? fileId : noteId, false);
-        return;
-    }
-    
-    // Check if content is just the title (which would indicate an error)
-    if (content.trimmed() == title.trimmed()) {
-        qDebug() << "WARNING: Content appears to be just the title, this might indicate an error";
-        qDebug() << "Title:" << title;
-        qDebug() << "Content:" << content;
-        qDebug() << "This suggests the content parameter is not being passed correctly!";
-    }
-    
-    // Check if content contains markdown-like content
-    if (content.contains("#") || content.contains("*") || content.contains("`") || content.contains("[")) {
-        qDebug() << "Content appears to contain markdown formatting - good!";
-    } else {
-        qDebug() << "WARNING: Content does not appear to contain markdown formatting";
-        qDebug() << "This might indicate the content is not being passed correctly";
-    }
-    
-    // Upload the content to the file
-    QString url = QString("%1/files/%2?alt=media").arg(API_BASE_URL, fileId);
+    // Upload the content to the file, a media upload replaces only its content
+    QString url = QString("%1/files/%2?uploadType=media").arg(m_uploadBaseUrl, fileId);
     
     QNetworkRequest request{QUrl(url)};
     addAuthHeader(request);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "text/markdown; charset=utf-8");
     
-    QByteArray contentData = content.toUtf8();
-    qDebug() << "Content data size (UTF-8):" << contentData.size();
-    qDebug() << "Content data preview (hex):" << contentData.left(100).toHex();
-    
-    QNetworkReply *reply = m_networkManager->put(request, contentData);
+    DriveRequestContext context = uploadContext(DriveRequestType::UploadContent, jobId);
+    context.noteId = fileId;
+    context.fileId = fileId;
     
-    // Store properties for response handling
-    reply->setProperty("fileId", fileId);
-    reply->setProperty("title", title);
-    reply->setProperty("noteId", noteId);
-    
-    trackRequest(reply, "upload_content", fileId);
+    sendUploadBody("PATCH", request, context);
     
     qDebug() << "Content upload request sent for file:" << fileId;
 }
 
-void GoogleDriveManager::uploadFileContentToSession(const QString &sessionUrl, const QString &content, const QString &title, const QString &noteId)
+void GoogleDriveManager::uploadFileContentToSession(quint64 jobId, const QString &sessionUrl)
 {
-    qDebug() << "Uploading file content to resumable session for:" << title;
-    qDebug() << "Content length:" << content.length();
-    qDebug() << "Content preview:" << content.mid(0, 200) + "...";
-    
-    // Validate content before uploading
-    if (content.isEmpty()) {
-        qDebug() << "ERROR: Content is empty, cannot upload!";
-        emit uploadComplete(noteId, false);
-        return;
-    }
-    
-    // Check if content is just whitespace
-    if (content.trimmed().isEmpty()) {
-        qDebug() << "ERROR: Content is only whitespace, cannot upload!";
-        emit uploadComplete(noteId, false);
+    if (!m_uploadJobs.contains(jobId)) {
         return;
     }
-    
-    // Check if content is just the title (which would indicate an error)
-    if (content.trimmed() == title.trimmed()) {
-        qDebug() << "WARNING: Content appears to be just the title, this might indicate an error";
-        qDebug() << "Title:" << title;
-        qDebug() << "Content:" << content;
-        qDebug() << "This suggests the content parameter is not being passed correctly!";
-    }
-    
-    // Check if content contains markdown-like content
-    if (content.contains("#") || content.contains("*") || content.contains("`") || content.contains("[")) {
-        qDebug() << "Content appears to contain markdown formatting - good!";
-    } else {
-        qDebug() << "WARNING: Content does not appear to contain markdown formatting";
-        qDebug() << "This might indicate the content is not being passed correctly";
-    }
+    UploadJob job = m_uploadJobs.value(jobId);
+    qDebug() << "Uploading file content to resumable session for:" << job.title;
     
     QNetworkRequest request{QUrl(sessionUrl)};
     // No need to add auth header for resumable upload session URLs
     request.setHeader(QNetworkRequest::ContentTypeHeader, "text/markdown; charset=utf-8");
     
-    QByteArray contentData = content.toUtf8();
-    qDebug() << "Content data size (UTF-8):" << contentData.size();
-    qDebug() << "Content data preview (hex):" << contentData.left(100).toHex();
+    // Re-sending the whole body to the session URL replaces any partial upload
+    DriveRequestContext context = uploadContext(DriveRequestType::UploadSession, jobId);
+    context.noteId = job.remoteId;
     
-    QNetworkReply *reply = m_networkManager->put(request, contentData);
+    sendUploadBody("PUT", request, context);
     
-    // Store properties for response handling
-    reply->setProperty("sessionUrl", sessionUrl);
-    reply->setProperty("title", title);
-    reply->setProperty("noteId", noteId);
-    
-    trackRequest(reply, "upload_session", noteId);
+    qDebug() << "Content upload to session sent for:" << job.title;
+}
+
+void GoogleDriveManager::sendUploadBody(const QByteArray &verb, const QNetworkRequest &request,
+                                        const DriveRequestContext &context)
+{
+    PendingRequest pending;
+    pending.context = context;
+    pending.verb = verb;
+    pending.request = request;
+    pending.idempotent = true;
+    pending.streamsUploadBody = true;
+    dispatchRequest(pending);
+}
+
+QByteArray GoogleDriveManager::uploadBody(quint64 jobId) const
+{
+    auto it = m_uploadJobs.constFind(jobId);
+    if (it == m_uploadJobs.constEnd() || !it->body) {
+        return QByteArray();
+    }
     
-    qDebug() << "Content upload to session sent for:" << title;
+    QByteArray body = it->body();
+    if (body.trimmed().isEmpty()) {
+        qDebug() << "ERROR: Content is empty, cannot upload:" << it->title;
+        return QByteArray();
+    }
+    return body;
 }
 
-void GoogleDriveManager::handleUploadContentResponse(QNetworkReply *reply)
+void GoogleDriveManager::finishUploadJob(quint64 jobId, const QString &remoteId, bool success)
 {
-    QString fileId = reply->property("fileId").toString();
-    QString title = reply->property("title").toString();
-    QString noteId = reply->property("noteId").toString();
+    UploadJob job = m_uploadJobs.take(jobId);
+    reportUpload(job.localNoteId, remoteId, success);
+}
+
+void GoogleDriveManager::handleUploadContentResponse(QNetworkReply *reply, const DriveRequestContext &context)
+{
+    quint64 jobId = context.uploadJobId;
+    QString fileId = context.fileId;
+    QString title = context.title;
     bool success = (reply->error() == QNetworkReply::NoError);
     
     qDebug() << "Upload content response received for file:" << fileId;
     qDebug() << "Success:" << success;
-    qDebug() << "Response data:" << reply->readAll();
     
     if (success) {
         qDebug() << "File content uploaded successfully for:" << title;
-        qDebug() << "HTTP status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        emit uploadComplete(noteId.isEmpty() ? fileId : noteId, true);
     } else {
         qDebug() << "File content upload failed with error:" << reply->errorString();
         qDebug() << "HTTP status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        qDebug() << "Error details:" << reply->error();
-        emit uploadComplete(noteId.isEmpty() ? fileId : noteId, false);
     }
+    finishUploadJob(jobId, fileId, success);
 }
 
-void GoogleDriveManager::handleUploadSessionResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleUploadSessionResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
-    QString title = reply->property("title").toString();
-    QString noteId = reply->property("noteId").toString();
+    quint64 jobId = context.uploadJobId;
+    QString title = context.title;
+    QString noteId = context.noteId;
     bool success = (reply->error() == QNetworkReply::NoError);
+    QByteArray responseData = reply->readAll();
     
     qDebug() << "Upload session response received for:" << title;
     qDebug() << "Success:" << success;
-    qDebug() << "Response data:" << reply->readAll();
     
     if (success) {
         qDebug() << "File content uploaded successfully via session for:" << title;
-        qDebug() << "HTTP status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        emit uploadComplete(noteId, true);
+        
+        // A completed session answers with the file resource, which carries the ID of new files
+        if (noteId.isEmpty()) {
+            noteId = QJsonDocument::fromJson(responseData).object()["id"].toString();
+        }
     } else {
         qDebug() << "File content upload via session failed with error:" << reply->errorString();
         qDebug() << "HTTP status code:" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        qDebug() << "Error details:" << reply->error();
-        emit uploadComplete(noteId, false);
     }
+    finishUploadJob(jobId, noteId, success);
 }
 
-void GoogleDriveManager::handleDownloadResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleDownloadResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
-    QString noteId = reply->property("noteId").toString();
+    QString noteId = context.noteId;
     bool success = (reply->error() == QNetworkReply::NoError);
     QString content;
     
@@ -1272,15 +1771,95 @@ void GoogleDriveManager::handleDownloadResponse(QNetworkReply *reply)
     emit downloadComplete(noteId, content, success);
 }
 
-void GoogleDriveManager::handleDeleteResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleStreamedDownloadResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
-    QString noteId = reply->property("noteId").toString();
+    QString fileId = context.fileId;
     bool success = (reply->error() == QNetworkReply::NoError);
     
+    if (success) {
+        // Whatever arrived after the last readyRead
+        QByteArray rest = reply->readAll();
+        if (!rest.isEmpty()) {
+            emit noteDataReceived(fileId, rest);
+        }
+    } else {
+        qDebug() << "Streamed download failed for file:" << fileId << "error:" << reply->errorString();
+    }
+    
+    emit noteStreamFinished(fileId, success);
+}
+
+void GoogleDriveManager::handleDeleteResponse(QNetworkReply *reply, const DriveRequestContext &context)
+{
+    QString noteId = context.noteId;
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    // A file that is already gone counts as deleted
+    bool success = (reply->error() == QNetworkReply::NoError) || statusCode == 404;
+    
     emit deleteComplete(noteId, success);
 }
 
-void GoogleDriveManager::handleListResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleUpdateMetadataResponse(QNetworkReply *reply, const DriveRequestContext &context)
+{
+    QString fileId = context.fileId;
+    QString localNoteId = context.localNoteId;
+    bool success = (reply->error() == QNetworkReply::NoError);
+    
+    if (!success) {
+        qDebug() << "Metadata update failed for file:" << fileId << "error:" << reply->errorString();
+    }
+    
+    emit metadataUpdated(fileId, success);
+    
+    // Renames and moves of local notes complete like an upload
+    if (!localNoteId.isEmpty()) {
+        if (isUploadSuperseded(localNoteId, context.uploadGeneration)) {
+            qDebug() << "Ignoring metadata update superseded by a newer edit for local note:" << localNoteId;
+            return;
+        }
+        reportUpload(localNoteId, fileId, success);
+    }
+}
+
+void GoogleDriveManager::handleBatchResponse(QNetworkReply *reply, const DriveRequestContext &)
+{
+    QList<DriveBatchItem> items = m_inFlightBatches.take(reply);
+    
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Batch request failed with error:" << reply->errorString();
+        
+        // Every operation in the batch failed the same way
+        for (const DriveBatchItem &item : items) {
+            auto *part = new DriveBatchPartReply(item, reply->error(), reply->errorString(), this);
+            completeRequest(part, item.context);
+            part->deleteLater();
+        }
+        return;
+    }
+    
+    QByteArray boundary = DriveBatch::boundaryFromContentType(reply->rawHeader("Content-Type"));
+    QMap<int, DriveBatchResponse> responses = DriveBatch::decode(reply->readAll(), boundary);
+    
+    qDebug() << "Batch response received:" << responses.size() << "of" << items.size() << "operations answered";
+    
+    // Hand each part to the handler of the request it came from
+    for (int i = 0; i < items.size(); ++i) {
+        if (responses.contains(i) && retryBatchItem(items[i], responses.value(i))) {
+            continue;
+        }
+        
+        DriveBatchPartReply *part;
+        if (responses.contains(i)) {
+            part = new DriveBatchPartReply(items[i], responses.value(i), this);
+        } else {
+            part = new DriveBatchPartReply(items[i], QNetworkReply::ProtocolFailure, "Missing response in batch", this);
+        }
+        completeRequest(part, items[i].context);
+        part->deleteLater();
+    }
+}
+
+void GoogleDriveManager::handleListResponse(QNetworkReply *reply, const DriveRequestContext &)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
@@ -1293,10 +1872,50 @@ void GoogleDriveManager::handleListResponse(QNetworkReply *reply)
     }
 }
 
-void GoogleDriveManager::handleCreateResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleListAllResponse(QNetworkReply *reply, const DriveRequestContext &context)
+{
+    QString folderId = context.folderId;
+    QString folderName = context.folderName;
+    m_pendingListPages--;
+    
+    if (reply->error() == QNetworkReply::NoError) {
+        QJsonObject response = QJsonDocument::fromJson(reply->readAll()).object();
+        const QJsonArray files = response["files"].toArray();
+        
+        for (const QJsonValue &value : files) {
+            QJsonObject file = value.toObject();
+            if (file["mimeType"].toString() == "application/vnd.google-apps.folder") {
+                // Notes live one level below the notes folder
+                if (folderName.isEmpty()) {
+                    m_remoteFolderIds[file["name"].toString()] = file["id"].toString();
+                    listFolderContents(file["id"].toString(), file["name"].toString());
+                }
+                continue;
+            }
+            m_listedNotes.append(remoteNoteFromJson(file, folderName));
+        }
+        
+        QString nextPageToken = response["nextPageToken"].toString();
+        if (!nextPageToken.isEmpty()) {
+            listFolderContents(folderId, folderName, nextPageToken);
+        }
+    } else {
+        qDebug() << "Failed to list folder" << folderName << ":" << reply->errorString();
+        m_listingFailed = true;
+    }
+    
+    if (m_pendingListPages == 0) {
+        qDebug() << "Full listing found" << m_listedNotes.size() << "notes" << (m_listingFailed ? "(incomplete)" : "");
+        QList<RemoteNoteFile> notes = m_listedNotes;
+        m_listedNotes.clear();
+        emit remoteNotesListed(notes, !m_listingFailed);
+    }
+}
+
+void GoogleDriveManager::handleCreateResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
     // Same as upload response for new files
-    handleUploadResponse(reply);
+    handleUploadResponse(reply, context);
 }
 
 void GoogleDriveManager::createNotesFolder()
@@ -1318,7 +1937,7 @@ void GoogleDriveManager::findExistingNotesFolder()
     }
     
     // Search for existing "Notes App" folder
-    QUrl url(API_BASE_URL + "/files");
+    QUrl url(m_apiBaseUrl + "/files");
     QUrlQuery query;
     query.addQueryItem("q", "name='Notes App' and mimeType='application/vnd.google-apps.folder' and trashed=false");
     query.addQueryItem("fields", "files(id,name)");
@@ -1334,8 +1953,7 @@ void GoogleDriveManager::findExistingNotesFolder()
     qDebug() << "Searching for existing Notes App folder...";
     qDebug() << "URL:" << url.toString();
     
-    QNetworkReply *reply = m_networkManager->get(request);
-    trackRequest(reply, "find_folder", "");
+    sendRequest("GET", request, QByteArray(), true, DriveRequestContext(DriveRequestType::FindFolder));
 }
 
 void GoogleDriveManager::createNewNotesFolder()
@@ -1346,7 +1964,7 @@ void GoogleDriveManager::createNewNotesFolder()
     }
     
     // Create the notes folder in Google Drive
-    QUrl url(API_BASE_URL + "/files");
+    QUrl url(m_apiBaseUrl + "/files");
     QNetworkRequest request(url);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     addAuthHeader(request);
@@ -1361,8 +1979,7 @@ void GoogleDriveManager::createNewNotesFolder()
     QJsonDocument doc(folderMetadata);
     QByteArray data = doc.toJson();
     
-    QNetworkReply *reply = m_networkManager->post(request, data);
-    trackRequest(reply, "create_folder", "");
+    sendRequest("POST", request, data, false, DriveRequestContext(DriveRequestType::CreateFolder));
     
     qDebug() << "Creating new Notes App folder in Google Drive...";
     qDebug() << "URL:" << url.toString();
@@ -1379,7 +1996,7 @@ bool GoogleDriveManager::isStructureChecked() const
     return m_structureChecked;
 }
 
-void GoogleDriveManager::handleCreateFolderResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleCreateFolderResponse(QNetworkReply *reply, const DriveRequestContext &)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
@@ -1409,37 +2026,49 @@ void GoogleDriveManager::handleCreateFolderResponse(QNetworkReply *reply)
     }
 }
 
-void GoogleDriveManager::handleCreateSubfolderResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleCreateSubfolderResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
+    m_foldersBeingCreated.remove(context.folderName);
+    const QList<QString> awaitingUploads = m_uploadsAwaitingFolder.values(context.folderName);
+    m_uploadsAwaitingFolder.remove(context.folderName);
+    
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
         QJsonObject response = doc.object();
         
         QString folderId = response["id"].toString();
         QString folderName = response["name"].toString();
+        if (folderName.isEmpty()) {
+            folderName = context.folderName;
+        }
         
         qDebug() << "Successfully created subfolder:" << folderName << "with ID:" << folderId;
         
         // Store the subfolder ID for future use
         m_subfolderIds[folderName] = folderId;
+        m_remoteFolderIds[folderName] = folderId;
         qDebug() << "Stored subfolder ID:" << folderName << "->" << folderId;
-        
-        // Move to next subfolder or start uploading notes
-        m_pendingSubfolderIndex++;
-        createNextSubfolder();
-        
+        emit remoteFolderReady(folderName);
     } else {
         QString errorMsg = "Failed to create subfolder: " + reply->errorString();
         qDebug() << errorMsg;
         emit error(errorMsg);
         
-        // Even on error, try to continue with next subfolder
-        m_pendingSubfolderIndex++;
-        createNextSubfolder();
+        // Uploads that waited for the folder fail with it, so their attempts are counted
+        for (const QString &localNoteId : awaitingUploads) {
+            reportUpload(localNoteId, QString(), false);
+        }
+    }
+    
+    // Once every queued subfolder has answered (even on error), start uploading notes
+    if (m_pendingSubfolderCreates > 0 && --m_pendingSubfolderCreates == 0) {
+        qDebug() << "All subfolders processed, starting note uploads...";
+        qDebug() << "Available subfolder IDs:" << m_subfolderIds;
+        startNoteUploads();
     }
 }
 
-void GoogleDriveManager::handleFindFolderResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleFindFolderResponse(QNetworkReply *reply, const DriveRequestContext &)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
@@ -1476,7 +2105,7 @@ void GoogleDriveManager::handleFindFolderResponse(QNetworkReply *reply)
     }
 }
 
-void GoogleDriveManager::handleListSubfoldersResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleListSubfoldersResponse(QNetworkReply *reply, const DriveRequestContext &)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
@@ -1499,18 +2128,17 @@ void GoogleDriveManager::handleListSubfoldersResponse(QNetworkReply *reply)
         // Mark structure as checked
         m_structureChecked = true;
         
-        // Now check notes in each existing subfolder
+        // Now check notes in each existing subfolder; the check finishes with the last listing
+        m_pendingFolderListings = m_remoteFolderIds.size();
+        if (m_pendingFolderListings == 0) {
+            finishStructureCheck();
+            return;
+        }
         for (const auto &folderName : m_remoteFolderIds.keys()) {
             QString folderId = m_remoteFolderIds[folderName];
             listNotesInFolder(folderId, folderName);
         }
         
-        // After checking existing structure, continue with creating any missing subfolders
-        if (!m_pendingFolderStructure.isEmpty()) {
-            qDebug() << "Structure check complete, continuing with missing subfolder creation...";
-            createNextSubfolder();
-        }
-        
     } else {
         QString errorMsg = "Failed to list subfolders: " + reply->errorString();
         qDebug() << errorMsg;
@@ -1518,14 +2146,15 @@ void GoogleDriveManager::handleListSubfoldersResponse(QNetworkReply *reply)
     }
 }
 
-void GoogleDriveManager::handleListNotesInFolderResponse(QNetworkReply *reply)
+void GoogleDriveManager::handleListNotesInFolderResponse(QNetworkReply *reply, const DriveRequestContext &context)
 {
     if (reply->error() == QNetworkReply::NoError) {
         QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
         QJsonObject response = doc.object();
         QJsonArray files = response["files"].toArray();
         
-        QString folderName = reply->property("folderName").toString();
+        QString folderName = context.folderName;
+        QString folderId = m_remoteFolderIds.value(folderName);
         qDebug() << "Found" << files.size() << "notes in subfolder:" << folderName;
         
         // Store existing note IDs and hashes
@@ -1540,25 +2169,52 @@ void GoogleDriveManager::handleListNotesInFolderResponse(QNetworkReply *reply)
                 title = title.left(title.length() - 3);
             }
             
-            m_remoteNoteIds[title] = noteId;
-            qDebug() << "Found existing note:" << title << "with ID:" << noteId;
+            QString key = remoteNoteKey(folderName, title);
+            m_remoteNoteIds[key] = noteId;
+            if (!folderId.isEmpty()) {
+                m_remoteNoteParents[noteId] = folderId;
+            }
+            
+            // Files uploaded by this app carry the local note they belong to
+            QJsonObject appProperties = note["appProperties"].toObject();
+            QString localNoteId = appProperties["notesLocalId"].toString();
+            if (!localNoteId.isEmpty()) {
+                m_remoteNotesByLocalId[localNoteId] = noteId;
+            }
+            QString contentHash = appProperties["notesContentHash"].toString();
+            if (!contentHash.isEmpty()) {
+                m_remoteNoteHashes[key] = contentHash;
+            }
+            qDebug() << "Found existing note:" << title << "with ID:" << noteId << "local ID:" << localNoteId;
         }
         
-        // Check if this was the last folder to process
-        // For now, we'll emit smart sync complete after processing notes
-        // In a more sophisticated implementation, you'd track completion of all folders
-        if (m_structureChecked && !m_remoteFolderIds.isEmpty()) {
-            qDebug() << "Smart sync structure check completed";
-            emit smartSyncComplete();
+        if (m_pendingFolderListings > 0 && --m_pendingFolderListings == 0) {
+            finishStructureCheck();
         }
         
     } else {
+        // Without every listing, existing notes would look missing and be uploaded again
+        m_pendingFolderListings = 0;
+        m_structureChecked = false;
         QString errorMsg = "Failed to list notes in folder: " + reply->errorString();
         qDebug() << errorMsg;
         emit error(errorMsg);
     }
 }
 
+void GoogleDriveManager::finishStructureCheck()
+{
+    // After checking existing structure, continue with creating any missing subfolders
+    if (!m_pendingFolderStructure.isEmpty()) {
+        qDebug() << "Structure check complete, continuing with missing subfolder creation...";
+        createMissingSubfolders();
+        return;
+    }
+    
+    qDebug() << "Smart sync structure check completed";
+    emit smartSyncComplete();
+}
+
 void GoogleDriveManager::syncSingleNote(const QString &noteId, const QString &content, const QString &title, const QString &folderName)
 {
     if (!isAuthenticated()) {
@@ -1580,40 +2236,121 @@ void GoogleDriveManager::syncSingleNote(const QString &noteId, const QString &co
     updateNoteIfChanged(noteId, content, title, folderName);
 }
 
+void GoogleDriveManager::uploadLocalNote(const NoteUpload &upload)
+{
+    if (!isAuthenticated()) {
+        reportUpload(upload.localNoteId, upload.remoteId, false);
+        return;
+    }
+    
+    if (!m_remoteFolderIds.contains(upload.folderName)) {
+        // Not a failed attempt: the caller retries once remoteFolderReady arrives,
+        // and the upload only fails if the folder cannot be created
+        if (!m_foldersBeingCreated.contains(upload.folderName)) {
+            qDebug() << "Creating missing subfolder before uploading:" << upload.title << "folder:" << upload.folderName;
+            m_foldersBeingCreated.insert(upload.folderName);
+            createFolder(upload.folderName);
+        }
+        if (upload.localNoteId.isEmpty()) {
+            reportUpload(upload.localNoteId, upload.remoteId, false);
+        } else {
+            m_uploadsAwaitingFolder.insert(upload.folderName, upload.localNoteId);
+            emit localNoteUploadDeferred(upload.localNoteId);
+        }
+        return;
+    }
+    
+    QString folderId = m_remoteFolderIds[upload.folderName];
+    
+    // A file tagged with this note in an earlier run is updated instead of duplicated
+    QString remoteId = upload.remoteId;
+    if (remoteId.isEmpty()) {
+        remoteId = remoteIdForLocalNote(upload.localNoteId);
+    }
+    
+    // Where the file currently lives, if it has to move
+    QString removeParentId = m_remoteNoteParents.value(remoteId);
+    if (removeParentId.isEmpty() && !upload.previousFolderName.isEmpty()) {
+        removeParentId = m_remoteFolderIds.value(upload.previousFolderName);
+    }
+    if (removeParentId == folderId) {
+        removeParentId.clear();
+    }
+    
+    if (!remoteId.isEmpty()) {
+        m_remoteNoteParents[remoteId] = folderId;
+    }
+    
+    if (upload.metadataOnly && !remoteId.isEmpty()) {
+        // Renames and moves only touch metadata, the content on Drive is current
+        qDebug() << "Updating metadata only for note:" << upload.title << "file:" << remoteId;
+        QJsonObject metadata;
+        metadata["name"] = upload.title + ".md";
+        metadata["appProperties"] = noteAppProperties(upload);
+        
+        DriveBatchItem item = metadataUpdateItem(remoteId, metadata, removeParentId.isEmpty() ? QString() : folderId, removeParentId);
+        item.context.localNoteId = upload.localNoteId;
+        item.context.uploadGeneration = m_uploadGenerations.value(upload.localNoteId);
+        enqueueBatchItem(item);
+        return;
+    }
+    
+    UploadJob job;
+    job.localNoteId = upload.localNoteId;
+    job.remoteId = remoteId;
+    job.title = upload.title;
+    job.folderId = folderId;
+    job.body = upload.body;
+    startUpload(job, noteAppProperties(upload), removeParentId);
+}
+
+QString GoogleDriveManager::remoteIdForLocalNote(const QString &localNoteId) const
+{
+    return m_remoteNotesByLocalId.value(localNoteId);
+}
+
+QJsonObject GoogleDriveManager::noteAppProperties(const NoteUpload &upload)
+{
+    // appProperties values are strings and only visible to this app
+    QJsonObject properties;
+    properties["notesLocalId"] = upload.localNoteId;
+    properties["notesContentHash"] = upload.contentHash;
+    properties["notesRevision"] = QString::number(upload.revision);
+    return properties;
+}
+
+QString GoogleDriveManager::remoteNoteKey(const QString &folderName, const QString &title)
+{
+    return folderName + "/" + title;
+}
+
 void GoogleDriveManager::updateNoteIfChanged(const QString &noteId, const QString &content, const QString &title, const QString &folderName)
 {
-    QString remoteNoteId = m_remoteNoteIds.value(title, "");
+    QString key = remoteNoteKey(folderName, title);
+    QString remoteNoteId = m_remoteNotesByLocalId.value(noteId, m_remoteNoteIds.value(key));
     QString currentHash = calculateFileHash(content);
     
     if (remoteNoteId.isEmpty()) {
         // Note doesn't exist remotely, upload it
         qDebug() << "Note doesn't exist remotely, uploading:" << title;
         QString folderId = m_remoteFolderIds[folderName];
-        uploadNoteToFolder("", content, title, folderId);
+        uploadNoteToFolder("", content, title, folderId, noteId);
     } else {
         // Note exists, check if it needs update
-        QString remoteHash = m_remoteNoteHashes.value(title, "");
+        QString remoteHash = m_remoteNoteHashes.value(key, "");
         if (remoteHash != currentHash) {
             qDebug() << "Note changed, updating:" << title;
             QString folderId = m_remoteFolderIds[folderName];
-            uploadNoteToFolder(remoteNoteId, content, title, folderId);
+            uploadNoteToFolder(remoteNoteId, content, title, folderId, noteId);
         } else {
             qDebug() << "Note unchanged, skipping:" << title;
         }
     }
 }
 
-QString GoogleDriveManager::calculateFileHash(const QString &content)
-{
-    // Simple hash for content comparison
-    // In production, you might want to use a more robust hashing algorithm
-    QByteArray hash = QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Md5);
-    return hash.toHex();
-}
-
 QString GoogleDriveManager::getRemoteNoteId(const QString &title, const QString &folderName)
 {
-    return m_remoteNoteIds.value(title, "");
+    return m_remoteNoteIds.value(remoteNoteKey(folderName, title), "");
 }
 
 void GoogleDriveManager::clearStructureData()
@@ -1623,7 +2360,10 @@ void GoogleDriveManager::clearStructureData()
     m_remoteFolderIds.clear();
     m_remoteNoteIds.clear();
     m_remoteNoteHashes.clear();
+    m_remoteNotesByLocalId.clear();
+    m_remoteNoteParents.clear();
     m_structureChecked = false;
     m_pendingFolderStructure.clear();
-    m_pendingSubfolderIndex = 0;
+    m_pendingSubfolderCreates = 0;
+    m_pendingFolderListings = 0;
 }
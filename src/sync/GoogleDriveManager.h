@@ -13,92 +13,122 @@
 #include <QTimer>
 #include <QFile>
 #include <QDir>
+#include <QSet>
+#include <QVector>
+#include "DriveBatch.h"
+#include "DriveRequest.h"
+#include "RetryPolicy.h"
+#include "SyncBackend.h"
 
-class GoogleDriveManager : public QObject
+class GoogleDriveManager : public SyncBackend
 {
     Q_OBJECT
 
 public:
     explicit GoogleDriveManager(QObject *parent = nullptr);
-    ~GoogleDriveManager();
+    ~GoogleDriveManager() override;
 
     // Authentication
-    bool isAuthenticated() const;
-    void authenticate();
-    void completeOAuth(const QString &authCode);
+    bool isAuthenticated() const override;
+    void authenticate() override;
+    void completeOAuth(const QString &authCode) override;
     void refreshToken();
-    void forceReauthenticate();
-    void logout();
+    void forceReauthenticate() override;
+    void logout() override;
+    
+    // Endpoints default to Google's; a local Drive stand-in can replace them
+    void setServiceUrls(const QString &apiBaseUrl, const QString &uploadBaseUrl,
+                        const QString &batchUrl, const QString &tokenUrl);
+    // Signs in with tokens obtained elsewhere, without storing them
+    void setTokens(const QString &accessToken, const QString &refreshToken, const QDateTime &expiry);
 
     // File operations
     void uploadNote(const QString &noteId, const QString &content, const QString &title);
-    void uploadNoteToFolder(const QString &noteId, const QString &content, const QString &title, const QString &folderId);
-    void downloadNote(const QString &noteId);
-    void deleteNote(const QString &noteId);
-    void listNotes();
-    void createNote(const QString &title, const QString &content);
+    void uploadNoteToFolder(const QString &noteId, const QString &content, const QString &title, const QString &folderId,
+                            const QString &localNoteId = QString(), const QJsonObject &appProperties = QJsonObject(),
+                            const QString &removeParentId = QString());
+    void cancelUploads(const QString &localNoteId) override;
+    // Uploads a local note, or only patches its metadata when the content is already on Drive
+    void uploadLocalNote(const NoteUpload &upload) override;
+    void downloadNote(const QString &noteId) override;
+    // Streams the file through noteDataReceived instead of buffering it
+    void downloadNoteStreaming(const QString &fileId) override;
+    void deleteNote(const QString &noteId) override;
+    void listNotes() override;
+    void listAllNotes() override;  // Every note in the notes folder and its subfolders, all pages
+    void createNote(const QString &title, const QString &content) override;
     void createFolder(const QString &folderName);
+    void updateFileMetadata(const QString &fileId, const QJsonObject &metadata,
+                            const QString &addParentId = QString(), const QString &removeParentId = QString());
 
     // Sync operations
     void syncAll();
-    void smartSync(); // New smart sync method
+    void smartSync() override; // New smart sync method
     void uploadAllNotes(const QList<QPair<QString, QString>> &notes);
     void uploadFolderStructure(const QList<QPair<QString, QList<QPair<QString, QString>>>> &folderStructure);
     void createSubfoldersAndUploadNotes(const QList<QPair<QString, QList<QPair<QString, QString>>>> &folderStructure);
-    void setSyncFolder(const QString &folderId);
-    void createNotesFolder();
+    void setSyncFolder(const QString &folderId) override;
+    void createNotesFolder() override;
     void findExistingNotesFolder();
     void createNewNotesFolder();
-    QString getNotesFolderId() const;
-    bool isStructureChecked() const;
+    QString getNotesFolderId() const override;
+    bool isStructureChecked() const override;
     
     // Smart sync methods
     void checkExistingStructure();
-    void syncSingleNote(const QString &noteId, const QString &content, const QString &title, const QString &folderName);
+    void syncSingleNote(const QString &noteId, const QString &content, const QString &title, const QString &folderName) override;
     void updateNoteIfChanged(const QString &noteId, const QString &content, const QString &title, const QString &folderName);
-    void clearStructureData();
+    void clearStructureData() override;
     
-    // Private helper methods for sequential subfolder creation
-    void createNextSubfolder();
+    // Subfolder creation (all missing folders go out in one batch)
+    void createMissingSubfolders();
     void startNoteUploads();
+    // Runs once every subfolder has been listed
+    void finishStructureCheck();
+    
+    // Batch requests
+    void flushBatch() override;
+    
+    // Set while repeated transient failures suggest Drive is unreachable
+    bool isCircuitOpen() const override;
     
     // Utility methods
-    QString calculateFileHash(const QString &content);
+    qint64 inFlightBytes() const override;  // Request bodies held by sync work in progress
+    DriveRequestTiming requestTiming(DriveRequestType type) const;
+    void resetRequestTimings();
     QString getRemoteNoteId(const QString &title, const QString &folderName);
+    QString remoteIdForLocalNote(const QString &localNoteId) const;
     void listSubfolders();
     void listNotesInFolder(const QString &folderId, const QString &folderName);
-    void uploadFileContent(const QString &fileId, const QString &content, const QString &title, const QString &noteId);
-    void uploadFileContentToSession(const QString &sessionUrl, const QString &content, const QString &title, const QString &noteId);
 
 signals:
-    void authenticationChanged(bool authenticated);
-    void uploadComplete(const QString &noteId, bool success);
-    void downloadComplete(const QString &noteId, const QString &content, bool success);
-    void deleteComplete(const QString &noteId, bool success);
-    void notesListReceived(const QJsonArray &notes);
-    void syncProgress(int current, int total);
-    void syncComplete();
-    void smartSyncComplete(); // New signal for smart sync completion
-    void error(const QString &errorMessage);
-
-private slots:
-    void handleAuthResponse(QNetworkReply *reply);
-    void handleTokenRefresh(QNetworkReply *reply);
-    void handleUploadResponse(QNetworkReply *reply);
-    void handleDownloadResponse(QNetworkReply *reply);
-    void handleDeleteResponse(QNetworkReply *reply);
-    void handleListResponse(QNetworkReply *reply);
-    void handleCreateResponse(QNetworkReply *reply);
-    void handleCreateFolderResponse(QNetworkReply *reply);
-    void handleCreateSubfolderResponse(QNetworkReply *reply);
-    void handleFindFolderResponse(QNetworkReply *reply);
-    void handleListSubfoldersResponse(QNetworkReply *reply);
-    void handleListNotesInFolderResponse(QNetworkReply *reply);
-    void handleUploadMetadataResponse(QNetworkReply *reply);
-    void handleUploadContentResponse(QNetworkReply *reply);
-    void handleUploadSessionResponse(QNetworkReply *reply);
+    void metadataUpdated(const QString &fileId, bool success);
+    void requestFinished(DriveRequestType type, qint64 elapsedMs, bool success);
 
 private:
+    // Completion handlers, one per request type
+    using ReplyHandler = void (GoogleDriveManager::*)(QNetworkReply *, const DriveRequestContext &);
+    static ReplyHandler handlerFor(DriveRequestType type);
+    void handleAuthResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleTokenRefresh(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleUploadResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleDownloadResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleStreamedDownloadResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleDeleteResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleListResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleListAllResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleCreateResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleCreateFolderResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleCreateSubfolderResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleFindFolderResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleListSubfoldersResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleListNotesInFolderResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleUploadMetadataResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleUploadContentResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleUploadSessionResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleUpdateMetadataResponse(QNetworkReply *reply, const DriveRequestContext &context);
+    void handleBatchResponse(QNetworkReply *reply, const DriveRequestContext &context);
+
     // OAuth 2.0
     void requestAccessToken(const QString &authCode);
     void saveTokens();
@@ -111,12 +141,78 @@ private:
     void addAuthHeader(QNetworkRequest &request);
     QString getApiUrl(const QString &endpoint) const;
     
-    // Request tracking
-    void trackRequest(QNetworkReply *reply, const QString &requestType, const QString &noteId = "");
+    // Every request goes through sendRequest, so it can be replayed and its
+    // reply completes through the handler for its context
+    struct PendingRequest
+    {
+        DriveRequestContext context;
+        QByteArray verb;
+        QNetworkRequest request;
+        QByteArray body;
+        bool idempotent = false;
+        int attempt = 0;
+        bool streamsUploadBody = false;  // Body comes from the upload job instead of body
+        bool superseded = false;         // Cancelled by a newer edit of the note
+        bool authReplayed = false;       // Already replayed once after a 401
+        QList<DriveBatchItem> batchItems;
+        qint64 heldBytes = 0;
+    };
+    void sendRequest(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body,
+                     bool idempotent, const DriveRequestContext &context, int attempt = 0);
+    void dispatchRequest(const PendingRequest &pending);
+    void holdSentRequest(QNetworkReply *reply, const PendingRequest &pending);
+    PendingRequest releaseSentRequest(QNetworkReply *reply);
+    void onReplyFinished(QNetworkReply *reply);
+    void completeRequest(QNetworkReply *reply, const DriveRequestContext &context);
+    bool retryIfTransient(QNetworkReply *reply, PendingRequest pending);
+    bool retryBatchItem(const DriveBatchItem &item, const DriveBatchResponse &response);
+    void recordRequestOutcome(bool transientFailure);
+    
+    // Full listing and streamed downloads
+    void listFolderContents(const QString &folderId, const QString &folderName, const QString &pageToken = QString());
+    void streamReply(QNetworkReply *reply, const QString &fileId);
+    
+    // Upload jobs: metadata request, then content streamed from the body provider
+    struct UploadJob
+    {
+        QString localNoteId;
+        QString remoteId;
+        QString title;
+        QString folderId;
+        NoteBodyProvider body;
+    };
+    void startUpload(const UploadJob &job, const QJsonObject &appProperties, const QString &removeParentId);
+    void uploadFileContent(quint64 jobId, const QString &fileId);
+    void uploadFileContentToSession(quint64 jobId, const QString &sessionUrl);
+    void sendUploadBody(const QByteArray &verb, const QNetworkRequest &request, const DriveRequestContext &context);
+    QByteArray uploadBody(quint64 jobId) const;
+    void finishUploadJob(quint64 jobId, const QString &remoteId, bool success);
+    
+    // Uploads per local note, so a newer edit can cancel an obsolete one
+    DriveRequestContext uploadContext(DriveRequestType type, quint64 jobId) const;
+    bool isUploadSuperseded(const QString &localNoteId, int generation) const;
+    void reportUpload(const QString &localNoteId, const QString &remoteId, bool success);
+    
+    // Batching of small metadata operations
+    void enqueueBatchItem(const DriveBatchItem &item);
+    void sendBatchItem(const DriveBatchItem &item);
+    DriveBatchItem metadataUpdateItem(const QString &fileId, const QJsonObject &metadata,
+                                      const QString &addParentId, const QString &removeParentId) const;
+    QString apiPath(const QString &endpoint) const;
+    
+    // Remote identity
+    static QJsonObject noteAppProperties(const NoteUpload &upload);
+    static QString remoteNoteKey(const QString &folderName, const QString &title);
 
-    // Token management
+    // Token management. While a refresh is in flight, requests to Drive are
+    // parked and sent with the new token once it arrives.
     void startTokenRefreshTimer();
     void refreshTokenIfNeeded();
+    bool isTokenExpiring(int withinSecs) const;
+    void parkRequest(const PendingRequest &pending);
+    void releaseParkedRequests();
+    void failParkedRequests(const QString &reason);
+    bool replayAfterTokenRefresh(QNetworkReply *reply, PendingRequest pending);
 
     QNetworkAccessManager *m_networkManager;
     
@@ -135,22 +231,65 @@ private:
     QString m_appDataFolderId;
     QMap<QString, QString> m_subfolderIds;  // Map folder names to their IDs
     
-    // Sequential subfolder creation tracking
+    // Subfolder creation tracking
     QList<QPair<QString, QList<QPair<QString, QString>>>> m_pendingFolderStructure;
-    int m_pendingSubfolderIndex;
+    int m_pendingSubfolderCreates;
+    
+    // Batch request state
+    QList<DriveBatchItem> m_batchQueue;
+    QMap<QNetworkReply*, QList<DriveBatchItem>> m_inFlightBatches;
+    QTimer *m_batchTimer;
+    
+    // Retry state
+    RetryPolicy m_retryPolicy;
+    CircuitBreaker m_circuitBreaker;
+    QMap<QNetworkReply*, PendingRequest> m_sentRequests;
+    QTimer *m_circuitTimer;
+    
+    // Upload jobs by ID, and bytes held by requests in flight
+    QHash<quint64, UploadJob> m_uploadJobs;
+    quint64 m_nextUploadJobId;
+    qint64 m_inFlightBytes;
+    
+    // Completed requests by type, indexed by DriveRequestType
+    QVector<DriveRequestTiming> m_requestTimings;
+    
+    // In-flight uploads by local note ID
+    QMultiHash<QString, QNetworkReply*> m_activeUploads;
+    QHash<QString, int> m_uploadGenerations;
     
     // Smart sync state tracking
-    QMap<QString, QString> m_remoteNoteHashes; // Map note title to hash
-    QMap<QString, QString> m_remoteNoteIds;    // Map note title to remote ID
+    QMap<QString, QString> m_remoteNoteHashes; // Map "folder/title" to hash
+    QMap<QString, QString> m_remoteNoteIds;    // Map "folder/title" to remote ID
     QMap<QString, QString> m_remoteFolderIds;  // Map folder name to remote ID
+    QHash<QString, QString> m_remoteNotesByLocalId;  // appProperties notesLocalId -> remote ID
+    QHash<QString, QString> m_remoteNoteParents;     // Remote note ID -> parent folder ID
+    QSet<QString> m_foldersBeingCreated;
+    QMultiHash<QString, QString> m_uploadsAwaitingFolder;  // Folder name -> local note IDs deferred on it
     bool m_structureChecked;
+    int m_pendingFolderListings;
+    
+    // Full listing state
+    QList<RemoteNoteFile> m_listedNotes;
+    int m_pendingListPages;
+    bool m_listingFailed;
     
     // State
     bool m_isAuthenticated;
     QTimer *m_tokenRefreshTimer;
+    bool m_tokenRefreshInFlight;
+    QList<PendingRequest> m_parkedRequests;
+    
+    // Service endpoints
+    QString m_apiBaseUrl;
+    QString m_uploadBaseUrl;
+    QString m_batchUrl;
+    QString m_tokenUrl;
     
     // Constants
     static const QString API_BASE_URL;
+    static const QString UPLOAD_BASE_URL;
+    static const QString BATCH_URL;
     static const QString AUTH_BASE_URL;
     static const QString TOKEN_BASE_URL;
     static const QString SCOPE;
@@ -0,0 +1,569 @@
+#include "LocalSyncBackend.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTimer>
+#include <QDebug>
+
+// Streamed downloads arrive in chunks of this size, like network reads
+static const int STREAM_CHUNK_SIZE = 64 * 1024;
+
+LocalSyncBackend::LocalSyncBackend(const QString &rootPath, QObject *parent)
+    : SyncBackend(parent)
+    , m_rootPath(QDir::cleanPath(QDir(rootPath).absolutePath()))
+    , m_authenticated(true)
+    , m_structureChecked(false)
+    , m_indexLoaded(false)
+    , m_nextFileId(1)
+    , m_running(0)
+    , m_maxConcurrent(6)
+    , m_minLatencyMs(0)
+    , m_maxLatencyMs(0)
+    , m_failureRate(0.0)
+    , m_random(1)
+    , m_operationCount(0)
+    , m_failedOperations(0)
+    , m_bytesUploaded(0)
+    , m_bytesDownloaded(0)
+{
+}
+
+LocalSyncBackend::~LocalSyncBackend()
+{
+}
+
+void LocalSyncBackend::setLatency(int minMs, int maxMs)
+{
+    m_minLatencyMs = qMax(0, minMs);
+    m_maxLatencyMs = qMax(m_minLatencyMs, maxMs);
+}
+
+void LocalSyncBackend::setFailureRate(double rate)
+{
+    m_failureRate = qBound(0.0, rate, 1.0);
+}
+
+void LocalSyncBackend::setMaxConcurrent(int maxConcurrent)
+{
+    m_maxConcurrent = qMax(1, maxConcurrent);
+    startOperations();
+}
+
+void LocalSyncBackend::setSeed(quint32 seed)
+{
+    m_random.seed(seed);
+}
+
+int LocalSyncBackend::operationCount() const
+{
+    return m_operationCount;
+}
+
+int LocalSyncBackend::failedOperationCount() const
+{
+    return m_failedOperations;
+}
+
+qint64 LocalSyncBackend::bytesUploaded() const
+{
+    return m_bytesUploaded;
+}
+
+qint64 LocalSyncBackend::bytesDownloaded() const
+{
+    return m_bytesDownloaded;
+}
+
+void LocalSyncBackend::resetCounters()
+{
+    m_operationCount = 0;
+    m_failedOperations = 0;
+    m_bytesUploaded = 0;
+    m_bytesDownloaded = 0;
+}
+
+QString LocalSyncBackend::rootPath() const
+{
+    return m_rootPath;
+}
+
+bool LocalSyncBackend::isAuthenticated() const
+{
+    return m_authenticated;
+}
+
+void LocalSyncBackend::authenticate()
+{
+    // Nothing to sign in to
+    m_authenticated = true;
+    emit authenticationChanged(true);
+}
+
+void LocalSyncBackend::completeOAuth(const QString &authCode)
+{
+    Q_UNUSED(authCode);
+    authenticate();
+}
+
+void LocalSyncBackend::forceReauthenticate()
+{
+    logout();
+    authenticate();
+}
+
+void LocalSyncBackend::logout()
+{
+    m_authenticated = false;
+    clearStructureData();
+    emit authenticationChanged(false);
+}
+
+void LocalSyncBackend::createNotesFolder()
+{
+    schedule([this](bool failed) {
+        if (failed || !QDir().mkpath(m_rootPath)) {
+            emit error("Failed to create folder: " + m_rootPath);
+            return;
+        }
+        m_folderId = m_rootPath;
+        emit syncComplete();
+    });
+}
+
+void LocalSyncBackend::setSyncFolder(const QString &folderId)
+{
+    m_folderId = folderId;
+}
+
+QString LocalSyncBackend::getNotesFolderId() const
+{
+    return m_folderId;
+}
+
+void LocalSyncBackend::smartSync()
+{
+    schedule([this](bool failed) {
+        if (failed) {
+            emit error("Failed to list notes: injected failure");
+            return;
+        }
+        loadIndex();
+        m_structureChecked = true;
+        emit smartSyncComplete();
+    });
+}
+
+bool LocalSyncBackend::isStructureChecked() const
+{
+    return m_structureChecked;
+}
+
+void LocalSyncBackend::clearStructureData()
+{
+    // The directory is read again on the next smart sync
+    m_structureChecked = false;
+    m_indexLoaded = false;
+    m_files.clear();
+    m_filesByLocalId.clear();
+}
+
+void LocalSyncBackend::listNotes()
+{
+    schedule([this](bool failed) {
+        if (failed) {
+            emit error("Failed to list notes: injected failure");
+            return;
+        }
+        loadIndex();
+        QJsonArray files;
+        for (const RemoteNoteFile &file : m_files) {
+            if (file.folderName.isEmpty()) {
+                files.append(toJson(file));
+            }
+        }
+        emit notesListReceived(files);
+    });
+}
+
+void LocalSyncBackend::listAllNotes()
+{
+    schedule([this](bool failed) {
+        if (failed) {
+            emit remoteNotesListed(QList<RemoteNoteFile>(), false);
+            return;
+        }
+        loadIndex();
+        emit remoteNotesListed(m_files.values(), true);
+    });
+}
+
+void LocalSyncBackend::uploadLocalNote(const NoteUpload &upload)
+{
+    int generation = m_uploadGenerations.value(upload.localNoteId);
+    schedule([this, upload, generation](bool failed) {
+        if (m_uploadGenerations.value(upload.localNoteId) != generation) {
+            // A newer edit of the note replaced this upload
+            return;
+        }
+        if (failed || !m_authenticated) {
+            reportUpload(upload.localNoteId, upload.remoteId, false);
+            return;
+        }
+        loadIndex();
+
+        QString fileId = upload.remoteId;
+        if (!m_files.contains(fileId)) {
+            fileId = m_filesByLocalId.value(upload.localNoteId);
+        }
+
+        RemoteNoteFile file;
+        bool existing = m_files.contains(fileId);
+        if (existing) {
+            file = m_files.value(fileId);
+        } else {
+            file.id = newFileId();
+            file.localNoteId = upload.localNoteId;
+        }
+        file.title = upload.title;
+        file.contentHash = upload.contentHash;
+        file.revision = upload.revision;
+
+        bool ok = existing ? moveNote(file, upload.folderName) : true;
+        file.folderName = upload.folderName;
+        if (ok && existing && upload.metadataOnly) {
+            ok = writeNote(file, nullptr);
+        } else if (ok) {
+            QByteArray body = upload.body ? upload.body() : QByteArray();
+            m_bytesUploaded += body.size();
+            ok = writeNote(file, &body);
+        }
+
+        reportUpload(upload.localNoteId, ok ? file.id : upload.remoteId, ok);
+    });
+}
+
+void LocalSyncBackend::cancelUploads(const QString &localNoteId)
+{
+    m_uploadGenerations[localNoteId]++;
+}
+
+void LocalSyncBackend::createNote(const QString &title, const QString &content)
+{
+    schedule([this, title, content](bool failed) {
+        if (failed) {
+            emit uploadComplete(QString(), false);
+            return;
+        }
+        loadIndex();
+        RemoteNoteFile file;
+        file.id = newFileId();
+        file.title = title;
+        QByteArray body = content.toUtf8();
+        m_bytesUploaded += body.size();
+        bool ok = writeNote(file, &body);
+        emit uploadComplete(file.id, ok);
+    });
+}
+
+void LocalSyncBackend::syncSingleNote(const QString &noteId, const QString &content, const QString &title,
+                                      const QString &folderName)
+{
+    Q_UNUSED(noteId);
+    schedule([this, content, title, folderName](bool failed) {
+        if (failed) {
+            emit uploadComplete(QString(), false);
+            return;
+        }
+        loadIndex();
+        QString fileId = findNote(folderName, title);
+        RemoteNoteFile file = m_files.value(fileId);
+        QString hash = calculateFileHash(content);
+        if (!fileId.isEmpty() && file.contentHash == hash) {
+            // Unchanged
+            emit uploadComplete(fileId, true);
+            return;
+        }
+        if (fileId.isEmpty()) {
+            file.id = newFileId();
+            file.title = title;
+            file.folderName = folderName;
+        }
+        QByteArray body = content.toUtf8();
+        m_bytesUploaded += body.size();
+        bool ok = writeNote(file, &body);
+        emit uploadComplete(file.id, ok);
+    });
+}
+
+void LocalSyncBackend::downloadNote(const QString &noteId)
+{
+    schedule([this, noteId](bool failed) {
+        loadIndex();
+        bool ok = !failed && m_files.contains(noteId);
+        QByteArray content = ok ? readContent(m_files.value(noteId), &ok) : QByteArray();
+        m_bytesDownloaded += content.size();
+        emit downloadComplete(noteId, ok ? QString::fromUtf8(content) : QString(), ok);
+    });
+}
+
+void LocalSyncBackend::downloadNoteStreaming(const QString &fileId)
+{
+    schedule([this, fileId](bool failed) {
+        loadIndex();
+        bool ok = !failed && m_files.contains(fileId);
+        QByteArray content = ok ? readContent(m_files.value(fileId), &ok) : QByteArray();
+        if (!ok) {
+            emit noteStreamFinished(fileId, false);
+            return;
+        }
+        m_bytesDownloaded += content.size();
+        for (int offset = 0; offset < content.size(); offset += STREAM_CHUNK_SIZE) {
+            emit noteDataReceived(fileId, content.mid(offset, STREAM_CHUNK_SIZE));
+        }
+        emit noteStreamFinished(fileId, true);
+    });
+}
+
+void LocalSyncBackend::deleteNote(const QString &noteId)
+{
+    schedule([this, noteId](bool failed) {
+        if (failed) {
+            emit deleteComplete(noteId, false);
+            return;
+        }
+        loadIndex();
+        // A file that is already gone counts as deleted, as on Drive
+        bool ok = !m_files.contains(noteId) || removeNote(noteId);
+        emit deleteComplete(noteId, ok);
+    });
+}
+
+void LocalSyncBackend::flushBatch()
+{
+    // Nothing is held back for batching
+}
+
+bool LocalSyncBackend::isCircuitOpen() const
+{
+    return false;
+}
+
+qint64 LocalSyncBackend::inFlightBytes() const
+{
+    // Bodies are read and written in one step when an upload runs
+    return 0;
+}
+
+void LocalSyncBackend::schedule(const Operation &operation)
+{
+    m_queue.enqueue(operation);
+    startOperations();
+}
+
+void LocalSyncBackend::startOperations()
+{
+    while (m_running < m_maxConcurrent && !m_queue.isEmpty()) {
+        Operation operation = m_queue.dequeue();
+        m_running++;
+        // Completes from the event loop even without latency, like a reply
+        QTimer::singleShot(nextLatency(), this, [this, operation]() {
+            m_running--;
+            m_operationCount++;
+            bool failed = m_failureRate > 0.0 && m_random.generateDouble() < m_failureRate;
+            if (failed) {
+                m_failedOperations++;
+            }
+            operation(failed);
+            startOperations();
+        });
+    }
+}
+
+int LocalSyncBackend::nextLatency()
+{
+    if (m_maxLatencyMs <= m_minLatencyMs) {
+        return m_minLatencyMs;
+    }
+    return m_random.bounded(m_minLatencyMs, m_maxLatencyMs + 1);
+}
+
+void LocalSyncBackend::loadIndex()
+{
+    if (m_indexLoaded) {
+        return;
+    }
+    m_indexLoaded = true;
+    m_files.clear();
+    m_filesByLocalId.clear();
+
+    QDir root(m_rootPath);
+    QDirIterator it(m_rootPath, QStringList() << "*.json", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QFile metadata(path);
+        if (!metadata.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to read note metadata:" << path;
+            continue;
+        }
+        QString folderName = root.relativeFilePath(QFileInfo(path).absolutePath());
+        if (folderName == ".") {
+            folderName.clear();
+        }
+
+        RemoteNoteFile file = remoteNoteFromJson(QJsonDocument::fromJson(metadata.readAll()).object(), folderName);
+        if (file.id.isEmpty()) {
+            continue;
+        }
+        m_files.insert(file.id, file);
+        if (!file.localNoteId.isEmpty()) {
+            m_filesByLocalId.insert(file.localNoteId, file.id);
+        }
+        m_nextFileId = qMax(m_nextFileId, file.id.mid(file.id.indexOf('-') + 1).toULongLong() + 1);
+    }
+    qDebug() << "Local sync backend holds" << m_files.size() << "notes in" << m_rootPath;
+}
+
+QString LocalSyncBackend::folderPath(const QString &folderName) const
+{
+    return folderName.isEmpty() ? m_rootPath : m_rootPath + "/" + folderName;
+}
+
+bool LocalSyncBackend::isInsideRoot(const QString &folderName) const
+{
+    // Folder names come from the notes database; one like "../x" must not reach outside the store
+    QString path = QDir::cleanPath(QDir::fromNativeSeparators(folderPath(folderName)));
+    return path == m_rootPath || path.startsWith(m_rootPath + "/");
+}
+
+QString LocalSyncBackend::contentPath(const RemoteNoteFile &file) const
+{
+    return folderPath(file.folderName) + "/" + file.id + ".md";
+}
+
+QString LocalSyncBackend::metadataPath(const RemoteNoteFile &file) const
+{
+    return folderPath(file.folderName) + "/" + file.id + ".json";
+}
+
+bool LocalSyncBackend::writeNote(RemoteNoteFile &file, const QByteArray *content)
+{
+    if (!isInsideRoot(file.folderName)) {
+        qWarning() << "Rejecting folder outside the store:" << file.folderName;
+        return false;
+    }
+    if (!QDir().mkpath(folderPath(file.folderName))) {
+        qWarning() << "Failed to create folder for note:" << folderPath(file.folderName);
+        return false;
+    }
+
+    if (content) {
+        QFile out(contentPath(file));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate) || out.write(*content) != content->size()) {
+            qWarning() << "Failed to write note content:" << contentPath(file);
+            return false;
+        }
+        file.size = content->size();
+        file.contentHash = calculateFileHash(QString::fromUtf8(*content));
+    }
+    file.modifiedTime = QDateTime::currentDateTimeUtc();
+
+    QFile metadata(metadataPath(file));
+    if (!metadata.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || metadata.write(QJsonDocument(toJson(file)).toJson(QJsonDocument::Compact)) < 0) {
+        qWarning() << "Failed to write note metadata:" << metadataPath(file);
+        return false;
+    }
+
+    m_files.insert(file.id, file);
+    if (!file.localNoteId.isEmpty()) {
+        m_filesByLocalId.insert(file.localNoteId, file.id);
+    }
+    return true;
+}
+
+bool LocalSyncBackend::moveNote(RemoteNoteFile &file, const QString &folderName)
+{
+    if (file.folderName == folderName) {
+        return true;
+    }
+    if (!isInsideRoot(folderName)) {
+        qWarning() << "Rejecting folder outside the store:" << folderName;
+        return false;
+    }
+    RemoteNoteFile moved = file;
+    moved.folderName = folderName;
+    if (!QDir().mkpath(folderPath(folderName))
+        || !QFile::rename(contentPath(file), contentPath(moved))
+        || !QFile::rename(metadataPath(file), metadataPath(moved))) {
+        qWarning() << "Failed to move note" << file.id << "to folder:" << folderName;
+        return false;
+    }
+    file = moved;
+    return true;
+}
+
+bool LocalSyncBackend::removeNote(const QString &fileId)
+{
+    RemoteNoteFile file = m_files.take(fileId);
+    if (!file.localNoteId.isEmpty() && m_filesByLocalId.value(file.localNoteId) == fileId) {
+        m_filesByLocalId.remove(file.localNoteId);
+    }
+    bool removed = QFile::remove(metadataPath(file));
+    QFile::remove(contentPath(file));
+    return removed;
+}
+
+QByteArray LocalSyncBackend::readContent(const RemoteNoteFile &file, bool *ok) const
+{
+    QFile in(contentPath(file));
+    *ok = in.open(QIODevice::ReadOnly);
+    return *ok ? in.readAll() : QByteArray();
+}
+
+QString LocalSyncBackend::findNote(const QString &folderName, const QString &title) const
+{
+    for (const RemoteNoteFile &file : m_files) {
+        if (file.folderName == folderName && file.title == title) {
+            return file.id;
+        }
+    }
+    return QString();
+}
+
+void LocalSyncBackend::reportUpload(const QString &localNoteId, const QString &remoteId, bool success)
+{
+    emit uploadComplete(remoteId, success);
+    if (!localNoteId.isEmpty()) {
+        emit localNoteUploaded(localNoteId, remoteId, success);
+    }
+}
+
+QString LocalSyncBackend::newFileId()
+{
+    return QString("local-%1").arg(m_nextFileId++);
+}
+
+QJsonObject LocalSyncBackend::toJson(const RemoteNoteFile &file)
+{
+    // Same shape as a Drive file resource, so listings read like Drive's
+    QJsonObject appProperties;
+    if (!file.localNoteId.isEmpty()) {
+        appProperties["notesLocalId"] = file.localNoteId;
+    }
+    appProperties["notesContentHash"] = file.contentHash;
+    appProperties["notesRevision"] = QString::number(file.revision);
+
+    QJsonObject json;
+    json["id"] = file.id;
+    json["name"] = file.title + ".md";
+    json["mimeType"] = "text/markdown";
+    json["md5Checksum"] = file.contentHash;
+    json["size"] = QString::number(file.size);
+    json["modifiedTime"] = file.modifiedTime.toString(Qt::ISODate);
+    json["appProperties"] = appProperties;
+    return json;
+}
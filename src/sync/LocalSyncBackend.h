@@ -0,0 +1,121 @@
+#ifndef LOCALSYNCBACKEND_H
+#define LOCALSYNCBACKEND_H
+
+#include <QHash>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <functional>
+#include "SyncBackend.h"
+
+// Sync backend that keeps the remote notes in a local directory, one content
+// file and one metadata file per note, with a subdirectory per folder. It
+// stands in for Drive in offline runs and benchmarks: operations complete
+// asynchronously after a configurable latency, at most maxConcurrent at a
+// time, and fail at a configurable rate. A fixed seed makes failures repeat.
+class LocalSyncBackend : public SyncBackend
+{
+    Q_OBJECT
+
+public:
+    explicit LocalSyncBackend(const QString &rootPath, QObject *parent = nullptr);
+    ~LocalSyncBackend() override;
+
+    // Simulated service behaviour
+    void setLatency(int minMs, int maxMs);
+    void setFailureRate(double rate);    // 0 to 1, per operation
+    void setMaxConcurrent(int maxConcurrent);
+    void setSeed(quint32 seed);
+
+    // Work done so far
+    int operationCount() const;
+    int failedOperationCount() const;
+    qint64 bytesUploaded() const;
+    qint64 bytesDownloaded() const;
+    void resetCounters();
+
+    QString rootPath() const;
+
+    // SyncBackend
+    bool isAuthenticated() const override;
+    void authenticate() override;
+    void completeOAuth(const QString &authCode) override;
+    void forceReauthenticate() override;
+    void logout() override;
+
+    void createNotesFolder() override;
+    void setSyncFolder(const QString &folderId) override;
+    QString getNotesFolderId() const override;
+    void smartSync() override;
+    bool isStructureChecked() const override;
+    void clearStructureData() override;
+
+    void listNotes() override;
+    void listAllNotes() override;
+
+    void uploadLocalNote(const NoteUpload &upload) override;
+    void cancelUploads(const QString &localNoteId) override;
+    void createNote(const QString &title, const QString &content) override;
+    void syncSingleNote(const QString &noteId, const QString &content, const QString &title,
+                        const QString &folderName) override;
+
+    void downloadNote(const QString &noteId) override;
+    void downloadNoteStreaming(const QString &fileId) override;
+    void deleteNote(const QString &noteId) override;
+
+    void flushBatch() override;
+
+    bool isCircuitOpen() const override;
+    qint64 inFlightBytes() const override;
+
+private:
+    // Every operation runs through the queue; failed is set for injected failures
+    using Operation = std::function<void(bool failed)>;
+    void schedule(const Operation &operation);
+    void startOperations();
+    int nextLatency();
+
+    // Directory store
+    void loadIndex();
+    QString folderPath(const QString &folderName) const;
+    bool isInsideRoot(const QString &folderName) const;
+    QString contentPath(const RemoteNoteFile &file) const;
+    QString metadataPath(const RemoteNoteFile &file) const;
+    bool writeNote(RemoteNoteFile &file, const QByteArray *content);
+    bool moveNote(RemoteNoteFile &file, const QString &folderName);
+    bool removeNote(const QString &fileId);
+    QByteArray readContent(const RemoteNoteFile &file, bool *ok) const;
+    QString findNote(const QString &folderName, const QString &title) const;
+    void reportUpload(const QString &localNoteId, const QString &remoteId, bool success);
+    QString newFileId();
+    static QJsonObject toJson(const RemoteNoteFile &file);
+
+    QString m_rootPath;
+    QString m_folderId;
+    bool m_authenticated;
+    bool m_structureChecked;
+
+    // Notes by file ID, and file IDs by the local note that uploaded them
+    QHash<QString, RemoteNoteFile> m_files;
+    QHash<QString, QString> m_filesByLocalId;
+    bool m_indexLoaded;
+    quint64 m_nextFileId;
+
+    // Uploads per local note, so a newer edit can cancel an obsolete one
+    QHash<QString, int> m_uploadGenerations;
+
+    // Simulation
+    QQueue<Operation> m_queue;
+    int m_running;
+    int m_maxConcurrent;
+    int m_minLatencyMs;
+    int m_maxLatencyMs;
+    double m_failureRate;
+    QRandomGenerator m_random;
+
+    int m_operationCount;
+    int m_failedOperations;
+    qint64 m_bytesUploaded;
+    qint64 m_bytesDownloaded;
+};
+
+#endif // LOCALSYNCBACKEND_H
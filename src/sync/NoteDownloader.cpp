@@ -0,0 +1,287 @@
+#include "NoteDownloader.h"
+#include "SyncOutbox.h"
+#include "../db/DatabaseManager.h"
+#include "../utils/Tracer.h"
+#include <QDir>
+#include <QSqlDatabase>
+#include <QDebug>
+
+NoteDownloader::NoteDownloader(SyncBackend *backend, DatabaseManager *dbManager, SyncOutbox *outbox,
+                               QObject *parent)
+    : QObject(parent)
+    , m_backend(backend)
+    , m_dbManager(dbManager)
+    , m_outbox(outbox)
+    , m_maxParallel(6)
+    , m_batchSize(50)
+    , m_batchBytes(8 * 1024 * 1024)
+    , m_readyBytes(0)
+    , m_running(false)
+    , m_total(0)
+    , m_restored(0)
+    , m_failed(0)
+    , m_bytes(0)
+{
+    connect(m_backend, &SyncBackend::noteDataReceived, this, &NoteDownloader::onDataReceived);
+    connect(m_backend, &SyncBackend::noteDownloadRestarted, this, &NoteDownloader::onDownloadRestarted);
+    connect(m_backend, &SyncBackend::noteStreamFinished, this, &NoteDownloader::onDownloadFinished);
+}
+
+NoteDownloader::~NoteDownloader()
+{
+    // Nobody is left to hear finished
+    abort();
+}
+
+void NoteDownloader::setMaxParallel(int maxParallel)
+{
+    // QNetworkAccessManager opens at most six connections per host
+    m_maxParallel = qBound(1, maxParallel, 6);
+}
+
+void NoteDownloader::setBatchSize(int batchSize)
+{
+    m_batchSize = qMax(1, batchSize);
+}
+
+void NoteDownloader::setBatchBytes(qint64 batchBytes)
+{
+    m_batchBytes = qMax<qint64>(1, batchBytes);
+}
+
+bool NoteDownloader::isRunning() const
+{
+    return m_running;
+}
+
+void NoteDownloader::start(const QList<RemoteNoteFile> &notes)
+{
+    if (m_running) {
+        qDebug() << "Download already running, ignoring new request";
+        return;
+    }
+
+    m_queue = notes;
+    m_total = notes.size();
+    m_restored = 0;
+    m_failed = 0;
+    m_bytes = 0;
+    m_running = true;
+
+    m_folderIds.clear();
+    for (const FolderData &folder : m_dbManager->getAllFolders()) {
+        m_folderIds.insert(folder.name, folder.id);
+    }
+
+    qDebug() << "Downloading" << m_total << "notes," << m_maxParallel << "at a time";
+    emit progress(0, m_total);
+
+    startDownloads();
+    finishIfDone();
+}
+
+void NoteDownloader::cancel()
+{
+    if (!m_running) {
+        return;
+    }
+
+    abort();
+    emit finished(m_restored, m_failed);
+}
+
+void NoteDownloader::abort()
+{
+    if (!m_running) {
+        return;
+    }
+
+    // Notes already downloaded are kept, the rest is fetched by the next run
+    commitBatch();
+    for (auto it = m_active.begin(); it != m_active.end(); ++it) {
+        discard(it.value());
+    }
+    m_active.clear();
+    m_queue.clear();
+    m_running = false;
+}
+
+void NoteDownloader::startDownloads()
+{
+    while (m_active.size() < m_maxParallel && !m_queue.isEmpty()) {
+        RemoteNoteFile note = m_queue.takeFirst();
+
+        Download download;
+        download.note = note;
+        download.staging = new QTemporaryFile(QDir::tempPath() + "/notes-download-XXXXXX.md", this);
+        if (!download.staging->open()) {
+            qWarning() << "Failed to create staging file for note:" << note.title;
+            delete download.staging;
+            m_failed++;
+            continue;
+        }
+
+        m_active.insert(note.id, download);
+        m_backend->downloadNoteStreaming(note.id);
+    }
+}
+
+void NoteDownloader::onDataReceived(const QString &fileId, const QByteArray &chunk)
+{
+    TRACE_SCOPE("sync", "NoteDownloader::onDataReceived");
+    auto it = m_active.find(fileId);
+    if (it == m_active.end()) {
+        return;
+    }
+
+    it.value().staging->write(chunk);
+    m_bytes += chunk.size();
+    emit bytesReceived(m_bytes);
+}
+
+void NoteDownloader::onDownloadRestarted(const QString &fileId)
+{
+    auto it = m_active.find(fileId);
+    if (it == m_active.end()) {
+        return;
+    }
+
+    m_bytes -= it.value().staging->size();
+    it.value().staging->resize(0);
+    it.value().staging->seek(0);
+}
+
+void NoteDownloader::onDownloadFinished(const QString &fileId, bool success)
+{
+    TRACE_SCOPE("sync", "NoteDownloader::onDownloadFinished");
+    auto it = m_active.find(fileId);
+    if (it == m_active.end()) {
+        return;
+    }
+    Download download = it.value();
+    m_active.erase(it);
+
+    if (success) {
+        m_ready.append(download);
+        m_readyBytes += download.staging->size();
+    } else {
+        discard(download);
+        m_failed++;
+        emit progress(m_restored + m_failed, m_total);
+    }
+
+    if (m_ready.size() >= m_batchSize || m_readyBytes >= m_batchBytes || (m_queue.isEmpty() && m_active.isEmpty())) {
+        commitBatch();
+    }
+
+    startDownloads();
+    finishIfDone();
+}
+
+void NoteDownloader::commitBatch()
+{
+    if (m_ready.isEmpty()) {
+        return;
+    }
+
+    // Rows only inside the transaction; files and signals follow the commit,
+    // since a rollback could not take them back
+    QSqlDatabase db = m_dbManager->database();
+    db.transaction();
+
+    QList<QPair<int, QString>> restored;
+    QList<int> createdFolders;
+    int failed = 0;
+    for (Download &download : m_ready) {
+        const RemoteNoteFile &note = download.note;
+        // A body is stored in one column, so it is read whole; only one is held at a time
+        download.staging->seek(0);
+        QString body = QString::fromUtf8(download.staging->readAll());
+        discard(download);
+
+        int folderId = localFolderId(note.folderName, createdFolders);
+        if (folderId <= 0) {
+            failed++;
+            continue;
+        }
+
+        // A note restored by an earlier run is updated in place
+        int noteId = m_dbManager->writeRestoredNote(m_outbox->noteIdForRemote(note.id), folderId, note.title, body);
+        if (noteId <= 0) {
+            failed++;
+            continue;
+        }
+
+        SyncedNote synced;
+        synced.noteId = noteId;
+        synced.remoteId = note.id;
+        synced.contentHash = m_backend->calculateFileHash(body);
+        synced.revision = note.revision;
+        synced.title = note.title;
+        synced.folderId = folderId;
+        m_outbox->recordSynced(synced);
+        restored.append(qMakePair(noteId, note.id));
+    }
+    int batchSize = m_ready.size();
+    m_ready.clear();
+    m_readyBytes = 0;
+
+    if (!db.commit()) {
+        qWarning() << "Failed to commit downloaded notes, rolling back batch of" << batchSize;
+        db.rollback();
+        // The folders this batch created went with it
+        for (int folderId : createdFolders) {
+            m_folderIds.remove(m_folderIds.key(folderId));
+        }
+        m_failed += batchSize;
+        emit progress(m_restored + m_failed, m_total);
+        return;
+    }
+
+    m_restored += restored.size();
+    m_failed += failed;
+    qDebug() << "Committed" << restored.size() << "downloaded notes," << m_restored << "of" << m_total << "done";
+
+    QList<int> noteIds;
+    for (const auto &note : restored) {
+        noteIds.append(note.first);
+    }
+    m_dbManager->finishRestore(noteIds, createdFolders);
+    for (const auto &note : restored) {
+        emit noteRestored(note.first, note.second);
+    }
+    emit progress(m_restored + m_failed, m_total);
+}
+
+void NoteDownloader::finishIfDone()
+{
+    if (!m_running || !m_queue.isEmpty() || !m_active.isEmpty()) {
+        return;
+    }
+
+    commitBatch();
+    m_running = false;
+    qDebug() << "Download finished:" << m_restored << "restored," << m_failed << "failed";
+    emit finished(m_restored, m_failed);
+}
+
+int NoteDownloader::localFolderId(const QString &folderName, QList<int> &createdFolders)
+{
+    // Files directly in the notes folder go to the imported notes
+    const QString name = folderName.isEmpty() ? QStringLiteral("Imported") : folderName;
+    if (!m_folderIds.contains(name)) {
+        int folderId = m_dbManager->writeRestoredFolder(name);
+        if (folderId <= 0) {
+            return -1;
+        }
+        m_folderIds.insert(name, folderId);
+        createdFolders.append(folderId);
+    }
+    return m_folderIds.value(name);
+}
+
+void NoteDownloader::discard(Download &download)
+{
+    delete download.staging;
+    download.staging = nullptr;
+}
@@ -0,0 +1,83 @@
+#ifndef NOTEDOWNLOADER_H
+#define NOTEDOWNLOADER_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QTemporaryFile>
+#include "SyncBackend.h"
+
+class DatabaseManager;
+class SyncOutbox;
+
+// Restores remote notes into the local database. Up to maxParallel files are
+// downloaded at once, each streamed into a staging file as it arrives, and
+// finished files are written to the database in batches of one transaction.
+// A batch is committed once it holds batchSize notes or batchBytes of staged
+// bodies, whichever comes first; a larger note ends the batch it joins.
+// Committed notes are recorded in sync_state, so an interrupted restore picks
+// up where it stopped when it is started again.
+class NoteDownloader : public QObject
+{
+    Q_OBJECT
+
+public:
+    NoteDownloader(SyncBackend *backend, DatabaseManager *dbManager, SyncOutbox *outbox,
+                   QObject *parent = nullptr);
+    ~NoteDownloader();
+
+    void setMaxParallel(int maxParallel);
+    void setBatchSize(int batchSize);
+    void setBatchBytes(qint64 batchBytes);
+
+    void start(const QList<RemoteNoteFile> &notes);
+    void cancel();
+    bool isRunning() const;
+
+signals:
+    void progress(int completed, int total);
+    void bytesReceived(qint64 totalBytes);
+    void noteRestored(int noteId, const QString &remoteId);
+    void finished(int restored, int failed);
+
+private slots:
+    void onDataReceived(const QString &fileId, const QByteArray &chunk);
+    void onDownloadRestarted(const QString &fileId);
+    void onDownloadFinished(const QString &fileId, bool success);
+
+private:
+    struct Download
+    {
+        RemoteNoteFile note;
+        QTemporaryFile *staging;
+    };
+
+    void startDownloads();
+    void commitBatch();
+    void abort();
+    void finishIfDone();
+    int localFolderId(const QString &folderName, QList<int> &createdFolders);
+    void discard(Download &download);
+
+    SyncBackend *m_backend;
+    DatabaseManager *m_dbManager;
+    SyncOutbox *m_outbox;
+
+    int m_maxParallel;
+    int m_batchSize;
+    qint64 m_batchBytes;
+
+    QList<RemoteNoteFile> m_queue;
+    QHash<QString, Download> m_active;   // Remote file ID -> download in progress
+    QList<Download> m_ready;             // Downloaded, waiting for the next commit
+    qint64 m_readyBytes;                 // Staged size of m_ready
+    QHash<QString, int> m_folderIds;     // Local folder IDs by name
+
+    bool m_running;
+    int m_total;
+    int m_restored;
+    int m_failed;
+    qint64 m_bytes;
+};
+
+#endif // NOTEDOWNLOADER_H
@@ -0,0 +1,169 @@
+#include "RetryPolicy.h"
+#include <QRandomGenerator>
+#include <QtGlobal>
+
+RetryPolicy::RetryPolicy(int maxAttempts, int baseDelayMs, int maxDelayMs, int maxRetryAfterMs)
+    : m_maxAttempts(maxAttempts)
+    , m_baseDelayMs(baseDelayMs)
+    , m_maxDelayMs(maxDelayMs)
+    , m_maxRetryAfterMs(maxRetryAfterMs)
+{
+}
+
+int RetryPolicy::maxAttempts() const
+{
+    return m_maxAttempts;
+}
+
+bool RetryPolicy::isTransient(int httpStatus, QNetworkReply::NetworkError error, const QByteArray &body) const
+{
+    switch (httpStatus) {
+        case 408:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+            return true;
+        case 403:
+            // Drive reports quota throttling as 403 with a rate limit reason
+            return body.contains("rateLimitExceeded") || body.contains("userRateLimitExceeded");
+        default:
+            break;
+    }
+
+    if (httpStatus != 0) {
+        return false;
+    }
+
+    switch (error) {
+        case QNetworkReply::ConnectionRefusedError:
+        case QNetworkReply::RemoteHostClosedError:
+        case QNetworkReply::HostNotFoundError:
+        case QNetworkReply::TimeoutError:
+        case QNetworkReply::TemporaryNetworkFailureError:
+        case QNetworkReply::NetworkSessionFailedError:
+        case QNetworkReply::ProxyConnectionRefusedError:
+        case QNetworkReply::ProxyConnectionClosedError:
+        case QNetworkReply::ProxyTimeoutError:
+        case QNetworkReply::UnknownNetworkError:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool RetryPolicy::isSafeToReplay(int httpStatus, QNetworkReply::NetworkError error, bool idempotent) const
+{
+    if (idempotent) {
+        return true;
+    }
+
+    // The server explicitly did not act on the request
+    if (httpStatus == 429 || httpStatus == 503 || httpStatus == 403) {
+        return true;
+    }
+
+    // The request never reached the server
+    return httpStatus == 0 && (error == QNetworkReply::ConnectionRefusedError ||
+                               error == QNetworkReply::HostNotFoundError ||
+                               error == QNetworkReply::ProxyConnectionRefusedError);
+}
+
+int RetryPolicy::retryDelayMs(int attempt, int httpStatus, QNetworkReply::NetworkError error,
+                              bool idempotent, const QByteArray &retryAfter, const QByteArray &body) const
+{
+    if (attempt >= m_maxAttempts) {
+        return -1;
+    }
+    if (!isTransient(httpStatus, error, body) || !isSafeToReplay(httpStatus, error, idempotent)) {
+        return -1;
+    }
+
+    int serverDelay = parseRetryAfter(retryAfter);
+    if (serverDelay >= 0) {
+        // Waiting longer than this is better left to the next sync
+        return serverDelay <= m_maxRetryAfterMs ? serverDelay : -1;
+    }
+
+    return backoffDelayMs(attempt);
+}
+
+int RetryPolicy::parseRetryAfter(const QByteArray &value, const QDateTime &now)
+{
+    QByteArray trimmed = value.trimmed();
+    if (trimmed.isEmpty()) {
+        return -1;
+    }
+
+    bool ok = false;
+    int seconds = trimmed.toInt(&ok);
+    if (ok) {
+        return seconds >= 0 ? seconds * 1000 : -1;
+    }
+
+    QDateTime date = QDateTime::fromString(QString::fromLatin1(trimmed), Qt::RFC2822Date);
+    if (!date.isValid()) {
+        return -1;
+    }
+    return qMax<qint64>(0, now.msecsTo(date));
+}
+
+int RetryPolicy::backoffDelayMs(int attempt) const
+{
+    // Full jitter: uniformly random in [0, min(cap, base * 2^attempt)]
+    qint64 ceiling = qint64(m_baseDelayMs) << qMin(attempt, 20);
+    ceiling = qMin<qint64>(ceiling, m_maxDelayMs);
+    return QRandomGenerator::global()->bounded(int(ceiling) + 1);
+}
+
+CircuitBreaker::CircuitBreaker(int failureThreshold, int baseCooldownMs, int maxCooldownMs)
+    : m_failureThreshold(failureThreshold)
+    , m_baseCooldownMs(baseCooldownMs)
+    , m_maxCooldownMs(maxCooldownMs)
+    , m_consecutiveFailures(0)
+    , m_timesOpened(0)
+{
+}
+
+bool CircuitBreaker::recordSuccess()
+{
+    bool wasTripped = m_timesOpened > 0;
+    m_consecutiveFailures = 0;
+    m_timesOpened = 0;
+    m_openUntil = QDateTime();
+    return wasTripped;
+}
+
+bool CircuitBreaker::recordFailure()
+{
+    // A failed probe after the cooldown reopens immediately
+    bool probing = m_timesOpened > 0 && !isOpen();
+    m_consecutiveFailures++;
+
+    if (!probing && m_consecutiveFailures < m_failureThreshold) {
+        return false;
+    }
+    if (isOpen()) {
+        return false;
+    }
+
+    qint64 cooldown = qint64(m_baseCooldownMs) << qMin(m_timesOpened, 10);
+    cooldown = qMin<qint64>(cooldown, m_maxCooldownMs);
+    m_timesOpened++;
+    m_openUntil = QDateTime::currentDateTimeUtc().addMSecs(cooldown);
+    return true;
+}
+
+bool CircuitBreaker::isOpen() const
+{
+    return m_openUntil.isValid() && QDateTime::currentDateTimeUtc() < m_openUntil;
+}
+
+int CircuitBreaker::remainingCooldownMs() const
+{
+    if (!isOpen()) {
+        return 0;
+    }
+    return int(QDateTime::currentDateTimeUtc().msecsTo(m_openUntil));
+}
@@ -0,0 +1,67 @@
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QNetworkReply>
+
+// Decides whether a failed Drive request is retried and how long to wait.
+// Delays use capped exponential backoff with full jitter; a Retry-After
+// header from the server takes precedence over the computed delay.
+class RetryPolicy
+{
+public:
+    RetryPolicy(int maxAttempts = 5, int baseDelayMs = 500, int maxDelayMs = 32000, int maxRetryAfterMs = 120000);
+
+    int maxAttempts() const;
+
+    // 408, 429, 5xx, Drive's 403 rate-limit errors and transient network failures
+    bool isTransient(int httpStatus, QNetworkReply::NetworkError error, const QByteArray &body = QByteArray()) const;
+
+    // Whether replaying the request cannot apply it twice. Non-idempotent requests
+    // are only replayed when the server reports it did not process them (429/503,
+    // rate-limit 403) or the connection failed before anything was sent.
+    bool isSafeToReplay(int httpStatus, QNetworkReply::NetworkError error, bool idempotent) const;
+
+    // attempt is the number of retries already made (0 for the first retry).
+    // Returns -1 when the request should not be retried.
+    int retryDelayMs(int attempt, int httpStatus, QNetworkReply::NetworkError error,
+                     bool idempotent, const QByteArray &retryAfter, const QByteArray &body = QByteArray()) const;
+
+    // Parses a Retry-After value (delta seconds or HTTP date), -1 if absent or invalid
+    static int parseRetryAfter(const QByteArray &value, const QDateTime &now = QDateTime::currentDateTimeUtc());
+
+private:
+    int backoffDelayMs(int attempt) const;
+
+    int m_maxAttempts;
+    int m_baseDelayMs;
+    int m_maxDelayMs;
+    int m_maxRetryAfterMs;
+};
+
+// Stops automatic sync after repeated transient failures so a Drive outage
+// does not turn into a stream of doomed requests. After the cooldown a single
+// probe is allowed through; another failure reopens it with a longer cooldown.
+class CircuitBreaker
+{
+public:
+    CircuitBreaker(int failureThreshold = 5, int baseCooldownMs = 30000, int maxCooldownMs = 600000);
+
+    // Both return true when the open/closed state changed
+    bool recordSuccess();
+    bool recordFailure();
+
+    bool isOpen() const;
+    int remainingCooldownMs() const;
+
+private:
+    int m_failureThreshold;
+    int m_baseCooldownMs;
+    int m_maxCooldownMs;
+    int m_consecutiveFailures;
+    int m_timesOpened;
+    QDateTime m_openUntil;
+};
+
+#endif // RETRYPOLICY_H
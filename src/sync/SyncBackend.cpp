@@ -0,0 +1,42 @@
+#include "SyncBackend.h"
+#include <QJsonObject>
+#include <QCryptographicHash>
+
+SyncBackend::SyncBackend(QObject *parent)
+    : QObject(parent)
+{
+}
+
+SyncBackend::~SyncBackend()
+{
+}
+
+QString SyncBackend::calculateFileHash(const QString &content) const
+{
+    // Drive reports md5Checksum for files, so every backend uses MD5
+    QByteArray hash = QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Md5);
+    return hash.toHex();
+}
+
+RemoteNoteFile SyncBackend::remoteNoteFromJson(const QJsonObject &file, const QString &folderName)
+{
+    QJsonObject appProperties = file["appProperties"].toObject();
+    
+    RemoteNoteFile note;
+    note.id = file["id"].toString();
+    note.title = file["name"].toString();
+    if (note.title.endsWith(".md")) {
+        note.title.chop(3);
+    }
+    note.folderName = folderName;
+    note.localNoteId = appProperties["notesLocalId"].toString();
+    // Drive's own checksum covers files edited outside the app as well
+    note.contentHash = file["md5Checksum"].toString();
+    if (note.contentHash.isEmpty()) {
+        note.contentHash = appProperties["notesContentHash"].toString();
+    }
+    note.revision = appProperties["notesRevision"].toString().toInt();
+    note.size = file["size"].toString().toLongLong();
+    note.modifiedTime = QDateTime::fromString(file["modifiedTime"].toString(), Qt::ISODate);
+    return note;
+}
@@ -0,0 +1,121 @@
+#ifndef SYNCBACKEND_H
+#define SYNCBACKEND_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <functional>
+
+// Reads a note body when its upload is sent, so queued uploads hold no content
+using NoteBodyProvider = std::function<QByteArray()>;
+
+// A local note to bring up to date on the remote. Files are tagged with the local
+// note ID, content hash and revision, so a note keeps its remote file across
+// renames and moves.
+struct NoteUpload
+{
+    QString localNoteId;
+    QString remoteId;            // Empty if the caller does not know the file yet
+    QString title;
+    NoteBodyProvider body;
+    QString folderName;
+    QString previousFolderName;  // Set when the note moved since its last sync
+    QString contentHash;
+    int revision = 0;
+    bool metadataOnly = false;   // Content unchanged, only the name or folder moved
+};
+
+// A note file found on the remote by a full listing
+struct RemoteNoteFile
+{
+    QString id;
+    QString title;
+    QString folderName;   // Empty for files directly in the notes folder
+    QString localNoteId;  // Set if this app uploaded the file
+    QString contentHash;  // MD5 of the content, matches calculateFileHash()
+    int revision = 0;
+    qint64 size = 0;
+    QDateTime modifiedTime;
+};
+
+// Remote store that SyncManager syncs notes with. GoogleDriveManager talks to
+// Drive; LocalSyncBackend keeps the notes in a local directory, for offline runs
+// and benchmarks. Every operation is asynchronous and completes through the
+// signals below, the way a Drive reply would.
+class SyncBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncBackend(QObject *parent = nullptr);
+    ~SyncBackend() override;
+
+    // Authentication
+    virtual bool isAuthenticated() const = 0;
+    virtual void authenticate() = 0;
+    virtual void completeOAuth(const QString &authCode) = 0;
+    virtual void forceReauthenticate() = 0;
+    virtual void logout() = 0;
+
+    // Notes folder and folder structure. smartSync looks up the remote folders,
+    // which uploads need, and reports smartSyncComplete.
+    virtual void createNotesFolder() = 0;
+    virtual void setSyncFolder(const QString &folderId) = 0;
+    virtual QString getNotesFolderId() const = 0;
+    virtual void smartSync() = 0;
+    virtual bool isStructureChecked() const = 0;
+    virtual void clearStructureData() = 0;
+
+    // Listing
+    virtual void listNotes() = 0;     // Notes folder only, as Drive file JSON
+    virtual void listAllNotes() = 0;  // Every note in the notes folder and its subfolders
+
+    // Uploads
+    virtual void uploadLocalNote(const NoteUpload &upload) = 0;
+    virtual void cancelUploads(const QString &localNoteId) = 0;
+    virtual void createNote(const QString &title, const QString &content) = 0;
+    virtual void syncSingleNote(const QString &noteId, const QString &content, const QString &title,
+                                const QString &folderName) = 0;
+
+    // Downloads and deletes
+    virtual void downloadNote(const QString &noteId) = 0;
+    virtual void downloadNoteStreaming(const QString &fileId) = 0;  // Through noteDataReceived
+    virtual void deleteNote(const QString &noteId) = 0;
+
+    // Sends operations held back for batching right away
+    virtual void flushBatch() = 0;
+
+    // Health and load
+    virtual bool isCircuitOpen() const = 0;
+    virtual qint64 inFlightBytes() const = 0;  // Request bodies held by sync work in progress
+
+    // Hash of note content as listings report it
+    QString calculateFileHash(const QString &content) const;
+    // Reads a note file from Drive file JSON, the format of notesListReceived
+    static RemoteNoteFile remoteNoteFromJson(const QJsonObject &file, const QString &folderName);
+
+signals:
+    void authenticationChanged(bool authenticated);
+    void uploadComplete(const QString &noteId, bool success);
+    void localNoteUploaded(const QString &localNoteId, const QString &remoteId, bool success);
+    void localNoteUploadDeferred(const QString &localNoteId);  // Not sent yet; its folder is being created
+    void remoteFolderReady(const QString &folderName);
+    void downloadComplete(const QString &noteId, const QString &content, bool success);
+    void deleteComplete(const QString &noteId, bool success);
+    void notesListReceived(const QJsonArray &notes);
+    void remoteNotesListed(const QList<RemoteNoteFile> &notes, bool complete);
+    void noteDataReceived(const QString &fileId, const QByteArray &chunk);
+    void noteDownloadRestarted(const QString &fileId);  // Discard data received so far
+    void noteStreamFinished(const QString &fileId, bool success);
+    void syncProgress(int current, int total);
+    void syncComplete();        // The notes folder is ready
+    void smartSyncComplete();
+    void error(const QString &errorMessage);
+    void circuitBreakerChanged(bool open);
+    void inFlightBytesChanged(qint64 bytes);
+};
+
+#endif // SYNCBACKEND_H
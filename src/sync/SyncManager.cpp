@@ -1,5 +1,7 @@
 #include "SyncManager.h"
+#include "GoogleDriveManager.h"
 #include "../db/DatabaseManager.h"
+#include "../utils/Tracer.h"
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -7,36 +9,99 @@
 #include <QDir>
 #include <QFile>
 #include <QTextStream>
+#include <QSet>
 #include <QDebug>
 
+// Outbox entries sent per round, and attempts before an entry is marked failed
+static const int OUTBOX_BATCH_SIZE = 50;
+static const int OUTBOX_MAX_ATTEMPTS = 5;
+
+// Changed notes read from the database per batch when queueing a full upload
+static const int CHANGE_SCAN_BATCH_SIZE = 500;
+
 SyncManager::SyncManager(DatabaseManager *dbManager, QObject *parent)
+    : SyncManager(dbManager, new GoogleDriveManager(), parent)
+{
+}
+
+SyncManager::SyncManager(DatabaseManager *dbManager, SyncBackend *backend, QObject *parent)
     : QObject(parent)
     , m_dbManager(dbManager)
-    , m_driveManager(new GoogleDriveManager(this))
+    , m_backend(backend)
+    , m_outbox(dbManager->database())
+    , m_downloader(new NoteDownloader(m_backend, dbManager, &m_outbox, this))
     , m_isSyncing(false)
     , m_autoSyncEnabled(false)
     , m_autoSyncTimer(new QTimer(this))
+    , m_noteChangeTimer(new QTimer(this))
+    , m_changeIdleMs(5000)
+    , m_changeMaxStalenessMs(60000)
     , m_autoSyncInterval(15)
 {
-    // Connect Google Drive signals
-    connect(m_driveManager, &GoogleDriveManager::authenticationChanged, this, &SyncManager::onAuthenticationChanged);
-    connect(m_driveManager, &GoogleDriveManager::notesListReceived, this, &SyncManager::onNotesListReceived);
-    connect(m_driveManager, &GoogleDriveManager::uploadComplete, this, &SyncManager::onUploadComplete);
-    connect(m_driveManager, &GoogleDriveManager::downloadComplete, this, &SyncManager::onDownloadComplete);
-    connect(m_driveManager, &GoogleDriveManager::deleteComplete, this, &SyncManager::onDeleteComplete);
-    connect(m_driveManager, &GoogleDriveManager::syncComplete, this, &SyncManager::onFolderCreated);
-    connect(m_driveManager, &GoogleDriveManager::smartSyncComplete, this, &SyncManager::onSmartSyncComplete);
-    connect(m_driveManager, &GoogleDriveManager::error, this, &SyncManager::onError);
+    m_backend->setParent(this);
+    
+    // Connect backend signals
+    connect(m_backend, &SyncBackend::authenticationChanged, this, &SyncManager::onAuthenticationChanged);
+    connect(m_backend, &SyncBackend::notesListReceived, this, &SyncManager::onNotesListReceived);
+    connect(m_backend, &SyncBackend::uploadComplete, this, &SyncManager::onUploadComplete);
+    connect(m_backend, &SyncBackend::localNoteUploaded, this, &SyncManager::onLocalNoteUploaded);
+    connect(m_backend, &SyncBackend::localNoteUploadDeferred, this, &SyncManager::onLocalNoteUploadDeferred);
+    connect(m_backend, &SyncBackend::remoteFolderReady, this, &SyncManager::onRemoteFolderReady);
+    connect(m_backend, &SyncBackend::downloadComplete, this, &SyncManager::onDownloadComplete);
+    connect(m_backend, &SyncBackend::deleteComplete, this, &SyncManager::onDeleteComplete);
+    connect(m_backend, &SyncBackend::syncComplete, this, &SyncManager::onFolderCreated);
+    connect(m_backend, &SyncBackend::smartSyncComplete, this, &SyncManager::onSmartSyncComplete);
+    connect(m_backend, &SyncBackend::error, this, &SyncManager::onError);
+    connect(m_backend, &SyncBackend::circuitBreakerChanged, this, &SyncManager::onCircuitBreakerChanged);
+    connect(m_backend, &SyncBackend::inFlightBytesChanged, this, &SyncManager::inFlightBytesChanged);
+    
+    // Bulk downloads: the full listing feeds the comparison, which feeds the downloader
+    connect(m_backend, &SyncBackend::remoteNotesListed, this, [this](const QList<RemoteNoteFile> &notes, bool complete) {
+        if (!complete) {
+            qDebug() << "Remote listing incomplete, downloading the notes found so far";
+        }
+        compareNotes(notes);
+    });
+    connect(m_downloader, &NoteDownloader::progress, this, &SyncManager::syncProgress);
+    connect(m_downloader, &NoteDownloader::noteRestored, this, [this](int noteId, const QString &) {
+        emit noteDownloaded(QString::number(noteId), true);
+    });
+    connect(m_downloader, &NoteDownloader::finished, this, [this](int restored, int failed) {
+        qDebug() << "Downloaded" << restored << "notes," << failed << "failed";
+        if (failed > 0) {
+            m_isSyncing = false;
+            emit syncFailed(QString("%1 notes could not be downloaded and will be retried on the next sync").arg(failed));
+            return;
+        }
+        checkSyncCompletion();
+    });
     
     // Set up auto-sync timer
     connect(m_autoSyncTimer, &QTimer::timeout, this, &SyncManager::performAutoSync);
     
+    // Single timer armed for the earliest pending note change
+    m_noteChangeTimer->setSingleShot(true);
+    connect(m_noteChangeTimer, &QTimer::timeout, this, &SyncManager::flushDueNoteChanges);
+    m_changeClock.start();
+    
+    // Deleted notes leave tombstones; only their unsent edits need dropping here
+    connect(m_dbManager, &DatabaseManager::noteDeleted, this, [this](int noteId) {
+        handleNoteDeleted(QString::number(noteId));
+    });
+    
     // Load saved sync state
     loadSyncState();
+    
+    // Work the previous run claimed but never finished is sent again
+    int recovered = m_outbox.recoverInFlight();
+    int compacted = m_outbox.compact();
+    qDebug() << "Sync outbox:" << m_outbox.pendingCount() << "pending," << recovered << "recovered," << compacted << "compacted";
 }
 
 SyncManager::~SyncManager()
 {
+    // Commits what it has downloaded while m_outbox, which it records into, still exists
+    delete m_downloader;
     saveSyncState();
 }
 
@@ -46,7 +111,7 @@ void SyncManager::startAutoSync(int intervalMinutes)
     m_autoSyncEnabled = true;
     m_syncCompletedEmitted = false;  // Reset flag when starting auto-sync
     
-    if (m_driveManager->isAuthenticated()) {
+    if (m_backend->isAuthenticated()) {
         m_autoSyncTimer->start(intervalMinutes * 60 * 1000);
         performAutoSync(); // Initial sync
     }
@@ -64,7 +129,7 @@ void SyncManager::syncNow()
         return;
     }
     
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated with Google Drive");
         return;
     }
@@ -74,14 +139,14 @@ void SyncManager::syncNow()
     emit syncStarted();
     
     // Start by getting the list of remote notes
-    m_driveManager->listNotes();
+    m_backend->listNotes();
 }
 
 void SyncManager::setAutoSyncEnabled(bool enabled)
 {
     m_autoSyncEnabled = enabled;
     
-    if (enabled && m_driveManager->isAuthenticated()) {
+    if (enabled && m_backend->isAuthenticated()) {
         startAutoSync(m_autoSyncInterval);
     } else {
         stopAutoSync();
@@ -105,28 +170,33 @@ QString SyncManager::getSyncStatus() const
 {
     if (m_isSyncing) {
         return "Syncing...";
-    } else if (m_driveManager->isAuthenticated()) {
+    } else if (m_backend->isAuthenticated()) {
         return "Connected to Google Drive";
     } else {
         return "Not connected";
     }
 }
 
+qint64 SyncManager::inFlightBytes() const
+{
+    return m_backend->inFlightBytes();
+}
+
 bool SyncManager::isAuthenticated() const
 {
-    bool authenticated = m_driveManager->isAuthenticated();
+    bool authenticated = m_backend->isAuthenticated();
     qDebug() << "SyncManager::isAuthenticated() called, returning:" << authenticated;
     return authenticated;
 }
 
 void SyncManager::authenticate()
 {
-    m_driveManager->authenticate();
+    m_backend->authenticate();
 }
 
 void SyncManager::logout()
 {
-    m_driveManager->logout();
+    m_backend->logout();
     
     // Clear sync state
     m_syncCompletedEmitted = false;  // Reset flag when logging out
@@ -141,13 +211,13 @@ void SyncManager::forceReauthenticate()
     m_syncCompletedEmitted = false;
     
     // Force re-authentication in the drive manager
-    m_driveManager->forceReauthenticate();
+    m_backend->forceReauthenticate();
 }
 
 void SyncManager::clearStructureData()
 {
     qDebug() << "Clearing structure data in SyncManager...";
-    m_driveManager->clearStructureData();
+    m_backend->clearStructureData();
 }
 
 void SyncManager::completeOAuth(const QString &authCode)
@@ -155,57 +225,96 @@ void SyncManager::completeOAuth(const QString &authCode)
     qDebug() << "Completing OAuth flow with auth code:" << authCode.mid(0, 10) + "...";
     
     // Call the GoogleDriveManager to complete the OAuth flow
-    m_driveManager->completeOAuth(authCode);
+    m_backend->completeOAuth(authCode);
 }
 
 void SyncManager::uploadAllNotes()
 {
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated");
         return;
     }
     
-    qDebug() << "Starting upload of all local notes to Google Drive";
+    qDebug() << "Starting upload of local notes changed since the last sync";
     m_syncCompletedEmitted = false;  // Reset flag for new upload operation
+    m_isSyncing = true;
+    emit syncStarted();
     
-    // Get the hierarchical folder structure from the database
-    QList<QPair<QString, QList<QPair<QString, QString>>>> folderStructure = m_dbManager->getFolderStructure();
+    uploadChangedNotes();
+}
+
+void SyncManager::uploadChangedNotes()
+{
+    int queued = queueChangedNotes();
+    qDebug() << "Queued" << queued << "changed notes," << m_outbox.pendingCount() << "operations pending";
     
-    if (folderStructure.isEmpty()) {
-        qDebug() << "No folder structure found to upload";
-        if (!m_syncCompletedEmitted) {
-            emit syncCompleted();
-            m_syncCompletedEmitted = true;
-        }
+    if (m_outbox.pendingCount() == 0) {
+        qDebug() << "Nothing to upload";
+        checkSyncCompletion();
         return;
     }
     
-    qDebug() << "Found" << folderStructure.size() << "folders to upload";
-    
-    // Upload the hierarchical folder structure to Google Drive
-    m_driveManager->uploadFolderStructure(folderStructure);
-    
-    m_syncCompletedEmitted = false;  // Reset flag when starting upload
-    emit syncStarted();
+    m_uploadingChanges = true;
+    if (m_backend->isStructureChecked()) {
+        drainOutbox();
+    } else {
+        // Uploads need the remote folder IDs; onSmartSyncComplete drains the outbox
+        m_backend->smartSync();
+    }
+}
+
+int SyncManager::queueChangedNotes()
+{
+    // Unchanged notes are filtered out by the query, so this costs what changed
+    int queued = 0;
+    int lastNoteId = 0;
+    QSqlDatabase db = m_dbManager->database();
+    forever {
+        QList<NoteChange> changes = m_dbManager->getNotesChangedSinceSync(lastNoteId, CHANGE_SCAN_BATCH_SIZE);
+        if (changes.isEmpty()) {
+            break;
+        }
+        
+        db.transaction();
+        for (const NoteChange &change : changes) {
+            if (m_outbox.enqueueUpload(change.id)) {
+                queued++;
+            }
+        }
+        db.commit();
+        
+        lastNoteId = changes.last().id;
+        if (changes.size() < CHANGE_SCAN_BATCH_SIZE) {
+            break;
+        }
+    }
+    return queued;
 }
 
 void SyncManager::downloadAllNotes()
 {
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated");
         return;
     }
     
+    if (m_downloader->isRunning()) {
+        qDebug() << "Download of remote notes already running";
+        return;
+    }
+    
     qDebug() << "Starting download of all remote notes from Google Drive";
     m_syncCompletedEmitted = false;  // Reset flag when starting download
+    m_isSyncing = true;
+    emit syncStarted();
     
-    // Get list of remote notes and download them all
-    m_driveManager->listNotes();
+    // List every note in every subfolder; compareNotes picks the ones to fetch
+    m_backend->listAllNotes();
 }
 
 void SyncManager::syncAllNotes()
 {
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated");
         return;
     }
@@ -213,14 +322,20 @@ void SyncManager::syncAllNotes()
     qDebug() << "Starting full sync: upload local notes, then download remote notes";
     m_syncCompletedEmitted = false;  // Reset flag for new sync operation
     
+    // A manual sync gives up on nothing: uploads and deletes that ran out of attempts go again
+    int requeued = m_outbox.requeueFailed();
+    if (requeued > 0) {
+        qDebug() << "Requeued" << requeued << "failed sync operations";
+    }
+    
     // Clear any existing structure data to prevent duplication
-    m_driveManager->clearStructureData();
+    m_backend->clearStructureData();
     
     // Check if we have a sync folder, create one if needed
     if (m_syncFolderId.isEmpty()) {
         qDebug() << "No sync folder found, creating one...";
         m_isSyncing = true;  // Set sync flag before creating folder
-        m_driveManager->createNotesFolder();
+        m_backend->createNotesFolder();
         return; // Wait for folder creation to complete
     }
     
@@ -236,7 +351,7 @@ void SyncManager::syncAllNotes()
 
 void SyncManager::smartSync()
 {
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated");
         return;
     }
@@ -245,13 +360,13 @@ void SyncManager::smartSync()
     m_syncCompletedEmitted = false;  // Reset flag for new sync operation
     
     // Clear any existing structure data to prevent duplication
-    m_driveManager->clearStructureData();
+    m_backend->clearStructureData();
     
     // Check if we have a sync folder, create one if needed
     if (m_syncFolderId.isEmpty()) {
         qDebug() << "No sync folder found, creating one...";
         m_isSyncing = true;  // Set sync flag before creating folder
-        m_driveManager->createNotesFolder();
+        m_backend->createNotesFolder();
         return; // Wait for folder creation to complete
     }
     
@@ -259,12 +374,12 @@ void SyncManager::smartSync()
     m_isSyncing = true;  // Set sync flag for smart sync
     
     // Use the new smart sync method
-    m_driveManager->smartSync();
+    m_backend->smartSync();
 }
 
 void SyncManager::syncSingleNote(const QString &noteId, const QString &content, const QString &title, const QString &folderName)
 {
-    if (!m_driveManager->isAuthenticated()) {
+    if (!m_backend->isAuthenticated()) {
         emit syncFailed("Not authenticated");
         return;
     }
@@ -272,27 +387,264 @@ void SyncManager::syncSingleNote(const QString &noteId, const QString &content,
     qDebug() << "Syncing single note:" << title << "in folder:" << folderName;
     
     // Use the smart sync method for individual notes
-    m_driveManager->syncSingleNote(noteId, content, title, folderName);
+    m_backend->syncSingleNote(noteId, content, title, folderName);
 }
 
 void SyncManager::handleNoteChanged(const QString &noteId, const QString &content, const QString &title, const QString &folderName)
 {
-    if (!m_driveManager->isAuthenticated()) {
-        qDebug() << "Not authenticated, skipping note sync";
+    Q_UNUSED(content);
+    
+    // Record the change durably first so it survives a restart or going offline
+    m_outbox.enqueueUpload(noteId.toInt());
+    
+    if (!m_backend->isAuthenticated()) {
+        qDebug() << "Not authenticated, note change queued for later sync";
+        return;
+    }
+    
+    // Only the latest content matters, earlier unsent edits are simply replaced
+    qint64 now = m_changeClock.elapsed();
+    auto it = m_pendingNoteChanges.find(noteId);
+    if (it == m_pendingNoteChanges.end()) {
+        PendingNoteChange change;
+        change.firstChangedAt = now;
+        it = m_pendingNoteChanges.insert(noteId, change);
+    }
+    it->title = title;
+    it->lastChangedAt = now;
+    
+    qDebug() << "Note changed, coalescing:" << title << "in folder:" << folderName;
+    
+    scheduleNoteChangeFlush();
+}
+
+void SyncManager::handleNoteDeleted(const QString &noteId)
+{
+    m_pendingNoteChanges.remove(noteId);
+    scheduleNoteChangeFlush();
+    
+    // The delete left a tombstone in the database, which the next drain sends to Drive
+}
+
+void SyncManager::drainOutbox()
+{
+    TRACE_SCOPE("sync", "SyncManager::drainOutbox");
+    if (!m_backend->isAuthenticated() || m_backend->isCircuitOpen()) {
+        return;
+    }
+    if (m_syncFolderId.isEmpty()) {
+        // The Notes App folder is still being looked up; onFolderCreated drains afterwards
+        return;
+    }
+    if (m_outbox.pendingCount() == 0) {
+        return;
+    }
+    
+    // Uploads need the remote folder IDs, which a smart sync fetches
+    if (!m_backend->isStructureChecked()) {
+        if (!m_isSyncing) {
+            smartSync();
+        }
+        return;
+    }
+    
+    QList<SyncOutboxEntry> entries = m_outbox.takeQueued(OUTBOX_BATCH_SIZE);
+    QList<SyncTombstone> tombstones;
+    const QList<int> deletingIds = m_inFlightDeletes.values();
+    const QSet<int> deleting(deletingIds.begin(), deletingIds.end());
+    for (const SyncTombstone &tombstone : m_outbox.pendingTombstones(OUTBOX_BATCH_SIZE)) {
+        if (!deleting.contains(tombstone.noteId)) {
+            tombstones.append(tombstone);
+        }
+    }
+    if (entries.isEmpty() && tombstones.isEmpty()) {
+        return;
+    }
+    
+    qDebug() << "Replaying" << entries.size() << "queued uploads and" << tombstones.size() << "deletes";
+    m_outboxRoundProgressed = false;
+    dispatchOutboxEntries(entries);
+    
+    // Deletes of one round share a batch request
+    bool acknowledged = false;
+    for (const SyncTombstone &tombstone : tombstones) {
+        if (tombstone.remoteId.isEmpty()) {
+            // The note never made it to Drive
+            m_outbox.acknowledgeTombstone(tombstone.noteId);
+            acknowledged = true;
+            continue;
+        }
+        m_inFlightDeletes.insert(tombstone.remoteId, tombstone.noteId);
+        m_backend->deleteNote(tombstone.remoteId);
+    }
+    
+    if (m_inFlightUploads.isEmpty() && m_inFlightDeletes.isEmpty()) {
+        // Entries settled without a request, such as unchanged notes, are progress too
+        finishOutboxRound(acknowledged || !entries.isEmpty());
+    }
+}
+
+void SyncManager::dispatchOutboxEntries(const QList<SyncOutboxEntry> &entries)
+{
+    for (const SyncOutboxEntry &entry : entries) {
+        NoteData note = m_dbManager->getNote(entry.noteId);
+        if (note.id <= 0 || note.body.trimmed().isEmpty()) {
+            // Deleted since it was queued, or nothing to upload
+            m_outbox.markDone(entry.id);
+            continue;
+        }
+        
+        FolderData folder = m_dbManager->getFolder(note.folderId);
+        if (folder.name.isEmpty()) {
+            m_outbox.markFailed(entry.id, "Folder not found", OUTBOX_MAX_ATTEMPTS);
+            continue;
+        }
+        
+        SyncedNote synced = m_outbox.syncedNote(entry.noteId);
+        QString contentHash = m_backend->calculateFileHash(note.body);
+        bool contentSynced = synced.noteId > 0 && synced.contentHash == contentHash;
+        bool placeSynced = synced.title == note.title && synced.folderId == note.folderId;
+        if (contentSynced && placeSynced) {
+            qDebug() << "Note unchanged since last upload, skipping:" << note.title;
+            m_outbox.markDone(entry.id);
+            continue;
+        }
+        
+        // This version supersedes any upload of the same note still in flight
+        if (m_inFlightUploads.contains(entry.noteId)) {
+            m_outbox.markDone(m_inFlightUploads.take(entry.noteId).entryId);
+            m_backend->cancelUploads(QString::number(entry.noteId));
+        }
+        
+        InFlightUpload inFlight;
+        inFlight.entryId = entry.id;
+        inFlight.contentHash = contentHash;
+        inFlight.revision = synced.revision + 1;
+        inFlight.title = note.title;
+        inFlight.folderId = note.folderId;
+        inFlight.folderName = folder.name;
+        inFlight.updatedAt = note.updatedAt;
+        m_inFlightUploads.insert(entry.noteId, inFlight);
+        
+        // Renames and moves keep the remote file and skip the content upload
+        NoteUpload upload;
+        upload.localNoteId = QString::number(entry.noteId);
+        upload.remoteId = synced.remoteId;
+        upload.title = note.title;
+        // Read again when the content is sent, so nothing is pinned while the upload waits
+        DatabaseManager *dbManager = m_dbManager;
+        int noteId = entry.noteId;
+        upload.body = [dbManager, noteId]() { return dbManager->getNote(noteId).body.toUtf8(); };
+        upload.folderName = folder.name;
+        if (synced.folderId > 0 && synced.folderId != note.folderId) {
+            upload.previousFolderName = m_dbManager->getFolder(synced.folderId).name;
+        }
+        upload.contentHash = contentHash;
+        upload.revision = inFlight.revision;
+        upload.metadataOnly = contentSynced;
+        m_backend->uploadLocalNote(upload);
+    }
+}
+
+void SyncManager::finishOutboxRound(bool progressed)
+{
+    m_outboxRoundProgressed = m_outboxRoundProgressed || progressed;
+    if (!m_inFlightUploads.isEmpty() || !m_inFlightDeletes.isEmpty()) {
         return;
     }
     
-    qDebug() << "Note changed, syncing:" << title << "in folder:" << folderName;
+    m_outbox.compact();
+    
+    // Keep going while rounds make progress; failures wait for the next trigger
+    if (m_outboxRoundProgressed) {
+        m_outboxRoundProgressed = false;
+        drainOutbox();
+    }
+    if (!m_inFlightUploads.isEmpty() || !m_inFlightDeletes.isEmpty()) {
+        // The next round is out and still needs the folder structure
+        return;
+    }
+    
+    // A full upload is over once a round leaves nothing in flight
+    if (m_uploadingChanges) {
+        m_uploadingChanges = false;
+        checkSyncCompletion();
+    } else if (!m_isSyncing) {
+        // The drain is over; the next one starts from a fresh structure check
+        clearStructureData();
+    }
+}
+
+void SyncManager::setChangeCoalescing(int idleMs, int maxStalenessMs)
+{
+    m_changeIdleMs = qMax(0, idleMs);
+    m_changeMaxStalenessMs = qMax(m_changeIdleMs, maxStalenessMs);
+    scheduleNoteChangeFlush();
+}
+
+void SyncManager::scheduleNoteChangeFlush()
+{
+    if (m_pendingNoteChanges.isEmpty()) {
+        m_noteChangeTimer->stop();
+        return;
+    }
+    
+    qint64 earliest = -1;
+    for (const PendingNoteChange &change : m_pendingNoteChanges) {
+        qint64 due = qMin(change.lastChangedAt + m_changeIdleMs, change.firstChangedAt + m_changeMaxStalenessMs);
+        if (earliest < 0 || due < earliest) {
+            earliest = due;
+        }
+    }
+    
+    m_noteChangeTimer->start(int(qMax<qint64>(0, earliest - m_changeClock.elapsed())));
+}
+
+void SyncManager::flushDueNoteChanges()
+{
+    TRACE_SCOPE("sync", "SyncManager::flushDueNoteChanges");
+    qint64 now = m_changeClock.elapsed();
+    
+    QStringList dueNotes;
+    for (auto it = m_pendingNoteChanges.constBegin(); it != m_pendingNoteChanges.constEnd(); ++it) {
+        const PendingNoteChange &change = it.value();
+        if (now >= change.lastChangedAt + m_changeIdleMs || now >= change.firstChangedAt + m_changeMaxStalenessMs) {
+            dueNotes.append(it.key());
+        }
+    }
+    
+    for (const QString &noteId : dueNotes) {
+        flushNoteChange(noteId);
+    }
+    
+    scheduleNoteChangeFlush();
+}
+
+void SyncManager::flushNoteChange(const QString &noteId)
+{
+    if (!m_backend->isAuthenticated() || m_backend->isCircuitOpen()) {
+        // Stays in the outbox until Drive is reachable again
+        m_pendingNoteChanges.remove(noteId);
+        return;
+    }
     
     // Check if we have the structure information
-    if (!m_driveManager->isStructureChecked()) {
+    if (!m_backend->isStructureChecked()) {
         qDebug() << "Structure not checked yet, performing smart sync first";
-        smartSync();
+        if (!m_isSyncing) {
+            smartSync();
+        }
+        // The change is in the outbox, which onSmartSyncComplete drains; if the
+        // structure check fails it waits there for the next sync or edit
+        m_pendingNoteChanges.remove(noteId);
         return;
     }
     
-    // Use the smart sync method for individual notes
-    m_driveManager->syncSingleNote(noteId, content, title, folderName);
+    PendingNoteChange change = m_pendingNoteChanges.take(noteId);
+    qDebug() << "Syncing coalesced change for note:" << change.title;
+    
+    // The outbox entry reads the latest body from the database
+    dispatchOutboxEntries(m_outbox.takeQueued(OUTBOX_BATCH_SIZE, noteId.toInt()));
 }
 
 void SyncManager::resolveConflicts()
@@ -311,7 +663,7 @@ void SyncManager::onAuthenticationChanged(bool authenticated)
         m_syncCompletedEmitted = false;  // Reset flag for new authentication session
         
         // Create the notes folder in Google Drive
-        m_driveManager->createNotesFolder();
+        m_backend->createNotesFolder();
         
         if (m_autoSyncEnabled) {
             startAutoSync(m_autoSyncInterval);
@@ -327,12 +679,21 @@ void SyncManager::onAuthenticationChanged(bool authenticated)
 
 void SyncManager::onNotesListReceived(const QJsonArray &notes)
 {
+    TRACE_SCOPE("sync", "SyncManager::onNotesListReceived");
     // Compare remote notes with local notes
-    compareNotes(notes);
+    QList<RemoteNoteFile> remoteNotes;
+    for (const QJsonValue &value : notes) {
+        QJsonObject note = value.toObject();
+        if (note["mimeType"].toString() != "application/vnd.google-apps.folder") {
+            remoteNotes.append(SyncBackend::remoteNoteFromJson(note, QString()));
+        }
+    }
+    compareNotes(remoteNotes);
 }
 
 void SyncManager::onUploadComplete(const QString &noteId, bool success)
 {
+    TRACE_SCOPE("sync", "SyncManager::onUploadComplete");
     if (success) {
         // Update the ID mapping
         // This would need to be implemented based on your data structure
@@ -345,8 +706,66 @@ void SyncManager::onUploadComplete(const QString &noteId, bool success)
     checkSyncCompletion();
 }
 
+void SyncManager::onLocalNoteUploaded(const QString &localNoteId, const QString &remoteId, bool success)
+{
+    TRACE_SCOPE("sync", "SyncManager::onLocalNoteUploaded");
+    int noteId = localNoteId.toInt();
+    if (!m_inFlightUploads.contains(noteId)) {
+        return;
+    }
+    InFlightUpload upload = m_inFlightUploads.take(noteId);
+    
+    if (success && !remoteId.isEmpty()) {
+        SyncedNote synced;
+        synced.noteId = noteId;
+        synced.remoteId = remoteId;
+        synced.contentHash = upload.contentHash;
+        synced.revision = upload.revision;
+        synced.title = upload.title;
+        synced.folderId = upload.folderId;
+        synced.noteUpdatedAt = upload.updatedAt;
+        m_outbox.recordSynced(synced);
+        m_outbox.markDone(upload.entryId);
+    } else {
+        m_outbox.markFailed(upload.entryId, "Upload failed", OUTBOX_MAX_ATTEMPTS);
+    }
+    
+    finishOutboxRound(success);
+}
+
+void SyncManager::onLocalNoteUploadDeferred(const QString &localNoteId)
+{
+    int noteId = localNoteId.toInt();
+    if (!m_inFlightUploads.contains(noteId)) {
+        return;
+    }
+    
+    // Stays in flight until the folder is answered: onRemoteFolderReady requeues
+    // it, and a folder that cannot be created fails it through onLocalNoteUploaded
+    m_inFlightUploads[noteId].awaitingFolder = true;
+}
+
+void SyncManager::onRemoteFolderReady(const QString &folderName)
+{
+    qDebug() << "Remote folder ready, resuming queued uploads:" << folderName;
+    
+    // Waiting for a folder costs no attempt
+    for (auto it = m_inFlightUploads.begin(); it != m_inFlightUploads.end();) {
+        if (it->awaitingFolder && it->folderName == folderName) {
+            m_outbox.requeue(it->entryId);
+            it = m_inFlightUploads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    // Drains now, or once the uploads still in flight have answered
+    finishOutboxRound(true);
+}
+
 void SyncManager::onDownloadComplete(const QString &noteId, const QString &content, bool success)
 {
+    TRACE_SCOPE("sync", "SyncManager::onDownloadComplete");
     if (success) {
         // Save the downloaded note to local database
         // This would need to be implemented based on your DatabaseManager interface
@@ -360,14 +779,19 @@ void SyncManager::onDownloadComplete(const QString &noteId, const QString &conte
 
 void SyncManager::onDeleteComplete(const QString &noteId, bool success)
 {
-    if (success) {
-        // Remove from ID mappings
-        QString localId = getLocalNoteId(noteId);
-        if (!localId.isEmpty()) {
-            m_localToRemoteIdMap.remove(localId);
-            m_remoteToLocalIdMap.remove(noteId);
+    TRACE_SCOPE("sync", "SyncManager::onDeleteComplete");
+    if (m_inFlightDeletes.contains(noteId)) {
+        int localId = m_inFlightDeletes.take(noteId);
+        if (success) {
+            // Drive confirmed the delete, so the tombstone can go
+            m_outbox.acknowledgeTombstone(localId);
+        } else {
+            m_outbox.markTombstoneFailed(localId, "Delete failed", OUTBOX_MAX_ATTEMPTS);
         }
-        
+        finishOutboxRound(success);
+    }
+    
+    if (success) {
         emit noteDownloaded(noteId, true);
     } else {
         emit noteDownloaded(noteId, false);
@@ -404,18 +828,18 @@ void SyncManager::onError(const QString &errorMessage)
 void SyncManager::onFolderCreated()
 {
     qDebug() << "Notes folder created successfully in Google Drive!";
-    qDebug() << "Folder ID from drive manager:" << m_driveManager->getNotesFolderId();
+    qDebug() << "Folder ID from drive manager:" << m_backend->getNotesFolderId();
     qDebug() << "Current sync folder ID:" << m_syncFolderId;
     
     // Store the folder ID for future use
-    m_syncFolderId = m_driveManager->getNotesFolderId();
+    m_syncFolderId = m_backend->getNotesFolderId();
     
     qDebug() << "Updated sync folder ID to:" << m_syncFolderId;
     
-    // Ensure the GoogleDriveManager also has the correct folder ID
-    m_driveManager->setSyncFolder(m_syncFolderId);
+    // Ensure the backend also has the correct folder ID
+    m_backend->setSyncFolder(m_syncFolderId);
     
-    qDebug() << "Set GoogleDriveManager sync folder to:" << m_syncFolderId;
+    qDebug() << "Set backend sync folder to:" << m_syncFolderId;
     
     // Emit syncCompleted to update the UI (only once per folder creation)
     if (!m_syncCompletedEmitted) {
@@ -428,26 +852,33 @@ void SyncManager::onFolderCreated()
         // Check if this is a smart sync or regular sync
         // For now, we'll use the existing hierarchical upload
         // In the future, we could add a flag to distinguish between sync types
-        qDebug() << "Manual sync in progress, continuing with hierarchical upload...";
-        // Get the folder structure and upload it
-        QList<QPair<QString, QList<QPair<QString, QString>>>> folderStructure = m_dbManager->getFolderStructure();
-        m_driveManager->createSubfoldersAndUploadNotes(folderStructure);
+        qDebug() << "Manual sync in progress, uploading changed notes...";
+        uploadChangedNotes();
     } else if (m_autoSyncEnabled) {
         qDebug() << "Starting initial auto-sync...";
         syncNow();
+    } else {
+        // Replay work queued while offline or before a restart
+        drainOutbox();
     }
 }
 
 void SyncManager::onSmartSyncComplete()
 {
+    TRACE_SCOPE("sync", "SyncManager::onSmartSyncComplete");
     qDebug() << "Smart sync structure check completed!";
     
     // Mark sync as complete
     m_isSyncing = false;
     updateSyncTimestamp();
     
-    // Clear structure data to prevent duplication in next sync
-    clearStructureData();
+    // Folder IDs are known now and kept for every round of the drain;
+    // finishOutboxRound clears them once it is over
+    drainOutbox();
+    if (m_inFlightUploads.isEmpty() && m_inFlightDeletes.isEmpty()) {
+        // Nothing was sent; clear structure data to prevent duplication in next sync
+        clearStructureData();
+    }
     
     // Emit sync completed signal
     if (!m_syncCompletedEmitted) {
@@ -458,8 +889,32 @@ void SyncManager::onSmartSyncComplete()
     qDebug() << "Smart sync completed successfully";
 }
 
+void SyncManager::onCircuitBreakerChanged(bool open)
+{
+    if (open) {
+        // Requests already in flight keep their own retries; just stop starting new syncs
+        qDebug() << "Google Drive unavailable, pausing automatic sync";
+        emit syncFailed("Google Drive is temporarily unavailable. Sync will resume automatically.");
+        // With work in flight, the sync ends when it answers (finishOutboxRound, checkSyncCompletion)
+        if (m_inFlightUploads.isEmpty() && m_inFlightDeletes.isEmpty() && !m_downloader->isRunning()) {
+            m_isSyncing = false;
+        }
+    } else {
+        qDebug() << "Google Drive circuit breaker released, resuming automatic sync";
+        performAutoSync();
+    }
+}
+
 void SyncManager::performAutoSync()
 {
+    if (m_backend->isCircuitOpen()) {
+        qDebug() << "Skipping automatic sync while Google Drive is unavailable";
+        return;
+    }
+    
+    // Replay anything left over from edits made offline or before a restart
+    drainOutbox();
+    
     if (m_autoSyncEnabled && !m_isSyncing) {
         m_syncCompletedEmitted = false;  // Reset flag for auto-sync operation
         syncNow();
@@ -468,33 +923,51 @@ void SyncManager::performAutoSync()
 
 // Private methods
 
-void SyncManager::compareNotes(const QJsonArray &remoteNotes)
+void SyncManager::compareNotes(const QList<RemoteNoteFile> &remoteNotes)
 {
-    // This is a simplified comparison logic
-    // In production, you'd want more sophisticated conflict detection
+    TRACE_SCOPE("sync", "SyncManager::compareNotes");
+    QList<RemoteNoteFile> toDownload;
+    int upToDate = 0;
+    int keptLocal = 0;
     
-    QMap<QString, QJsonObject> remoteNotesMap;
-    
-    // Build map of remote notes by filename
-    for (const QJsonValue &value : remoteNotes) {
-        QJsonObject note = value.toObject();
-        QString filename = note["name"].toString();
-        remoteNotesMap[filename] = note;
+    for (const RemoteNoteFile &remote : remoteNotes) {
+        int noteId = m_outbox.noteIdForRemote(remote.id);
+        if (noteId <= 0) {
+            // Not on this machine yet
+            toDownload.append(remote);
+            continue;
+        }
+        
+        NoteData local = m_dbManager->getNote(noteId);
+        if (local.id <= 0) {
+            // Deleted locally, the outbox propagates the delete
+            continue;
+        }
+        
+        SyncedNote synced = m_outbox.syncedNote(noteId);
+        bool remoteChanged = remote.contentHash.isEmpty() || remote.contentHash != synced.contentHash;
+        bool localChanged = m_backend->calculateFileHash(local.body) != synced.contentHash;
+        
+        if (!remoteChanged) {
+            upToDate++;
+        } else if (localChanged) {
+            // Edited on both sides; the local edit is queued and wins
+            keptLocal++;
+            m_outbox.enqueueUpload(noteId);
+        } else {
+            toDownload.append(remote);
+        }
     }
     
-    // Get local notes (this would need to be implemented based on your DatabaseManager)
-    // For now, we'll assume we have a way to get local notes
-    
-    // Compare and determine what needs to be uploaded/downloaded
-    // This is a placeholder for the actual comparison logic
+    qDebug() << "Compared" << remoteNotes.size() << "remote notes:" << toDownload.size() << "to download,"
+             << upToDate << "up to date," << keptLocal << "kept local";
     
-    // For now, we'll just mark sync as complete
-    m_isSyncing = false;
-    updateSyncTimestamp();
-    if (!m_syncCompletedEmitted) {
-        emit syncCompleted();
-        m_syncCompletedEmitted = true;
+    if (toDownload.isEmpty()) {
+        checkSyncCompletion();
+        return;
     }
+    
+    m_downloader->start(toDownload);
 }
 
 void SyncManager::uploadLocalNote(const QString &noteId)
@@ -506,17 +979,17 @@ void SyncManager::uploadLocalNote(const QString &noteId)
 
 void SyncManager::downloadRemoteNote(const QString &noteId)
 {
-    m_driveManager->downloadNote(noteId);
+    m_backend->downloadNote(noteId);
 }
 
 void SyncManager::createRemoteNote(const QString &title, const QString &content)
 {
-    m_driveManager->createNote(title, content);
+    m_backend->createNote(title, content);
 }
 
 void SyncManager::deleteRemoteNote(const QString &noteId)
 {
-    m_driveManager->deleteNote(noteId);
+    m_backend->deleteNote(noteId);
 }
 
 void SyncManager::resolveNoteConflict(const QString &noteId, const QString &localContent, const QString &remoteContent)
@@ -550,12 +1023,13 @@ QString SyncManager::getNoteTitleFromFilename(const QString &filename) const
 
 QString SyncManager::getRemoteNoteId(const QString &localNoteId) const
 {
-    return m_localToRemoteIdMap.value(localNoteId);
+    return m_outbox.remoteIdForNote(localNoteId.toInt());
 }
 
 QString SyncManager::getLocalNoteId(const QString &remoteNoteId) const
 {
-    return m_remoteToLocalIdMap.value(remoteNoteId);
+    int noteId = m_outbox.noteIdForRemote(remoteNoteId);
+    return noteId > 0 ? QString::number(noteId) : QString();
 }
 
 void SyncManager::updateSyncTimestamp()
@@ -577,11 +1051,13 @@ void SyncManager::loadSyncState()
         m_autoSyncEnabled = state["auto_sync_enabled"].toBool();
         m_autoSyncInterval = state["auto_sync_interval"].toInt(15);
         
-        // Load ID mappings
+        // ID mappings used to live here; move them into the database once
         QJsonObject localToRemote = state["local_to_remote"].toObject();
         for (auto it = localToRemote.begin(); it != localToRemote.end(); ++it) {
-            m_localToRemoteIdMap[it.key()] = it.value().toString();
-            m_remoteToLocalIdMap[it.value().toString()] = it.key();
+            int noteId = it.key().toInt();
+            if (noteId > 0 && m_outbox.remoteIdForNote(noteId).isEmpty()) {
+                m_outbox.setRemoteId(noteId, it.value().toString());
+            }
         }
     }
 }
@@ -598,13 +1074,6 @@ void SyncManager::saveSyncState()
         state["auto_sync_enabled"] = m_autoSyncEnabled;
         state["auto_sync_interval"] = m_autoSyncInterval;
         
-        // Save ID mappings
-        QJsonObject localToRemote;
-        for (auto it = m_localToRemoteIdMap.begin(); it != m_localToRemoteIdMap.end(); ++it) {
-            localToRemote[it.key()] = it.value();
-        }
-        state["local_to_remote"] = localToRemote;
-        
         QTextStream stream(&stateFile);
         stream << QJsonDocument(state).toJson();
     }
@@ -613,7 +1082,7 @@ void SyncManager::saveSyncState()
 void SyncManager::checkSyncCompletion()
 {
     // Check if all pending operations are complete
-    if (m_pendingUploads.isEmpty() && m_pendingDownloads.isEmpty() && m_pendingDeletes.isEmpty()) {
+    if (m_inFlightUploads.isEmpty() && !m_downloader->isRunning() && m_inFlightDeletes.isEmpty()) {
         m_isSyncing = false;
         updateSyncTimestamp();
         
@@ -5,7 +5,10 @@
 #include <QTimer>
 #include <QDateTime>
 #include <QMap>
-#include "GoogleDriveManager.h"
+#include <QElapsedTimer>
+#include "SyncBackend.h"
+#include "SyncOutbox.h"
+#include "NoteDownloader.h"
 
 class DatabaseManager; // Forward declaration
 
@@ -14,7 +17,9 @@ class SyncManager : public QObject
     Q_OBJECT
 
 public:
-    explicit SyncManager(DatabaseManager *dbManager, QObject *parent = nullptr);
+    explicit SyncManager(DatabaseManager *dbManager, QObject *parent = nullptr);  // Syncs with Google Drive
+    // Syncs with the given backend and takes ownership of it
+    SyncManager(DatabaseManager *dbManager, SyncBackend *backend, QObject *parent = nullptr);
     ~SyncManager();
 
     // Sync control
@@ -27,6 +32,7 @@ public:
     bool isSyncing() const;
     QString getLastSyncTime() const;
     QString getSyncStatus() const;
+    qint64 inFlightBytes() const;
     
     // Authentication
     bool isAuthenticated() const;
@@ -42,6 +48,9 @@ public:
     void smartSync(); // New smart sync method
     void syncSingleNote(const QString &noteId, const QString &content, const QString &title, const QString &folderName);
     void handleNoteChanged(const QString &noteId, const QString &content, const QString &title, const QString &folderName);
+    void setChangeCoalescing(int idleMs, int maxStalenessMs);
+    void handleNoteDeleted(const QString &noteId);
+    void drainOutbox();
     void resolveConflicts();
     void clearStructureData();
 
@@ -50,6 +59,7 @@ signals:
     void syncProgress(int current, int total);
     void syncCompleted();
     void syncFailed(const QString &error);
+    void inFlightBytesChanged(qint64 bytes);
     void noteUploaded(const QString &noteId, bool success);
     void noteDownloaded(const QString &noteId, bool success);
     void conflictDetected(const QString &noteId, const QString &localContent, const QString &remoteContent);
@@ -59,16 +69,21 @@ private slots:
     void onAuthenticationChanged(bool authenticated);
     void onNotesListReceived(const QJsonArray &notes);
     void onUploadComplete(const QString &noteId, bool success);
+    void onLocalNoteUploaded(const QString &localNoteId, const QString &remoteId, bool success);
+    void onLocalNoteUploadDeferred(const QString &localNoteId);
+    void onRemoteFolderReady(const QString &folderName);
     void onDownloadComplete(const QString &noteId, const QString &content, bool success);
     void onDeleteComplete(const QString &noteId, bool success);
     void onFolderCreated();
     void onSmartSyncComplete();
     void onError(const QString &errorMessage);
+    void onCircuitBreakerChanged(bool open);
     void performAutoSync();
+    void flushDueNoteChanges();
 
 private:
     // Sync logic
-    void compareNotes(const QJsonArray &remoteNotes);
+    void compareNotes(const QList<RemoteNoteFile> &remoteNotes);
     void uploadLocalNote(const QString &noteId);
     void downloadRemoteNote(const QString &noteId);
     void createRemoteNote(const QString &title, const QString &content);
@@ -86,9 +101,23 @@ private:
     void loadSyncState();
     void saveSyncState();
     void checkSyncCompletion();
+    
+    // Edit coalescing
+    void scheduleNoteChangeFlush();
+    void flushNoteChange(const QString &noteId);
+    
+    // Outbox replay
+    void dispatchOutboxEntries(const QList<SyncOutboxEntry> &entries);
+    void finishOutboxRound(bool progressed);
+    
+    // Full uploads queue only notes changed since their last sync
+    void uploadChangedNotes();
+    int queueChangedNotes();
 
     DatabaseManager *m_dbManager;
-    GoogleDriveManager *m_driveManager;
+    SyncBackend *m_backend;
+    SyncOutbox m_outbox;
+    NoteDownloader *m_downloader;
     
     // Sync state
     bool m_isSyncing;
@@ -96,14 +125,37 @@ private:
     QDateTime m_lastSyncTime;
     QTimer *m_autoSyncTimer;
     
-    // Mapping between local and remote note IDs
-    QMap<QString, QString> m_localToRemoteIdMap;
-    QMap<QString, QString> m_remoteToLocalIdMap;
+    // Pending operations. Uploads live in the outbox and deletes as tombstones;
+    // these track the ones currently being sent.
+    struct InFlightUpload
+    {
+        qint64 entryId;
+        QString contentHash;
+        int revision;
+        QString title;
+        int folderId;
+        QString folderName;
+        QDateTime updatedAt;
+        bool awaitingFolder = false;  // Deferred until its remote folder exists
+    };
+    QMap<int, InFlightUpload> m_inFlightUploads;   // Local note ID -> entry
+    QMap<QString, int> m_inFlightDeletes;          // Remote note ID -> local note ID
+    bool m_outboxRoundProgressed = false;
+    bool m_uploadingChanges = false;
     
-    // Pending operations
-    QList<QString> m_pendingUploads;
-    QList<QString> m_pendingDownloads;
-    QList<QString> m_pendingDeletes;
+    // Latest unsynced edit per note. A note is uploaded once it has been idle for
+    // m_changeIdleMs, or at the latest m_changeMaxStalenessMs after its first edit.
+    struct PendingNoteChange
+    {
+        QString title;
+        qint64 firstChangedAt;
+        qint64 lastChangedAt;
+    };
+    QMap<QString, PendingNoteChange> m_pendingNoteChanges;
+    QTimer *m_noteChangeTimer;
+    QElapsedTimer m_changeClock;
+    int m_changeIdleMs;
+    int m_changeMaxStalenessMs;
     
     // Sync configuration
     QString m_syncFolderId;
@@ -0,0 +1,328 @@
+#include "SyncOutbox.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QStringList>
+#include <QDebug>
+
+SyncOutbox::SyncOutbox(const QSqlDatabase &db)
+    : m_db(db)
+{
+}
+
+bool SyncOutbox::enqueueUpload(int noteId)
+{
+    // Uploads read the body at send time, so one queued upload per note is enough
+    QSqlQuery q(m_db);
+    q.prepare("SELECT 1 FROM sync_outbox WHERE note_id = ? AND op = 'upload' AND state = 'queued' LIMIT 1");
+    q.addBindValue(noteId);
+    if (q.exec() && q.next()) {
+        return true;
+    }
+
+    q.prepare("INSERT INTO sync_outbox (note_id, op, state) VALUES (?, 'upload', 'queued')");
+    q.addBindValue(noteId);
+    if (!q.exec()) {
+        qWarning() << "Failed to queue upload for note" << noteId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+QList<SyncOutboxEntry> SyncOutbox::takeQueued(int limit, int noteId)
+{
+    QList<SyncOutboxEntry> entries;
+
+    m_db.transaction();
+    QSqlQuery q(m_db);
+
+    QString sql = "SELECT id, note_id, attempts, last_error FROM sync_outbox "
+                  "WHERE op = 'upload' AND state = 'queued' ";
+    if (noteId >= 0) {
+        sql += "AND note_id = ? ";
+    }
+    sql += "ORDER BY id LIMIT ?";
+
+    q.prepare(sql);
+    if (noteId >= 0) {
+        q.addBindValue(noteId);
+    }
+    q.addBindValue(limit);
+    if (!q.exec()) {
+        qWarning() << "Failed to read sync outbox:" << q.lastError();
+        m_db.rollback();
+        return entries;
+    }
+
+    while (q.next()) {
+        SyncOutboxEntry entry;
+        entry.id = q.value(0).toLongLong();
+        entry.noteId = q.value(1).toInt();
+        entry.state = SyncOutboxEntry::InFlight;
+        entry.attempts = q.value(2).toInt();
+        entry.lastError = q.value(3).toString();
+        entries.append(entry);
+    }
+
+    QSqlQuery update(m_db);
+    update.prepare("UPDATE sync_outbox SET state = 'in_flight', updated_at = CURRENT_TIMESTAMP WHERE id = ?");
+    for (const SyncOutboxEntry &entry : entries) {
+        update.addBindValue(entry.id);
+        if (!update.exec()) {
+            qWarning() << "Failed to claim outbox entry" << entry.id << ":" << update.lastError();
+            m_db.rollback();
+            return QList<SyncOutboxEntry>();
+        }
+    }
+
+    m_db.commit();
+    return entries;
+}
+
+bool SyncOutbox::markDone(qint64 entryId)
+{
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE sync_outbox SET state = 'done', last_error = NULL, updated_at = CURRENT_TIMESTAMP WHERE id = ?");
+    q.addBindValue(entryId);
+    if (!q.exec()) {
+        qWarning() << "Failed to complete outbox entry" << entryId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SyncOutbox::markFailed(qint64 entryId, const QString &error, int maxAttempts)
+{
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE sync_outbox SET attempts = attempts + 1, last_error = ?, "
+              "state = CASE WHEN attempts + 1 >= ? THEN 'failed' ELSE 'queued' END, "
+              "updated_at = CURRENT_TIMESTAMP WHERE id = ?");
+    q.addBindValue(error);
+    q.addBindValue(maxAttempts);
+    q.addBindValue(entryId);
+    if (!q.exec()) {
+        qWarning() << "Failed to record outbox failure" << entryId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SyncOutbox::requeue(qint64 entryId)
+{
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE sync_outbox SET state = 'queued', updated_at = CURRENT_TIMESTAMP WHERE id = ?");
+    q.addBindValue(entryId);
+    if (!q.exec()) {
+        qWarning() << "Failed to requeue outbox entry" << entryId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+QList<SyncTombstone> SyncOutbox::pendingTombstones(int limit) const
+{
+    QList<SyncTombstone> tombstones;
+    QSqlQuery q(m_db);
+
+    // The remote ID is taken from sync_state when an upload finished after the delete
+    q.prepare("SELECT t.note_id, COALESCE(t.remote_id, s.remote_id), t.attempts FROM sync_tombstones t "
+              "LEFT JOIN sync_state s ON s.note_id = t.note_id "
+              "WHERE t.state = 'queued' "
+              "AND t.note_id NOT IN (SELECT note_id FROM sync_outbox WHERE state = 'in_flight') "
+              "ORDER BY t.deleted_at, t.note_id LIMIT ?");
+    q.addBindValue(limit);
+    if (!q.exec()) {
+        qWarning() << "Failed to read sync tombstones:" << q.lastError();
+        return tombstones;
+    }
+
+    while (q.next()) {
+        SyncTombstone tombstone;
+        tombstone.noteId = q.value(0).toInt();
+        tombstone.remoteId = q.value(1).toString();
+        tombstone.attempts = q.value(2).toInt();
+        tombstones.append(tombstone);
+    }
+    return tombstones;
+}
+
+bool SyncOutbox::acknowledgeTombstone(int noteId)
+{
+    m_db.transaction();
+    QSqlQuery q(m_db);
+
+    const QStringList statements = {
+        "DELETE FROM sync_tombstones WHERE note_id = ?",
+        "DELETE FROM sync_state WHERE note_id = ?"
+    };
+    for (const QString &statement : statements) {
+        q.prepare(statement);
+        q.addBindValue(noteId);
+        if (!q.exec()) {
+            qWarning() << "Failed to acknowledge tombstone for note" << noteId << ":" << q.lastError();
+            m_db.rollback();
+            return false;
+        }
+    }
+    return m_db.commit();
+}
+
+bool SyncOutbox::markTombstoneFailed(int noteId, const QString &error, int maxAttempts)
+{
+    QSqlQuery q(m_db);
+    q.prepare("UPDATE sync_tombstones SET attempts = attempts + 1, last_error = ?, "
+              "state = CASE WHEN attempts + 1 >= ? THEN 'failed' ELSE 'queued' END "
+              "WHERE note_id = ?");
+    q.addBindValue(error);
+    q.addBindValue(maxAttempts);
+    q.addBindValue(noteId);
+    if (!q.exec()) {
+        qWarning() << "Failed to record tombstone failure for note" << noteId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+int SyncOutbox::recoverInFlight()
+{
+    QSqlQuery q(m_db);
+    if (!q.exec("UPDATE sync_outbox SET state = 'queued', updated_at = CURRENT_TIMESTAMP WHERE state = 'in_flight'")) {
+        qWarning() << "Failed to recover in-flight outbox entries:" << q.lastError();
+        return 0;
+    }
+    return q.numRowsAffected();
+}
+
+int SyncOutbox::requeueFailed()
+{
+    QSqlQuery q(m_db);
+    if (!q.exec("UPDATE sync_outbox SET state = 'queued', attempts = 0, updated_at = CURRENT_TIMESTAMP WHERE state = 'failed'")) {
+        qWarning() << "Failed to requeue failed outbox entries:" << q.lastError();
+        return 0;
+    }
+    int requeued = q.numRowsAffected();
+
+    if (!q.exec("UPDATE sync_tombstones SET state = 'queued', attempts = 0 WHERE state = 'failed'")) {
+        qWarning() << "Failed to requeue failed tombstones:" << q.lastError();
+        return requeued;
+    }
+    return requeued + q.numRowsAffected();
+}
+
+int SyncOutbox::compact()
+{
+    int removed = 0;
+    QSqlQuery q(m_db);
+
+    m_db.transaction();
+
+    const QStringList statements = {
+        // Finished work
+        "DELETE FROM sync_outbox WHERE state = 'done'",
+        // Uploads of notes deleted since; the delete trigger normally drops these already
+        "DELETE FROM sync_outbox WHERE op = 'upload' AND state IN ('queued', 'failed') "
+        "AND note_id IN (SELECT note_id FROM sync_tombstones)",
+        // Failed uploads that a newer queued upload of the same note replaces
+        "DELETE FROM sync_outbox WHERE op = 'upload' AND state = 'failed' "
+        "AND note_id IN (SELECT note_id FROM sync_outbox WHERE op = 'upload' AND state = 'queued')",
+        // Duplicate queued uploads of one note, keep the oldest row
+        "DELETE FROM sync_outbox WHERE op = 'upload' AND state = 'queued' "
+        "AND id NOT IN (SELECT MIN(id) FROM sync_outbox WHERE op = 'upload' AND state = 'queued' GROUP BY note_id)"
+    };
+    for (const QString &statement : statements) {
+        if (!q.exec(statement)) {
+            qWarning() << "Failed to compact sync outbox:" << q.lastError();
+            m_db.rollback();
+            return 0;
+        }
+        removed += q.numRowsAffected();
+    }
+
+    m_db.commit();
+    return removed;
+}
+
+int SyncOutbox::pendingCount() const
+{
+    QSqlQuery q(m_db);
+    if (q.exec("SELECT (SELECT COUNT(*) FROM sync_outbox WHERE state IN ('queued', 'in_flight')) "
+               "+ (SELECT COUNT(*) FROM sync_tombstones WHERE state = 'queued')") && q.next()) {
+        return q.value(0).toInt();
+    }
+    return 0;
+}
+
+QString SyncOutbox::remoteIdForNote(int noteId) const
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT remote_id FROM sync_state WHERE note_id = ?");
+    q.addBindValue(noteId);
+    if (q.exec() && q.next()) {
+        return q.value(0).toString();
+    }
+    return QString();
+}
+
+int SyncOutbox::noteIdForRemote(const QString &remoteId) const
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT note_id FROM sync_state WHERE remote_id = ?");
+    q.addBindValue(remoteId);
+    if (q.exec() && q.next()) {
+        return q.value(0).toInt();
+    }
+    return -1;
+}
+
+SyncedNote SyncOutbox::syncedNote(int noteId) const
+{
+    SyncedNote note;
+    QSqlQuery q(m_db);
+    q.prepare("SELECT note_id, remote_id, content_hash, revision, title, folder_id, note_updated_at "
+              "FROM sync_state WHERE note_id = ?");
+    q.addBindValue(noteId);
+    if (q.exec() && q.next()) {
+        note.noteId = q.value(0).toInt();
+        note.remoteId = q.value(1).toString();
+        note.contentHash = q.value(2).toString();
+        note.revision = q.value(3).toInt();
+        note.title = q.value(4).toString();
+        note.folderId = q.value(5).toInt();
+        note.noteUpdatedAt = q.value(6).toDateTime();
+    }
+    return note;
+}
+
+bool SyncOutbox::recordSynced(const SyncedNote &note)
+{
+    QSqlQuery q(m_db);
+    q.prepare("INSERT OR REPLACE INTO sync_state (note_id, remote_id, content_hash, revision, title, folder_id, "
+              "note_updated_at, synced_at) "
+              "VALUES (?, ?, ?, ?, ?, ?, COALESCE(?, (SELECT updated_at FROM notes WHERE id = ?)), CURRENT_TIMESTAMP)");
+    q.addBindValue(note.noteId);
+    q.addBindValue(note.remoteId);
+    q.addBindValue(note.contentHash.isEmpty() ? QVariant() : note.contentHash);
+    q.addBindValue(note.revision);
+    q.addBindValue(note.title.isEmpty() ? QVariant() : note.title);
+    q.addBindValue(note.folderId > 0 ? note.folderId : QVariant());
+    q.addBindValue(note.noteUpdatedAt.isValid() ? QVariant(note.noteUpdatedAt) : QVariant());
+    q.addBindValue(note.noteId);
+    if (!q.exec()) {
+        qWarning() << "Failed to record sync state for note" << note.noteId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SyncOutbox::setRemoteId(int noteId, const QString &remoteId)
+{
+    QSqlQuery q(m_db);
+    q.prepare("INSERT OR REPLACE INTO sync_state (note_id, remote_id, synced_at) VALUES (?, ?, CURRENT_TIMESTAMP)");
+    q.addBindValue(noteId);
+    q.addBindValue(remoteId);
+    if (!q.exec()) {
+        qWarning() << "Failed to store remote ID for note" << noteId << ":" << q.lastError();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef SYNCOUTBOX_H
+#define SYNCOUTBOX_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QList>
+#include <QDateTime>
+
+// One pending upload. It carries no payload: the note body is read from the
+// database when the upload is sent, so repeated edits of a note collapse into a
+// single queued row.
+struct SyncOutboxEntry
+{
+    enum State { Queued, InFlight, Done, Failed };
+
+    qint64 id = 0;
+    int noteId = 0;
+    State state = Queued;
+    int attempts = 0;
+    QString lastError;
+};
+
+// What Drive holds for a note after its last successful sync
+struct SyncedNote
+{
+    int noteId = 0;
+    QString remoteId;
+    QString contentHash;
+    int revision = 0;
+    QString title;
+    int folderId = 0;
+    QDateTime noteUpdatedAt;  // updated_at of the synced version; the note's current one if unset
+};
+
+// A locally deleted note whose Drive file still has to be removed. The notes
+// table writes these itself on delete (sync_tombstones), folder cascades included.
+struct SyncTombstone
+{
+    int noteId = 0;
+    QString remoteId;   // Empty if the note never reached Drive
+    int attempts = 0;
+};
+
+// Durable queue of sync work kept in the notes database (sync_outbox uploads and
+// sync_tombstones deletes), plus the local-to-remote note ID map (sync_state).
+// Work survives restarts and offline periods and is replayed when Drive is
+// reachable again.
+class SyncOutbox
+{
+public:
+    explicit SyncOutbox(const QSqlDatabase &db);
+
+    // Queueing, with compaction of redundant operations
+    bool enqueueUpload(int noteId);
+
+    // Claims up to limit queued entries and marks them in flight
+    QList<SyncOutboxEntry> takeQueued(int limit, int noteId = -1);
+    bool markDone(qint64 entryId);
+    // Back to queued until maxAttempts is reached, then failed
+    bool markFailed(qint64 entryId, const QString &error, int maxAttempts);
+    // Back to queued without counting an attempt, for uploads that could not be sent yet
+    bool requeue(qint64 entryId);
+
+    // Deletes to send. A tombstone waits while an upload of its note is in
+    // flight, since that upload may still create the remote file.
+    QList<SyncTombstone> pendingTombstones(int limit) const;
+    bool acknowledgeTombstone(int noteId);  // Drops the tombstone and the note's sync state
+    bool markTombstoneFailed(int noteId, const QString &error, int maxAttempts);
+
+    // Maintenance
+    int recoverInFlight();   // Entries left in flight by a previous run
+    int requeueFailed();
+    int compact();           // Drops finished entries
+    int pendingCount() const;  // Queued or in-flight uploads plus unacknowledged deletes
+
+    // Local <-> remote note IDs and the state last synced for each note
+    QString remoteIdForNote(int noteId) const;
+    int noteIdForRemote(const QString &remoteId) const;
+    SyncedNote syncedNote(int noteId) const;  // noteId is 0 if never synced
+    bool recordSynced(const SyncedNote &note);
+    bool setRemoteId(int noteId, const QString &remoteId);
+
+private:
+    QSqlDatabase m_db;
+};
+
+#endif // SYNCOUTBOX_H
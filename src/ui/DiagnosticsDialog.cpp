@@ -0,0 +1,194 @@
+#include "DiagnosticsDialog.h"
+#include "../utils/Metrics.h"
+#include "../utils/Logger.h"
+#include "../db/DatabaseManager.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QHeaderView>
+#include <QHBoxLayout>
+#include <QJsonDocument>
+#include <QLabel>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QScrollBar>
+#include <QTabWidget>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+// Refresh period while the dialog is open
+static const int REFRESH_INTERVAL_MS = 1000;
+static const int LOG_TAIL_LINES = 300;
+
+DiagnosticsDialog::DiagnosticsDialog(QWidget *parent)
+    : QDialog(parent),
+      m_refreshTimer(new QTimer(this)) {
+    setWindowTitle("Diagnostics");
+    setMinimumSize(760, 480);
+    setupUi();
+
+    connect(m_refreshTimer, &QTimer::timeout, this, &DiagnosticsDialog::refresh);
+}
+
+void DiagnosticsDialog::setupUi() {
+    auto *layout = new QVBoxLayout(this);
+    m_tabs = new QTabWidget(this);
+
+    // Metrics tab
+    m_metricsTree = new QTreeWidget(m_tabs);
+    m_metricsTree->setColumnCount(7);
+    m_metricsTree->setHeaderLabels({"Metric", "Value / count", "Mean", "p50", "p90", "p99", "Max"});
+    m_metricsTree->setRootIsDecorated(true);
+    m_metricsTree->setAlternatingRowColors(true);
+    m_metricsTree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_tabs->addTab(m_metricsTree, "Metrics");
+
+    // Slow queries tab; the plan is shown under each query
+    m_slowQueryTree = new QTreeWidget(m_tabs);
+    m_slowQueryTree->setColumnCount(4);
+    m_slowQueryTree->setHeaderLabels({"Time", "ms", "Query", "Parameters"});
+    m_slowQueryTree->setAlternatingRowColors(true);
+    m_slowQueryTree->header()->setSectionResizeMode(2, QHeaderView::Stretch);
+    m_tabs->addTab(m_slowQueryTree, "Slow queries");
+
+    // Log tab
+    m_logView = new QPlainTextEdit(m_tabs);
+    m_logView->setReadOnly(true);
+    m_logView->setLineWrapMode(QPlainTextEdit::NoWrap);
+    m_logView->setStyleSheet("QPlainTextEdit { font-family: 'Monaco', 'Menlo', 'Ubuntu Mono', monospace; font-size: 11px; }");
+    m_tabs->addTab(m_logView, "Log");
+
+    // Buttons
+    auto *buttonLayout = new QHBoxLayout();
+    m_statusLabel = new QLabel(this);
+    m_statusLabel->setStyleSheet("color: #999999; font-size: 11px;");
+    auto *copyButton = new QPushButton("Copy JSON", this);
+    auto *dumpButton = new QPushButton("Write snapshot", this);
+    auto *closeButton = new QPushButton("Close", this);
+    buttonLayout->addWidget(m_statusLabel);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(copyButton);
+    buttonLayout->addWidget(dumpButton);
+    buttonLayout->addWidget(closeButton);
+
+    layout->addWidget(m_tabs);
+    layout->addLayout(buttonLayout);
+
+    connect(copyButton, &QPushButton::clicked, this, &DiagnosticsDialog::copySnapshot);
+    connect(dumpButton, &QPushButton::clicked, this, &DiagnosticsDialog::dumpSnapshot);
+    connect(closeButton, &QPushButton::clicked, this, &QDialog::close);
+
+    setStyleSheet("QDialog { background: #1e1e1e; color: #e0e0e0; } "
+                  "QTreeWidget, QPlainTextEdit { background: #252525; color: #e0e0e0; border: 1px solid #404040; } "
+                  "QPushButton { background: #404040; border: none; border-radius: 4px; padding: 6px 12px; color: #e0e0e0; } "
+                  "QPushButton:hover { background: #505050; }");
+}
+
+void DiagnosticsDialog::showEvent(QShowEvent *event) {
+    QDialog::showEvent(event);
+    refresh();
+    m_refreshTimer->start(REFRESH_INTERVAL_MS);
+}
+
+void DiagnosticsDialog::hideEvent(QHideEvent *event) {
+    m_refreshTimer->stop();
+    QDialog::hideEvent(event);
+}
+
+void DiagnosticsDialog::refresh() {
+    QJsonObject snapshot = Metrics::instance().snapshot();
+
+    // Rebuilt each time; keep the scroll position so the view does not jump
+    int scroll = m_metricsTree->verticalScrollBar()->value();
+    m_metricsTree->clear();
+
+    auto addSection = [this](const QString &title) {
+        auto *section = new QTreeWidgetItem(m_metricsTree, {title});
+        section->setFirstColumnSpanned(true);
+        section->setExpanded(true);
+        return section;
+    };
+
+    QJsonObject counters = snapshot.value("counters").toObject();
+    QTreeWidgetItem *section = addSection("Counters");
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        new QTreeWidgetItem(section, {it.key(), QString::number(qint64(it.value().toDouble()))});
+    }
+
+    QJsonObject gauges = snapshot.value("gauges").toObject();
+    section = addSection("Gauges");
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        new QTreeWidgetItem(section, {it.key(), QString::number(qint64(it.value().toDouble()))});
+    }
+
+    QJsonObject histograms = snapshot.value("histograms").toObject();
+    section = addSection("Histograms");
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        QJsonObject h = it.value().toObject();
+        auto number = [&h](const char *key) { return QString::number(qint64(h.value(key).toDouble())); };
+        new QTreeWidgetItem(section, {it.key(), number("count"), QString::number(h.value("mean").toDouble(), 'f', 1),
+                                      number("p50"), number("p90"), number("p99"), number("max")});
+    }
+
+    m_metricsTree->verticalScrollBar()->setValue(scroll);
+
+    // Follow the end of the log unless the user scrolled up
+    QScrollBar *logScroll = m_logView->verticalScrollBar();
+    bool atEnd = logScroll->value() == logScroll->maximum();
+    m_logView->setPlainText(Logger::instance().tail(LOG_TAIL_LINES).join('\n'));
+    if (atEnd) {
+        logScroll->setValue(logScroll->maximum());
+    }
+
+    quint64 dropped = Logger::instance().droppedCount();
+    m_tabs->setTabText(2, dropped > 0 ? QString("Log (%1 dropped)").arg(dropped) : QString("Log"));
+
+    refreshSlowQueries();
+}
+
+void DiagnosticsDialog::refreshSlowQueries() {
+    DatabaseManager &db = DatabaseManager::instance();
+    QList<SlowQuery> queries = db.slowQueries();
+    QDateTime newest = queries.isEmpty() ? QDateTime() : queries.last().at;
+    if (newest == m_lastSlowQueryAt && m_slowQueryTree->topLevelItemCount() > 0) {
+        return;
+    }
+    m_lastSlowQueryAt = newest;
+
+    m_slowQueryTree->clear();
+    m_tabs->setTabText(1, QString("Slow queries (%1)").arg(queries.size()));
+    if (queries.isEmpty()) {
+        QString message = db.slowQueryThreshold() < 0
+            ? QString("The slow-query log is off")
+            : QString("No query has taken %1 ms or more").arg(db.slowQueryThreshold());
+        auto *item = new QTreeWidgetItem(m_slowQueryTree, {message});
+        item->setFirstColumnSpanned(true);
+        return;
+    }
+
+    // Newest first
+    for (int i = queries.size() - 1; i >= 0; --i) {
+        const SlowQuery &query = queries[i];
+        auto *item = new QTreeWidgetItem(m_slowQueryTree, {query.at.toString("hh:mm:ss.zzz"),
+                                                           QString::number(query.elapsedMs), query.sql,
+                                                           query.parameters});
+        item->setToolTip(2, query.sql);
+        for (const QString &step : query.plan.split('\n', Qt::SkipEmptyParts)) {
+            new QTreeWidgetItem(item, {QString(), QString(), step});
+        }
+    }
+}
+
+void DiagnosticsDialog::copySnapshot() {
+    QApplication::clipboard()->setText(QString::fromUtf8(QJsonDocument(Metrics::instance().snapshot()).toJson()));
+    m_statusLabel->setText("Snapshot copied to the clipboard");
+}
+
+void DiagnosticsDialog::dumpSnapshot() {
+    Metrics &metrics = Metrics::instance();
+    if (metrics.dumpNow()) {
+        m_statusLabel->setText(QString("Snapshot written to %1").arg(metrics.dumpFilePath()));
+    } else {
+        m_statusLabel->setText("Could not write the snapshot");
+    }
+}
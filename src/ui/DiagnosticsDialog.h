@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QDialog>
+#include <QDateTime>
+
+class QTreeWidget;
+class QPlainTextEdit;
+class QLabel;
+class QTabWidget;
+class QTimer;
+
+// Live view of the metrics registry, the slow-query log and the recent log,
+// for support sessions.
+// Not in any menu; MainWindow opens it with Ctrl+Alt+Shift+D.
+class DiagnosticsDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDialog(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+    void copySnapshot();
+    void dumpSnapshot();
+
+private:
+    void setupUi();
+    void refreshSlowQueries();
+
+    QTabWidget *m_tabs;
+    QTreeWidget *m_metricsTree;
+    QTreeWidget *m_slowQueryTree;
+    QPlainTextEdit *m_logView;
+    QLabel *m_statusLabel;
+    QTimer *m_refreshTimer;
+    QDateTime m_lastSlowQueryAt;  // Newest record shown, to skip rebuilding
+};
@@ -54,6 +54,8 @@
 #include "../utils/Roles.h"
 #include "TextEditor.h"
 #include "SettingsDialog.h"
+#include "DiagnosticsDialog.h"
+#include "../utils/Metrics.h"
 #include "../sync/SyncManager.h"
 #include "../sync/ConfigLoader.h"
 #include "GoogleAuthDialog.h"
@@ -95,7 +97,8 @@ MainWindow::MainWindow(QWidget *parent)
       m_autoSaveEnabled(true),
       m_folderModel(new QStandardItemModel(this)),
       m_notesModel(new NotesModel(this)),
-      m_syncManager(nullptr) {
+      m_syncManager(nullptr),
+      m_diagnosticsDialog(nullptr) {
     setWindowTitle("Notes - Orchard");
     setMinimumSize(1200, 700);  // More reasonable minimum size
     resize(2000, 900);  // Increased default window width
@@ -857,6 +860,8 @@ void MainWindow::updateDeleteButtonText() {
 void MainWindow::saveCurrentNote() {
     if (m_currentNoteId <= 0) return;
     
+    MetricTimer timer(METRIC_HISTOGRAM("editor.save_us"));
+    METRIC_COUNTER("editor.saves").add();
     QString content = m_textEditor->toPlainText();
     
     // Extract title from first line
@@ -879,6 +884,14 @@ void MainWindow::saveCurrentNote() {
         // Reload notes to update the list
         loadNotesFromDatabase(m_currentFolderId);
         m_noteModified = false;
+
+        // Sync queues the change durably and coalesces rapid saves into one upload
+        if (m_syncManager) {
+            FolderData folder = db.getFolder(db.getNote(m_currentNoteId).folderId);
+            if (!folder.name.isEmpty()) {
+                m_syncManager->handleNoteChanged(QString::number(m_currentNoteId), content, title, folder.name);
+            }
+        }
     }
 }
 
@@ -888,6 +901,8 @@ void MainWindow::loadNoteContent(const QModelIndex &index) {
     int noteId = index.data(Qt::UserRole).toInt();
     if (noteId <= 0) return;
     
+    // Includes laying out and highlighting the text
+    MetricTimer timer(METRIC_HISTOGRAM("editor.load_note_us"));
     DatabaseManager &db = DatabaseManager::instance();
     NoteData note = db.getNote(noteId);
     
@@ -1015,6 +1030,7 @@ void MainWindow::onAutoSaveTriggered() {
 }
 
 void MainWindow::onTextChanged() {
+    METRIC_COUNTER("editor.edits").add();
     if (m_currentNoteIndex.isValid()) {
         m_noteModified = true;
         scheduleAutoSave();
@@ -1031,10 +1047,14 @@ void MainWindow::showSettings() {
     SettingsDialog dialog(this);
     if (dialog.exec() == QDialog::Accepted) {
         DatabaseManager &db = DatabaseManager::instance();
+        // The directory first, so a new storage mode converts the notes where
+        // they will live; failures are reported through operationFailed
         db.setNotesDirectory(dialog.getNotesDirectory());
+        db.setStorageMode(dialog.storageMode());
         db.enableAutoSave(dialog.isAutoSaveEnabled());
         db.setAutoSaveInterval(dialog.getAutoSaveInterval());
         db.setAutoImportEnabled(dialog.isAutoImportEnabled());
+        db.setTracingEnabled(dialog.isTracingEnabled());
         
         m_autoSaveEnabled = dialog.isAutoSaveEnabled();
         
@@ -1153,11 +1173,12 @@ void MainWindow::moveNoteToFolder(int noteId, int targetFolderId) {
     NoteData note = db.getNote(noteId);
     if (note.id == -1) return;
     
-    // Create the note in the new folder
-    int newNoteId = db.createNote(targetFolderId, note.title, note.body);
-    if (newNoteId > 0) {
-        // Delete the note from the old folder
-        db.deleteNote(noteId);
+    if (db.moveNote(noteId, targetFolderId)) {
+        // Drive moves the existing file instead of uploading a copy
+        FolderData folder = db.getFolder(targetFolderId);
+        if (m_syncManager && !folder.name.isEmpty()) {
+            m_syncManager->handleNoteChanged(QString::number(noteId), note.body, note.title, folder.name);
+        }
         
         // Reload the current folder's notes
         if (m_currentFolderId == note.folderId) {
@@ -1383,6 +1404,17 @@ void MainWindow::setupKeyboardShortcuts()
     auto *deleteShortcut = new QShortcut(QKeySequence::Delete, this);
     connect(deleteShortcut, &QShortcut::activated, this, &MainWindow::smartDelete);
     
+    // Diagnostics panel; deliberately not in any menu
+    auto *diagnosticsShortcut = new QShortcut(QKeySequence("Ctrl+Alt+Shift+D"), this);
+    connect(diagnosticsShortcut, &QShortcut::activated, this, [this]() {
+        if (!m_diagnosticsDialog) {
+            m_diagnosticsDialog = new DiagnosticsDialog(this);
+        }
+        m_diagnosticsDialog->show();
+        m_diagnosticsDialog->raise();
+        m_diagnosticsDialog->activateWindow();
+    });
+    
     // Removed theme toggle shortcut - dark theme only
 }
 
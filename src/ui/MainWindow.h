@@ -22,6 +22,7 @@ class QTextBrowser;
 class QLineEdit;
 class TextEditor;
 class SettingsDialog;
+class DiagnosticsDialog;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -125,6 +126,9 @@ private:
     
     // Google Drive Sync manager
     SyncManager *m_syncManager;
+    
+    // Created on first use
+    DiagnosticsDialog *m_diagnosticsDialog;
 };
 
 
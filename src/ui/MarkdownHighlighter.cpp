@@ -1,4 +1,6 @@
 #include "MarkdownHighlighter.h"
+#include "../utils/Tracer.h"
+#include "../utils/Metrics.h"
 
 #include <QBrush>
 #include <QColor>
@@ -87,6 +89,8 @@ void MarkdownHighlighter::setActiveBlockNumber(int blockNumber) {
 }
 
 void MarkdownHighlighter::highlightBlock(const QString &text) {
+    TRACE_SCOPE("ui", "MarkdownHighlighter::highlightBlock");
+    MetricTimer timer(METRIC_HISTOGRAM("editor.highlight_block_us"));
     // Headings with enhanced styling
     if (text.startsWith("# ")) {
         setFormat(0, text.length(), m_heading1);
@@ -43,9 +43,26 @@ void SettingsDialog::setupUi() {
     notesInfoLabel->setStyleSheet("color: #999999; font-size: 11px; margin-top: 5px;");
     notesInfoLabel->setWordWrap(true);
     
+    auto *storageModeLabel = new QLabel("Keep note contents in:", notesGroup);
+    storageModeLabel->setStyleSheet("color: #e0e0e0; margin-top: 10px; margin-bottom: 5px;");
+    
+    m_storageModeCombo = new QComboBox(notesGroup);
+    m_storageModeCombo->addItem("The database, with markdown copies in this directory", int(StorageMode::Database));
+    m_storageModeCombo->addItem("The markdown files in this directory", int(StorageMode::Files));
+    m_storageModeCombo->setStyleSheet("QComboBox { background: #2d2d2d; border: 1px solid #404040; border-radius: 4px; padding: 6px; color: #e0e0e0; }");
+    
+    auto *storageModeInfoLabel = new QLabel("With the database, the markdown copies are updated shortly after each save and edits made to them elsewhere are not read back. "
+                                            "With markdown files, the files are the notes and can be edited with any editor; the database only indexes them. "
+                                            "Changing this converts all notes.", notesGroup);
+    storageModeInfoLabel->setStyleSheet("color: #999999; font-size: 11px; margin-top: 5px;");
+    storageModeInfoLabel->setWordWrap(true);
+    
     notesLayout->addWidget(notesLabel);
     notesLayout->addLayout(notesDirLayout);
     notesLayout->addWidget(notesInfoLabel);
+    notesLayout->addWidget(storageModeLabel);
+    notesLayout->addWidget(m_storageModeCombo);
+    notesLayout->addWidget(storageModeInfoLabel);
     
     // Auto-save Group
     auto *autoSaveGroup = new QGroupBox("Auto-save Settings", this);
@@ -105,6 +122,26 @@ void SettingsDialog::setupUi() {
     autoImportLayout->addWidget(m_autoImportCheckBox);
     autoImportLayout->addWidget(autoImportInfoLabel);
     
+    // Diagnostics Group
+    auto *diagnosticsGroup = new QGroupBox("Diagnostics", this);
+    diagnosticsGroup->setStyleSheet("QGroupBox { font-weight: bold; border: 1px solid #404040; border-radius: 8px; margin-top: 10px; padding-top: 10px; } "
+                                   "QGroupBox::title { subcontrol-origin: margin; left: 10px; padding: 0 5px 0 5px; }");
+    
+    auto *diagnosticsLayout = new QVBoxLayout(diagnosticsGroup);
+    
+    m_tracingCheckBox = new QCheckBox("Record a performance trace", diagnosticsGroup);
+    m_tracingCheckBox->setStyleSheet(m_autoImportCheckBox->styleSheet());
+    
+    QString traceDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/traces";
+    auto *tracingInfoLabel = new QLabel(QString("Records how long saving, loading, highlighting and sync take, for reporting slowdowns. "
+                                                "Traces are written to %1 and open in ui.perfetto.dev. "
+                                                "Turn this off again when you are done.").arg(QDir::toNativeSeparators(traceDir)), diagnosticsGroup);
+    tracingInfoLabel->setStyleSheet("color: #999999; font-size: 11px; margin-top: 5px;");
+    tracingInfoLabel->setWordWrap(true);
+    
+    diagnosticsLayout->addWidget(m_tracingCheckBox);
+    diagnosticsLayout->addWidget(tracingInfoLabel);
+    
     // Buttons
     auto *buttonLayout = new QHBoxLayout();
     buttonLayout->addStretch();
@@ -126,6 +163,7 @@ void SettingsDialog::setupUi() {
     layout->addWidget(notesGroup);
     layout->addWidget(autoSaveGroup);
     layout->addWidget(autoImportGroup);
+    layout->addWidget(diagnosticsGroup);
     layout->addStretch();
     layout->addLayout(buttonLayout);
     
@@ -141,9 +179,11 @@ void SettingsDialog::setupUi() {
 void SettingsDialog::loadCurrentSettings() {
     DatabaseManager &db = DatabaseManager::instance();
     m_notesDirectoryEdit->setText(db.getNotesDirectory());
+    m_storageModeCombo->setCurrentIndex(m_storageModeCombo->findData(int(db.storageMode())));
     m_autoSaveCheckBox->setChecked(true); // Default to enabled
     m_autoSaveIntervalSpinBox->setValue(2); // Default to 2 seconds
     m_autoImportCheckBox->setChecked(db.isAutoImportEnabled());
+    m_tracingCheckBox->setChecked(db.isTracingEnabled());
 }
 
 void SettingsDialog::browseNotesDirectory() {
@@ -176,6 +216,10 @@ QString SettingsDialog::getNotesDirectory() const {
     return m_notesDirectoryEdit->text().trimmed();
 }
 
+StorageMode SettingsDialog::storageMode() const {
+    return StorageMode(m_storageModeCombo->currentData().toInt());
+}
+
 bool SettingsDialog::isAutoSaveEnabled() const {
     return m_autoSaveCheckBox->isChecked();
 }
@@ -187,3 +231,7 @@ int SettingsDialog::getAutoSaveInterval() const {
 bool SettingsDialog::isAutoImportEnabled() const {
     return m_autoImportCheckBox->isChecked();
 }
+
+bool SettingsDialog::isTracingEnabled() const {
+    return m_tracingCheckBox->isChecked();
+}
@@ -10,6 +10,8 @@
 #include <QLabel>
 #include <QGroupBox>
 #include <QFileDialog>
+#include <QComboBox>
+#include "../db/DatabaseManager.h"
 
 class SettingsDialog : public QDialog {
     Q_OBJECT
@@ -18,9 +20,11 @@ public:
     explicit SettingsDialog(QWidget *parent = nullptr);
 
     QString getNotesDirectory() const;
+    StorageMode storageMode() const;
     bool isAutoSaveEnabled() const;
     int getAutoSaveInterval() const;
     bool isAutoImportEnabled() const;
+    bool isTracingEnabled() const;
 
 private slots:
     void browseNotesDirectory();
@@ -32,9 +36,11 @@ private:
 
     QLineEdit *m_notesDirectoryEdit;
     QPushButton *m_browseButton;
+    QComboBox *m_storageModeCombo;
     QCheckBox *m_autoSaveCheckBox;
     QSpinBox *m_autoSaveIntervalSpinBox;
     QCheckBox *m_autoImportCheckBox;
+    QCheckBox *m_tracingCheckBox;
     QPushButton *m_okButton;
     QPushButton *m_cancelButton;
 };
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+
+// Bounded lock-free queue for many producers and one consumer (after Dmitry
+// Vyukov's bounded MPMC queue). Each slot carries a sequence number: a producer
+// claims a slot by advancing the enqueue position with a CAS and publishes it
+// by bumping the slot's sequence; the consumer reads slots in order and hands
+// them back one lap ahead. tryPush never blocks and fails when the queue is full.
+template <typename T>
+class LogRing
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit LogRing(int capacity)
+    {
+        quint64 size = 2;
+        while (size < quint64(qMax(2, capacity))) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (quint64 i = 0; i < size; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LogRing(const LogRing &) = delete;
+    LogRing &operator=(const LogRing &) = delete;
+
+    int capacity() const { return int(m_mask + 1); }
+
+    // Any thread
+    bool tryPush(T &&value)
+    {
+        quint64 position = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = m_slots[position & m_mask];
+            quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+            qint64 diff = qint64(sequence) - qint64(position);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full: the consumer has not freed this slot yet
+            } else {
+                position = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only
+    bool tryPop(T &value)
+    {
+        quint64 position = m_dequeuePos.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[position & m_mask];
+        quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (qint64(sequence) - qint64(position + 1) < 0) {
+            return false;  // Empty, or the producer has not published it yet
+        }
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(position + m_mask + 1, std::memory_order_release);
+        m_dequeuePos.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Approximate, for deciding when to wake the consumer early
+    int size() const
+    {
+        qint64 used = qint64(m_enqueuePos.load(std::memory_order_relaxed))
+                    - qint64(m_dequeuePos.load(std::memory_order_relaxed));
+        return int(qBound<qint64>(0, used, qint64(m_mask + 1)));
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<quint64> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    quint64 m_mask = 0;
+    // Separate cache lines, so producers and the consumer do not share one
+    alignas(64) std::atomic<quint64> m_enqueuePos{0};
+    alignas(64) std::atomic<quint64> m_dequeuePos{0};
+};
@@ -1,8 +1,11 @@
 #include "Logger.h"
+#include "LogRing.h"
 #include <QStandardPaths>
 #include <QDir>
+#include <QFileInfo>
 #include <QCoreApplication>
-#include <iostream>
+#include <QThread>
+#include <cstdio>
 
 // Define logging categories
 Q_LOGGING_CATEGORY(database, "notes.database")
@@ -12,6 +15,15 @@ Q_LOGGING_CATEGORY(config, "notes.config")
 Q_LOGGING_CATEGORY(file, "notes.file")
 Q_LOGGING_CATEGORY(network, "notes.network")
 
+// Messages held between writes; beyond this they are dropped
+static const int RING_CAPACITY = 16384;
+static const int DEFAULT_FLUSH_INTERVAL_MS = 200;
+
+static const qint64 DEFAULT_MAX_FILE_SIZE = 5 * 1024 * 1024;
+static const qint64 DEFAULT_MAX_FILE_AGE = 7 * 24 * 60 * 60;
+static const int DEFAULT_RETAINED_FILES = 5;
+static const int TAIL_CAPACITY = 1000;
+
 Logger& Logger::instance()
 {
     static Logger instance;
@@ -21,10 +33,28 @@ Logger& Logger::instance()
 Logger::Logger(QObject* parent)
     : QObject(parent)
     , m_logLevel(Info)  // Default to Info level in production
+    , m_hasCategoryLevels(false)
+    , m_ring(new LogRing<Entry>(RING_CAPACITY))
+    , m_dropped(0)
+    , m_reportedDropped(0)
+    , m_wakePending(false)
     , m_logToFile(false)
     , m_logToConsole(false)
     , m_logFile(nullptr)
-    , m_logStream(nullptr)
+    , m_logFileSize(0)
+    , m_maxFileSize(DEFAULT_MAX_FILE_SIZE)
+    , m_maxFileAge(DEFAULT_MAX_FILE_AGE)
+    , m_retainedFiles(DEFAULT_RETAINED_FILES)
+    , m_archiver(nullptr)
+    , m_tail(TAIL_CAPACITY)
+    , m_tailNext(0)
+    , m_tailCount(0)
+    , m_writer(nullptr)
+    , m_wakeRequested(false)
+    , m_stopping(false)
+    , m_flushIntervalMs(DEFAULT_FLUSH_INTERVAL_MS)
+    , m_flushRequested(0)
+    , m_flushCompleted(0)
 {
     // Set up default logging based on build type
 #ifdef QT_DEBUG
@@ -34,35 +64,98 @@ Logger::Logger(QObject* parent)
     m_logLevel = Warning;  // Only warnings and errors in release
     m_logToConsole = false;
 #endif
+
+    m_writer = QThread::create([this]() { writerLoop(); });
+    m_writer->setObjectName("Logger");
+    m_writer->start(QThread::LowPriority);
 }
 
 Logger::~Logger()
 {
-    if (m_logStream) {
-        delete m_logStream;
+    {
+        QMutexLocker locker(&m_wakeMutex);
+        m_stopping = true;
+        m_wakeCondition.wakeOne();
     }
-    if (m_logFile) {
-        m_logFile->close();
-        delete m_logFile;
+    m_writer->wait();
+    delete m_writer;
+
+    QMutexLocker locker(&m_mutex);
+    closeLogFile();
+    if (m_archiver) {
+        m_archiver->wait();
+        delete m_archiver;
     }
 }
 
 void Logger::setLogLevel(LogLevel level)
 {
-    QMutexLocker locker(&m_mutex);
-    m_logLevel = level;
+    QMutexLocker locker(&m_categoryMutex);
+    m_logLevel.store(level, std::memory_order_relaxed);
+    for (auto& entry : m_categories) {
+        updateCategoryThreshold(*entry.second);
+    }
+}
+
+void Logger::setCategoryLevel(const QString& category, LogLevel level)
+{
+    QMutexLocker locker(&m_categoryMutex);
+    m_categoryLevels.insert(category, level);
+    m_hasCategoryLevels.store(true, std::memory_order_relaxed);
+    auto it = m_categories.find(category);
+    if (it != m_categories.end()) {
+        updateCategoryThreshold(*it->second);
+    }
+}
+
+void Logger::clearCategoryLevel(const QString& category)
+{
+    QMutexLocker locker(&m_categoryMutex);
+    m_categoryLevels.remove(category);
+    m_hasCategoryLevels.store(!m_categoryLevels.isEmpty(), std::memory_order_relaxed);
+    auto it = m_categories.find(category);
+    if (it != m_categories.end()) {
+        updateCategoryThreshold(*it->second);
+    }
+}
+
+bool Logger::isEnabled(LogLevel level, const QString& category)
+{
+    // Without per-category levels the global level decides, no lookup needed
+    if (!m_hasCategoryLevels.load(std::memory_order_relaxed)) {
+        return level >= m_logLevel.load(std::memory_order_relaxed);
+    }
+    return this->category(category).isEnabled(level);
+}
+
+LogCategory& Logger::category(const QString& name)
+{
+    QMutexLocker locker(&m_categoryMutex);
+    std::unique_ptr<LogCategory>& category = m_categories[name];
+    if (!category) {
+        category.reset(new LogCategory(name));
+        updateCategoryThreshold(*category);
+    }
+    return *category;
+}
+
+void Logger::updateCategoryThreshold(LogCategory& category)
+{
+    // m_categoryMutex is held
+    int level = m_categoryLevels.value(category.m_name, m_logLevel.load(std::memory_order_relaxed));
+    category.m_threshold.store(level, std::memory_order_relaxed);
 }
 
 void Logger::setLogToFile(bool enabled, const QString& filePath)
 {
     QMutexLocker locker(&m_mutex);
-    
+
     if (m_logToFile == enabled) {
         return;
     }
-    
+
     m_logToFile = enabled;
-    
+
     if (enabled) {
         if (filePath.isEmpty()) {
             // Use default log file location
@@ -72,26 +165,15 @@ void Logger::setLogToFile(bool enabled, const QString& filePath)
         } else {
             m_logFilePath = filePath;
         }
-        
-        m_logFile = new QFile(m_logFilePath);
-        if (m_logFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
-            m_logStream = new QTextStream(m_logFile);
-            m_logStream->setCodec("UTF-8");
-        } else {
-            delete m_logFile;
-            m_logFile = nullptr;
+
+        if (!openLogFile()) {
             m_logToFile = false;
+            return;
         }
+        // Finish archives a previous run left uncompressed, and apply retention
+        startArchiving();
     } else {
-        if (m_logStream) {
-            delete m_logStream;
-            m_logStream = nullptr;
-        }
-        if (m_logFile) {
-            m_logFile->close();
-            delete m_logFile;
-            m_logFile = nullptr;
-        }
+        closeLogFile();
     }
 }
 
@@ -101,23 +183,88 @@ void Logger::setLogToConsole(bool enabled)
     m_logToConsole = enabled;
 }
 
+void Logger::setFlushInterval(int milliseconds)
+{
+    QMutexLocker locker(&m_wakeMutex);
+    m_flushIntervalMs = qMax(1, milliseconds);
+}
+
+void Logger::setMaxFileSize(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxFileSize = qMax<qint64>(0, bytes);
+}
+
+void Logger::setMaxFileAge(qint64 seconds)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxFileAge = qMax<qint64>(0, seconds);
+}
+
+void Logger::setRetainedFiles(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_retainedFiles = qMax(0, count);
+}
+
+QString Logger::logFilePath() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_logFilePath;
+}
+
+void Logger::installMessageHandler()
+{
+    qInstallMessageHandler(&Logger::messageHandler);
+}
+
+void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    LogLevel level = Debug;
+    switch (type) {
+        case QtDebugMsg: level = Debug; break;
+        case QtInfoMsg: level = Info; break;
+        case QtWarningMsg: level = Warning; break;
+        case QtCriticalMsg: level = Error; break;
+        case QtFatalMsg: level = Critical; break;
+    }
+
+    const char *category = context.category && qstrcmp(context.category, "default") != 0 ? context.category : "qt";
+    Logger::instance().log(level, QString::fromLatin1(category), message);
+}
+
 void Logger::log(LogLevel level, const QString& category, const QString& message)
 {
-    if (level < m_logLevel) {
-        return;
+    if (isEnabled(level, category)) {
+        enqueue(level, category, message);
     }
-    
-    QString formattedMessage = formatMessage(level, category, message);
-    
-    QMutexLocker locker(&m_mutex);
-    
-    if (m_logToConsole) {
-        std::cerr << formattedMessage.toStdString() << std::endl;
+}
+
+void Logger::write(LogLevel level, const LogCategory& category, const QString& message)
+{
+    enqueue(level, category.name(), message);
+}
+
+void Logger::enqueue(LogLevel level, const QString& category, const QString& message)
+{
+    // Only a timestamp and two reference-counted strings; formatting and
+    // writing happen on the writer thread
+    Entry entry;
+    entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+    entry.level = level;
+    entry.category = category;
+    entry.message = message;
+    if (!m_ring->tryPush(std::move(entry))) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        wakeWriter();
+        return;
     }
-    
-    if (m_logToFile && m_logStream) {
-        *m_logStream << formattedMessage << Qt::endl;
-        m_logStream->flush();
+
+    if (level >= Critical) {
+        // The process may be about to go down
+        flush();
+    } else if (level >= Error || m_ring->size() > m_ring->capacity() / 2) {
+        wakeWriter();
     }
 }
 
@@ -146,6 +293,278 @@ void Logger::critical(const QString& category, const QString& message)
     log(Critical, category, message);
 }
 
+void Logger::flush()
+{
+    if (QThread::currentThread() == m_writer) {
+        return;
+    }
+
+    QMutexLocker locker(&m_wakeMutex);
+    if (m_stopping) {
+        return;
+    }
+    quint64 target = ++m_flushRequested;
+    m_wakeRequested = true;
+    m_wakeCondition.wakeOne();
+    while (m_flushCompleted < target && !m_stopping) {
+        m_flushedCondition.wait(&m_wakeMutex);
+    }
+}
+
+quint64 Logger::droppedCount() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+QStringList Logger::tail(int lines) const
+{
+    QMutexLocker locker(&m_tailMutex);
+    int count = qBound(0, lines, m_tailCount);
+    QStringList result;
+    result.reserve(count);
+    int capacity = m_tail.size();
+    for (int i = count; i > 0; --i) {
+        result.append(m_tail[(m_tailNext - i + capacity) % capacity]);
+    }
+    return result;
+}
+
+void Logger::wakeWriter()
+{
+    // One wake-up per writer round, so a burst of errors takes the mutex once
+    if (m_wakePending.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    QMutexLocker locker(&m_wakeMutex);
+    m_wakeRequested = true;
+    m_wakeCondition.wakeOne();
+}
+
+void Logger::writerLoop()
+{
+    QMutexLocker locker(&m_wakeMutex);
+    for (;;) {
+        if (!m_wakeRequested && !m_stopping) {
+            m_wakeCondition.wait(&m_wakeMutex, m_flushIntervalMs);
+        }
+        bool stopping = m_stopping;
+        quint64 flushTarget = m_flushRequested;
+        m_wakeRequested = false;
+        m_wakePending.store(false, std::memory_order_release);
+        locker.unlock();
+
+        drain();
+
+        locker.relock();
+        m_flushCompleted = flushTarget;
+        m_flushedCondition.wakeAll();
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void Logger::drain()
+{
+    QByteArray batch;
+    Entry entry;
+    while (m_ring->tryPop(entry)) {
+        QString line = formatMessage(entry.timestamp, entry.level, entry.category, entry.message);
+        appendToTail(line);
+        batch += line.toUtf8();
+        batch += '\n';
+    }
+
+    quint64 dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reportedDropped) {
+        QString notice = QString("%1 messages dropped, the log buffer was full").arg(dropped - m_reportedDropped);
+        QString line = formatMessage(QDateTime::currentMSecsSinceEpoch(), Warning, "logger", notice);
+        appendToTail(line);
+        batch += line.toUtf8();
+        batch += '\n';
+        m_reportedDropped = dropped;
+    }
+
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_logToConsole) {
+        std::fwrite(batch.constData(), 1, size_t(batch.size()), stderr);
+        std::fflush(stderr);
+    }
+    if (m_logToFile && m_logFile) {
+        bool tooBig = m_maxFileSize > 0 && m_logFileSize > 0 && m_logFileSize + batch.size() > m_maxFileSize;
+        bool tooOld = m_maxFileAge > 0 && m_logFileCreated.secsTo(QDateTime::currentDateTime()) > m_maxFileAge;
+        if (tooBig || tooOld) {
+            rotateLogFile();
+        }
+        if (m_logFile) {
+            m_logFile->write(batch);
+            m_logFile->flush();
+            m_logFileSize += batch.size();
+        }
+    }
+}
+
+void Logger::appendToTail(const QString& line)
+{
+    QMutexLocker locker(&m_tailMutex);
+    m_tail[m_tailNext] = line;
+    m_tailNext = (m_tailNext + 1) % m_tail.size();
+    m_tailCount = qMin(m_tailCount + 1, m_tail.size());
+}
+
+// The methods below expect m_mutex to be held
+
+bool Logger::openLogFile()
+{
+    m_logFile = new QFile(m_logFilePath);
+    if (!m_logFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        delete m_logFile;
+        m_logFile = nullptr;
+        return false;
+    }
+
+    // Appending to an existing file keeps its age
+    QFileInfo info(m_logFilePath);
+    m_logFileSize = m_logFile->size();
+    m_logFileCreated = m_logFileSize > 0 && info.birthTime().isValid() ? info.birthTime()
+                                                                        : QDateTime::currentDateTime();
+    return true;
+}
+
+void Logger::closeLogFile()
+{
+    if (m_logFile) {
+        m_logFile->close();
+        delete m_logFile;
+        m_logFile = nullptr;
+    }
+}
+
+void Logger::rotateLogFile()
+{
+    closeLogFile();
+
+    // Millisecond names sort in age order and do not collide between rotations
+    QFileInfo info(m_logFilePath);
+    QString stamp = QDateTime::currentDateTime().toString("yyyyMMdd-hhmmsszzz");
+    QString rotatedPath = info.dir().filePath(QString("%1-%2.%3").arg(info.completeBaseName(), stamp, info.suffix()));
+    if (!QFile::rename(m_logFilePath, rotatedPath)) {
+        // Keep appending rather than lose messages; the next batch tries again
+        openLogFile();
+        return;
+    }
+
+    if (!openLogFile()) {
+        m_logToFile = false;
+    }
+    startArchiving();
+}
+
+void Logger::startArchiving()
+{
+    // One archiver at a time; the previous run has normally finished long ago
+    if (m_archiver) {
+        m_archiver->wait();
+        delete m_archiver;
+        m_archiver = nullptr;
+    }
+
+    QString logFilePath = m_logFilePath;
+    int retainedFiles = m_retainedFiles;
+    m_archiver = QThread::create([logFilePath, retainedFiles]() {
+        archiveRotatedFiles(logFilePath, retainedFiles);
+    });
+    m_archiver->setObjectName("LogArchiver");
+    m_archiver->start(QThread::LowestPriority);
+}
+
+void Logger::archiveRotatedFiles(const QString& logFilePath, int retainedFiles)
+{
+    // Runs on the archiver thread, so it must not log
+    QFileInfo info(logFilePath);
+    QDir dir = info.dir();
+    QString rotatedPattern = QString("%1-*.%2").arg(info.completeBaseName(), info.suffix());
+
+    for (const QString& name : dir.entryList({rotatedPattern}, QDir::Files)) {
+        QString path = dir.filePath(name);
+        if (gzipFile(path, path + ".gz")) {
+            QFile::remove(path);
+        }
+    }
+
+    // Uncompressed leftovers still count towards the limit
+    QStringList archives = dir.entryList({rotatedPattern, rotatedPattern + ".gz"}, QDir::Files, QDir::Name | QDir::Reversed);
+    for (int i = retainedFiles; i < archives.size(); ++i) {
+        QFile::remove(dir.filePath(archives[i]));
+    }
+}
+
+static quint32 gzipCrc32(const QByteArray& data)
+{
+    static const QVector<quint32> table = []() {
+        QVector<quint32> t(256);
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[int(n)] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xFFFFFFFFu;
+    for (char byte : data) {
+        crc = table[int((crc ^ quint8(byte)) & 0xFF)] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void appendLittleEndian(QByteArray& out, quint32 value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.append(char((value >> (8 * i)) & 0xFF));
+    }
+}
+
+bool Logger::gzipFile(const QString& sourcePath, const QString& targetPath)
+{
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = source.readAll();
+    source.close();
+
+    // qCompress gives a 4-byte length, a 2-byte zlib header, the deflate stream
+    // and a 4-byte Adler-32; gzip wants the bare deflate stream in its own frame,
+    // which keeps the archives readable with zcat without linking zlib directly
+    QByteArray compressed = qCompress(data, 9);
+    if (compressed.size() < 10) {
+        return false;
+    }
+
+    QByteArray gzip;
+    gzip.reserve(compressed.size() + 12);
+    gzip.append("\x1f\x8b\x08\x00", 4);                  // Magic, deflate, no flags
+    appendLittleEndian(gzip, quint32(QFileInfo(sourcePath).lastModified().toSecsSinceEpoch()));
+    gzip.append("\x02\xff", 2);                          // Best compression, unknown OS
+    gzip.append(compressed.constData() + 6, compressed.size() - 10);
+    appendLittleEndian(gzip, gzipCrc32(data));
+    appendLittleEndian(gzip, quint32(data.size()));
+
+    QFile target(targetPath);
+    if (!target.open(QIODevice::WriteOnly | QIODevice::Truncate) || target.write(gzip) != gzip.size()) {
+        target.remove();
+        return false;
+    }
+    return true;
+}
+
 QString Logger::levelToString(LogLevel level) const
 {
     switch (level) {
@@ -158,9 +577,9 @@ QString Logger::levelToString(LogLevel level) const
     }
 }
 
-QString Logger::formatMessage(LogLevel level, const QString& category, const QString& message) const
+QString Logger::formatMessage(qint64 timestamp, LogLevel level, const QString& category, const QString& message) const
 {
-    QString timestamp = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz");
+    QString time = QDateTime::fromMSecsSinceEpoch(timestamp).toString("yyyy-MM-dd hh:mm:ss.zzz");
     QString levelStr = levelToString(level);
-    return QString("[%1] %2 [%3] %4").arg(timestamp, levelStr, category, message);
+    return QString("[%1] %2 [%3] %4").arg(time, levelStr, category, message);
 }
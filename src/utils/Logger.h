@@ -4,10 +4,30 @@
 #include <QString>
 #include <QLoggingCategory>
 #include <QFile>
-#include <QTextStream>
 #include <QDateTime>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <atomic>
+#include <map>
+#include <memory>
 
+template <typename T> class LogRing;
+class QThread;
+class LogCategory;
+
+// Logging is asynchronous: log() stamps the message and pushes it onto a
+// lock-free ring buffer, and a writer thread formats and writes whole batches.
+// The writer runs every flushInterval, at once for Error, and synchronously for
+// Critical. When the buffer is full, messages are dropped and counted, rather
+// than blocking the caller; the count is written to the log.
+//
+// The log file is rotated when it outgrows maxFileSize or maxFileAge. Rotated
+// files are renamed to notes-<timestamp>.log and gzipped on a background thread;
+// only the newest retainedFiles archives are kept. The most recent lines are also
+// kept in memory for tail().
 class Logger : public QObject
 {
     Q_OBJECT
@@ -22,40 +42,168 @@ public:
     };
 
     static Logger& instance();
-    
+
+    // The global level applies to every category without a level of its own
     void setLogLevel(LogLevel level);
+    void setCategoryLevel(const QString& category, LogLevel level);
+    void clearCategoryLevel(const QString& category);
+    bool isEnabled(LogLevel level, const QString& category);
+    // Created on first use and never destroyed, so references can be cached
+    LogCategory& category(const QString& name);
     void setLogToFile(bool enabled, const QString& filePath = QString());
     void setLogToConsole(bool enabled);
-    
+    void setFlushInterval(int milliseconds);
+
+    // Rotation; 0 disables the size or age limit
+    void setMaxFileSize(qint64 bytes);
+    void setMaxFileAge(qint64 seconds);
+    void setRetainedFiles(int count);
+    QString logFilePath() const;
+
+    // Routes qDebug(), qWarning() and friends through the logger
+    void installMessageHandler();
+
     void log(LogLevel level, const QString& category, const QString& message);
+    // For callers that already checked category.isEnabled(level), like the LOG_* macros
+    void write(LogLevel level, const LogCategory& category, const QString& message);
     void debug(const QString& category, const QString& message);
     void info(const QString& category, const QString& message);
     void warning(const QString& category, const QString& message);
     void error(const QString& category, const QString& message);
     void critical(const QString& category, const QString& message);
 
+    // Blocks until everything logged so far has been written
+    void flush();
+    quint64 droppedCount() const;
+
+    // The last written lines, oldest first; call flush() first to include
+    // messages still waiting in the buffer
+    QStringList tail(int lines = 100) const;
+
 private:
+    struct Entry
+    {
+        qint64 timestamp = 0;  // Milliseconds since the epoch
+        LogLevel level = Debug;
+        QString category;
+        QString message;
+    };
+
     explicit Logger(QObject* parent = nullptr);
     ~Logger() override;
-    
+
     QString levelToString(LogLevel level) const;
-    QString formatMessage(LogLevel level, const QString& category, const QString& message) const;
-    
-    LogLevel m_logLevel;
+    QString formatMessage(qint64 timestamp, LogLevel level, const QString& category, const QString& message) const;
+
+    void enqueue(LogLevel level, const QString& category, const QString& message);
+    void updateCategoryThreshold(LogCategory& category);
+    void wakeWriter();
+    void writerLoop();
+    void drain();
+    bool openLogFile();
+    void closeLogFile();
+    void rotateLogFile();
+    void startArchiving();
+    void appendToTail(const QString& line);
+
+    static void archiveRotatedFiles(const QString& logFilePath, int retainedFiles);
+    static bool gzipFile(const QString& sourcePath, const QString& targetPath);
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+    std::atomic<int> m_logLevel;
+
+    // Category filters; guarded by m_categoryMutex, read lock-free through LogCategory
+    std::map<QString, std::unique_ptr<LogCategory>> m_categories;
+    QHash<QString, int> m_categoryLevels;
+    std::atomic<bool> m_hasCategoryLevels;
+    QMutex m_categoryMutex;
+
+    std::unique_ptr<LogRing<Entry>> m_ring;
+    std::atomic<quint64> m_dropped;
+    quint64 m_reportedDropped;       // Writer thread only
+    std::atomic<bool> m_wakePending;
+
+    // Sinks; the writer holds m_mutex while it writes
     bool m_logToFile;
     bool m_logToConsole;
     QString m_logFilePath;
     QFile* m_logFile;
-    QTextStream* m_logStream;
-    QMutex m_mutex;
+    qint64 m_logFileSize;
+    QDateTime m_logFileCreated;
+    qint64 m_maxFileSize;
+    qint64 m_maxFileAge;
+    int m_retainedFiles;
+    QThread* m_archiver;
+    mutable QMutex m_mutex;
+
+    // Recently written lines, a circular buffer guarded by m_tailMutex
+    QVector<QString> m_tail;
+    int m_tailNext;
+    int m_tailCount;
+    mutable QMutex m_tailMutex;
+
+    // Writer thread control, guarded by m_wakeMutex
+    QThread* m_writer;
+    QMutex m_wakeMutex;
+    QWaitCondition m_wakeCondition;
+    QWaitCondition m_flushedCondition;
+    bool m_wakeRequested;
+    bool m_stopping;
+    int m_flushIntervalMs;
+    quint64 m_flushRequested;
+    quint64 m_flushCompleted;
+};
+
+// A log category's filter. The logger keeps its threshold at the category's own
+// level, or the global level when it has none, so a check is one load and one
+// compare.
+class LogCategory
+{
+public:
+    const QString& name() const { return m_name; }
+    bool isEnabled(Logger::LogLevel level) const
+    {
+        return level >= m_threshold.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class Logger;
+    explicit LogCategory(const QString& name) : m_name(name), m_threshold(Logger::Debug) {}
+
+    QString m_name;
+    std::atomic<int> m_threshold;
 };
 
-// Convenience macros for easy logging
-#define LOG_DEBUG(category, message) Logger::instance().debug(category, message)
-#define LOG_INFO(category, message) Logger::instance().info(category, message)
-#define LOG_WARNING(category, message) Logger::instance().warning(category, message)
-#define LOG_ERROR(category, message) Logger::instance().error(category, message)
-#define LOG_CRITICAL(category, message) Logger::instance().critical(category, message)
+// LOG_* calls below this level are compiled out: 0 debug, 1 info, 2 warning,
+// 3 error, 4 critical. Debug builds keep everything, others drop debug; set
+// the NOTES_LOG_MIN_LEVEL CMake cache variable to choose.
+#ifndef NOTES_LOG_MIN_LEVEL
+#ifdef QT_DEBUG
+#define NOTES_LOG_MIN_LEVEL 0
+#else
+#define NOTES_LOG_MIN_LEVEL 1
+#endif
+#endif
+
+// The message is only evaluated when the level is compiled in and enabled for
+// the category, so it may format freely. categoryName must be a string literal;
+// each call site looks its category up once.
+#define NOTES_LOG(logLevel, categoryName, message) \
+    do { \
+        if (int(logLevel) >= NOTES_LOG_MIN_LEVEL) { \
+            static LogCategory& notesLogCategory = Logger::instance().category(QStringLiteral(categoryName)); \
+            if (notesLogCategory.isEnabled(logLevel)) { \
+                Logger::instance().write(logLevel, notesLogCategory, message); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(category, message) NOTES_LOG(Logger::Debug, category, message)
+#define LOG_INFO(category, message) NOTES_LOG(Logger::Info, category, message)
+#define LOG_WARNING(category, message) NOTES_LOG(Logger::Warning, category, message)
+#define LOG_ERROR(category, message) NOTES_LOG(Logger::Error, category, message)
+#define LOG_CRITICAL(category, message) NOTES_LOG(Logger::Critical, category, message)
 
 // Category definitions
 Q_DECLARE_LOGGING_CATEGORY(database)
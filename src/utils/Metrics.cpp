@@ -0,0 +1,239 @@
+#include "Metrics.h"
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QTimer>
+#include <QDir>
+#include <limits>
+
+MetricHistogram::MetricHistogram()
+    : m_buckets(new std::atomic<quint64>[BUCKETS])
+    , m_min(std::numeric_limits<qint64>::max())
+{
+    for (int i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricHistogram::record(qint64 value)
+{
+    value = qMax<qint64>(0, value);
+    m_buckets[bucketFor(quint64(value))].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    qint64 current = m_min.load(std::memory_order_relaxed);
+    while (value < current && !m_min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+    current = m_max.load(std::memory_order_relaxed);
+    while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+qint64 MetricHistogram::min() const
+{
+    return count() > 0 ? m_min.load(std::memory_order_relaxed) : 0;
+}
+
+double MetricHistogram::mean() const
+{
+    quint64 n = count();
+    return n > 0 ? double(sum()) / double(n) : 0.0;
+}
+
+qint64 MetricHistogram::percentile(double q) const
+{
+    // Counters move while we read; the total is taken from the buckets
+    // themselves so the walk always ends inside them
+    quint64 total = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        total += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    quint64 rank = quint64(qBound(0.0, q, 1.0) * double(total - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return qMin(qint64(bucketUpperBound(i)), max());
+        }
+    }
+    return max();
+}
+
+int MetricHistogram::bucketFor(quint64 value)
+{
+    if (value < quint64(SUB_BUCKETS)) {
+        return int(value);
+    }
+
+    int highestBit = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (value >> (highestBit + shift)) {
+            highestBit += shift;
+        }
+    }
+    // The top SUB_BUCKET_BITS + 1 bits pick the bucket; 16..31 for values below 32
+    int exponent = highestBit - SUB_BUCKET_BITS;
+    int subBucket = int(value >> exponent) - SUB_BUCKETS;
+    return (exponent + 1) * SUB_BUCKETS + subBucket;
+}
+
+quint64 MetricHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+        return quint64(bucket);
+    }
+    int exponent = bucket / SUB_BUCKETS - 1;
+    quint64 top = quint64(SUB_BUCKETS + bucket % SUB_BUCKETS);
+    return ((top + 1) << exponent) - 1;
+}
+
+Metrics& Metrics::instance()
+{
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Metrics(QObject* parent)
+    : QObject(parent)
+    , m_dumpTimer(nullptr)
+{
+    m_uptime.start();
+}
+
+Metrics::~Metrics()
+{
+    delete m_dumpTimer;
+}
+
+MetricCounter& Metrics::counter(const QString& name)
+{
+    QMutexLocker locker(&m_mutex);
+    std::unique_ptr<MetricCounter>& metric = m_counters[name];
+    if (!metric) {
+        metric.reset(new MetricCounter);
+    }
+    return *metric;
+}
+
+MetricGauge& Metrics::gauge(const QString& name)
+{
+    QMutexLocker locker(&m_mutex);
+    std::unique_ptr<MetricGauge>& metric = m_gauges[name];
+    if (!metric) {
+        metric.reset(new MetricGauge);
+    }
+    return *metric;
+}
+
+MetricHistogram& Metrics::histogram(const QString& name)
+{
+    QMutexLocker locker(&m_mutex);
+    std::unique_ptr<MetricHistogram>& metric = m_histograms[name];
+    if (!metric) {
+        metric.reset(new MetricHistogram);
+    }
+    return *metric;
+}
+
+QJsonObject Metrics::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QJsonObject counters;
+    for (const auto& entry : m_counters) {
+        counters.insert(entry.first, double(entry.second->value()));
+    }
+
+    QJsonObject gauges;
+    for (const auto& entry : m_gauges) {
+        gauges.insert(entry.first, double(entry.second->value()));
+    }
+
+    QJsonObject histograms;
+    for (const auto& entry : m_histograms) {
+        const MetricHistogram& h = *entry.second;
+        QJsonObject summary;
+        summary.insert("count", double(h.count()));
+        summary.insert("min", double(h.min()));
+        summary.insert("mean", h.mean());
+        summary.insert("p50", double(h.percentile(0.50)));
+        summary.insert("p90", double(h.percentile(0.90)));
+        summary.insert("p99", double(h.percentile(0.99)));
+        summary.insert("p999", double(h.percentile(0.999)));
+        summary.insert("max", double(h.max()));
+        histograms.insert(entry.first, summary);
+    }
+
+    QJsonObject result;
+    result.insert("counters", counters);
+    result.insert("gauges", gauges);
+    result.insert("histograms", histograms);
+    return result;
+}
+
+void Metrics::startPeriodicDump(const QString& filePath, int intervalMs)
+{
+    if (filePath.isEmpty()) {
+        QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(dataDir);
+        m_dumpFilePath = dataDir + "/metrics.json";
+    } else {
+        m_dumpFilePath = filePath;
+    }
+
+    if (!m_dumpTimer) {
+        // No parent, so the timer lives in the calling thread rather than in
+        // whichever thread first touched instance()
+        m_dumpTimer = new QTimer;
+        QObject::connect(m_dumpTimer, &QTimer::timeout, m_dumpTimer, [this]() {
+            dumpNow();
+        });
+    }
+    m_dumpTimer->start(qMax(1000, intervalMs));
+}
+
+void Metrics::stopPeriodicDump()
+{
+    if (m_dumpTimer) {
+        m_dumpTimer->stop();
+    }
+}
+
+bool Metrics::dumpNow()
+{
+    if (m_dumpFilePath.isEmpty()) {
+        return false;
+    }
+
+    QJsonObject metrics = snapshot();
+    QByteArray comparable = QJsonDocument(metrics).toJson(QJsonDocument::Compact);
+    if (comparable == m_lastDump) {
+        return true;
+    }
+
+    metrics.insert("timestamp", QDateTime::currentDateTime().toString(Qt::ISODateWithMs));
+    metrics.insert("uptime_ms", double(m_uptime.elapsed()));
+
+    // Readers never see a half-written file
+    QSaveFile file(m_dumpFilePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(metrics).toJson());
+    if (!file.commit()) {
+        return false;
+    }
+    m_lastDump = comparable;
+    return true;
+}
+
+QString Metrics::dumpFilePath() const
+{
+    return m_dumpFilePath;
+}
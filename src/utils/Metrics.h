@@ -0,0 +1,142 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <atomic>
+#include <map>
+#include <memory>
+
+class QTimer;
+
+// Monotonic count of events or bytes
+class MetricCounter
+{
+public:
+    void add(quint64 amount = 1) { m_value.fetch_add(amount, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+// Current level of something, e.g. requests in flight
+class MetricGauge
+{
+public:
+    void set(qint64 value) { m_value.store(value, std::memory_order_relaxed); }
+    void add(qint64 delta) { m_value.fetch_add(delta, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> m_value{0};
+};
+
+// Distribution of non-negative values (latencies in microseconds, sizes in
+// bytes) in HDR-style log-linear buckets: values below 16 are exact, and every
+// power of two above is split into 16 sub-buckets, so percentiles are within
+// about 6% at any magnitude. Recording is lock-free and the footprint is fixed.
+class MetricHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    MetricHistogram();
+
+    void record(qint64 value);
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    qint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+    qint64 min() const;
+    qint64 max() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const;
+    // Highest value of the bucket holding the q-th quantile, capped at max()
+    qint64 percentile(double q) const;
+
+    static int bucketFor(quint64 value);
+    static quint64 bucketUpperBound(int bucket);
+
+private:
+    std::unique_ptr<std::atomic<quint64>[]> m_buckets;
+    std::atomic<quint64> m_count{0};
+    std::atomic<qint64> m_sum{0};
+    std::atomic<qint64> m_min;
+    std::atomic<qint64> m_max{0};
+};
+
+// Records the lifetime of the scope into a histogram, in microseconds
+class MetricTimer
+{
+public:
+    explicit MetricTimer(MetricHistogram& histogram)
+        : m_histogram(histogram)
+    {
+        m_timer.start();
+    }
+
+    ~MetricTimer()
+    {
+        m_histogram.record(m_timer.nsecsElapsed() / 1000);
+    }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+    MetricHistogram& m_histogram;
+    QElapsedTimer m_timer;
+};
+
+// Process-wide registry of named metrics. Metrics are created on first use and
+// live as long as the process, so references can be cached; the METRIC_*
+// macros below do that, leaving an atomic add on the hot path.
+//
+// Names are dotted, subsystem first, with the unit as a suffix where it is not
+// a plain count: "db.note_updates", "file.bytes_written", "drive.request_ms".
+class Metrics : public QObject
+{
+    Q_OBJECT
+
+public:
+    static Metrics& instance();
+
+    MetricCounter& counter(const QString& name);
+    MetricGauge& gauge(const QString& name);
+    MetricHistogram& histogram(const QString& name);
+
+    QJsonObject snapshot() const;
+
+    // Writes snapshot() to filePath (default AppData/metrics.json) every
+    // intervalMs, skipping writes when nothing changed. Call from the GUI thread.
+    void startPeriodicDump(const QString& filePath = QString(), int intervalMs = 60000);
+    void stopPeriodicDump();
+    bool dumpNow();
+    QString dumpFilePath() const;
+
+private:
+    explicit Metrics(QObject* parent = nullptr);
+    ~Metrics() override;
+
+    mutable QMutex m_mutex;
+    std::map<QString, std::unique_ptr<MetricCounter>> m_counters;
+    std::map<QString, std::unique_ptr<MetricGauge>> m_gauges;
+    std::map<QString, std::unique_ptr<MetricHistogram>> m_histograms;
+    QElapsedTimer m_uptime;
+
+    QTimer* m_dumpTimer;
+    QString m_dumpFilePath;
+    QByteArray m_lastDump;
+};
+
+// name must be a string literal; each use site looks the metric up once
+#define METRIC_COUNTER(name) \
+    ([]() -> MetricCounter& { static MetricCounter& metric = Metrics::instance().counter(QStringLiteral(name)); return metric; }())
+#define METRIC_GAUGE(name) \
+    ([]() -> MetricGauge& { static MetricGauge& metric = Metrics::instance().gauge(QStringLiteral(name)); return metric; }())
+#define METRIC_HISTOGRAM(name) \
+    ([]() -> MetricHistogram& { static MetricHistogram& metric = Metrics::instance().histogram(QStringLiteral(name)); return metric; }())
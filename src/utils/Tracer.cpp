@@ -0,0 +1,154 @@
+#include "Tracer.h"
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QThread>
+#include <QDir>
+#include <QDebug>
+
+// Buffered events are written out once they reach this size
+static const int WRITE_THRESHOLD = 64 * 1024;
+
+Tracer& Tracer::instance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::Tracer()
+    : m_recording(false)
+    , m_firstEvent(true)
+{
+}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+bool Tracer::start(const QString& filePath)
+{
+#ifndef NOTES_TRACING
+    Q_UNUSED(filePath);
+    qWarning() << "Tracing is not compiled in; configure with -DNOTES_ENABLE_TRACING=ON";
+    return false;
+#else
+    QMutexLocker locker(&m_mutex);
+    if (m_recording.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    QString path = filePath;
+    if (path.isEmpty()) {
+        QString traceDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/traces";
+        QDir().mkpath(traceDir);
+        path = traceDir + "/notes-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+    }
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not open trace file" << path << ":" << m_file.errorString();
+        return false;
+    }
+
+    // The JSON array form; the closing bracket is optional, so a trace cut
+    // short by a crash still loads
+    m_buffer = "[\n";
+    m_firstEvent = true;
+    m_threadIds.clear();
+    m_clock.start();
+    m_recording.store(true, std::memory_order_release);
+    return true;
+#endif
+}
+
+void Tracer::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_recording.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    m_buffer += "\n]\n";
+    writeBuffer();
+    m_file.close();
+}
+
+QString Tracer::filePath() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_file.fileName();
+}
+
+qint64 Tracer::now() const
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+void Tracer::addCompleteEvent(const char* category, const char* name, qint64 startUs, qint64 durationUs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_recording.load(std::memory_order_relaxed)) {
+        return;  // Stopped while the span was open
+    }
+
+    QByteArray event = "{\"ph\":\"X\",\"cat\":\"";
+    event += category;
+    event += "\",\"name\":\"";
+    event += name;
+    event += "\",\"ts\":" + QByteArray::number(startUs)
+           + ",\"dur\":" + QByteArray::number(durationUs)
+           + ",\"pid\":" + QByteArray::number(QCoreApplication::applicationPid())
+           + ",\"tid\":" + QByteArray::number(threadId()) + "}";
+    appendEvent(event);
+
+    if (m_buffer.size() >= WRITE_THRESHOLD) {
+        writeBuffer();
+    }
+}
+
+// The methods below expect m_mutex to be held
+
+int Tracer::threadId()
+{
+    Qt::HANDLE handle = QThread::currentThreadId();
+    auto it = m_threadIds.constFind(handle);
+    if (it != m_threadIds.constEnd()) {
+        return it.value();
+    }
+
+    // Small ids read better than native handles; the metadata event names the
+    // thread's track in the viewer
+    int id = m_threadIds.size() + 1;
+    m_threadIds.insert(handle, id);
+
+    QString threadName = QThread::currentThread()->objectName();
+    if (threadName.isEmpty()) {
+        bool isMainThread = QCoreApplication::instance()
+                         && QThread::currentThread() == QCoreApplication::instance()->thread();
+        threadName = isMainThread ? QString("main") : QString("thread %1").arg(id);
+    }
+    threadName.replace('\\', "\\\\").replace('"', "\\\"");
+
+    appendEvent("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":"
+                + QByteArray::number(QCoreApplication::applicationPid())
+                + ",\"tid\":" + QByteArray::number(id)
+                + ",\"args\":{\"name\":\"" + threadName.toUtf8() + "\"}}");
+    return id;
+}
+
+void Tracer::appendEvent(const QByteArray& event)
+{
+    if (!m_firstEvent) {
+        m_buffer += ",\n";
+    }
+    m_firstEvent = false;
+    m_buffer += event;
+}
+
+void Tracer::writeBuffer()
+{
+    m_file.write(m_buffer);
+    m_file.flush();
+    m_buffer.clear();
+}
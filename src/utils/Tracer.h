@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Span tracing in the Chrome trace-event format, which Perfetto
+// (ui.perfetto.dev) and chrome://tracing load directly. TRACE_SCOPE records
+// how long the enclosing scope took as one complete event on the calling thread.
+//
+// Spans are compiled in when NOTES_TRACING is defined (the NOTES_ENABLE_TRACING
+// CMake option). Recording is switched on at runtime with start(); while it is
+// off a span costs one atomic load.
+class Tracer
+{
+public:
+    static Tracer& instance();
+
+    // Records into filePath, or into a new file under AppData/traces
+    bool start(const QString& filePath = QString());
+    void stop();
+    bool isRecording() const { return m_recording.load(std::memory_order_acquire); }
+    QString filePath() const;
+
+    // Microseconds since start()
+    qint64 now() const;
+    void addCompleteEvent(const char* category, const char* name, qint64 startUs, qint64 durationUs);
+
+private:
+    Tracer();
+    ~Tracer();
+
+    int threadId();
+    void appendEvent(const QByteArray& event);
+    void writeBuffer();
+
+    std::atomic<bool> m_recording;
+    QElapsedTimer m_clock;
+
+    // Guarded by m_mutex
+    QFile m_file;
+    QByteArray m_buffer;
+    bool m_firstEvent;
+    QHash<Qt::HANDLE, int> m_threadIds;
+    mutable QMutex m_mutex;
+};
+
+class TraceSpan
+{
+public:
+    TraceSpan(const char* category, const char* name)
+        : m_category(category)
+        , m_name(name)
+        , m_start(Tracer::instance().isRecording() ? Tracer::instance().now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_start >= 0) {
+            Tracer& tracer = Tracer::instance();
+            tracer.addCompleteEvent(m_category, m_name, m_start, tracer.now() - m_start);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_category;
+    const char* m_name;
+    qint64 m_start;
+};
+
+// category and name must be string literals; they are written without escaping
+#ifdef NOTES_TRACING
+#define NOTES_TRACE_CONCAT_(a, b) a##b
+#define NOTES_TRACE_CONCAT(a, b) NOTES_TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(category, name) TraceSpan NOTES_TRACE_CONCAT(traceSpan_, __LINE__)(category, name)
+#else
+#define TRACE_SCOPE(category, name) do {} while (0)
+#endif
@@ -0,0 +1,397 @@
+// notes-cli: runs the app's bulk and maintenance operations without the UI.
+//
+//   notes-cli import                     # manualImportMarkdownFiles
+//   notes-cli export <dir>               # one .md file per note
+//   notes-cli recreate                   # recreateAllMarkdownFiles
+//   notes-cli sync-files                 # syncAllNotesWithFiles
+//   notes-cli sync                       # full sync with Google Drive
+//   notes-cli search <text>
+//   notes-cli check                      # database and markdown file consistency
+//   notes-cli vacuum
+//
+// It works on the app's own database unless --db is given. Progress goes to
+// stderr and the result to stdout, as text or, with --json, as one JSON object.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLoggingCategory>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTextStream>
+#include <QSqlQuery>
+#include <QSqlError>
+#include "db/DatabaseManager.h"
+#include "sync/SyncManager.h"
+#include "sync/SyncOutbox.h"
+#include "sync/LocalSyncBackend.h"
+
+// Minimum time between progress lines
+static const int PROGRESS_INTERVAL_MS = 250;
+// Idle time after the last sync signal before a sync counts as finished
+static const int SYNC_SETTLE_MS = 1000;
+
+class Progress
+{
+public:
+    explicit Progress(bool enabled)
+        : m_enabled(enabled)
+    {
+        m_timer.start();
+    }
+
+    void report(const QString &operation, int current, int total)
+    {
+        bool last = total > 0 && current >= total;
+        if (!m_enabled || (!last && m_timer.elapsed() - m_lastReport < PROGRESS_INTERVAL_MS)) {
+            return;
+        }
+        m_lastReport = m_timer.elapsed();
+        QTextStream err(stderr);
+        err << "  " << operation << ": " << current;
+        if (total >= 0) {
+            err << " / " << total;
+        }
+        err << " (" << m_timer.elapsed() << " ms)\n";
+    }
+
+private:
+    bool m_enabled;
+    QElapsedTimer m_timer;
+    qint64 m_lastReport = -PROGRESS_INTERVAL_MS;
+};
+
+struct CommandResult
+{
+    bool ok = true;
+    QJsonObject data;
+    QStringList lines;     // Text output
+};
+
+static int noteCount(DatabaseManager &db)
+{
+    QSqlQuery q(db.database());
+    if (q.exec("SELECT COUNT(*) FROM notes") && q.next()) {
+        return q.value(0).toInt();
+    }
+    return -1;
+}
+
+static QString fileNameForNote(const NoteData &note)
+{
+    QString name;
+    for (const QChar &c : note.title.left(60)) {
+        name += c.isLetterOrNumber() ? c : QChar('_');
+    }
+    return QString("%1_%2.md").arg(note.id).arg(name);
+}
+
+static CommandResult runImport(DatabaseManager &db)
+{
+    CommandResult result;
+    int before = noteCount(db);
+    int files = db.getMarkdownFileList().size();
+    db.manualImportMarkdownFiles();
+    int imported = noteCount(db) - before;
+
+    result.data["filesScanned"] = files;
+    result.data["notesImported"] = imported;
+    result.lines << QString("Scanned %1 files in %2, imported %3 notes").arg(files).arg(db.getNotesDirectory()).arg(imported);
+    return result;
+}
+
+static CommandResult runExport(DatabaseManager &db, const QString &directory, Progress &progress)
+{
+    CommandResult result;
+    if (!QDir().mkpath(directory)) {
+        result.ok = false;
+        result.lines << QString("Could not create %1").arg(directory);
+        return result;
+    }
+
+    // Only IDs and titles up front; each body is read when its note is exported
+    QList<NoteData> notes;
+    QSqlQuery q(db.database());
+    if (!q.exec("SELECT id, title FROM notes ORDER BY id")) {
+        result.ok = false;
+        result.lines << QString("Could not list notes: %1").arg(q.lastError().text());
+        return result;
+    }
+    while (q.next()) {
+        NoteData note;
+        note.id = q.value(0).toInt();
+        note.title = q.value(1).toString();
+        notes.append(note);
+    }
+
+    int exported = 0;
+    QJsonArray failed;
+    for (const NoteData &note : notes) {
+        QString filePath = QDir(directory).filePath(fileNameForNote(note));
+        if (db.exportNoteToFile(note.id, filePath)) {
+            exported++;
+        } else {
+            failed.append(note.id);
+        }
+        progress.report("Export", exported + failed.size(), notes.size());
+    }
+
+    result.ok = failed.isEmpty();
+    result.data["directory"] = QFileInfo(directory).absoluteFilePath();
+    result.data["notesExported"] = exported;
+    result.data["failedNoteIds"] = failed;
+    result.lines << QString("Exported %1 of %2 notes to %3").arg(exported).arg(notes.size()).arg(directory);
+    return result;
+}
+
+static CommandResult runRecreate(DatabaseManager &db)
+{
+    CommandResult result;
+    result.ok = db.recreateAllMarkdownFiles();
+    result.data["notes"] = noteCount(db);
+    result.lines << QString("Recreated markdown files for %1 notes in %2%3")
+                        .arg(noteCount(db)).arg(db.getNotesDirectory())
+                        .arg(result.ok ? "" : " (some failed, see the log)");
+    return result;
+}
+
+static CommandResult runSyncFiles(DatabaseManager &db)
+{
+    CommandResult result;
+    result.ok = db.syncAllNotesWithFiles();
+    result.data["notes"] = noteCount(db);
+    result.lines << QString("Synced %1 notes with their markdown files%2")
+                        .arg(noteCount(db)).arg(result.ok ? "" : " (some failed, see the log)");
+    return result;
+}
+
+static CommandResult runSync(DatabaseManager &db, const QString &localBackend, int timeoutSec, Progress &progress)
+{
+    CommandResult result;
+    SyncManager *sync = localBackend.isEmpty()
+        ? new SyncManager(&db)
+        : new SyncManager(&db, new LocalSyncBackend(localBackend));
+    if (!sync->isAuthenticated()) {
+        result.ok = false;
+        result.lines << "Not signed in to Google Drive; sign in from the app first";
+        delete sync;
+        return result;
+    }
+
+    bool finished = false;
+    QString error;
+    QElapsedTimer clock;
+    clock.start();
+    qint64 lastActivity = 0;
+    QObject::connect(sync, &SyncManager::syncProgress, [&](int current, int total) {
+        lastActivity = clock.elapsed();
+        progress.report("Sync", current, total);
+    });
+    QObject::connect(sync, &SyncManager::syncCompleted, [&]() {
+        lastActivity = clock.elapsed();
+        finished = true;
+    });
+    QObject::connect(sync, &SyncManager::syncFailed, [&](const QString &message) {
+        lastActivity = clock.elapsed();
+        finished = true;
+        error = message;
+    });
+    QObject::connect(sync, &SyncManager::noteUploaded, [&]() { lastActivity = clock.elapsed(); });
+    QObject::connect(sync, &SyncManager::noteDownloaded, [&]() { lastActivity = clock.elapsed(); });
+
+    sync->syncAllNotes();
+
+    // syncCompleted can come before queued uploads are sent, so also wait for
+    // the outbox to drain and the connection to go quiet
+    SyncOutbox outbox(db.database());
+    QEventLoop loop;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+        bool settled = finished && !sync->isSyncing() && sync->inFlightBytes() == 0
+            && (!error.isEmpty() || outbox.pendingCount() == 0)
+            && clock.elapsed() - lastActivity >= SYNC_SETTLE_MS;
+        if (settled || clock.elapsed() > timeoutSec * 1000) {
+            loop.quit();
+        }
+    });
+    poll.start(50);
+    loop.exec();
+
+    int pending = outbox.pendingCount();
+    result.ok = finished && error.isEmpty() && pending == 0;
+    result.data["pendingOperations"] = pending;
+    if (!error.isEmpty()) {
+        result.data["error"] = error;
+    }
+    if (!finished) {
+        result.lines << QString("Sync did not finish within %1 s").arg(timeoutSec);
+    } else if (!error.isEmpty()) {
+        result.lines << "Sync failed: " + error;
+    } else {
+        result.lines << QString("Sync finished, %1 operations still pending").arg(pending);
+    }
+    delete sync;
+    return result;
+}
+
+static QString snippetFor(const NoteData &note, const QString &text)
+{
+    int at = note.body.indexOf(text, 0, Qt::CaseInsensitive);
+    if (at < 0) {
+        return note.body.left(100).simplified();
+    }
+    int start = qMax(0, at - 40);
+    return note.body.mid(start, 100).simplified();
+}
+
+static CommandResult runSearch(DatabaseManager &db, const QString &text, int limit)
+{
+    CommandResult result;
+    const QList<NoteData> notes = db.searchNotes(text, limit);
+    QJsonArray matches;
+    for (const NoteData &note : notes) {
+        QJsonObject match;
+        match["id"] = note.id;
+        match["folderId"] = note.folderId;
+        match["title"] = note.title;
+        match["updatedAt"] = note.updatedAt.toString(Qt::ISODate);
+        match["snippet"] = snippetFor(note, text);
+        matches.append(match);
+        result.lines << QString("%1\t%2\t%3").arg(note.id).arg(note.title, match["snippet"].toString());
+    }
+    result.data["query"] = text;
+    result.data["matches"] = matches;
+    result.lines << QString("%1 matches").arg(notes.size());
+    return result;
+}
+
+static CommandResult runCheck(DatabaseManager &db)
+{
+    CommandResult result;
+    const QStringList problems = db.checkIntegrity();
+    result.ok = problems.isEmpty();
+    result.data["problems"] = QJsonArray::fromStringList(problems);
+    result.lines << problems;
+    result.lines << (problems.isEmpty() ? QString("No problems found")
+                                        : QString("%1 problems found").arg(problems.size()));
+    return result;
+}
+
+static CommandResult runVacuum(DatabaseManager &db, const QString &databasePath)
+{
+    CommandResult result;
+    qint64 before = QFileInfo(databasePath).size();
+    result.ok = db.vacuum();
+    qint64 after = QFileInfo(databasePath).size();
+    result.data["bytesBefore"] = double(before);
+    result.data["bytesAfter"] = double(after);
+    result.lines << QString("%1: %2 -> %3 bytes").arg(databasePath).arg(before).arg(after);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Same identity as the app, so the default database and settings are shared
+    QCoreApplication::setOrganizationName("Orchard");
+    QCoreApplication::setOrganizationDomain("orchard.local");
+    QCoreApplication::setApplicationName("Notes");
+    QCoreApplication::setApplicationVersion("0.1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs Notes maintenance operations without the UI.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("command", "import, export, recreate, sync-files, sync, search, check or vacuum.");
+    parser.addPositionalArgument("argument", "Directory for export, text for search.", "[argument]");
+    parser.addOptions({
+        {"db", "Database to use instead of the app's.", "path"},
+        {"json", "Print the result as JSON."},
+        {"quiet", "No progress output."},
+        {"verbose", "Keep debug output from the app code."},
+        {"limit", "Maximum number of search results.", "count", "100"},
+        {"local-backend", "Sync with a local directory instead of Google Drive.", "dir"},
+        {"timeout", "Give up on sync after this long.", "seconds", "600"},
+    });
+    parser.process(app);
+
+    const QStringList positional = parser.positionalArguments();
+    const QString command = positional.value(0);
+    const QString argument = positional.value(1);
+    const QStringList commands = {"import", "export", "recreate", "sync-files", "sync", "search", "check", "vacuum"};
+    if (!commands.contains(command)) {
+        QTextStream(stderr) << (command.isEmpty() ? QString("No command given") : "Unknown command: " + command)
+                            << "\n" << parser.helpText();
+        return 2;
+    }
+    if ((command == "export" || command == "search") && argument.isEmpty()) {
+        QTextStream(stderr) << command << " needs an argument\n";
+        return 2;
+    }
+
+    if (!parser.isSet("verbose")) {
+        QLoggingCategory::setFilterRules("*.debug=false\n*.info=false");
+    }
+
+    DatabaseManager &db = DatabaseManager::instance();
+    if (parser.isSet("db")) {
+        db.setDatabasePath(QFileInfo(parser.value("db")).absoluteFilePath());
+    }
+    if (!db.open() || !db.initializeSchema()) {
+        QTextStream(stderr) << "Could not open the database\n";
+        return 1;
+    }
+    QString databasePath = db.database().databaseName();
+
+    Progress progress(!parser.isSet("quiet"));
+    QObject::connect(&db, &DatabaseManager::operationProgress,
+                     [&progress](const QString &operation, int current, int total) {
+                         progress.report(operation, current, total);
+                     });
+
+    QElapsedTimer timer;
+    timer.start();
+    CommandResult result;
+    if (command == "import") {
+        result = runImport(db);
+    } else if (command == "export") {
+        result = runExport(db, argument, progress);
+    } else if (command == "recreate") {
+        result = runRecreate(db);
+    } else if (command == "sync-files") {
+        result = runSyncFiles(db);
+    } else if (command == "sync") {
+        result = runSync(db, parser.value("local-backend"), parser.value("timeout").toInt(), progress);
+    } else if (command == "search") {
+        result = runSearch(db, argument, parser.value("limit").toInt());
+    } else if (command == "check") {
+        result = runCheck(db);
+    } else if (command == "vacuum") {
+        result = runVacuum(db, databasePath);
+    }
+    qint64 elapsed = timer.elapsed();
+
+    QTextStream out(stdout);
+    if (parser.isSet("json")) {
+        QJsonObject json = result.data;
+        json["command"] = command;
+        json["database"] = databasePath;
+        json["ok"] = result.ok;
+        json["elapsedMs"] = double(elapsed);
+        out << QJsonDocument(json).toJson(QJsonDocument::Indented);
+    } else {
+        for (const QString &line : result.lines) {
+            out << line << "\n";
+        }
+        out << command << " took " << elapsed << " ms\n";
+    }
+    out.flush();
+
+    db.close();
+    return result.ok ? 0 : 1;
+}
@@ -0,0 +1,349 @@
+#include "CorpusGenerator.h"
+#include <QtMath>
+#include <algorithm>
+
+static const char *WORDS[] = {
+    "alpha", "archive", "backlog", "budget", "cache", "calendar", "client", "commit", "config", "cursor",
+    "deadline", "deploy", "design", "draft", "editor", "estimate", "feature", "feedback", "folder", "garden",
+    "goal", "habit", "index", "invoice", "journal", "kernel", "launch", "layout", "library", "meeting",
+    "milestone", "mobile", "network", "outline", "parser", "payment", "pipeline", "plan", "question", "query",
+    "recipe", "release", "report", "research", "review", "roadmap", "schema", "script", "server", "sketch",
+    "snippet", "sprint", "storage", "summary", "sync", "target", "template", "thread", "ticket", "travel",
+    "update", "vendor", "version", "widget", "workflow", "writing", "the", "a", "of", "and",
+    "to", "in", "for", "with", "on", "this", "that", "from", "about", "before"
+};
+static const int WORD_COUNT = int(sizeof(WORDS) / sizeof(WORDS[0]));
+
+static const char *LANGUAGES[] = {"cpp", "python", "bash", "json", "sql", ""};
+static const int LANGUAGE_COUNT = int(sizeof(LANGUAGES) / sizeof(LANGUAGES[0]));
+
+// Zipf exponent of the notes-per-folder distribution
+static const double FOLDER_SKEW = 1.0;
+
+CorpusProfile CorpusProfile::byName(const QString &name, bool *ok)
+{
+    CorpusProfile profile;
+    profile.name = name;
+    profile.minBodyBytes = 200;
+    bool known = true;
+
+    if (name == "tiny") {
+        profile.notes = 100;
+        profile.folders = 5;
+        profile.maxDepth = 2;
+        profile.maxBodyBytes = 16 * 1024;
+    } else if (name == "small") {
+        profile.notes = 1000;
+        profile.folders = 20;
+        profile.maxDepth = 3;
+        profile.maxBodyBytes = 64 * 1024;
+    } else if (name == "medium") {
+        profile.notes = 10000;
+        profile.folders = 100;
+        profile.maxDepth = 4;
+        profile.maxBodyBytes = 256 * 1024;
+    } else if (name == "large") {
+        profile.notes = 100000;
+        profile.folders = 500;
+        profile.maxDepth = 5;
+        profile.maxBodyBytes = 1024 * 1024;
+    } else if (name == "huge") {
+        profile.notes = 1000000;
+        profile.folders = 2000;
+        profile.maxDepth = 6;
+        profile.maxBodyBytes = 1024 * 1024;
+    } else {
+        known = false;
+    }
+
+    if (ok) {
+        *ok = known;
+    }
+    return profile;
+}
+
+QStringList CorpusProfile::names()
+{
+    return {"tiny", "small", "medium", "large", "huge"};
+}
+
+CorpusGenerator::CorpusGenerator(const CorpusProfile &profile, quint32 seed)
+    : m_profile(profile)
+    , m_folderRandom(seed)
+    , m_noteRandom(seed ^ 0x9e3779b9u)
+    , m_generated(0)
+    , m_baseTime(QDate(2020, 1, 1), QTime(9, 0), Qt::UTC)
+{
+    m_profile.folders = qMax(1, m_profile.folders);
+    m_profile.maxDepth = qMax(1, m_profile.maxDepth);
+    m_profile.minBodyBytes = qMax(1, m_profile.minBodyBytes);
+    m_profile.maxBodyBytes = qMax(m_profile.minBodyBytes, m_profile.maxBodyBytes);
+    generateFolders();
+}
+
+const CorpusProfile &CorpusGenerator::profile() const
+{
+    return m_profile;
+}
+
+const QList<GeneratedFolder> &CorpusGenerator::folders() const
+{
+    return m_folders;
+}
+
+bool CorpusGenerator::hasNextNote() const
+{
+    return m_generated < m_profile.notes;
+}
+
+GeneratedNote CorpusGenerator::nextNote()
+{
+    GeneratedNote note;
+    note.folder = pickFolder();
+    note.title = generateTitle();
+
+    // Spread over five years; a third of the notes were edited later
+    note.createdAt = m_baseTime.addSecs(qint64(m_noteRandom.bounded(5 * 365 * 24)) * 3600);
+    note.updatedAt = m_noteRandom.bounded(3) == 0
+        ? note.createdAt.addSecs(qint64(m_noteRandom.bounded(90 * 24)) * 3600)
+        : note.createdAt;
+
+    note.body = generateBody(note.title, pickBodySize(), note.createdAt);
+    m_generated++;
+    return note;
+}
+
+void CorpusGenerator::generateFolders()
+{
+    // Each folder goes under a random earlier folder that still has room below
+    // it, or at the top level, which gives a few deep branches and many shallow ones
+    for (int i = 0; i < m_profile.folders; ++i) {
+        GeneratedFolder folder;
+        if (i > 0 && m_folderRandom.bounded(3) != 0) {
+            int parent = m_folderRandom.bounded(i);
+            if (m_folders[parent].depth < m_profile.maxDepth) {
+                folder.parent = parent;
+                folder.depth = m_folders[parent].depth + 1;
+            }
+        }
+        QString name = QString::fromLatin1(WORDS[m_folderRandom.bounded(WORD_COUNT - 10)]);
+        name[0] = name[0].toUpper();
+        folder.name = QString("%1 %2").arg(name).arg(i + 1);
+        m_folders.append(folder);
+    }
+
+    // Zipf weights over a shuffled order, so the big folders are not always the first ones
+    QVector<int> order(m_folders.size());
+    for (int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    for (int i = order.size() - 1; i > 0; --i) {
+        std::swap(order[i], order[m_folderRandom.bounded(i + 1)]);
+    }
+    QVector<double> weights(m_folders.size());
+    for (int rank = 0; rank < order.size(); ++rank) {
+        weights[order[rank]] = 1.0 / qPow(rank + 1, FOLDER_SKEW);
+    }
+    double total = 0.0;
+    m_folderWeights.resize(weights.size());
+    for (int i = 0; i < weights.size(); ++i) {
+        total += weights[i];
+        m_folderWeights[i] = total;
+    }
+}
+
+int CorpusGenerator::pickFolder()
+{
+    double target = m_noteRandom.generateDouble() * m_folderWeights.last();
+    auto it = std::upper_bound(m_folderWeights.begin(), m_folderWeights.end(), target);
+    return qMin(int(it - m_folderWeights.begin()), m_folderWeights.size() - 1);
+}
+
+int CorpusGenerator::pickBodySize()
+{
+    double u = m_noteRandom.generateDouble();
+    double size = m_profile.minBodyBytes / qPow(1.0 - u, 1.0 / m_profile.sizeShape);
+    return int(qMin(size, double(m_profile.maxBodyBytes)));
+}
+
+QString CorpusGenerator::generateTitle()
+{
+    // Numbered, so the markdown writer never maps two notes to one file
+    QString title = sentence(2, 5);
+    title.chop(1);
+    return QString("%1 %2").arg(title).arg(m_generated + 1);
+}
+
+QString CorpusGenerator::generateBody(const QString &title, int targetSize, const QDateTime &createdAt)
+{
+    QString body;
+    if (m_noteRandom.bounded(4) == 0) {
+        body += frontMatter(title, createdAt);
+    }
+    body += "# " + title + "\n\n";
+    body += paragraph();
+
+    while (body.size() < targetSize) {
+        int block = m_noteRandom.bounded(100);
+        if (block < 40) {
+            body += paragraph();
+        } else if (block < 52) {
+            body += heading();
+        } else if (block < 64) {
+            body += bulletList();
+        } else if (block < 70) {
+            body += taskList();
+        } else if (block < 82) {
+            body += codeFence();
+        } else if (block < 90) {
+            body += table();
+        } else {
+            body += quote();
+        }
+    }
+    return body;
+}
+
+QString CorpusGenerator::frontMatter(const QString &title, const QDateTime &createdAt)
+{
+    QStringList tags;
+    int tagCount = 1 + m_noteRandom.bounded(4);
+    for (int i = 0; i < tagCount; ++i) {
+        tags.append(word());
+    }
+    return QString("---\ntitle: \"%1\"\ncreated: %2\ntags: [%3]\n---\n\n")
+        .arg(title, createdAt.toString(Qt::ISODate), tags.join(", "));
+}
+
+QString CorpusGenerator::paragraph()
+{
+    QString text;
+    int sentences = 2 + m_noteRandom.bounded(6);
+    for (int i = 0; i < sentences; ++i) {
+        if (i > 0) {
+            text += ' ';
+        }
+        QString s = sentence(5, 18);
+        int decoration = m_noteRandom.bounded(10);
+        if (decoration == 0) {
+            s.insert(s.indexOf(' ') + 1, "**");
+            s.insert(s.indexOf(' ', s.indexOf("**")), "**");
+        } else if (decoration == 1) {
+            s.chop(1);
+            s += " (see " + link() + ").";
+        } else if (decoration == 2) {
+            s.chop(1);
+            s += " with `" + word() + "()`.";
+        }
+        text += s;
+    }
+    return text + "\n\n";
+}
+
+QString CorpusGenerator::sentence(int minWords, int maxWords)
+{
+    int count = minWords + m_noteRandom.bounded(maxWords - minWords + 1);
+    QStringList words;
+    for (int i = 0; i < count; ++i) {
+        words.append(word());
+    }
+    QString text = words.join(' ');
+    text[0] = text[0].toUpper();
+    return text + '.';
+}
+
+QString CorpusGenerator::heading()
+{
+    QString text = sentence(2, 5);
+    text.chop(1);
+    return QString(2 + m_noteRandom.bounded(2), '#') + ' ' + text + "\n\n";
+}
+
+QString CorpusGenerator::bulletList()
+{
+    QString text;
+    int items = 2 + m_noteRandom.bounded(7);
+    for (int i = 0; i < items; ++i) {
+        bool nested = i > 0 && m_noteRandom.bounded(4) == 0;
+        text += nested ? "  - " : "- ";
+        text += sentence(3, 10) + '\n';
+    }
+    return text + '\n';
+}
+
+QString CorpusGenerator::taskList()
+{
+    QString text;
+    int items = 2 + m_noteRandom.bounded(6);
+    for (int i = 0; i < items; ++i) {
+        text += m_noteRandom.bounded(2) ? "- [x] " : "- [ ] ";
+        text += sentence(2, 8) + '\n';
+    }
+    return text + '\n';
+}
+
+QString CorpusGenerator::codeFence()
+{
+    QString text = QString("```%1\n").arg(QLatin1String(LANGUAGES[m_noteRandom.bounded(LANGUAGE_COUNT)]));
+    int lines = 3 + m_noteRandom.bounded(20);
+    int indent = 0;
+    for (int i = 0; i < lines; ++i) {
+        text += QString(indent * 4, ' ');
+        int kind = m_noteRandom.bounded(4);
+        if (kind == 0 && indent < 3) {
+            text += QString("if (%1 > %2) {\n").arg(word()).arg(m_noteRandom.bounded(100));
+            indent++;
+        } else if (kind == 1 && indent > 0) {
+            text += "}\n";
+            indent--;
+        } else {
+            // One call per statement; argument evaluation order is unspecified
+            QString target = word();
+            QString function = word();
+            QString argument = word();
+            text += QString("%1 = %2(\"%3\");\n").arg(target, function, argument);
+        }
+    }
+    while (indent-- > 0) {
+        text += QString(indent * 4, ' ') + "}\n";
+    }
+    return text + "```\n\n";
+}
+
+QString CorpusGenerator::table()
+{
+    int columns = 2 + m_noteRandom.bounded(4);
+    int rows = 2 + m_noteRandom.bounded(10);
+    QStringList header;
+    QStringList rule;
+    for (int c = 0; c < columns; ++c) {
+        header.append(word());
+        rule.append("---");
+    }
+    QString text = "| " + header.join(" | ") + " |\n| " + rule.join(" | ") + " |\n";
+    for (int r = 0; r < rows; ++r) {
+        QStringList cells;
+        for (int c = 0; c < columns; ++c) {
+            cells.append(c == 0 ? word() : QString::number(m_noteRandom.bounded(10000)));
+        }
+        text += "| " + cells.join(" | ") + " |\n";
+    }
+    return text + '\n';
+}
+
+QString CorpusGenerator::quote()
+{
+    return "> " + sentence(6, 20) + "\n\n";
+}
+
+QString CorpusGenerator::link()
+{
+    QString text = word();
+    QString section = word();
+    return QString("[%1](https://example.com/%2/%3)").arg(text, section).arg(m_noteRandom.bounded(1000));
+}
+
+QString CorpusGenerator::word()
+{
+    return QString::fromLatin1(WORDS[m_noteRandom.bounded(WORD_COUNT)]);
+}
@@ -0,0 +1,87 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QDateTime>
+#include <QRandomGenerator>
+
+// Size profile of a generated corpus. Note bodies follow a Pareto distribution
+// between minBodyBytes and maxBodyBytes, so most notes are short and a few are
+// very large; notes are spread over folders with a Zipf distribution.
+struct CorpusProfile
+{
+    QString name;
+    int notes = 0;
+    int folders = 0;
+    int maxDepth = 0;          // Folder nesting, 1 for a flat list
+    int minBodyBytes = 0;
+    int maxBodyBytes = 0;
+    double sizeShape = 1.2;    // Pareto shape; lower gives a heavier tail
+
+    static CorpusProfile byName(const QString &name, bool *ok = nullptr);
+    static QStringList names();
+};
+
+struct GeneratedFolder
+{
+    int parent = -1;           // Index into the folder list, -1 for a top-level folder
+    int depth = 1;
+    QString name;
+};
+
+struct GeneratedNote
+{
+    int folder = 0;            // Index into the folder list
+    QString title;
+    QString body;
+    QDateTime createdAt;
+    QDateTime updatedAt;
+};
+
+// Deterministic notebook generator: the same profile and seed always give the
+// same folders and notes, in the same order.
+class CorpusGenerator
+{
+public:
+    CorpusGenerator(const CorpusProfile &profile, quint32 seed);
+
+    const CorpusProfile &profile() const;
+    const QList<GeneratedFolder> &folders() const;
+
+    // Notes are generated one at a time, so large corpora need not fit in memory
+    bool hasNextNote() const;
+    GeneratedNote nextNote();
+
+private:
+    void generateFolders();
+    int pickFolder();
+    int pickBodySize();
+    QString generateTitle();
+    QString generateBody(const QString &title, int targetSize, const QDateTime &createdAt);
+
+    // Markdown blocks
+    QString frontMatter(const QString &title, const QDateTime &createdAt);
+    QString paragraph();
+    QString sentence(int minWords, int maxWords);
+    QString heading();
+    QString bulletList();
+    QString taskList();
+    QString codeFence();
+    QString table();
+    QString quote();
+    QString link();
+    QString word();
+
+    CorpusProfile m_profile;
+    QRandomGenerator m_folderRandom;
+    QRandomGenerator m_noteRandom;
+    QList<GeneratedFolder> m_folders;
+    QVector<double> m_folderWeights;    // Cumulative Zipf weights
+    int m_generated;
+    QDateTime m_baseTime;
+};
+
+#endif // CORPUSGENERATOR_H
@@ -0,0 +1,237 @@
+// notes-gen: writes a reproducible synthetic notebook, either into a fresh
+// database (through DatabaseManager, so the markdown files are written as the
+// app writes them) or as a directory of .md files for the importer.
+//
+//   notes-gen --profile medium --seed 7 --db /tmp/corpus/notes.db
+//   notes-gen --profile small --dir /tmp/corpus-md
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLoggingCategory>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <algorithm>
+#include "CorpusGenerator.h"
+#include "db/DatabaseManager.h"
+
+// Notes per transaction when writing to a database
+static const int BATCH_SIZE = 1000;
+
+struct CorpusStats
+{
+    QVector<int> bodySizes;
+    qint64 totalBytes = 0;
+};
+
+static void reportProgress(int done, int total, bool quiet)
+{
+    if (quiet || total < 10 || done % (total / 10) != 0) {
+        return;
+    }
+    QTextStream(stderr) << "  " << done << " / " << total << " notes\n";
+}
+
+static QString fileNameForTitle(const QString &title)
+{
+    QString name;
+    for (const QChar &c : title.toLower()) {
+        name += c.isLetterOrNumber() ? c : QChar('-');
+    }
+    return name + ".md";
+}
+
+static bool writeDatabase(CorpusGenerator &generator, const QString &databasePath, const QString &notesDirectory,
+                          bool quiet, CorpusStats *stats)
+{
+    DatabaseManager &db = DatabaseManager::instance();
+    db.setDatabasePath(databasePath);
+    if (!db.open() || !db.initializeSchema()) {
+        QTextStream(stderr) << "Could not create the database " << databasePath << "\n";
+        return false;
+    }
+    // A settings.ini left next to the database could select Files mode
+    if (!db.setStorageMode(StorageMode::Database)) {
+        return false;
+    }
+    db.setNotesDirectory(notesDirectory);
+    db.enableAutoSave(false);
+
+    const QList<GeneratedFolder> &folders = generator.folders();
+    QVector<int> folderIds(folders.size());
+    for (int i = 0; i < folders.size(); ++i) {
+        // Parents always come before their children
+        int parentId = folders[i].parent >= 0 ? folderIds[folders[i].parent] : -1;
+        folderIds[i] = db.createFolder(folders[i].name, parentId);
+    }
+
+    QSqlDatabase sql = db.database();
+    QSqlQuery stamp(sql);
+    stamp.prepare("UPDATE notes SET created_at = ?, updated_at = ?, filepath = ? WHERE id = ?");
+
+    int total = generator.profile().notes;
+    int written = 0;
+    sql.transaction();
+    while (generator.hasNextNote()) {
+        GeneratedNote note = generator.nextNote();
+        int noteId = db.createNote(folderIds[note.folder], note.title, note.body);
+        if (noteId < 0) {
+            sql.rollback();
+            return false;
+        }
+
+        // createNote stamps the current time; the corpus carries its own. The
+        // mirror close() writes would otherwise be named after the clock too.
+        stamp.addBindValue(note.createdAt);
+        stamp.addBindValue(note.updatedAt);
+        stamp.addBindValue(QString("%1-%2").arg(written + 1, 6, 10, QChar('0')).arg(fileNameForTitle(note.title)));
+        stamp.addBindValue(noteId);
+        stamp.exec();
+
+        stats->bodySizes.append(note.body.toUtf8().size());
+        stats->totalBytes += stats->bodySizes.last();
+        reportProgress(++written, total, quiet);
+        if (written % BATCH_SIZE == 0) {
+            sql.commit();
+            sql.transaction();
+        }
+    }
+    return sql.commit();
+}
+
+static bool writeDirectory(CorpusGenerator &generator, const QString &directory, bool quiet, CorpusStats *stats)
+{
+    // scanAndImportMarkdownFiles reads the top level only, so the folder tree is
+    // not reproduced on disk
+    if (!QDir().mkpath(directory)) {
+        QTextStream(stderr) << "Could not create " << directory << "\n";
+        return false;
+    }
+
+    int total = generator.profile().notes;
+    int written = 0;
+    while (generator.hasNextNote()) {
+        GeneratedNote note = generator.nextNote();
+        QByteArray content = note.body.toUtf8();
+
+        QFile file(QDir(directory).filePath(fileNameForTitle(note.title)));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(content) != content.size()) {
+            QTextStream(stderr) << "Could not write " << file.fileName() << ": " << file.errorString() << "\n";
+            return false;
+        }
+        file.flush();  // A later write would reset the modification time
+        file.setFileTime(note.updatedAt, QFileDevice::FileModificationTime);
+        file.close();
+
+        stats->bodySizes.append(content.size());
+        stats->totalBytes += content.size();
+        reportProgress(++written, total, quiet);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("notes-gen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates a reproducible synthetic notebook.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"profile", "Size profile: " + CorpusProfile::names().join(", ") + ".", "name", "small"},
+        {"seed", "Seed; the same seed and profile give the same corpus.", "seed", "1"},
+        {"notes", "Override the number of notes.", "count"},
+        {"folders", "Override the number of folders.", "count"},
+        {"db", "Write into a new database at this path.", "path"},
+        {"notes-dir", "Markdown directory for --db (default: notes/ next to the database).", "path"},
+        {"dir", "Write .md files into this directory instead.", "path"},
+        {"force", "Replace an existing database, its settings.ini and notes directory."},
+        {"quiet", "Only print the summary."},
+    });
+    parser.process(app);
+
+    bool knownProfile = false;
+    CorpusProfile profile = CorpusProfile::byName(parser.value("profile"), &knownProfile);
+    if (!knownProfile) {
+        QTextStream(stderr) << "Unknown profile " << parser.value("profile") << "; use one of "
+                            << CorpusProfile::names().join(", ") << "\n";
+        return 2;
+    }
+    if (parser.isSet("notes")) {
+        profile.notes = parser.value("notes").toInt();
+    }
+    if (parser.isSet("folders")) {
+        profile.folders = parser.value("folders").toInt();
+    }
+    if (parser.isSet("db") == parser.isSet("dir")) {
+        QTextStream(stderr) << "Give exactly one of --db or --dir\n";
+        return 2;
+    }
+
+    bool quiet = parser.isSet("quiet");
+    QLoggingCategory::setFilterRules("*.debug=false\n*.info=false");
+
+    quint32 seed = parser.value("seed").toUInt();
+    CorpusGenerator generator(profile, seed);
+    CorpusStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    bool written = false;
+    QString target;
+    if (parser.isSet("db")) {
+        target = QFileInfo(parser.value("db")).absoluteFilePath();
+        QString notesDirectory = parser.isSet("notes-dir") ? parser.value("notes-dir")
+                                                           : QFileInfo(target).absolutePath() + "/notes";
+        // settings.ini and the markdown of an earlier corpus would carry over
+        QString settingsFile = QFileInfo(target).absolutePath() + "/settings.ini";
+        QStringList leftovers;
+        for (const QString &path : {target, settingsFile, notesDirectory}) {
+            if (QFileInfo::exists(path)) {
+                leftovers.append(path);
+            }
+        }
+        if (!leftovers.isEmpty()) {
+            if (!parser.isSet("force")) {
+                QTextStream(stderr) << "Found " << leftovers.join(", ") << "; use --force to replace them\n";
+                return 2;
+            }
+            QFile::remove(target);
+            QFile::remove(settingsFile);
+            QDir(notesDirectory).removeRecursively();
+        }
+        QDir().mkpath(QFileInfo(target).absolutePath());
+        QDir().mkpath(notesDirectory);
+        written = writeDatabase(generator, target, notesDirectory, quiet, &stats);
+        DatabaseManager::instance().close();
+    } else {
+        target = QFileInfo(parser.value("dir")).absoluteFilePath();
+        written = writeDirectory(generator, target, quiet, &stats);
+    }
+    if (!written) {
+        return 1;
+    }
+
+    int maxDepth = 0;
+    for (const GeneratedFolder &folder : generator.folders()) {
+        maxDepth = qMax(maxDepth, folder.depth);
+    }
+    QVector<int> sizes = stats.bodySizes;
+    std::sort(sizes.begin(), sizes.end());
+    auto percentile = [&sizes](double p) {
+        return sizes.isEmpty() ? 0 : sizes[qMin(sizes.size() - 1, int(p * sizes.size()))];
+    };
+
+    QTextStream out(stdout);
+    out << "Wrote " << sizes.size() << " notes in " << generator.folders().size() << " folders (depth "
+        << maxDepth << ") to " << target << "\n";
+    out << "profile " << profile.name << ", seed " << seed << ", " << timer.elapsed() << " ms\n";
+    out << "body bytes: total " << stats.totalBytes << ", p50 " << percentile(0.5) << ", p90 " << percentile(0.9)
+        << ", p99 " << percentile(0.99) << ", max " << (sizes.isEmpty() ? 0 : sizes.last()) << "\n";
+    return 0;
+}